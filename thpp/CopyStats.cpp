@@ -0,0 +1,92 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+#include <thpp/CopyStats.h>
+
+#include <atomic>
+
+namespace thpp {
+
+namespace {
+
+constexpr int kNumReasons = int(CopyReason::kCount);
+
+// One cache line per reason, so that unrelated copies on different threads
+// don't contend
+struct alignas(64) Counters {
+  std::atomic<uint64_t> count{0};
+  std::atomic<uint64_t> bytes{0};
+};
+
+Counters gCounters[kNumReasons];
+std::atomic<CopyHook> gHook{nullptr};
+
+}  // namespace
+
+namespace detail {
+
+void recordCopy(CopyReason reason, size_t bytes) {
+  auto& c = gCounters[int(reason)];
+  c.count.fetch_add(1, std::memory_order_relaxed);
+  c.bytes.fetch_add(bytes, std::memory_order_relaxed);
+  auto hook = gHook.load(std::memory_order_acquire);
+  if (hook) {
+    hook(reason, bytes);
+  }
+}
+
+}  // namespace detail
+
+CopyStats getCopyStats(CopyReason reason) {
+  auto& c = gCounters[int(reason)];
+  CopyStats stats;
+  stats.count = c.count.load(std::memory_order_relaxed);
+  stats.bytes = c.bytes.load(std::memory_order_relaxed);
+  return stats;
+}
+
+CopyStats getTotalCopyStats() {
+  CopyStats total;
+  for (int i = 0; i < kNumReasons; ++i) {
+    auto stats = getCopyStats(CopyReason(i));
+    total.count += stats.count;
+    total.bytes += stats.bytes;
+  }
+  return total;
+}
+
+void resetCopyStats() {
+  for (auto& c : gCounters) {
+    c.count.store(0, std::memory_order_relaxed);
+    c.bytes.store(0, std::memory_order_relaxed);
+  }
+}
+
+const char* copyReasonName(CopyReason reason) {
+  switch (reason) {
+  case CopyReason::UNSHARE: return "unshare";
+  case CopyReason::MAKE_MANAGED: return "make_managed";
+  case CopyReason::UNCHAIN: return "unchain";
+  case CopyReason::MISALIGNED: return "misaligned";
+  case CopyReason::REALLOC_UNSHARE: return "realloc_unshare";
+  case CopyReason::GATHER: return "gather";
+  case CopyReason::BYTE_SWAP: return "byte_swap";
+  case CopyReason::COPY_ON_WRITE: return "copy_on_write";
+  case CopyReason::COPY: return "copy";
+  case CopyReason::kCount: break;
+  }
+  return "unknown";
+}
+
+CopyHook setCopyHook(CopyHook hook) {
+  return gHook.exchange(hook, std::memory_order_acq_rel);
+}
+
+}  // namespaces
@@ -0,0 +1,77 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+#ifndef THPP_COPYSTATS_H_
+#define THPP_COPYSTATS_H_
+
+#include <cstddef>
+#include <cstdint>
+
+namespace thpp {
+
+/**
+ * Process-wide counters for the copies that thpp makes behind the caller's
+ * back when sharing memory with IOBufs isn't possible, to verify that
+ * pipelines that are meant to be zero-copy really are (and to notice when
+ * an upstream change in IOBuf layout makes them copy).
+ *
+ * Each counter update is two relaxed atomic adds, done once per copy (not
+ * per element), so they are always on.
+ */
+enum class CopyReason : int {
+  // SHARE_NONE requested, and the IOBuf was shared
+  UNSHARE,
+  // SHARE_IOBUF_MANAGED requested, and the IOBuf wasn't managed
+  MAKE_MANAGED,
+  // Storage created from an IOBuf chain with more than one non-empty buffer
+  UNCHAIN,
+  // Storage created from an IOBuf whose data isn't aligned for the type
+  MISALIGNED,
+  // Storage shared with an IOBuf grown beyond the original buffer
+  REALLOC_UNSHARE,
+  // Non-contiguous tensor gathered into a new buffer on serialization
+  GATHER,
+  // Data byte swapped into a new buffer because the original was shared
+  BYTE_SWAP,
+  // Copy-on-write tensor written to while still sharing its buffer
+  COPY_ON_WRITE,
+  // Contiguous data copied (not gathered) into a new buffer on
+  // serialization, because it was too small to share or sharing wasn't
+  // allowed
+  COPY,
+
+  kCount
+};
+
+struct CopyStats {
+  uint64_t count = 0;  // number of copies
+  uint64_t bytes = 0;  // total size of all copies
+};
+
+// Counters for one reason, and for all reasons together
+CopyStats getCopyStats(CopyReason reason);
+CopyStats getTotalCopyStats();
+void resetCopyStats();
+
+const char* copyReasonName(CopyReason reason);
+
+// Optional hook called (synchronously, on the copying thread) for every
+// copy, for example to log the stack trace of unexpected copies in tests.
+// Returns the previous hook. Pass nullptr to remove.
+typedef void (*CopyHook)(CopyReason reason, size_t bytes);
+CopyHook setCopyHook(CopyHook hook);
+
+namespace detail {
+void recordCopy(CopyReason reason, size_t bytes);
+}  // namespace detail
+
+}  // namespaces
+
+#endif /* THPP_COPYSTATS_H_ */
@@ -0,0 +1,104 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+#include <thpp/Half.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define THPP_HALF_F16C 1
+#endif
+
+namespace thpp {
+
+namespace {
+
+void floatToHalfScalar(uint16_t* dest, const float* src, size_t n) {
+  for (size_t i = 0; i < n; ++i) {
+    dest[i] = floatToHalf(src[i]);
+  }
+}
+
+void halfToFloatScalar(float* dest, const uint16_t* src, size_t n) {
+  for (size_t i = 0; i < n; ++i) {
+    dest[i] = halfToFloat(src[i]);
+  }
+}
+
+typedef void (*NarrowFn)(uint16_t*, const float*, size_t);
+typedef void (*WidenFn)(float*, const uint16_t*, size_t);
+
+#ifdef THPP_HALF_F16C
+
+__attribute__((__target__("avx,f16c")))
+void floatToHalfF16C(uint16_t* dest, const float* src, size_t n) {
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m256 v = _mm256_loadu_ps(src + i);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dest + i),
+                     _mm256_cvtps_ph(v, _MM_FROUND_TO_NEAREST_INT));
+  }
+  floatToHalfScalar(dest + i, src + i, n - i);
+}
+
+__attribute__((__target__("avx,f16c")))
+void halfToFloatF16C(float* dest, const uint16_t* src, size_t n) {
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+    _mm256_storeu_ps(dest + i, _mm256_cvtph_ps(v));
+  }
+  halfToFloatScalar(dest + i, src + i, n - i);
+}
+
+bool hasF16C() {
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("avx") && __builtin_cpu_supports("f16c");
+}
+
+NarrowFn selectNarrowFn() {
+  return hasF16C() ? &floatToHalfF16C : &floatToHalfScalar;
+}
+
+WidenFn selectWidenFn() {
+  return hasF16C() ? &halfToFloatF16C : &halfToFloatScalar;
+}
+
+#else
+
+NarrowFn selectNarrowFn() { return &floatToHalfScalar; }
+WidenFn selectWidenFn() { return &halfToFloatScalar; }
+
+#endif
+
+}  // namespace
+
+void floatToHalf(uint16_t* dest, const float* src, size_t n) {
+  static const NarrowFn fn = selectNarrowFn();
+  fn(dest, src, n);
+}
+
+void halfToFloat(float* dest, const uint16_t* src, size_t n) {
+  static const WidenFn fn = selectWidenFn();
+  fn(dest, src, n);
+}
+
+void floatToBFloat16(uint16_t* dest, const float* src, size_t n) {
+  for (size_t i = 0; i < n; ++i) {
+    dest[i] = floatToBFloat16(src[i]);
+  }
+}
+
+void bfloat16ToFloat(float* dest, const uint16_t* src, size_t n) {
+  for (size_t i = 0; i < n; ++i) {
+    dest[i] = bfloat16ToFloat(src[i]);
+  }
+}
+
+}  // namespaces
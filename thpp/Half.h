@@ -0,0 +1,103 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+#ifndef THPP_HALF_H_
+#define THPP_HALF_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace thpp {
+
+/**
+ * Conversions between float and 16-bit floating point formats, stored as
+ * uint16_t: IEEE-754 binary16 ("half"), and bfloat16 (the upper 16 bits of
+ * a binary32). Narrowing rounds to nearest, ties to even; NaNs stay NaNs.
+ *
+ * TH has no 16-bit floating point tensors, so these formats are only used
+ * for storage and transfer (see serializeAsHalf in Tensor.h); computation
+ * happens in float.
+ */
+
+inline uint32_t floatBits(float f) {
+  uint32_t u;
+  memcpy(&u, &f, sizeof(u));
+  return u;
+}
+
+inline float bitsFloat(uint32_t u) {
+  float f;
+  memcpy(&f, &u, sizeof(f));
+  return f;
+}
+
+inline uint16_t floatToHalf(float f) {
+  constexpr uint32_t kInf = 255U << 23;
+  constexpr uint32_t kHalfOverflow = (127U + 16) << 23;
+  constexpr uint32_t kMinNormal = 113U << 23;  // 2^-14
+  const float kDenormMagic = bitsFloat(((127U - 15) + (23 - 10) + 1) << 23);
+
+  uint32_t u = floatBits(f);
+  uint16_t sign = (u >> 16) & 0x8000;
+  u &= 0x7fffffff;
+  uint16_t h;
+  if (u >= kHalfOverflow) {
+    h = u > kInf ? 0x7e00 : 0x7c00;  // NaN or infinity
+  } else if (u < kMinNormal) {
+    // Denormal (or zero): let the FPU do the rounding
+    h = floatBits(bitsFloat(u) + kDenormMagic) - floatBits(kDenormMagic);
+  } else {
+    uint32_t mantOdd = (u >> 13) & 1;
+    u += ((15U - 127) << 23) + 0xfff + mantOdd;
+    h = u >> 13;
+  }
+  return h | sign;
+}
+
+inline float halfToFloat(uint16_t h) {
+  constexpr uint32_t kShiftedExp = 0x7c00U << 13;
+  const float kMagic = bitsFloat(113U << 23);
+
+  uint32_t u = (h & 0x7fffU) << 13;
+  uint32_t exp = u & kShiftedExp;
+  u += (127U - 15) << 23;
+  if (exp == kShiftedExp) {
+    u += (128U - 16) << 23;  // infinity or NaN
+  } else if (exp == 0) {
+    u += 1U << 23;  // denormal (or zero): renormalize
+    u = floatBits(bitsFloat(u) - kMagic);
+  }
+  return bitsFloat(u | (uint32_t(h & 0x8000) << 16));
+}
+
+inline uint16_t floatToBFloat16(float f) {
+  uint32_t u = floatBits(f);
+  if ((u & 0x7fffffff) > 0x7f800000) {
+    return (u >> 16) | 0x40;  // keep NaNs quiet (and NaN)
+  }
+  return (u + 0x7fff + ((u >> 16) & 1)) >> 16;
+}
+
+inline float bfloat16ToFloat(uint16_t b) {
+  return bitsFloat(uint32_t(b) << 16);
+}
+
+// Bulk conversions of n elements. The half conversions use F16C on x86
+// (selected at runtime); the bfloat16 loops are simple enough to be
+// auto-vectorized.
+void floatToHalf(uint16_t* dest, const float* src, size_t n);
+void halfToFloat(float* dest, const uint16_t* src, size_t n);
+void floatToBFloat16(uint16_t* dest, const float* src, size_t n);
+void bfloat16ToFloat(float* dest, const uint16_t* src, size_t n);
+
+}  // namespaces
+
+#endif /* THPP_HALF_H_ */
@@ -0,0 +1,311 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+#include <thpp/MemoryStats.h>
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+
+#ifdef __linux__
+#include <malloc.h>
+#endif
+
+#include <TH.h>
+
+namespace thpp {
+
+namespace {
+
+constexpr int kNumKinds = int(MemoryKind::kCount);
+constexpr int kNumSlots = kMemoryStatsMaxDevices + 1;  // slot 0 is the host
+
+// Bytes flushed by all threads, and the allocation counts of threads that
+// have exited. One cache line each, as in CopyStats.
+struct alignas(64) SharedCounters {
+  std::atomic<int64_t> liveBytes{0};
+  std::atomic<int64_t> peakBytes{0};
+  std::atomic<int64_t> liveAllocations{0};
+  std::atomic<uint64_t> totalAllocations{0};
+};
+
+SharedCounters gShared[kNumKinds][kNumSlots];
+
+// Only ever written by the owning thread; atomic so that readers may sum
+// them.
+struct LocalCounters {
+  std::atomic<int64_t> pendingBytes{0};
+  std::atomic<int64_t> liveAllocations{0};
+  std::atomic<uint64_t> totalAllocations{0};
+};
+
+struct ThreadCounters {
+  LocalCounters counters[kNumKinds][kNumSlots];
+};
+
+template <class T>
+void bump(std::atomic<T>& counter, T delta) {
+  counter.store(counter.load(std::memory_order_relaxed) + delta,
+                std::memory_order_relaxed);
+}
+
+void updatePeak(SharedCounters& s, int64_t live) {
+  int64_t peak = s.peakBytes.load(std::memory_order_relaxed);
+  while (live > peak &&
+         !s.peakBytes.compare_exchange_weak(peak, live,
+                                            std::memory_order_relaxed)) { }
+}
+
+void flush(SharedCounters& s, int64_t bytes) {
+  auto live = s.liveBytes.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+  updatePeak(s, live);
+}
+
+// Protects the registry, so that threads don't retire while being read
+std::mutex gMutex;
+std::vector<ThreadCounters*>& registry() {
+  static auto r = new std::vector<ThreadCounters*>;  // never destroyed
+  return *r;
+}
+
+// Counters of the current thread; nullptr before the first update, and
+// after they've been retired on thread exit (storages may still be freed by
+// later thread-local destructors), when updates go straight to the shared
+// counters.
+thread_local ThreadCounters* tCounters = nullptr;
+thread_local bool tRetired = false;
+
+struct Retirer {
+  bool active = false;
+
+  ~Retirer() {
+    auto c = tCounters;
+    if (!c) {
+      return;
+    }
+    {
+      std::lock_guard<std::mutex> lock(gMutex);
+      for (int k = 0; k < kNumKinds; ++k) {
+        for (int slot = 0; slot < kNumSlots; ++slot) {
+          auto& s = gShared[k][slot];
+          auto& l = c->counters[k][slot];
+          flush(s, l.pendingBytes.load(std::memory_order_relaxed));
+          s.liveAllocations.fetch_add(
+              l.liveAllocations.load(std::memory_order_relaxed),
+              std::memory_order_relaxed);
+          s.totalAllocations.fetch_add(
+              l.totalAllocations.load(std::memory_order_relaxed),
+              std::memory_order_relaxed);
+        }
+      }
+      auto& r = registry();
+      r.erase(std::find(r.begin(), r.end(), c));
+    }
+    tCounters = nullptr;
+    tRetired = true;
+    delete c;
+  }
+};
+
+thread_local Retirer tRetirer;
+
+ThreadCounters* threadCounters() {
+  if (tCounters || tRetired) {
+    return tCounters;
+  }
+  auto c = new ThreadCounters;
+  {
+    std::lock_guard<std::mutex> lock(gMutex);
+    registry().push_back(c);
+  }
+  tCounters = c;
+  tRetirer.active = true;  // make sure that it's destroyed on thread exit
+  return c;
+}
+
+void update(MemoryKind kind, int device, int64_t bytes, int allocations) {
+  int slot = device + 1;
+  if (slot < 0 || slot >= kNumSlots) {
+    return;
+  }
+  auto& s = gShared[int(kind)][slot];
+  auto c = threadCounters();
+  if (!c) {
+    flush(s, bytes);
+    s.liveAllocations.fetch_add(allocations, std::memory_order_relaxed);
+    if (allocations > 0) {
+      s.totalAllocations.fetch_add(allocations, std::memory_order_relaxed);
+    }
+    return;
+  }
+
+  // Net frees are flushed right away, so that the shared counters (and the
+  // peaks) never run ahead of the real live byte counts: unflushed bytes
+  // may only make the peaks low.
+  auto& l = c->counters[int(kind)][slot];
+  int64_t pending = l.pendingBytes.load(std::memory_order_relaxed) + bytes;
+  if (pending >= kMemoryStatsSlack || pending < 0) {
+    // Readers may briefly see these bytes in neither place, never in both
+    l.pendingBytes.store(0, std::memory_order_relaxed);
+    flush(s, pending);
+  } else {
+    l.pendingBytes.store(pending, std::memory_order_relaxed);
+  }
+  if (allocations != 0) {
+    bump(l.liveAllocations, int64_t(allocations));
+    if (allocations > 0) {
+      bump(l.totalAllocations, uint64_t(allocations));
+    }
+  }
+}
+
+// Must hold gMutex
+MemoryStats readLocked(int k, int slot) {
+  auto& s = gShared[k][slot];
+  MemoryStats stats;
+  stats.liveBytes = s.liveBytes.load(std::memory_order_relaxed);
+  stats.liveAllocations = s.liveAllocations.load(std::memory_order_relaxed);
+  stats.totalAllocations = s.totalAllocations.load(std::memory_order_relaxed);
+  for (auto c : registry()) {
+    auto& l = c->counters[k][slot];
+    stats.liveBytes += l.pendingBytes.load(std::memory_order_relaxed);
+    stats.liveAllocations += l.liveAllocations.load(std::memory_order_relaxed);
+    stats.totalAllocations +=
+      l.totalAllocations.load(std::memory_order_relaxed);
+  }
+  // Reading is another chance to notice a peak
+  updatePeak(s, stats.liveBytes);
+  stats.peakBytes = std::max(s.peakBytes.load(std::memory_order_relaxed),
+                             stats.liveBytes);
+  return stats;
+}
+
+#ifdef __linux__
+
+THAllocator gOriginalDefaultAllocator;
+
+void* countingMalloc(void* ctx, long size) {
+  void* p = gOriginalDefaultAllocator.malloc(ctx, size);
+  if (p) {
+    detail::recordAlloc(MemoryKind::DEFAULT, -1, malloc_usable_size(p));
+  }
+  return p;
+}
+
+void* countingRealloc(void* ctx, void* ptr, long size) {
+  if (!ptr) {
+    return countingMalloc(ctx, size);
+  }
+  int64_t oldSize = malloc_usable_size(ptr);
+  void* p = gOriginalDefaultAllocator.realloc(ctx, ptr, size);
+  if (p) {
+    detail::recordResize(MemoryKind::DEFAULT, -1,
+                         int64_t(malloc_usable_size(p)) - oldSize);
+  } else if (size == 0) {
+    // TH frees the memory when reallocating to size 0
+    detail::recordFree(MemoryKind::DEFAULT, -1, oldSize);
+  }
+  return p;
+}
+
+void countingFree(void* ctx, void* ptr) {
+  if (ptr) {
+    detail::recordFree(MemoryKind::DEFAULT, -1, malloc_usable_size(ptr));
+  }
+  gOriginalDefaultAllocator.free(ctx, ptr);
+}
+
+#endif  // __linux__
+
+}  // namespace
+
+namespace detail {
+
+void recordAlloc(MemoryKind kind, int device, int64_t bytes) {
+  update(kind, device, bytes, 1);
+}
+
+void recordFree(MemoryKind kind, int device, int64_t bytes) {
+  update(kind, device, -bytes, -1);
+}
+
+void recordResize(MemoryKind kind, int device, int64_t delta) {
+  update(kind, device, delta, 0);
+}
+
+}  // namespace detail
+
+MemoryStats getMemoryStats(MemoryKind kind, int device) {
+  int slot = device + 1;
+  if (slot < 0 || slot >= kNumSlots) {
+    return MemoryStats();
+  }
+  std::lock_guard<std::mutex> lock(gMutex);
+  return readLocked(int(kind), slot);
+}
+
+std::vector<MemoryStatsEntry> getAllMemoryStats() {
+  std::vector<MemoryStatsEntry> result;
+  std::lock_guard<std::mutex> lock(gMutex);
+  for (int k = 0; k < kNumKinds; ++k) {
+    for (int slot = 0; slot < kNumSlots; ++slot) {
+      auto stats = readLocked(k, slot);
+      if (stats.totalAllocations != 0) {
+        result.push_back(MemoryStatsEntry{MemoryKind(k), slot - 1, stats});
+      }
+    }
+  }
+  return result;
+}
+
+void resetPeakMemoryStats() {
+  std::lock_guard<std::mutex> lock(gMutex);
+  for (int k = 0; k < kNumKinds; ++k) {
+    for (int slot = 0; slot < kNumSlots; ++slot) {
+      auto live = readLocked(k, slot).liveBytes;
+      gShared[k][slot].peakBytes.store(live, std::memory_order_relaxed);
+    }
+  }
+}
+
+const char* memoryKindName(MemoryKind kind) {
+  switch (kind) {
+  case MemoryKind::DEFAULT: return "default";
+  case MemoryKind::IOBUF: return "iobuf";
+  case MemoryKind::MAPPED: return "mapped";
+  case MemoryKind::SHARED_MEMORY: return "shared_memory";
+  case MemoryKind::ARENA: return "arena";
+  case MemoryKind::POOLED: return "pooled";
+  case MemoryKind::NUMA: return "numa";
+  case MemoryKind::PINNED: return "pinned";
+  case MemoryKind::CUDA_CACHING: return "cuda_caching";
+  case MemoryKind::CUDA_MANAGED: return "cuda_managed";
+  case MemoryKind::CUDA_IOBUF: return "cuda_iobuf";
+  case MemoryKind::kCount: break;
+  }
+  return "unknown";
+}
+
+bool enableDefaultAllocatorAccounting() {
+#ifdef __linux__
+  static std::once_flag once;
+  std::call_once(once, [] {
+    gOriginalDefaultAllocator = THDefaultAllocator;
+    THDefaultAllocator.malloc = &countingMalloc;
+    THDefaultAllocator.realloc = &countingRealloc;
+    THDefaultAllocator.free = &countingFree;
+  });
+  return true;
+#else
+  return false;
+#endif
+}
+
+}  // namespaces
@@ -0,0 +1,116 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+#ifndef THPP_MEMORYSTATS_H_
+#define THPP_MEMORYSTATS_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace thpp {
+
+/**
+ * Process-wide accounting of the memory held by each of thpp's allocators,
+ * per device, to find out where memory goes (IOBuf-backed storages vs
+ * arenas vs pinned buffers vs the CUDA caching allocator, etc) in a running
+ * process.
+ *
+ * Counters are per thread, and only summed when read, so an update is a few
+ * thread-local stores. Live byte counts and allocation counts are exact when
+ * read. Peaks are only updated when a thread's unreported bytes exceed a
+ * threshold (or when stats are read), so a short-lived spike may be
+ * underreported by up to kMemoryStatsSlack bytes per thread; it's never
+ * overreported.
+ */
+enum class MemoryKind : int {
+  // Storage data allocated by TH's THDefaultAllocator; only counted after
+  // enableDefaultAllocatorAccounting()
+  DEFAULT,
+  // Storages sharing memory with IOBufs (the bytes the storages use, not
+  // the capacity of the buffers); memory of other kinds that Storage::getIOBuf
+  // hands to an IOBuf is counted as both
+  IOBUF,
+  // Files mapped with Storage::mapFile / Tensor::mapFile, and imported
+  // shared tensors
+  MAPPED,
+  // Segments created with Storage::createShared
+  SHARED_MEMORY,
+  // TensorArena slabs
+  ARENA,
+  // Blocks held by PooledAllocator, including free blocks in the per-thread
+  // caches
+  POOLED,
+  // NumaAllocator mappings
+  NUMA,
+  // Pinned host memory from PinnedMemoryPool, including cached buffers
+  PINNED,
+  // Device memory held by CudaCachingAllocator, including cached blocks
+  CUDA_CACHING,
+  // CudaManagedAllocator, attributed to the device that allocated it
+  CUDA_MANAGED,
+  // createCudaIOBuf (without a caching allocator)
+  CUDA_IOBUF,
+
+  kCount
+};
+
+// Largest CUDA device number that is accounted for; memory on other devices
+// isn't counted.
+constexpr int kMemoryStatsMaxDevices = 16;
+
+// Bytes that each thread may allocate before the shared counters (and so the
+// peaks) are updated. Frees in excess of a thread's unreported allocations
+// are reported immediately, so peaks are never overreported.
+constexpr int64_t kMemoryStatsSlack = 256 << 10;
+
+struct MemoryStats {
+  int64_t liveBytes = 0;         // currently allocated
+  int64_t peakBytes = 0;         // highest liveBytes since the last reset
+  int64_t liveAllocations = 0;   // currently allocated blocks
+  uint64_t totalAllocations = 0; // blocks allocated since the start
+};
+
+// Counters for one kind of memory, on one device (-1 for host memory, which
+// is where all non-CUDA kinds live)
+MemoryStats getMemoryStats(MemoryKind kind, int device = -1);
+
+struct MemoryStatsEntry {
+  MemoryKind kind;
+  int device;
+  MemoryStats stats;
+};
+
+// All (kind, device) pairs that have ever been allocated from
+std::vector<MemoryStatsEntry> getAllMemoryStats();
+
+// Reset all peaks to the current live byte counts
+void resetPeakMemoryStats();
+
+const char* memoryKindName(MemoryKind kind);
+
+// TH allocates storage data from THDefaultAllocator internally, which thpp
+// doesn't see, so it's only counted (as MemoryKind::DEFAULT) after this
+// replaces THDefaultAllocator's functions with counting wrappers. Call it
+// once, at startup, before any storages are created: memory allocated
+// before that is uncounted, and makes the counts low (even negative) when
+// it's freed. Returns false if not supported on this platform.
+bool enableDefaultAllocatorAccounting();
+
+namespace detail {
+void recordAlloc(MemoryKind kind, int device, int64_t bytes);
+void recordFree(MemoryKind kind, int device, int64_t bytes);
+// Allocation grown (positive) or shrunk (negative) in place
+void recordResize(MemoryKind kind, int device, int64_t delta);
+}  // namespace detail
+
+}  // namespaces
+
+#endif /* THPP_MEMORYSTATS_H_ */
@@ -0,0 +1,41 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+#ifndef THPP_NUMAALLOCATOR_H_
+#error This file may only be included from thpp/NumaAllocator.h
+#endif
+
+namespace thpp {
+
+template <class T>
+NumaReplicated<T>::NumaReplicated(const Tensor<T>& src) {
+  int n = NumaAllocator::numNodes();
+  replicas_.reserve(n);
+  for (int node = 0; node < n; ++node) {
+    auto storage = numaStorage<T>(NumaAllocator::onNode(node));
+    storage.resizeUninitialized(src.size());
+    replicas_.emplace_back(std::move(storage), 0, src.sizes());
+    replicas_.back().copy(src);
+  }
+}
+
+template <class T>
+const Tensor<T>& NumaReplicated<T>::local() const {
+  return onNode(NumaAllocator::currentNode());
+}
+
+template <class T>
+const Tensor<T>& NumaReplicated<T>::onNode(int node) const {
+  // Nodes outside the range we know about (CPU hotplug?) use replica 0
+  return node >= 0 && size_t(node) < replicas_.size() ?
+    replicas_[node] : replicas_[0];
+}
+
+}  // namespaces
@@ -0,0 +1,214 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+#include <thpp/NumaAllocator.h>
+#include <thpp/MemoryStats.h>
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+
+namespace thpp {
+
+namespace detail {
+
+THAllocator numaTHAllocator = {
+  &THAllocatorWrapper<NumaAllocator>::malloc,
+  &THAllocatorWrapper<NumaAllocator>::realloc,
+  &THAllocatorWrapper<NumaAllocator>::free,
+};
+
+}  // namespace detail
+
+namespace {
+
+// We talk to the kernel directly rather than through libnuma, so define
+// the few constants we need from <numaif.h>.
+constexpr int kMpolPreferred = 1;
+constexpr int kMpolInterleave = 3;
+
+constexpr int kMaxNodes = 1024;
+constexpr int kBitsPerWord = 8 * sizeof(unsigned long);
+
+// Stored at the start of each mapping; the data follows, aligned to
+// kHeaderSize
+struct Header {
+  size_t mappedSize;
+};
+constexpr size_t kHeaderSize = 64;
+
+size_t pageSize() {
+  static const size_t size = sysconf(_SC_PAGESIZE);
+  return size;
+}
+
+size_t mappedSizeFor(size_t size) {
+  size_t page = pageSize();
+  return (size + kHeaderSize + page - 1) / page * page;
+}
+
+Header* header(void* ptr) {
+  return reinterpret_cast<Header*>(static_cast<char*>(ptr) - kHeaderSize);
+}
+
+// Parse the highest node number out of a node list such as "0-1,3"
+int readNumNodes() {
+  FILE* f = fopen("/sys/devices/system/node/possible", "r");
+  if (!f) {
+    return 1;
+  }
+  char buf[256];
+  int maxNode = 0;
+  if (fgets(buf, sizeof(buf), f)) {
+    const char* p = buf;
+    while (*p) {
+      char* end;
+      long n = strtol(p, &end, 10);
+      if (end == p) {
+        ++p;
+        continue;
+      }
+      maxNode = std::max(maxNode, int(n));
+      p = end;
+    }
+  }
+  fclose(f);
+  return std::min(maxNode + 1, kMaxNodes);
+}
+
+}  // namespace
+
+NumaAllocator::NumaAllocator(Policy policy, int node)
+  : policy_(policy),
+    node_(node) {
+  if (policy_ == Policy::NODE && (node_ < 0 || node_ >= numNodes())) {
+    throw std::invalid_argument("Invalid NUMA node");
+  }
+}
+
+void NumaAllocator::bind(void* addr, size_t length) const {
+#ifdef SYS_mbind
+  if (policy_ == Policy::FIRST_TOUCH || numNodes() == 1) {
+    return;
+  }
+  unsigned long mask[kMaxNodes / kBitsPerWord];
+  memset(mask, 0, sizeof(mask));
+  int mode;
+  if (policy_ == Policy::NODE) {
+    mode = kMpolPreferred;
+    mask[node_ / kBitsPerWord] |= 1UL << (node_ % kBitsPerWord);
+  } else {
+    mode = kMpolInterleave;
+    for (int i = 0; i < numNodes(); ++i) {
+      mask[i / kBitsPerWord] |= 1UL << (i % kBitsPerWord);
+    }
+  }
+  // Placement is only a hint; if the kernel doesn't support it (and mbind
+  // fails), we still have perfectly good memory.
+  syscall(SYS_mbind, addr, length, mode, mask, kMaxNodes + 1, 0);
+#endif
+}
+
+void* NumaAllocator::malloc(long size) {
+  size_t mappedSize = mappedSizeFor(size);
+  void* p = mmap(nullptr, mappedSize, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (p == MAP_FAILED) {
+    throw std::bad_alloc();
+  }
+  // Before anything touches the memory
+  bind(p, mappedSize);
+  static_cast<Header*>(p)->mappedSize = mappedSize;
+  detail::recordAlloc(MemoryKind::NUMA, -1, mappedSize);
+  return static_cast<char*>(p) + kHeaderSize;
+}
+
+void* NumaAllocator::realloc(void* ptr, long size) {
+  if (!ptr) {
+    return malloc(size);
+  }
+  auto h = header(ptr);
+  size_t oldSize = h->mappedSize;
+  size_t mappedSize = mappedSizeFor(size);
+  if (mappedSize <= oldSize) {
+    return ptr;
+  }
+  void* p = mremap(h, oldSize, mappedSize, MREMAP_MAYMOVE);
+  if (p == MAP_FAILED) {
+    throw std::bad_alloc();
+  }
+  // The new pages haven't been touched yet
+  bind(static_cast<char*>(p) + oldSize, mappedSize - oldSize);
+  static_cast<Header*>(p)->mappedSize = mappedSize;
+  detail::recordResize(MemoryKind::NUMA, -1, mappedSize - oldSize);
+  return static_cast<char*>(p) + kHeaderSize;
+}
+
+void NumaAllocator::free(void* ptr) {
+  if (!ptr) {
+    return;
+  }
+  auto h = header(ptr);
+  size_t mappedSize = h->mappedSize;
+  munmap(h, mappedSize);
+  detail::recordFree(MemoryKind::NUMA, -1, mappedSize);
+}
+
+int NumaAllocator::numNodes() {
+  static const int n = readNumNodes();
+  return n;
+}
+
+int NumaAllocator::currentNode() {
+#ifdef SYS_getcpu
+  unsigned cpu;
+  unsigned node;
+  if (syscall(SYS_getcpu, &cpu, &node, nullptr) == 0) {
+    return node;
+  }
+#endif
+  return 0;
+}
+
+NumaAllocator& NumaAllocator::firstTouch() {
+  static auto alloc = new NumaAllocator(Policy::FIRST_TOUCH);
+  return *alloc;
+}
+
+NumaAllocator& NumaAllocator::onNode(int node) {
+  static auto allocs = [] {
+    auto v = new std::vector<std::unique_ptr<NumaAllocator>>;
+    for (int i = 0; i < numNodes(); ++i) {
+      v->emplace_back(new NumaAllocator(Policy::NODE, i));
+    }
+    return v;
+  }();
+  if (node < 0 || size_t(node) >= allocs->size()) {
+    throw std::invalid_argument("Invalid NUMA node");
+  }
+  return *(*allocs)[node];
+}
+
+NumaAllocator& NumaAllocator::interleaved() {
+  static auto alloc = new NumaAllocator(Policy::INTERLEAVE);
+  return *alloc;
+}
+
+THAllocator* NumaAllocator::thAllocator() {
+  return &detail::numaTHAllocator;
+}
+
+}  // namespaces
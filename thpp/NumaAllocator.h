@@ -0,0 +1,115 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+#ifndef THPP_NUMAALLOCATOR_H_
+#define THPP_NUMAALLOCATOR_H_
+
+#include <memory>
+#include <vector>
+
+#include <thpp/Storage.h>
+#include <thpp/Tensor.h>
+
+namespace thpp {
+
+/**
+ * Allocator that places memory on NUMA nodes according to a policy:
+ *
+ * FIRST_TOUCH: the kernel default; each page lands on the node of the
+ *   thread that first writes to it. Initialize the storage with
+ *   parallelFill() / parallelZero() / parallelCopy() (see
+ *   thpp/TensorParallel.h) from an executor whose threads run on the nodes
+ *   that will use the data, instead of from the (single) loader thread.
+ * NODE: pages are placed on the given node (if it has free memory),
+ *   regardless of which thread touches them.
+ * INTERLEAVE: pages are spread round-robin over all nodes, for data that
+ *   is read by threads on all nodes.
+ *
+ * Memory is mapped directly from the kernel, so this is meant for large,
+ * long-lived storages (model weights, big buffers); use it with
+ *
+ *   Storage<float>::withAllocator(NumaAllocator::thAllocator(), &alloc)
+ *
+ * or just numaStorage<float>(alloc). On systems without NUMA support, all
+ * policies behave like FIRST_TOUCH.
+ */
+class NumaAllocator {
+ public:
+  enum class Policy {
+    FIRST_TOUCH,
+    NODE,
+    INTERLEAVE,
+  };
+
+  // node is only used (and must be in [0, numNodes())) for Policy::NODE
+  explicit NumaAllocator(Policy policy = Policy::FIRST_TOUCH, int node = -1);
+
+  void* malloc(long size);
+  void* realloc(void* ptr, long size);
+  void free(void* ptr);
+
+  Policy policy() const { return policy_; }
+  int node() const { return node_; }
+
+  // Number of (possible) NUMA nodes; 1 if NUMA isn't supported
+  static int numNodes();
+
+  // Node of the CPU that the calling thread is running on
+  static int currentNode();
+
+  // Process-wide instances (never destroyed)
+  static NumaAllocator& firstTouch();
+  static NumaAllocator& onNode(int node);
+  static NumaAllocator& interleaved();
+
+  // THAllocator to use with an allocator context pointing to a
+  // NumaAllocator.
+  static THAllocator* thAllocator();
+
+ private:
+  void bind(void* addr, size_t length) const;
+
+  const Policy policy_;
+  const int node_;
+};
+
+// Create an empty Storage that allocates memory with the given allocator.
+template <class T>
+Storage<T> numaStorage(NumaAllocator& alloc) {
+  return Storage<T>::withAllocator(NumaAllocator::thAllocator(), &alloc);
+}
+
+/**
+ * Read-only tensor replicated on every NUMA node, so that threads on all
+ * nodes read local memory. Each replica is a contiguous copy of src,
+ * allocated with NumaAllocator::onNode(). The replicas must not be
+ * modified.
+ */
+template <class T>
+class NumaReplicated {
+ public:
+  explicit NumaReplicated(const Tensor<T>& src);
+
+  // Replica on the calling thread's node
+  const Tensor<T>& local() const;
+
+  const Tensor<T>& onNode(int node) const;
+
+  size_t numReplicas() const { return replicas_.size(); }
+
+ private:
+  std::vector<Tensor<T>> replicas_;
+};
+
+}  // namespaces
+
+#include <thpp/NumaAllocator-inl.h>
+
+#endif /* THPP_NUMAALLOCATOR_H_ */
@@ -0,0 +1,85 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+#include <thpp/OpStats.h>
+
+#include <algorithm>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <tuple>
+
+namespace thpp {
+
+namespace {
+
+std::mutex gMutex;
+// deque, so that registering doesn't move existing counters
+std::deque<detail::OpCounters>& registry() {
+  static auto r = new std::deque<detail::OpCounters>;  // never destroyed
+  return *r;
+}
+
+}  // namespace
+
+namespace detail {
+
+OpCounters* registerOp(const char* op, const char* type) {
+  std::lock_guard<std::mutex> lock(gMutex);
+  auto& r = registry();
+  // Each call site registers once, but several may (in different
+  // translation units, or through different wrappers) share an op
+  for (auto& c : r) {
+    if (strcmp(c.op, op) == 0 && strcmp(c.type, type) == 0) {
+      return &c;
+    }
+  }
+  r.emplace_back(op, type);
+  return &r.back();
+}
+
+}  // namespace detail
+
+std::vector<OpStats> getOpStats() {
+  std::vector<OpStats> result;
+  {
+    std::lock_guard<std::mutex> lock(gMutex);
+    for (auto& c : registry()) {
+      OpStats stats;
+      stats.calls = c.calls.load(std::memory_order_relaxed);
+      if (stats.calls == 0) {
+        continue;
+      }
+      stats.op = c.op;
+      stats.type = c.type;
+      stats.nanos = c.nanos.load(std::memory_order_relaxed);
+      stats.elements = c.elements.load(std::memory_order_relaxed);
+      stats.bytes = c.bytes.load(std::memory_order_relaxed);
+      result.push_back(std::move(stats));
+    }
+  }
+  std::sort(result.begin(), result.end(),
+            [] (const OpStats& a, const OpStats& b) {
+              return std::tie(a.op, a.type) < std::tie(b.op, b.type);
+            });
+  return result;
+}
+
+void resetOpStats() {
+  std::lock_guard<std::mutex> lock(gMutex);
+  for (auto& c : registry()) {
+    c.calls.store(0, std::memory_order_relaxed);
+    c.nanos.store(0, std::memory_order_relaxed);
+    c.elements.store(0, std::memory_order_relaxed);
+    c.bytes.store(0, std::memory_order_relaxed);
+  }
+}
+
+}  // namespaces
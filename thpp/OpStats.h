@@ -0,0 +1,121 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+#ifndef THPP_OPSTATS_H_
+#define THPP_OPSTATS_H_
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace thpp {
+
+/**
+ * Per-operation counters for the TH / THC math operations that thpp calls
+ * (everything that goes through detail::TensorOps: copies, fills,
+ * element-wise arithmetic, reductions, BLAS), per operation and tensor
+ * type, to find the operations that dominate CPU time without attaching a
+ * profiler.
+ *
+ * Off by default, as timing every call costs two clock reads: build with
+ * THPP_ENABLE_OP_STATS defined (the CMake option of the same name) to turn
+ * them on. Otherwise, the hooks compile to nothing, and getOpStats()
+ * returns nothing.
+ *
+ * Element and byte counts are computed from the operand sizes, so they
+ * are only as accurate as that allows: bytes counts each operand as read
+ * (or written) once, which is what a contiguous implementation does. CUDA
+ * operations are asynchronous, so their wall time is the time to enqueue
+ * them.
+ */
+#ifdef THPP_ENABLE_OP_STATS
+constexpr bool kOpStatsEnabled = true;
+#else
+constexpr bool kOpStatsEnabled = false;
+#endif
+
+struct OpStats {
+  std::string op;     // "cadd", "addmm", ...
+  std::string type;   // "torch.FloatTensor", ...
+  uint64_t calls = 0;
+  uint64_t nanos = 0;     // total wall time
+  uint64_t elements = 0;  // the main operand: input of element-wise
+                          // operations and reductions, result of BLAS
+  uint64_t bytes = 0;     // all operands
+};
+
+// Snapshot of all operations that were called at least once since the
+// last reset, sorted by op and type.
+std::vector<OpStats> getOpStats();
+void resetOpStats();
+
+namespace detail {
+
+struct alignas(64) OpCounters {
+  OpCounters(const char* o, const char* t) : op(o), type(t) { }
+
+  const char* const op;
+  const char* const type;
+  std::atomic<uint64_t> calls{0};
+  std::atomic<uint64_t> nanos{0};
+  std::atomic<uint64_t> elements{0};
+  std::atomic<uint64_t> bytes{0};
+};
+
+// Counters for op on type (both string literals); they live forever.
+OpCounters* registerOp(const char* op, const char* type);
+
+// Record one call, timed from construction to destruction
+class OpTimer {
+ public:
+  OpTimer(OpCounters* counters, uint64_t elements, uint64_t bytes)
+    : counters_(counters),
+      elements_(elements),
+      bytes_(bytes),
+      start_(std::chrono::steady_clock::now()) { }
+
+  ~OpTimer() {
+    auto nanos = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - start_).count();
+    counters_->calls.fetch_add(1, std::memory_order_relaxed);
+    counters_->nanos.fetch_add(nanos, std::memory_order_relaxed);
+    counters_->elements.fetch_add(elements_, std::memory_order_relaxed);
+    counters_->bytes.fetch_add(bytes_, std::memory_order_relaxed);
+  }
+
+ private:
+  OpTimer(const OpTimer&) = delete;
+  OpTimer& operator=(const OpTimer&) = delete;
+
+  OpCounters* counters_;
+  uint64_t elements_;
+  uint64_t bytes_;
+  std::chrono::steady_clock::time_point start_;
+};
+
+}  // namespace detail
+
+}  // namespaces
+
+// Time the rest of the enclosing scope as one call of op (a bare name) on
+// type. elements and bytes aren't evaluated unless THPP_ENABLE_OP_STATS is
+// defined.
+#ifdef THPP_ENABLE_OP_STATS
+#define THPP_OP_STATS(op, type, elements, bytes) \
+  static ::thpp::detail::OpCounters* const thppOpCounters = \
+    ::thpp::detail::registerOp(#op, type); \
+  ::thpp::detail::OpTimer thppOpTimer(thppOpCounters, (elements), (bytes))
+#else
+#define THPP_OP_STATS(op, type, elements, bytes) do { } while (false)
+#endif
+
+#endif /* THPP_OPSTATS_H_ */
@@ -0,0 +1,204 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+#include <thpp/PooledAllocator.h>
+#include <thpp/MemoryStats.h>
+
+#ifndef NO_FOLLY
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <glog/logging.h>
+
+namespace thpp {
+
+namespace {
+
+constexpr size_t kNumClasses = 64;
+constexpr uint32_t kUnpooled = ~uint32_t(0);
+
+// Smallest size class (in bytes)
+constexpr size_t kMinClassShift = 6;
+
+// Stored immediately before each block, so free() knows where the block
+// came from.
+struct BlockHeader {
+  uint32_t sizeClass;
+  uint64_t capacity;
+};
+
+size_t headerSize(size_t alignment) {
+  return std::max(alignment, sizeof(BlockHeader));
+}
+
+BlockHeader* header(void* ptr) {
+  return static_cast<BlockHeader*>(ptr) - 1;
+}
+
+size_t sizeClassFor(size_t size) {
+  size_t c = kMinClassShift;
+  while ((size_t(1) << c) < size) {
+    ++c;
+  }
+  return c;
+}
+
+}  // namespace
+
+namespace detail {
+
+THAllocator pooledTHAllocator = {
+  &THAllocatorWrapper<PooledAllocator>::malloc,
+  &THAllocatorWrapper<PooledAllocator>::realloc,
+  &THAllocatorWrapper<PooledAllocator>::free,
+};
+
+}  // namespace detail
+
+struct PooledAllocator::Cache {
+  explicit Cache(PooledAllocator* a) : allocator(a) { }
+  ~Cache();
+
+  PooledAllocator* allocator;
+  std::vector<void*> freeLists[kNumClasses];
+  size_t cachedBytes = 0;
+
+  // Only ever written by the owning thread; atomic so stats() can read them.
+  std::atomic<uint64_t> hits{0};
+  std::atomic<uint64_t> misses{0};
+
+  static void bump(std::atomic<uint64_t>& counter) {
+    counter.store(counter.load(std::memory_order_relaxed) + 1,
+                  std::memory_order_relaxed);
+  }
+};
+
+PooledAllocator::Cache::~Cache() {
+  for (auto& list : freeLists) {
+    for (void* p : list) {
+      allocator->releaseBlock(p);
+    }
+  }
+  allocator->exitedHits_ += hits.load(std::memory_order_relaxed);
+  allocator->exitedMisses_ += misses.load(std::memory_order_relaxed);
+}
+
+PooledAllocator::PooledAllocator(size_t alignment,
+                                 size_t maxCachedBytesPerThread,
+                                 size_t maxPooledSize)
+  : alignment_(alignment),
+    maxCachedBytesPerThread_(maxCachedBytesPerThread),
+    maxPooledSize_(maxPooledSize) {
+  CHECK(alignment_ >= sizeof(void*) && (alignment_ & (alignment_ - 1)) == 0)
+    << "Invalid alignment " << alignment_;
+}
+
+PooledAllocator::~PooledAllocator() { }
+
+void* PooledAllocator::allocateBlock(size_t sizeClass, size_t size) {
+  const size_t hdr = headerSize(alignment_);
+  void* base = nullptr;
+  if (posix_memalign(&base, alignment_, hdr + size) != 0) {
+    throw std::bad_alloc();
+  }
+  void* ptr = static_cast<char*>(base) + hdr;
+  *header(ptr) = BlockHeader{uint32_t(sizeClass), size};
+  detail::recordAlloc(MemoryKind::POOLED, -1, hdr + size);
+  return ptr;
+}
+
+void PooledAllocator::releaseBlock(void* ptr) {
+  const size_t hdr = headerSize(alignment_);
+  detail::recordFree(MemoryKind::POOLED, -1, hdr + header(ptr)->capacity);
+  std::free(static_cast<char*>(ptr) - hdr);
+}
+
+void* PooledAllocator::malloc(long size) {
+  DCHECK_GE(size, 0);
+  auto cache = caches_.get();
+  if (!cache) {
+    cache = new Cache(this);
+    caches_.reset(cache);
+  }
+
+  size_t c = sizeClassFor(size);
+  size_t capacity = size_t(1) << c;
+  if (capacity > maxPooledSize_) {
+    Cache::bump(cache->misses);
+    return allocateBlock(kUnpooled, size);
+  }
+
+  auto& list = cache->freeLists[c];
+  if (!list.empty()) {
+    void* p = list.back();
+    list.pop_back();
+    cache->cachedBytes -= capacity;
+    Cache::bump(cache->hits);
+    return p;
+  }
+
+  Cache::bump(cache->misses);
+  return allocateBlock(c, capacity);
+}
+
+void* PooledAllocator::realloc(void* ptr, long size) {
+  if (!ptr) {
+    return malloc(size);
+  }
+  auto h = header(ptr);
+  if (size_t(size) <= h->capacity) {
+    return ptr;
+  }
+  void* p = malloc(size);
+  memcpy(p, ptr, h->capacity);
+  free(ptr);
+  return p;
+}
+
+void PooledAllocator::free(void* ptr) {
+  if (!ptr) {
+    return;
+  }
+  auto h = header(ptr);
+  auto cache = caches_.get();
+  if (h->sizeClass == kUnpooled || !cache ||
+      cache->cachedBytes + h->capacity > maxCachedBytesPerThread_) {
+    releaseBlock(ptr);
+    return;
+  }
+  cache->freeLists[h->sizeClass].push_back(ptr);
+  cache->cachedBytes += h->capacity;
+}
+
+auto PooledAllocator::stats() const -> Stats {
+  Stats s;
+  s.hits = exitedHits_.load();
+  s.misses = exitedMisses_.load();
+  for (auto& cache : caches_.accessAllThreads()) {
+    s.hits += cache.hits.load(std::memory_order_relaxed);
+    s.misses += cache.misses.load(std::memory_order_relaxed);
+  }
+  return s;
+}
+
+THAllocator* PooledAllocator::thAllocator() {
+  return &detail::pooledTHAllocator;
+}
+
+PooledAllocator& PooledAllocator::defaultInstance() {
+  // Leaked on purpose, so storages may be freed during static destruction
+  static auto instance = new PooledAllocator();
+  return *instance;
+}
+
+}  // namespaces
+
+#endif  // !NO_FOLLY
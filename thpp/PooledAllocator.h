@@ -0,0 +1,95 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+#ifndef THPP_POOLEDALLOCATOR_H_
+#define THPP_POOLEDALLOCATOR_H_
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+#include <folly/ThreadLocal.h>
+#include <thpp/Storage.h>
+
+namespace thpp {
+
+/**
+ * Allocator that hands out aligned blocks from per-thread free lists, one
+ * per (power of two) size class. Blocks are returned to the free list of the
+ * thread that frees them, so there is no locking on the fast path.
+ *
+ * Use it for a Storage with
+ *
+ *   Storage<float>::withAllocator(PooledAllocator::thAllocator(), &pool)
+ *
+ * or just pooledStorage<float>(pool); setStorageAllocator() makes it the
+ * allocator of all storages built from values. The allocator must outlive
+ * all storage allocated from it.
+ */
+class PooledAllocator {
+ public:
+  // alignment must be a power of two, and at least sizeof(void*).
+  // Each thread caches at most maxCachedBytesPerThread bytes of free blocks;
+  // blocks larger than maxPooledSize are never cached.
+  explicit PooledAllocator(size_t alignment = 64,
+                           size_t maxCachedBytesPerThread = 64 << 20,
+                           size_t maxPooledSize = 16 << 20);
+  ~PooledAllocator();
+
+  void* malloc(long size);
+  void* realloc(void* ptr, long size);
+  void free(void* ptr);
+
+  size_t alignment() const { return alignment_; }
+
+  struct Stats {
+    // Allocations served from a free list
+    uint64_t hits = 0;
+    // Allocations that had to go to the system allocator
+    uint64_t misses = 0;
+  };
+  // Aggregated over all threads (including threads that have exited)
+  Stats stats() const;
+
+  // THAllocator to use with an allocator context pointing to a
+  // PooledAllocator.
+  static THAllocator* thAllocator();
+
+  // Process-wide instance with the default settings.
+  static PooledAllocator& defaultInstance();
+
+ private:
+  struct Cache;
+  struct Tag;
+
+  void* allocateBlock(size_t sizeClass, size_t size);
+  void releaseBlock(void* ptr);
+
+  const size_t alignment_;
+  const size_t maxCachedBytesPerThread_;
+  const size_t maxPooledSize_;
+
+  // Counters from threads that have exited
+  std::atomic<uint64_t> exitedHits_{0};
+  std::atomic<uint64_t> exitedMisses_{0};
+
+  folly::ThreadLocalPtr<Cache, Tag> caches_;
+};
+
+// Create an empty Storage that allocates memory from the given pool.
+template <class T>
+Storage<T> pooledStorage(
+    PooledAllocator& pool = PooledAllocator::defaultInstance()) {
+  return Storage<T>::withAllocator(PooledAllocator::thAllocator(), &pool);
+}
+
+}  // namespaces
+
+#endif /* THPP_POOLEDALLOCATOR_H_ */
@@ -0,0 +1,166 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+#ifndef THPP_SPARSETENSOR_H_
+#error This file may only be included from thpp/SparseTensor.h
+#endif
+
+#include <cstring>
+#include <vector>
+
+namespace thpp {
+
+template <class T>
+void serializeSparse(ThriftSparseTensor& out,
+                     const Tensor<T>& src,
+                     int indexedDims,
+                     ThriftTensorEndianness endianness,
+                     ThriftTensorCompression compression) {
+  const int ndims = src.ndims();
+  if (indexedDims < 1 || indexedDims > ndims) {
+    throw std::invalid_argument("serializeSparse: invalid indexedDims");
+  }
+
+  // No copy if already contiguous
+  Tensor<T> contig(src, Tensor<T>::CONTIGUOUS);
+  long nslices = 1;
+  for (int i = 0; i < indexedDims; ++i) {
+    nslices *= contig.size(i);
+  }
+  // An empty indexed dimension leaves nothing to encode
+  const long sliceSize = nslices == 0 ? 0 : contig.size() / nslices;
+
+  const T* data = contig.data();
+  std::vector<long> nonzero;
+  for (long s = 0; s < nslices; ++s) {
+    const T* p = data + s * sliceSize;
+    for (long i = 0; i < sliceSize; ++i) {
+      if (p[i] != T(0)) {
+        nonzero.push_back(s);
+        break;
+      }
+    }
+  }
+
+  const long n = nonzero.size();
+  Tensor<long> indices;
+  Tensor<T> values;
+  if (n != 0) {
+    indices = Tensor<long>({n, long(indexedDims)});
+    std::vector<long> valueSizes(1, n);
+    for (int i = indexedDims; i < ndims; ++i) {
+      valueSizes.push_back(contig.size(i));
+    }
+    values = Tensor<T>(valueSizes);
+
+    long* idx = indices.data();
+    T* dest = values.data();
+    for (long k = 0; k < n; ++k) {
+      long s = nonzero[k];
+      for (int i = indexedDims - 1; i >= 0; --i) {
+        idx[k * indexedDims + i] = s % contig.size(i);
+        s /= contig.size(i);
+      }
+      memcpy(dest + k * sliceSize, data + nonzero[k] * sliceSize,
+             sliceSize * sizeof(T));
+    }
+  }
+
+  auto sizes = contig.sizes();
+  out.sizes.assign(sizes.begin(), sizes.end());
+  out.indexedDims = indexedDims;
+  indices.serialize(out.indices, endianness, SHARE_IOBUF_MANAGED, nullptr,
+                    compression);
+  values.serialize(out.values, endianness, SHARE_IOBUF_MANAGED, nullptr,
+                   compression);
+}
+
+template <class T>
+void accumulateSparse(Tensor<T>& dest,
+                      const ThriftSparseTensor& in,
+                      T scale) {
+  const int ndims = dest.ndims();
+  const int indexedDims = in.indexedDims;
+  if (in.sizes.size() != size_t(ndims)) {
+    throw std::invalid_argument("accumulateSparse: dimension mismatch");
+  }
+  for (int i = 0; i < ndims; ++i) {
+    if (in.sizes[i] != dest.size(i)) {
+      throw std::invalid_argument("accumulateSparse: size mismatch");
+    }
+  }
+  if (indexedDims < 1 || indexedDims > ndims) {
+    throw std::invalid_argument("accumulateSparse: invalid indexedDims");
+  }
+
+  Tensor<long> indices(in.indices);
+  Tensor<T> values(in.values);
+  if (indices.ndims() == 0 && values.ndims() == 0) {
+    return;  // all zeros
+  }
+  const long n = indices.ndims() == 2 ? indices.size(0) : -1;
+  bool valid = (n >= 0 && indices.size(1) == indexedDims &&
+                values.ndims() == 1 + ndims - indexedDims &&
+                values.size(0) == n);
+  for (int i = indexedDims; valid && i < ndims; ++i) {
+    valid = (values.size(1 + i - indexedDims) == dest.size(i));
+  }
+  if (!valid) {
+    throw std::invalid_argument("accumulateSparse: malformed sparse tensor");
+  }
+  indices.force(Tensor<long>::CONTIGUOUS);
+  values.force(Tensor<T>::CONTIGUOUS);
+
+  const long* idx = indices.data();
+  const long sliceSize = n == 0 ? 0 : values.size() / n;
+  const T* src = values.data();
+  const bool contiguous = dest.isContiguous();
+  T* d = dest.data();
+
+  for (long k = 0; k < n; ++k) {
+    const long* ki = idx + k * indexedDims;
+    for (int i = 0; i < indexedDims; ++i) {
+      if (ki[i] < 0 || ki[i] >= dest.size(i)) {
+        throw std::invalid_argument("accumulateSparse: index out of range");
+      }
+    }
+
+    long offset = 0;
+    for (int i = 0; i < indexedDims; ++i) {
+      offset += ki[i] * dest.stride(i);
+    }
+    if (contiguous || indexedDims == ndims) {
+      T* p = d + offset;
+      const T* q = src + k * sliceSize;
+      for (long i = 0; i < sliceSize; ++i) {
+        p[i] += scale * q[i];
+      }
+    } else {
+      // Let TH deal with the strides
+      Tensor<T> slice(dest);
+      for (int i = 0; i < indexedDims; ++i) {
+        slice.select(0, ki[i]);
+      }
+      Tensor<T> value(values);
+      value.select(0, k);
+      slice.cadd(slice, scale, value);
+    }
+  }
+}
+
+template <class T>
+Tensor<T> deserializeSparse(const ThriftSparseTensor& in) {
+  Tensor<T> dest(std::vector<long>(in.sizes.begin(), in.sizes.end()));
+  dest.zero();
+  accumulateSparse(dest, in);
+  return dest;
+}
+
+}  // namespaces
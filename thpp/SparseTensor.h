@@ -0,0 +1,66 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+#ifndef THPP_SPARSETENSOR_H_
+#define THPP_SPARSETENSOR_H_
+
+#if !defined(NO_THRIFT) && !defined(NO_FOLLY)
+
+#include <thpp/Tensor.h>
+
+namespace thpp {
+
+/**
+ * Sparse serialization of mostly-zero dense tensors (for example, embedding
+ * gradients, where most rows are untouched in any given step).
+ *
+ * The tensor is viewed as a collection of slices along its first
+ * indexedDims dimensions; only the slices that contain a nonzero element
+ * are serialized, along with their indices. With indexedDims == 1 this is
+ * a row-sparse encoding; with indexedDims == src.ndims(), each slice is a
+ * single element (COO).
+ *
+ *   ThriftSparseTensor grad;
+ *   serializeSparse(grad, localGrad);
+ *   ...
+ *   accumulateSparse(weightGrad, grad);  // weightGrad += decoded grad
+ *
+ * indices and values are regular ThriftTensors, serialized with the given
+ * endianness and compression.
+ */
+template <class T>
+void serializeSparse(ThriftSparseTensor& out,
+                     const Tensor<T>& src,
+                     int indexedDims = 1,
+                     ThriftTensorEndianness endianness =
+                        ThriftTensorEndianness::NATIVE,
+                     ThriftTensorCompression compression =
+                        ThriftTensorCompression::NONE);
+
+// dest += scale * (the dense tensor represented by in). dest must have
+// the sizes of in, but needn't be contiguous. Throws if in is malformed
+// (for example, indices out of range); dest may have been partially
+// updated in that case.
+template <class T>
+void accumulateSparse(Tensor<T>& dest,
+                      const ThriftSparseTensor& in,
+                      T scale = T(1));
+
+// Return the dense tensor represented by in.
+template <class T>
+Tensor<T> deserializeSparse(const ThriftSparseTensor& in);
+
+}  // namespaces
+
+#include <thpp/SparseTensor-inl.h>
+
+#endif  // !NO_THRIFT && !NO_FOLLY
+
+#endif /* THPP_SPARSETENSOR_H_ */
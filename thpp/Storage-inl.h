@@ -16,6 +16,7 @@
 #include <folly/ScopeGuard.h>
 #include <folly/Format.h>
 #endif
+#include <thpp/detail/ByteSwap.h>
 
 #ifndef THPP_STORAGE_H_
 #error This file may only be included from thpp/Storage.h
@@ -28,6 +29,12 @@ namespace detail {
 
 #ifndef NO_FOLLY
 void applySharingMode(folly::IOBuf& iob, SharingMode sharing);
+
+// Return a single (unchained) IOBuf with the same contents as iob. If at most
+// one buffer in the chain is non-empty, that buffer is returned (sharing
+// memory with iob); otherwise, the data is copied into a fresh buffer, which
+// is suitably aligned for any type.
+folly::IOBuf unchain(folly::IOBuf&& iob);
 #endif
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -68,11 +75,55 @@ constexpr ThriftTensorDataType dataType() {
   return DataType<T>::value;
 }
 
+// Size (in bytes) of one element of the given type
+size_t dataTypeSize(ThriftTensorDataType dtype);
+
+// 16-bit floating point types, which have no corresponding tensor type;
+// they are widened to float on deserialization (see deserializeAs).
+inline bool isHalfDataType(ThriftTensorDataType dtype) {
+  return dtype == ThriftTensorDataType::HALF ||
+         dtype == ThriftTensorDataType::BFLOAT16;
+}
+
+// Convert data (HALF or BFLOAT16 elements with the given endianness) to
+// a freshly allocated buffer of floats in native byte order.
+folly::IOBuf widenToFloat(const folly::IOBuf& data,
+                          ThriftTensorDataType dtype,
+                          ThriftTensorEndianness endianness);
+
 void serialize(ThriftStorage& out,
                folly::IOBuf&& data,
                ThriftTensorDataType dtype,
                ThriftTensorEndianness endianness,
-               SharingMode sharing);
+               SharingMode sharing,
+               ThriftTensorChecksum checksum);
+
+// folly::crc32c() of all data in the chain, continuing from crc. We always
+// start from 0, so that checksums of parts can be combined with
+// folly::crc32c_combine().
+uint32_t crc32c(const folly::IOBuf& data, uint32_t crc = 0);
+
+// Throw unless crc matches the checksum recorded in in. Only call if
+// in.checksumType isn't NONE.
+template <class ThriftObj>
+void checkChecksum(const ThriftObj& in, uint32_t crc) {
+  if (in.checksumType != ThriftTensorChecksum::CRC32C) {
+    throw std::invalid_argument(folly::sformat(
+        "Invalid Thrift tensor checksum type {}", int(in.checksumType)));
+  }
+  if (uint32_t(in.checksum) != crc) {
+    throw std::invalid_argument(folly::sformat(
+        "Thrift tensor checksum mismatch: expected {:08x}, got {:08x}",
+        uint32_t(in.checksum), crc));
+  }
+}
+
+// Serialized data, decompressed if necessary (in which case the result is
+// freshly allocated, and won't share memory with in.data)
+folly::IOBuf uncompressedData(const ThriftTensor& in);
+inline const folly::IOBuf& uncompressedData(const ThriftStorage& in) {
+  return in.data;
+}
 
 template <class ThriftObj>
 folly::IOBuf deserialize(const ThriftObj& in,
@@ -82,13 +133,42 @@ folly::IOBuf deserialize(const ThriftObj& in,
         "Invalid Thrift tensor data type {}, expected {}",
         int(in.dataType), int(dtype)));
   }
-  if (in.endianness != gMachineEndianness) {
+  folly::IOBuf data(uncompressedData(in));
+  if (in.endianness == gMachineEndianness) {
+    return data;
+  }
+  if (in.endianness != ThriftTensorEndianness::LITTLE &&
+      in.endianness != ThriftTensorEndianness::BIG) {
     throw std::invalid_argument(folly::sformat(
-        "Non-native endianness not yet implemented: {}, expected {}",
-        int(in.endianness), int(gMachineEndianness)));
+        "Invalid Thrift tensor endianness {}", int(in.endianness)));
   }
 
-  return in.data;
+  // The swapped buffer is always freshly allocated, so it won't share
+  // memory with in.data, no matter what the sharing mode is.
+  return byteSwapped(std::move(data), dataTypeSize(dtype));
+}
+
+// Convert QUINT8 data to a freshly allocated buffer of floats in native
+// byte order. Only tensors carry the quantization parameters.
+folly::IOBuf dequantize(const ThriftTensor& in);
+inline folly::IOBuf dequantize(const ThriftStorage& /*in*/) {
+  throw std::invalid_argument("Quantized data requires a ThriftTensor");
+}
+
+// Deserialize data for a tensor / storage of type T. Same as deserialize,
+// except that float also accepts HALF, BFLOAT16, and QUINT8 data, which is
+// converted (and so never shares memory with in.data).
+template <class T, class ThriftObj>
+folly::IOBuf deserializeAs(const ThriftObj& in) {
+  if (std::is_same<T, float>::value) {
+    if (isHalfDataType(in.dataType)) {
+      return widenToFloat(uncompressedData(in), in.dataType, in.endianness);
+    }
+    if (in.dataType == ThriftTensorDataType::QUINT8) {
+      return dequantize(in);
+    }
+  }
+  return deserialize(in, dataType<T>());
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -98,6 +178,65 @@ folly::IOBuf deserialize(const ThriftObj& in,
 extern THAllocator ioBufTHAllocator;
 extern THAllocator ioBufTHAllocatorNoRealloc;
 
+/**
+ * Allocator that owns a read-only mmap() region; used by Storage::mapFile.
+ * Like IOBufAllocator, it deletes itself when THStorage frees the memory.
+ */
+class MMapAllocator {
+ public:
+  MMapAllocator(const char* path, uint64_t offset, uint64_t length,
+                unsigned flags);
+  // fd isn't closed (and may be closed once this returns)
+  MMapAllocator(int fd, uint64_t offset, uint64_t length, unsigned flags);
+  ~MMapAllocator();
+
+  void* malloc(long size);
+  void free(void* ptr);
+
+  void* data() const { return data_; }
+  uint64_t length() const { return length_; }
+
+ private:
+  void map(int fd, uint64_t offset, uint64_t length, unsigned flags,
+           const char* path);
+
+  void* base_ = nullptr;
+  uint64_t mapLength_ = 0;
+  void* data_ = nullptr;
+  uint64_t length_ = 0;
+};
+
+extern THAllocator mmapTHAllocator;
+
+/**
+ * Allocator that owns a new shared memory segment (memfd) and a writable
+ * mapping of all of it; used by Storage::createShared. Deletes itself
+ * (unmapping and closing the segment) when THStorage frees the memory.
+ */
+class SharedMemoryAllocator {
+ public:
+  explicit SharedMemoryAllocator(uint64_t length);
+  ~SharedMemoryAllocator();
+
+  void* malloc(long size);
+  void free(void* ptr);
+
+  void* data() const { return data_; }
+  uint64_t length() const { return length_; }
+  int fd() const { return fd_; }
+
+ private:
+  int fd_ = -1;
+  void* data_ = nullptr;
+  uint64_t length_;
+};
+
+extern THAllocator sharedMemoryTHAllocator;
+extern THAllocator arenaTHAllocator;
+#ifndef NO_FOLLY
+extern THAllocator pooledTHAllocator;
+#endif
+
 }  // namespace detail
 
 template <class T>
@@ -116,12 +255,15 @@ Storage<T>::Storage(It begin, It end) {
     this->t_ = nullptr;
     return;
   }
-  auto data = std::unique_ptr<T, decltype(&free)>({
-      static_cast<T*>(malloc(n * sizeof(T))),
-      free});
+  auto allocator = detail::gStorageAllocator;
+  auto context = detail::gStorageAllocatorContext;
+  auto deleter = [allocator, context] (T* p) { allocator->free(context, p); };
+  auto data = std::unique_ptr<T, decltype(deleter)>(
+      static_cast<T*>(allocator->malloc(context, n * sizeof(T))),
+      deleter);
   if (!data) throw std::bad_alloc();
   std::copy(begin, end, data.get());
-  this->t_ = Ops::_newWithData(data.get(), n);
+  this->t_ = Ops::_newWithDataAndAllocator(data.get(), n, allocator, context);
   data.release();
 }
 
@@ -131,12 +273,15 @@ Storage<T>::Storage(size_t n, T value) {
     this->t_ = nullptr;
     return;
   }
-  auto data = std::unique_ptr<T, decltype(&free)>({
-      static_cast<T*>(malloc(n * sizeof(T))),
-      free});
+  auto allocator = detail::gStorageAllocator;
+  auto context = detail::gStorageAllocatorContext;
+  auto deleter = [allocator, context] (T* p) { allocator->free(context, p); };
+  auto data = std::unique_ptr<T, decltype(deleter)>(
+      static_cast<T*>(allocator->malloc(context, n * sizeof(T))),
+      deleter);
   if (!data) throw std::bad_alloc();
   std::fill_n(data.get(), n, value);
-  this->t_ = Ops::_newWithData(data.get(), n);
+  this->t_ = Ops::_newWithDataAndAllocator(data.get(), n, allocator, context);
   data.release();
 }
 
@@ -201,6 +346,69 @@ Storage<T> Storage<T>::withAllocator(THAllocator* allocator,
   return s;
 }
 
+template <class T>
+Storage<T> Storage<T>::mapFile(const std::string& path, uint64_t offset,
+                               uint64_t length, unsigned flags) {
+  if (offset % alignof(T) != 0) {
+    throw std::invalid_argument("Mapped file offset must be aligned");
+  }
+  return fromMapping(std::unique_ptr<detail::MMapAllocator>(
+      new detail::MMapAllocator(path.c_str(), offset, length, flags)));
+}
+
+template <class T>
+Storage<T> Storage<T>::mapFile(int fd, uint64_t offset, uint64_t length,
+                               unsigned flags) {
+  if (offset % alignof(T) != 0) {
+    throw std::invalid_argument("Mapped file offset must be aligned");
+  }
+  return fromMapping(std::unique_ptr<detail::MMapAllocator>(
+      new detail::MMapAllocator(fd, offset, length, flags)));
+}
+
+template <class T>
+Storage<T> Storage<T>::fromMapping(
+    std::unique_ptr<detail::MMapAllocator> allocator) {
+  if (allocator->length() % sizeof(T) != 0) {
+    throw std::invalid_argument(
+        "Mapped file length must be multiple of data size");
+  }
+
+  Storage<T> s;
+  if (allocator->length() != 0) {
+    s.t_ = Ops::_newWithDataAndAllocator(
+        static_cast<T*>(allocator->data()), allocator->length() / sizeof(T),
+        &detail::mmapTHAllocator, allocator.get());
+    allocator.release();
+    Ops::_clearFlag(s.t_, TH_STORAGE_RESIZABLE);
+  }
+  return s;
+}
+
+template <class T>
+Storage<T> Storage<T>::createShared(size_t n) {
+  Storage<T> s;
+  if (n != 0) {
+    std::unique_ptr<detail::SharedMemoryAllocator> allocator(
+        new detail::SharedMemoryAllocator(n * sizeof(T)));
+    s.t_ = Ops::_newWithDataAndAllocator(
+        static_cast<T*>(allocator->data()), n,
+        &detail::sharedMemoryTHAllocator, allocator.get());
+    allocator.release();
+    Ops::_clearFlag(s.t_, TH_STORAGE_RESIZABLE);
+  }
+  return s;
+}
+
+template <class T>
+int Storage<T>::sharedMemoryFd() const {
+  if (!this->t_ ||
+      this->t_->allocator != &detail::sharedMemoryTHAllocator) {
+    return -1;
+  }
+  return static_cast<detail::SharedMemoryAllocator*>(
+      this->t_->allocatorContext)->fd();
+}
 
 template <class T>
 Storage<T>::~Storage() {
@@ -282,12 +490,20 @@ namespace detail {
 class IOBufAllocator {
  public:
   explicit IOBufAllocator(folly::IOBuf&& iob);
+  ~IOBufAllocator();
 
   void* malloc(long size);
   void* realloc(void* ptr, long size);
   void free(void* ptr);
   bool isUnique(const void* ptr) const;
 
+  // Copy-on-write storages (see Tensor's COPY_ON_WRITE mode) unshare the
+  // buffer before the first write, instead of writing to memory that other
+  // storages see. makeWritable() returns the (possibly new) data pointer.
+  bool copyOnWrite() const { return copyOnWrite_; }
+  void setCopyOnWrite() { copyOnWrite_ = true; }
+  void* makeWritable(void* ptr);
+
   folly::IOBuf clone() {
     folly::IOBuf buf;
     iob_.cloneInto(buf);
@@ -297,6 +513,7 @@ class IOBufAllocator {
  private:
   folly::IOBuf iob_;
   uint64_t maxLength_;
+  bool copyOnWrite_ = false;
 };
 
 struct THAllocFreeFuncData {
@@ -322,12 +539,15 @@ folly::IOBuf Storage<T>::getIOBuf() {
   auto len = this->size() * sizeof(T);
   auto curAllocator = this->t_->allocator;
   if (curAllocator == &THDefaultAllocator) {
-    // Switch to using IOBuf allocator.
-    // We know that memory from the default allocator was allocated with
-    // malloc, just like IOBuf, so we know how to free it.
+    // Switch to using IOBuf allocator, which may reallocate the memory (as
+    // IOBuf does), but must still free it with THDefaultAllocator: it may
+    // have been replaced, and it accounts for the memory it frees.
     this->t_->allocator = iobTHAllocator;
+    auto freeFuncData = new detail::THAllocFreeFuncData(
+      curAllocator, this->t_->allocatorContext);
     this->t_->allocatorContext = new detail::IOBufAllocator(folly::IOBuf(
-            folly::IOBuf::TAKE_OWNERSHIP, this->data(), len, len));
+            folly::IOBuf::TAKE_OWNERSHIP, this->data(), len, len,
+            detail::THAllocFreeFunc, freeFuncData));
   } else if (curAllocator == iobTHAllocator ||
              curAllocator == iobTHAllocatorNoRealloc) {
     // do nothing
@@ -361,7 +581,7 @@ Storage<T>::Storage(folly::IOBuf&& iob, SharingMode sharing,
 template <class T>
 Storage<T>::Storage(const ThriftStorage& in, SharingMode sharing)
   : Base(nullptr) {
-  setFromIOBuf(detail::deserialize(in, detail::dataType<T>()), sharing, true);
+  setFromIOBuf(detail::deserializeAs<T>(in), sharing, true);
 }
 #endif
 
@@ -374,13 +594,16 @@ void Storage<T>::setFromIOBuf(folly::IOBuf&& iob, SharingMode sharing,
   }
   len /= sizeof(T);
 
-  iob.coalesce();
+  if (iob.isChained()) {
+    iob = detail::unchain(std::move(iob));
+  }
   detail::applySharingMode(iob, sharing);
 
-  // Ensure properly aligned, make a copy otherwise. coalesce()
+  // Ensure properly aligned, make a copy otherwise. unchain()
   // and/or applySharingMode() might have already done that for us,
   // in which case we're likely already aligned.
   if ((reinterpret_cast<uintptr_t>(iob.data()) % alignof(T)) != 0) {
+    detail::recordCopy(CopyReason::MISALIGNED, iob.length());
     iob = folly::IOBuf(folly::IOBuf::COPY_BUFFER, iob.data(), iob.length());
   }
 
@@ -395,13 +618,79 @@ void Storage<T>::setFromIOBuf(folly::IOBuf&& iob, SharingMode sharing,
   }
 }
 
+template <class T>
+Storage<T> Storage<T>::newCopyOnWrite(THType* th) {
+  Storage<T> src(th);
+  Storage<T> dest(src.getIOBuf(), SHARE_ALL);
+  static_cast<detail::IOBufAllocator*>(src.t_->allocatorContext)->
+    setCopyOnWrite();
+  static_cast<detail::IOBufAllocator*>(dest.t_->allocatorContext)->
+    setCopyOnWrite();
+  return dest;
+}
+
+template <class T>
+auto Storage<T>::fromIOBufChain(folly::IOBuf&& iob, SharingMode sharing)
+  -> std::vector<Storage> {
+  if (iob.computeChainDataLength() % sizeof(T) != 0) {
+    throw std::invalid_argument("IOBuf size must be multiple of data size");
+  }
+
+  std::vector<Storage> out;
+
+  // An element that straddles buffer boundaries is assembled here
+  T carry;
+  size_t carryLen = 0;
+
+  const folly::IOBuf* p = &iob;
+  do {
+    const uint8_t* data = p->data();
+    size_t n = p->length();
+
+    if (carryLen != 0) {
+      size_t k = std::min(n, sizeof(T) - carryLen);
+      memcpy(reinterpret_cast<uint8_t*>(&carry) + carryLen, data, k);
+      carryLen += k;
+      data += k;
+      n -= k;
+      if (carryLen == sizeof(T)) {
+        out.emplace_back(size_t(1), carry);
+        carryLen = 0;
+      }
+    }
+
+    size_t whole = n / sizeof(T);
+    if (whole != 0) {
+      auto buf = p->cloneOneAsValue();
+      buf.trimStart(data - p->data());
+      buf.trimEnd(n - whole * sizeof(T));
+      Storage s;
+      // Copies if misaligned, shares otherwise
+      s.setFromIOBuf(std::move(buf), sharing, true);
+      out.push_back(std::move(s));
+    }
+
+    size_t rest = n - whole * sizeof(T);
+    if (rest != 0) {
+      memcpy(&carry, data + whole * sizeof(T), rest);
+      carryLen = rest;
+    }
+
+    p = p->next();
+  } while (p != &iob);
+
+  DCHECK_EQ(carryLen, 0);
+  return out;
+}
+
 #if !defined(NO_THRIFT) && !defined(NO_FOLLY)
 template <class T>
 void Storage<T>::serialize(ThriftStorage& out,
                            ThriftTensorEndianness endianness,
-                           SharingMode sharing) const {
+                           SharingMode sharing,
+                           ThriftTensorChecksum checksum) const {
   detail::serialize(out, const_cast<Storage*>(this)->getIOBuf(),
-                    detail::dataType<T>(), endianness, sharing);
+                    detail::dataType<T>(), endianness, sharing, checksum);
 }
 #endif
 
@@ -422,18 +711,39 @@ bool Storage<T>::isUnique(const THType* th) {
   if (th->allocator == &THDefaultAllocator) {
     return true;
   }
+  // Arena blocks are owned by exactly one storage until freed.
+  if (th->allocator == &detail::arenaTHAllocator) {
+    return true;
+  }
 
 #ifndef NO_FOLLY
-  // Check all our supported allocators. Currently one.
+  // Check all our supported allocators.
   auto iobTHAllocator = &detail::ioBufTHAllocator;
   if (th->allocator == iobTHAllocator) {
     return static_cast<const detail::IOBufAllocator*>(th->allocatorContext)->
       isUnique(th->data);
   }
+  // Pooled blocks are owned by exactly one storage until freed.
+  if (th->allocator == &detail::pooledTHAllocator) {
+    return true;
+  }
 #endif
 
   // Unknown allocator. Be on the safe side.
   return false;
 }
 
+template <class T>
+inline void Storage<T>::prepareWrite(THType* th) {
+#ifndef NO_FOLLY
+  if (th && (th->allocator == &detail::ioBufTHAllocator ||
+             th->allocator == &detail::ioBufTHAllocatorNoRealloc)) {
+    auto alloc = static_cast<detail::IOBufAllocator*>(th->allocatorContext);
+    if (alloc->copyOnWrite()) {
+      th->data = static_cast<T*>(alloc->makeWritable(th->data));
+    }
+  }
+#endif
+}
+
 }  // namespaces
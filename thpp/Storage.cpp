@@ -10,6 +10,13 @@
 
 #include <thpp/Storage.h>
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cerrno>
+#include <system_error>
+
 ////////////////////////////////////////////////////////////////////////////////
 #ifndef NO_FOLLY
 ////////////////////////////////////////////////////////////////////////////////
@@ -22,6 +29,11 @@ IOBufAllocator::IOBufAllocator(folly::IOBuf&& iob)
     maxLength_(iob_.isSharedOne() ? iob_.length() :
                std::numeric_limits<uint64_t>::max()) {
   DCHECK(!iob_.isChained());
+  recordAlloc(MemoryKind::IOBUF, -1, iob_.length());
+}
+
+IOBufAllocator::~IOBufAllocator() {
+  recordFree(MemoryKind::IOBUF, -1, iob_.length());
 }
 
 void* IOBufAllocator::malloc(long /*size*/) {
@@ -30,6 +42,7 @@ void* IOBufAllocator::malloc(long /*size*/) {
 
 void* IOBufAllocator::realloc(void* ptr, long size) {
   CHECK_EQ(ptr, iob_.writableData());
+  int64_t oldLength = iob_.length();
   if (size <= iob_.length()) {
     iob_.trimEnd(iob_.length() - size);
   } else {
@@ -39,6 +52,9 @@ void* IOBufAllocator::realloc(void* ptr, long size) {
     // might be filled with something else (other fields if decoding Thrift,
     // etc).
     if (size > maxLength_ || extra > iob_.tailroom()) {
+      if (iob_.isSharedOne()) {
+        recordCopy(CopyReason::REALLOC_UNSHARE, iob_.length());
+      }
       iob_.unshareOne();
       maxLength_ = std::numeric_limits<uint64_t>::max();
     }
@@ -47,6 +63,7 @@ void* IOBufAllocator::realloc(void* ptr, long size) {
     }
     iob_.append(extra);
   }
+  recordResize(MemoryKind::IOBUF, -1, int64_t(iob_.length()) - oldLength);
   return iob_.writableData();
 }
 
@@ -60,13 +77,29 @@ bool IOBufAllocator::isUnique(const void* ptr) const {
   return !iob_.isSharedOne();
 }
 
+void* IOBufAllocator::makeWritable(void* ptr) {
+  CHECK_EQ(ptr, iob_.data());
+  if (iob_.isSharedOne()) {
+    recordCopy(CopyReason::COPY_ON_WRITE, iob_.length());
+    iob_.unshareOne();
+    maxLength_ = std::numeric_limits<uint64_t>::max();
+  }
+  return iob_.writableData();
+}
+
 void applySharingMode(folly::IOBuf& iob, SharingMode sharing) {
   DCHECK(!iob.isChained());
   switch (sharing) {
   case SHARE_NONE:
+    if (iob.isSharedOne()) {
+      recordCopy(CopyReason::UNSHARE, iob.length());
+    }
     iob.unshareOne();
     break;
   case SHARE_IOBUF_MANAGED:
+    if (!iob.isManagedOne()) {
+      recordCopy(CopyReason::MAKE_MANAGED, iob.length());
+    }
     iob.makeManagedOne();
     break;
   case SHARE_ALL:
@@ -74,6 +107,34 @@ void applySharingMode(folly::IOBuf& iob, SharingMode sharing) {
   }
 }
 
+folly::IOBuf unchain(folly::IOBuf&& iob) {
+  const folly::IOBuf* nonEmpty = nullptr;
+  const folly::IOBuf* p = &iob;
+  do {
+    if (p->length() != 0) {
+      if (nonEmpty) {
+        // More than one non-empty buffer, must copy. IOBuf::coalesce()
+        // would preserve the headroom of the first buffer, which might
+        // leave the data misaligned and force a second copy.
+        size_t len = iob.computeChainDataLength();
+        recordCopy(CopyReason::UNCHAIN, len);
+        folly::IOBuf out(folly::IOBuf::CREATE, len);
+        const folly::IOBuf* q = &iob;
+        do {
+          memcpy(out.writableTail(), q->data(), q->length());
+          out.append(q->length());
+          q = q->next();
+        } while (q != &iob);
+        return out;
+      }
+      nonEmpty = p;
+    }
+    p = p->next();
+  } while (p != &iob);
+
+  return (nonEmpty ? nonEmpty : &iob)->cloneOneAsValue();
+}
+
 THAllocFreeFuncData::THAllocFreeFuncData(THAllocator* allocator, void* context):
   allocator(allocator), context(context) {}
 
@@ -102,3 +163,219 @@ THAllocator ioBufTHAllocatorNoRealloc = {
 ////////////////////////////////////////////////////////////////////////////////
 #endif // !NO_FOLLY
 ////////////////////////////////////////////////////////////////////////////////
+
+namespace thpp {
+namespace detail {
+
+namespace {
+
+constexpr uint64_t kHugePageSize = 2 << 20;
+
+[[noreturn]] void throwSystemError(const char* what, const char* path) {
+  throw std::system_error(errno, std::system_category(),
+                          std::string(what) + " " + path);
+}
+
+}  // namespace
+
+MMapAllocator::MMapAllocator(const char* path, uint64_t offset,
+                             uint64_t length, unsigned flags) {
+  int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+  if (fd == -1) {
+    throwSystemError("open", path);
+  }
+  try {
+    map(fd, offset, length, flags, path);
+  } catch (...) {
+    ::close(fd);
+    throw;
+  }
+  ::close(fd);
+}
+
+MMapAllocator::MMapAllocator(int fd, uint64_t offset, uint64_t length,
+                             unsigned flags) {
+  map(fd, offset, length, flags, "file descriptor");
+}
+
+void MMapAllocator::map(int fd, uint64_t offset, uint64_t length,
+                        unsigned flags, const char* path) {
+  struct stat st;
+  if (fstat(fd, &st) == -1) {
+    throwSystemError("fstat", path);
+  }
+  uint64_t fileSize = st.st_size;
+  if (offset > fileSize ||
+      (length != kMapToEnd && length > fileSize - offset)) {
+    throw std::invalid_argument("Mapped range extends past end of file");
+  }
+  length_ = (length == kMapToEnd ? fileSize - offset : length);
+  if (length_ == 0) {
+    return;
+  }
+
+  // mmap() wants a page-aligned file offset
+  uint64_t pageSize = sysconf(_SC_PAGESIZE);
+  uint64_t mapOffset = offset & ~(pageSize - 1);
+  mapLength_ = offset - mapOffset + length_;
+
+  int mmapFlags = MAP_SHARED;
+#ifdef MAP_POPULATE
+  if (flags & MAPPED_POPULATE) {
+    mmapFlags |= MAP_POPULATE;
+  }
+#endif
+
+  // For huge pages, reserve a larger range of address space and place the
+  // file mapping inside it at the right alignment, then give back the rest.
+  char* reservation = nullptr;
+  uint64_t reservationLength = 0;
+  char* addr = nullptr;
+  if ((flags & MAPPED_HUGEPAGES) && kHugePageSize > pageSize) {
+    reservationLength = mapLength_ + kHugePageSize;
+    void* r = mmap(nullptr, reservationLength, PROT_NONE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (r == MAP_FAILED) {
+      throwSystemError("mmap", path);
+    }
+    reservation = static_cast<char*>(r);
+    uint64_t misalignment =
+      (mapOffset - reinterpret_cast<uintptr_t>(reservation)) % kHugePageSize;
+    addr = reservation + misalignment;
+    mmapFlags |= MAP_FIXED;
+  }
+
+  base_ = mmap(addr, mapLength_, PROT_READ, mmapFlags, fd, mapOffset);
+  if (base_ == MAP_FAILED) {
+    int err = errno;
+    base_ = nullptr;
+    if (reservation) {
+      munmap(reservation, reservationLength);
+    }
+    errno = err;
+    throwSystemError("mmap", path);
+  }
+
+  if (reservation) {
+    auto start = static_cast<char*>(base_);
+    auto end = start + mapLength_;
+    if (start != reservation) {
+      munmap(reservation, start - reservation);
+    }
+    if (end != reservation + reservationLength) {
+      munmap(end, reservation + reservationLength - end);
+    }
+  }
+
+  // Hints only; failure is not fatal.
+  if (flags & MAPPED_SEQUENTIAL) {
+    madvise(base_, mapLength_, MADV_SEQUENTIAL);
+  }
+  if (flags & MAPPED_RANDOM) {
+    madvise(base_, mapLength_, MADV_RANDOM);
+  }
+  if (flags & MAPPED_WILLNEED) {
+    madvise(base_, mapLength_, MADV_WILLNEED);
+  }
+#ifdef MADV_HUGEPAGE
+  if (flags & MAPPED_HUGEPAGES) {
+    madvise(base_, mapLength_, MADV_HUGEPAGE);
+  }
+#endif
+
+  data_ = static_cast<char*>(base_) + (offset - mapOffset);
+  recordAlloc(MemoryKind::MAPPED, -1, length_);
+}
+
+MMapAllocator::~MMapAllocator() {
+  if (base_) {
+    munmap(base_, mapLength_);
+    recordFree(MemoryKind::MAPPED, -1, length_);
+  }
+}
+
+void* MMapAllocator::malloc(long /*size*/) {
+  DCHECK(false && "MMapAllocator::malloc should never be called");
+  return nullptr;
+}
+
+void MMapAllocator::free(void* ptr) {
+  DCHECK(ptr == data_);
+  delete this;
+}
+
+THAllocator mmapTHAllocator = {
+  &THAllocatorWrapper<MMapAllocator>::malloc,
+  nullptr,
+  &THAllocatorWrapper<MMapAllocator>::free,
+};
+
+SharedMemoryAllocator::SharedMemoryAllocator(uint64_t length)
+  : length_(length) {
+  DCHECK(length_ != 0);
+#ifdef MFD_ALLOW_SEALING
+  fd_ = memfd_create("thpp", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+#else
+  errno = ENOSYS;
+#endif
+  if (fd_ == -1) {
+    throwSystemError("memfd_create", "thpp");
+  }
+  try {
+    if (ftruncate(fd_, length_) == -1) {
+      throwSystemError("ftruncate", "memfd");
+    }
+#ifdef F_ADD_SEALS
+    // Peers map the segment read-only; make sure that it can't shrink
+    // from under them (which would make their accesses fault).
+    if (fcntl(fd_, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) ==
+        -1) {
+      throwSystemError("fcntl(F_ADD_SEALS)", "memfd");
+    }
+#endif
+    data_ = mmap(nullptr, length_, PROT_READ | PROT_WRITE, MAP_SHARED, fd_,
+                 0);
+    if (data_ == MAP_FAILED) {
+      data_ = nullptr;
+      throwSystemError("mmap", "memfd");
+    }
+  } catch (...) {
+    ::close(fd_);
+    throw;
+  }
+  recordAlloc(MemoryKind::SHARED_MEMORY, -1, length_);
+}
+
+SharedMemoryAllocator::~SharedMemoryAllocator() {
+  munmap(data_, length_);
+  ::close(fd_);
+  recordFree(MemoryKind::SHARED_MEMORY, -1, length_);
+}
+
+void* SharedMemoryAllocator::malloc(long /*size*/) {
+  DCHECK(false && "SharedMemoryAllocator::malloc should never be called");
+  return nullptr;
+}
+
+void SharedMemoryAllocator::free(void* ptr) {
+  DCHECK(ptr == data_);
+  delete this;
+}
+
+THAllocator sharedMemoryTHAllocator = {
+  &THAllocatorWrapper<SharedMemoryAllocator>::malloc,
+  nullptr,
+  &THAllocatorWrapper<SharedMemoryAllocator>::free,
+};
+
+THAllocator* gStorageAllocator = &THDefaultAllocator;
+void* gStorageAllocatorContext = nullptr;
+
+}  // namespace detail
+
+void setStorageAllocator(THAllocator* allocator, void* allocatorContext) {
+  detail::gStorageAllocator = allocator;
+  detail::gStorageAllocatorContext = allocatorContext;
+}
+
+}  // namespaces
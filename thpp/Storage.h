@@ -16,8 +16,12 @@
 #define DCHECK(x) assert(x)
 #endif
 
+#include <cstdint>
 #include <initializer_list>
+#include <limits>
 #include <memory>
+#include <string>
+#include <vector>
 #ifndef NO_THRIFT
 #include <thpp/if/gen-cpp2/Tensor_types.h>
 #endif
@@ -26,6 +30,8 @@
 #include <folly/Range.h>
 #include <folly/io/IOBuf.h>
 #endif
+#include <thpp/CopyStats.h>
+#include <thpp/MemoryStats.h>
 #include <thpp/StorageBase.h>
 #include <thpp/detail/Storage.h>
 
@@ -42,6 +48,45 @@ using folly::Range;
 template <class T> class Tensor;
 template <class T> class CudaTensor;
 
+namespace detail {
+class MMapAllocator;
+}  // namespace detail
+
+// Flags for Storage::mapFile. Bitwise OR of:
+enum MapFileFlags : unsigned {
+  // Fault in all pages when mapping (MAP_POPULATE), so that later accesses
+  // never block on I/O.
+  MAPPED_POPULATE = 1U << 0,
+
+  // Access pattern hints, passed on to madvise()
+  MAPPED_SEQUENTIAL = 1U << 1,
+  MAPPED_RANDOM = 1U << 2,
+  MAPPED_WILLNEED = 1U << 3,
+
+  // Place the mapping so that it may be backed by transparent huge pages
+  // (virtual addresses congruent to file offsets modulo the huge page size)
+  // and request huge pages with madvise().
+  MAPPED_HUGEPAGES = 1U << 4,
+};
+
+// Map until the end of the file
+constexpr uint64_t kMapToEnd = std::numeric_limits<uint64_t>::max();
+
+// Allocator for the data of storages built from values (the iterator,
+// initializer list, and (n, value) constructors); THDefaultAllocator, with a
+// null context, unless changed. Set it once, at startup, before any such
+// storages are created; it must outlive all of them. For example, to
+// allocate them from the default PooledAllocator:
+//
+//   setStorageAllocator(PooledAllocator::thAllocator(),
+//                       &PooledAllocator::defaultInstance());
+void setStorageAllocator(THAllocator* allocator, void* allocatorContext);
+
+namespace detail {
+extern THAllocator* gStorageAllocator;
+extern void* gStorageAllocatorContext;
+}  // namespace detail
+
 #ifndef NO_FOLLY
 enum SharingMode {
   // Do not share memory with the given IOBuf.
@@ -92,6 +137,17 @@ class Storage : public StorageBase<T, Storage<T>> {
                    bool resizable = true)
     : Storage(folly::IOBuf(iob), sharing, resizable) { }
 
+  // Create Storage objects that share memory with a (possibly chained)
+  // IOBuf without coalescing it. The returned storages cover all elements
+  // in iob, in order. Only elements that straddle buffer boundaries and
+  // buffers that aren't properly aligned for T are copied; everything else
+  // shares memory with iob according to sharing (as in the constructor
+  // above), so the cost is proportional to the fix-ups, not to the size
+  // of iob.
+  static std::vector<Storage> fromIOBufChain(
+      folly::IOBuf&& iob,
+      SharingMode sharing = SHARE_IOBUF_MANAGED);
+
 #if !defined(NO_THRIFT) && !defined(NO_FOLLY)
   // Deserialize from Thrift. Throws if wrong type.
   explicit Storage(const ThriftStorage& thriftStorage,
@@ -123,6 +179,40 @@ class Storage : public StorageBase<T, Storage<T>> {
   static Storage withAllocator(THAllocator* allocator,
                                void* allocatorContext);
 
+  // Map length bytes of a file, starting at offset, read-only. The data
+  // is in native byte order. offset must be aligned for T, and length must
+  // be a multiple of sizeof(T). flags is a bitwise OR of MapFileFlags.
+  //
+  // The mapping is shared, so all processes mapping the same file share
+  // one copy in the page cache. The resulting storage is not resizable,
+  // and it may not be written to; copy it (or a Tensor built on it) if you
+  // need to modify the data.
+  static Storage mapFile(const std::string& path,
+                         uint64_t offset = 0,
+                         uint64_t length = kMapToEnd,
+                         unsigned flags = 0);
+
+  // Same, for an open file descriptor, which may be closed once this
+  // returns (the mapping remains valid).
+  static Storage mapFile(int fd,
+                         uint64_t offset = 0,
+                         uint64_t length = kMapToEnd,
+                         unsigned flags = 0);
+
+  // Allocate n zero-initialized elements in a new shared memory segment
+  // (memfd), which other processes can map without copying: send them
+  // sharedMemoryFd() (with SCM_RIGHTS over a Unix domain socket, for
+  // example), and have them call mapFile() on it (or see
+  // Tensor::exportShared). Their mappings are read-only, and see writes
+  // made through this storage. The storage isn't resizable, and the
+  // segment is sealed so that it can't shrink from under the peers; it's
+  // freed once this storage and all mappings of it are gone.
+  static Storage createShared(size_t n);
+
+  // File descriptor of the shared memory segment of a storage created with
+  // createShared(), or -1. Owned by the storage; dup() it to keep it.
+  int sharedMemoryFd() const;
+
   ~Storage();
 
   Storage(Storage&& other) noexcept;
@@ -147,11 +237,14 @@ class Storage : public StorageBase<T, Storage<T>> {
   folly::IOBuf getIOBuf();
 
 #if !defined(NO_THRIFT) && !defined(NO_FOLLY)
-  // Serialize to Thrift.
+  // Serialize to Thrift, optionally with a checksum of the serialized
+  // data (see verifyChecksum()).
   void serialize(ThriftStorage& out,
                  ThriftTensorEndianness endianness =
                      ThriftTensorEndianness::NATIVE,
-                 SharingMode sharing = SHARE_IOBUF_MANAGED) const;
+                 SharingMode sharing = SHARE_IOBUF_MANAGED,
+                 ThriftTensorChecksum checksum =
+                     ThriftTensorChecksum::NONE) const;
 #endif
 
   // This is obvious, except on Cuda, where it isn't.
@@ -182,15 +275,34 @@ class Storage : public StorageBase<T, Storage<T>> {
   bool isUnique() const { return isUnique(this->t_); }
   static bool isUnique(const THType* th);
 
+  // If th is copy-on-write (see Tensor's COPY_ON_WRITE mode) and still
+  // shares its memory, give it a private copy. Tensor operations that
+  // write call this; writes through data() pointers of the storage itself
+  // don't.
+  static void prepareWrite(THType* th);
+
  private:
   template <class U> friend class Tensor;
   template <class U> friend class CudaTensor;
 
+  static Storage fromMapping(std::unique_ptr<detail::MMapAllocator> allocator);
+
 #ifndef NO_FOLLY
   void setFromIOBuf(folly::IOBuf&& iob, SharingMode sharing, bool resizable);
+
+  // Create a storage that shares th's memory, and make both copy-on-write
+  static Storage newCopyOnWrite(THType* th);
 #endif
 };
 
+#if !defined(NO_THRIFT) && !defined(NO_FOLLY)
+// Throw std::invalid_argument if in has a checksum that doesn't match its
+// data. Deserializing doesn't check (it usually doesn't even read the
+// data), so call this first if you need to. Does nothing if in has no
+// checksum.
+void verifyChecksum(const ThriftStorage& in);
+#endif
+
 /**
  * Wrap a THAllocator-like object with a C++ interface into THAllocator.
  */
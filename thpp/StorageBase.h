@@ -66,6 +66,10 @@ class StorageBase {
 
   void resizeUninitialized(size_t n);
 
+  // Called by tensors before writing to th's memory; see
+  // Storage::prepareWrite(). Nothing to do by default.
+  static void prepareWrite(THType* /*th*/) { }
+
  protected:
   StorageBase() { }  // leave t_ uninitialized
   explicit StorageBase(THType* t) : t_(t) { }
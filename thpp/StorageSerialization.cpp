@@ -9,11 +9,14 @@
  */
 
 #include <thpp/Storage.h>
+#include <thpp/Half.h>
 
 ////////////////////////////////////////////////////////////////////////////////
 #if !defined(NO_THRIFT) && !defined(NO_FOLLY)
 ////////////////////////////////////////////////////////////////////////////////
 
+#include <folly/hash/Checksum.h>
+
 namespace thpp {
 namespace detail {
 
@@ -22,25 +25,116 @@ void serialize(
     folly::IOBuf&& data,
     ThriftTensorDataType dtype,
     ThriftTensorEndianness endianness,
-    SharingMode sharing) {
+    SharingMode sharing,
+    ThriftTensorChecksum checksum) {
   DCHECK(!data.isChained());
   if (endianness == ThriftTensorEndianness::NATIVE) {
     endianness = gMachineEndianness;
   } else {
-    CHECK(endianness == gMachineEndianness)
-      << "Non-native endianness not yet implemented";
+    CHECK(endianness == ThriftTensorEndianness::LITTLE ||
+          endianness == ThriftTensorEndianness::BIG)
+      << "Invalid endianness " << int(endianness);
   }
 
   out.dataType = dtype;
   out.endianness = endianness;
-  detail::applySharingMode(data, sharing);
-  out.data = std::move(data);
+  if (endianness != gMachineEndianness) {
+    // Swapping never modifies memory that is shared, so there's no need
+    // to apply the sharing mode; the result is always unshared.
+    out.data = byteSwapped(std::move(data), dataTypeSize(dtype));
+  } else {
+    detail::applySharingMode(data, sharing);
+    out.data = std::move(data);
+  }
+
+  out.checksumType = checksum;
+  switch (checksum) {
+  case ThriftTensorChecksum::NONE:
+    out.checksum = 0;
+    break;
+  case ThriftTensorChecksum::CRC32C:
+    out.checksum = crc32c(out.data);
+    break;
+  default:
+    throw std::invalid_argument(folly::sformat(
+        "Invalid Thrift tensor checksum type {}", int(checksum)));
+  }
+}
+
+uint32_t crc32c(const folly::IOBuf& data, uint32_t crc) {
+  for (auto range : data) {
+    crc = folly::crc32c(range.data(), range.size(), crc);
+  }
+  return crc;
+}
+
+size_t dataTypeSize(ThriftTensorDataType dtype) {
+  switch (dtype) {
+#define X(TYPE) \
+  case DataType<TYPE>::value: return DataType<TYPE>::size;
+  X(unsigned char)
+  X(int32_t)
+  X(int64_t)
+  X(float)
+  X(double)
+#undef X
+  case ThriftTensorDataType::HALF:
+  case ThriftTensorDataType::BFLOAT16:
+    return 2;
+  case ThriftTensorDataType::QUINT8:
+    return 1;
+  }
+  throw std::invalid_argument(folly::sformat(
+      "Invalid Thrift tensor data type {}", int(dtype)));
+}
+
+folly::IOBuf widenToFloat(const folly::IOBuf& data,
+                          ThriftTensorDataType dtype,
+                          ThriftTensorEndianness endianness) {
+  if (endianness != ThriftTensorEndianness::LITTLE &&
+      endianness != ThriftTensorEndianness::BIG) {
+    throw std::invalid_argument(folly::sformat(
+        "Invalid Thrift tensor endianness {}", int(endianness)));
+  }
+  DCHECK(isHalfDataType(dtype));
+
+  // Get the 16-bit elements into one native-endian buffer; this is free
+  // if data is a single buffer in native byte order.
+  folly::IOBuf src(data);
+  if (endianness != gMachineEndianness) {
+    src = byteSwapped(std::move(src), 2);
+  } else {
+    src.coalesce();
+  }
+  if (src.length() % 2 != 0) {
+    throw std::invalid_argument("IOBuf size must be multiple of data size");
+  }
+
+  size_t n = src.length() / 2;
+  folly::IOBuf out(folly::IOBuf::CREATE, n * sizeof(float));
+  auto dest = reinterpret_cast<float*>(out.writableData());
+  auto p = reinterpret_cast<const uint16_t*>(src.data());
+  if (dtype == ThriftTensorDataType::HALF) {
+    halfToFloat(dest, p, n);
+  } else {
+    bfloat16ToFloat(dest, p, n);
+  }
+  out.append(n * sizeof(float));
+  return out;
 }
 
 template folly::IOBuf deserialize(const ThriftStorage& in,
                                   ThriftTensorDataType dtype);
 
-}}  // namespaces
+}  // namespace detail
+
+void verifyChecksum(const ThriftStorage& in) {
+  if (in.checksumType != ThriftTensorChecksum::NONE) {
+    detail::checkChecksum(in, detail::crc32c(in.data));
+  }
+}
+
+}  // namespaces
 
 ////////////////////////////////////////////////////////////////////////////////
 #endif // !NO_THRIFT && !NO_FOLLY
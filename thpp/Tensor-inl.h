@@ -12,6 +12,9 @@
 #error This file may only be included from thpp/Tensor.h
 #endif
 
+#include <thpp/detail/Convert.h>
+#include <thpp/detail/TensorIteration.h>
+
 namespace thpp {
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -27,11 +30,47 @@ void serialize(
     ThriftTensorDataType dtype,
     size_t elementSize,
     ThriftTensorEndianness endianness,
-    SharingMode sharing);
+    SharingMode sharing,
+    folly::Executor* executor,
+    ThriftTensorCompression compression,
+    ThriftTensorChecksum checksum);
 
 template <class ThriftObj>
 folly::IOBuf deserialize(const ThriftObj& in,
                          ThriftTensorDataType dtype);
+
+// Copy data (in row-major order) into the elements of a tensor with the
+// given sizes and strides starting at dest, optionally byte swapping. If
+// crc isn't null, the checksum of data is accumulated into *crc.
+void scatter(void* dest,
+             LongRange sizes,
+             LongRange strides,
+             const folly::IOBuf& data,
+             size_t elementSize,
+             bool swap,
+             uint32_t* crc = nullptr);
+
+// Throw unless a tensor with the given sizes can hold in
+void checkDeserializeSizes(LongRange sizes, const ThriftTensor& in);
+
+// Compare contiguous data against contiguous base (of the same sizes)
+// block by block, and serialize the changed blocks.
+void serializeDelta(ThriftTensorDelta& out,
+                    LongRange sizes,
+                    const void* data,
+                    const void* base,
+                    ThriftTensorDataType dtype,
+                    size_t elementSize,
+                    int64_t blockSize,
+                    ThriftTensorEndianness endianness,
+                    ThriftTensorCompression compression);
+
+// Patch contiguous data (of the delta's sizes) with the changed blocks
+void applyDelta(void* data,
+                LongRange sizes,
+                const ThriftTensorDelta& delta,
+                ThriftTensorDataType dtype,
+                size_t elementSize);
 }  // namespace detail
 ////////////////////////////////////////////////////////////////////////////////
 #endif // !NO_THRIFT && !NO_FOLLY
@@ -40,6 +79,15 @@ folly::IOBuf deserialize(const ThriftObj& in,
 template <class T>
 Tensor<T>::Tensor() : Base(Ops::_new()) { }
 
+template <class T>
+Tensor<T> Tensor<T>::makeResult() {
+  auto arena = TensorArena::current();
+  if (!arena) {
+    return Tensor();
+  }
+  return Tensor(arena->storage<T>(), 0, LongStorage());
+}
+
 template <class T>
 Tensor<T>::Tensor(StorageType storage, offset_type storageOffset,
                   LongStorage sizes, LongStorage strides) : Tensor() {
@@ -50,20 +98,45 @@ Tensor<T>::Tensor(StorageType storage, offset_type storageOffset,
 #ifndef NO_FOLLY
 template <class T>
 Tensor<T>::Tensor(StorageType storage, offset_type storageOffset,
-                  LongRange sizes, LongRange strides)
-  : Tensor(std::move(storage), storageOffset,
-           LongStorage::wrap(detail::makeMutable(sizes)),
-           LongStorage::wrap(detail::makeMutable(strides))) { }
+                  LongRange sizes, LongRange strides) : Tensor() {
+  if (!Base::setStorageSmall(this->t_, storage.th(), storageOffset,
+                             sizes.data(), sizes.size(),
+                             strides.data(), strides.size())) {
+    Ops::_setStorage(this->t_, storage.th(), storageOffset,
+                     LongStorage::wrap(detail::makeMutable(sizes)).th(),
+                     LongStorage::wrap(detail::makeMutable(strides)).th());
+  }
+}
 #endif
 
 template <class T>
 Tensor<T>::Tensor(StorageType storage, offset_type storageOffset,
                   std::initializer_list<size_type> sizes,
-                  std::initializer_list<size_type> strides)
-  : Tensor(std::move(storage), storageOffset,
-           LongStorage(sizes.begin(), sizes.end()),
-           LongStorage(strides.begin(), strides.end())) { }
+                  std::initializer_list<size_type> strides) : Tensor() {
+  if (!Base::setStorageSmall(this->t_, storage.th(), storageOffset,
+                             sizes.begin(), sizes.size(),
+                             strides.begin(), strides.size())) {
+    Ops::_setStorage(this->t_, storage.th(), storageOffset,
+                     LongStorage(sizes.begin(), sizes.end()).th(),
+                     LongStorage(strides.begin(), strides.end()).th());
+  }
+}
 
+template <class T>
+Tensor<T> Tensor<T>::mapFile(const std::string& path, uint64_t offset,
+                             const std::vector<size_type>& sizes,
+                             unsigned flags) {
+  // TH tensors with no dimensions are empty
+  uint64_t n = sizes.empty() ? 0 : 1;
+  for (auto s : sizes) {
+    if (s < 0) {
+      throw std::invalid_argument("Invalid tensor size");
+    }
+    n *= s;
+  }
+  return Tensor(StorageType::mapFile(path, offset, n * sizeof(T), flags), 0,
+                LongStorage(sizes.begin(), sizes.end()));
+}
 
 template <class T>
 Tensor<T>::Tensor(LongStorage sizes, LongStorage strides) : Tensor() {
@@ -72,22 +145,39 @@ Tensor<T>::Tensor(LongStorage sizes, LongStorage strides) : Tensor() {
 
 #ifndef NO_FOLLY
 template <class T>
-Tensor<T>::Tensor(LongRange sizes, LongRange strides)
-  : Tensor(LongStorage::wrap(detail::makeMutable(sizes)),
-           LongStorage::wrap(detail::makeMutable(strides))) { }
+Tensor<T>::Tensor(LongRange sizes, LongRange strides) : Tensor() {
+  if (!Base::setStorageSmall(this->t_, nullptr, 0, sizes.data(), sizes.size(),
+                             strides.data(), strides.size())) {
+    Ops::_setStorage(this->t_, nullptr, 0,
+                     LongStorage::wrap(detail::makeMutable(sizes)).th(),
+                     LongStorage::wrap(detail::makeMutable(strides)).th());
+  }
+}
 #endif
 
 template <class T>
 Tensor<T>::Tensor(std::initializer_list<size_type> sizes,
-                  std::initializer_list<size_type> strides)
-  : Tensor(LongStorage(sizes.begin(), sizes.end()),
-           LongStorage(strides.begin(), strides.end())) { }
+                  std::initializer_list<size_type> strides) : Tensor() {
+  if (!Base::setStorageSmall(this->t_, nullptr, 0,
+                             sizes.begin(), sizes.size(),
+                             strides.begin(), strides.size())) {
+    Ops::_setStorage(this->t_, nullptr, 0,
+                     LongStorage(sizes.begin(), sizes.end()).th(),
+                     LongStorage(strides.begin(), strides.end()).th());
+  }
+}
 
 template <class T>
 Tensor<T>::Tensor(const std::vector<size_type>& sizes,
-                  const std::vector<size_type>& strides)
-    : Tensor(LongStorage(sizes.begin(), sizes.end()),
-             LongStorage(strides.begin(), strides.end())) { }
+                  const std::vector<size_type>& strides) : Tensor() {
+  if (!Base::setStorageSmall(this->t_, nullptr, 0,
+                             sizes.data(), sizes.size(),
+                             strides.data(), strides.size())) {
+    Ops::_setStorage(this->t_, nullptr, 0,
+                     LongStorage(sizes.begin(), sizes.end()).th(),
+                     LongStorage(strides.begin(), strides.end()).th());
+  }
+}
 
 ////////////////////////////////////////////////////////////////////////////////
 #if !defined(NO_THRIFT) && !defined(NO_FOLLY)
@@ -95,13 +185,16 @@ Tensor<T>::Tensor(const std::vector<size_type>& sizes,
 template <class T>
 auto Tensor<T>::deserializeTH(const ThriftTensor& thriftTensor,
                               SharingMode sharing) -> THType* {
-  Storage<T> data(detail::deserialize(thriftTensor, detail::dataType<T>()),
-                  sharing);
-
-  LongStorage s(LongStorage::wrap(detail::makeMutable(LongRange(
-      thriftTensor.sizes.data(), thriftTensor.sizes.size()))));
-
-  return Ops::_newWithStorage(data.th(), 0, s.th(), nullptr);
+  Storage<T> data(detail::deserializeAs<T>(thriftTensor), sharing);
+
+  auto t = Ops::_new();
+  if (!Base::setStorageSmall(t, data.th(), 0, thriftTensor.sizes.data(),
+                             thriftTensor.sizes.size(), nullptr, 0)) {
+    LongStorage s(LongStorage::wrap(detail::makeMutable(LongRange(
+        thriftTensor.sizes.data(), thriftTensor.sizes.size()))));
+    Ops::_setStorage(t, data.th(), 0, s.th(), nullptr);
+  }
+  return t;
 }
 
 template <class T>
@@ -110,6 +203,233 @@ Tensor<T>::Tensor(const ThriftTensor& thriftTensor,
   : Base(deserializeTH(thriftTensor, sharing)) {
   DCHECK_EQ(this->storage().size(), this->size());
 }
+
+template <class T>
+void Tensor<T>::deserializeInto(const ThriftTensor& in) {
+  detail::checkDeserializeSizes(this->sizes(), in);
+  // Compressed data is verified as it's decompressed
+  const bool verify = in.checksumType != ThriftTensorChecksum::NONE &&
+                      in.compression == ThriftTensorCompression::NONE;
+  if (in.dataType != detail::dataType<T>()) {
+    if (verify) {
+      verifyChecksum(in);
+    }
+    // Needs conversion (or throws), which gives us native byte order
+    detail::scatter(this->data(), this->sizes(), this->strides(),
+                    detail::deserializeAs<T>(in), sizeof(T), false);
+    return;
+  }
+  if (in.endianness != ThriftTensorEndianness::LITTLE &&
+      in.endianness != ThriftTensorEndianness::BIG) {
+    throw std::invalid_argument(folly::sformat(
+        "Invalid Thrift tensor endianness {}", int(in.endianness)));
+  }
+  uint32_t crc = 0;
+  detail::scatter(this->data(), this->sizes(), this->strides(),
+                  detail::uncompressedData(in), sizeof(T),
+                  in.endianness != detail::gMachineEndianness,
+                  verify ? &crc : nullptr);
+  if (verify) {
+    detail::checkChecksum(in, crc);
+  }
+}
+
+template <class T>
+constexpr typename Tensor<T>::size_type Tensor<T>::kDefaultDeltaBlockSize;
+
+template <class T>
+void Tensor<T>::serializeDelta(const Tensor& base,
+                               ThriftTensorDelta& out,
+                               size_type blockSize,
+                               ThriftTensorEndianness endianness,
+                               ThriftTensorCompression compression) const {
+  if (this->sizes() != base.sizes()) {
+    throw std::invalid_argument("serializeDelta: base sizes don't match");
+  }
+  // No copies if already contiguous
+  Tensor contig(*this, Tensor::CONTIGUOUS);
+  Tensor baseContig(base, Tensor::CONTIGUOUS);
+  detail::serializeDelta(out, contig.sizes(), contig.data(),
+                         baseContig.data(), detail::dataType<T>(), sizeof(T),
+                         blockSize, endianness, compression);
+}
+
+template <class T>
+void Tensor<T>::applyDelta(const ThriftTensorDelta& delta) {
+  if (this->isContiguous()) {
+    detail::applyDelta(this->data(), this->sizes(), delta,
+                       detail::dataType<T>(), sizeof(T));
+    return;
+  }
+  Tensor contig(*this, Tensor::CONTIGUOUS | Tensor::UNIQUE);
+  detail::applyDelta(contig.data(), contig.sizes(), delta,
+                     detail::dataType<T>(), sizeof(T));
+  this->copy(contig);
+}
+
+template <class T>
+int Tensor<T>::exportShared(ThriftSharedTensor& out) const {
+  typename Base::StorageBuffer buf;
+  auto& storage = this->storageRef(&buf);
+  int fd = storage.sharedMemoryFd();
+  if (fd == -1) {
+    throw std::invalid_argument("Tensor is not in shared memory");
+  }
+  out.dataType = detail::dataType<T>();
+  out.sizes.assign(this->sizes().begin(), this->sizes().end());
+  out.strides.assign(this->strides().begin(), this->strides().end());
+  out.storageOffset = this->storageOffset();
+  out.storageSize = storage.size();
+  return fd;
+}
+
+template <class T>
+Tensor<T> Tensor<T>::importShared(const ThriftSharedTensor& shared, int fd,
+                                  unsigned flags) {
+  if (shared.dataType != detail::dataType<T>()) {
+    throw std::invalid_argument(folly::sformat(
+        "Invalid Thrift tensor data type {}, expected {}",
+        int(shared.dataType), int(detail::dataType<T>())));
+  }
+  if (!shared.strides.empty() &&
+      shared.strides.size() != shared.sizes.size()) {
+    throw std::invalid_argument("Shared tensor sizes / strides mismatch");
+  }
+  // The descriptor comes from another process, so check all arithmetic
+  // for overflow
+  if (shared.storageOffset < 0 || shared.storageSize < 0 ||
+      uint64_t(shared.storageSize) >
+        std::numeric_limits<size_t>::max() / sizeof(T)) {
+    throw std::invalid_argument("Invalid shared tensor storage");
+  }
+
+  // Make sure that the tensor is within the storage, and so within the
+  // mapping
+  uint64_t end = shared.storageOffset;
+  uint64_t contiguousSize = 1;
+  bool empty = shared.sizes.empty();
+  bool overflow = false;
+  for (int i = shared.sizes.size() - 1; i >= 0; --i) {
+    long size = shared.sizes[i];
+    long stride = shared.strides.empty() ? contiguousSize : shared.strides[i];
+    if (size < 0 || stride < 0) {
+      throw std::invalid_argument("Invalid shared tensor size or stride");
+    }
+    if (size == 0) {
+      empty = true;
+    } else {
+      uint64_t extent;
+      overflow |= __builtin_mul_overflow(uint64_t(size - 1), uint64_t(stride),
+                                         &extent);
+      overflow |= __builtin_add_overflow(end, extent, &end);
+    }
+    overflow |= __builtin_mul_overflow(contiguousSize, uint64_t(size),
+                                       &contiguousSize);
+    overflow |= contiguousSize > uint64_t(std::numeric_limits<long>::max());
+  }
+  if (overflow) {
+    throw std::invalid_argument("Shared tensor sizes or strides overflow");
+  }
+  if (!empty && end >= uint64_t(shared.storageSize)) {
+    throw std::invalid_argument("Shared tensor extends past its storage");
+  }
+
+  return Tensor(StorageType::mapFile(fd, 0, shared.storageSize * sizeof(T),
+                                     flags),
+                shared.storageOffset,
+                LongRange(shared.sizes.data(), shared.sizes.size()),
+                LongRange(shared.strides.data(), shared.strides.size()));
+}
+
+template <class T>
+void serializeMany(ThriftTensorBundle& out,
+                   folly::Range<const Tensor<T>*> tensors,
+                   ThriftTensorEndianness endianness) {
+  static_assert(kTensorBundleAlignment % sizeof(T) == 0,
+                "Bundle alignment must be a multiple of the element size");
+  constexpr size_t align = kTensorBundleAlignment / sizeof(T);
+
+  out.ndims.clear();
+  out.sizes.clear();
+  out.offsets.clear();
+  out.ndims.reserve(tensors.size());
+  out.offsets.reserve(tensors.size());
+
+  size_t total = 0;
+  for (auto& t : tensors) {
+    total = (total + align - 1) / align * align;
+    out.ndims.push_back(t.ndims());
+    auto sizes = t.sizes();
+    out.sizes.insert(out.sizes.end(), sizes.begin(), sizes.end());
+    out.offsets.push_back(total);
+    total += t.size();
+  }
+
+  Storage<T> data;
+  data.resizeUninitialized(total);
+  size_t end = 0;
+  for (size_t i = 0; i < tensors.size(); ++i) {
+    auto& t = tensors[i];
+    size_t offset = out.offsets[i];
+    // Zero the padding, so that the output doesn't depend on whatever
+    // was in uninitialized memory
+    if (offset != end) {
+      memset(data.data() + end, 0, (offset - end) * sizeof(T));
+    }
+    end = offset + t.size();
+    if (t.size() != 0) {
+      Tensor<T> dest(data, offset, t.sizes());
+      dest.copy(t);
+    }
+  }
+
+  // data isn't shared with anyone else
+  data.serialize(out.storage, endianness, SHARE_ALL);
+}
+
+template <class T>
+std::vector<Tensor<T>> deserializeMany(const ThriftTensorBundle& in,
+                                       SharingMode sharing) {
+  if (in.offsets.size() != in.ndims.size()) {
+    throw std::invalid_argument(folly::sformat(
+        "Bundle has {} offsets for {} tensors",
+        in.offsets.size(), in.ndims.size()));
+  }
+
+  Storage<T> data(in.storage, sharing);
+  std::vector<Tensor<T>> out;
+  out.reserve(in.ndims.size());
+  size_t sizeIdx = 0;
+  for (size_t i = 0; i < in.ndims.size(); ++i) {
+    int ndims = in.ndims[i];
+    if (ndims < 0 || size_t(ndims) > in.sizes.size() - sizeIdx) {
+      throw std::invalid_argument("Invalid number of dimensions in bundle");
+    }
+    LongRange sizes(in.sizes.data() + sizeIdx, ndims);
+    sizeIdx += ndims;
+
+    // TH tensors with no dimensions are empty; the sizes are untrusted, don't
+    // let them wrap around
+    uint64_t n = ndims == 0 ? 0 : 1;
+    for (auto s : sizes) {
+      if (s < 0 || __builtin_mul_overflow(n, uint64_t(s), &n)) {
+        throw std::invalid_argument("Invalid tensor size");
+      }
+    }
+    auto offset = in.offsets[i];
+    uint64_t end;
+    if (offset < 0 || __builtin_add_overflow(uint64_t(offset), n, &end) ||
+        end > data.size()) {
+      throw std::invalid_argument(folly::sformat(
+          "Bundle tensor {} out of range", i));
+    }
+    out.emplace_back(data, offset, sizes);
+  }
+  if (sizeIdx != in.sizes.size()) {
+    throw std::invalid_argument("Extra sizes in bundle");
+  }
+  return out;
+}
 ////////////////////////////////////////////////////////////////////////////////
 #endif // !NO_THRIFT && !NO_FOLLY
 ////////////////////////////////////////////////////////////////////////////////
@@ -125,7 +445,28 @@ Tensor<T>::Tensor(detail::SetTH, THType* t, bool incRef)
 
 template <class T>
 Tensor<T>::Tensor(const THType* other, unsigned cloneMode)
-  : Base(Base::cloneTH(other, cloneMode)) { }
+  : Base(cloneTH(other, cloneMode)) { }
+
+template <class T>
+auto Tensor<T>::cloneTH(const THType* other, unsigned cloneMode) -> THType* {
+#ifndef NO_FOLLY
+  // A copy-on-write clone gets its own storage, sharing memory with
+  // other's through IOBuf; writing through either storage (from any
+  // tensor that uses it) copies first if the memory is still shared.
+  if ((cloneMode & Base::COPY_ON_WRITE) && !(cloneMode & Base::UNIQUE) &&
+      !((cloneMode & Base::CONTIGUOUS) && !Base::isContiguous(other)) &&
+      other->storage && other->storage->size != 0) {
+    auto storage = Storage<T>::newCopyOnWrite(other->storage);
+    LongStorage sizes(other->size, other->size + other->nDimension);
+    LongStorage strides(other->stride, other->stride + other->nDimension);
+    auto th = Ops::_new();
+    Ops::_setStorage(th, storage.th(), other->storageOffset, sizes.th(),
+                     strides.th());
+    return th;
+  }
+#endif
+  return Base::cloneTH(other, cloneMode);
+}
 
 template <class T>
 Tensor<T>::Tensor(const Tensor& other, unsigned cloneMode)
@@ -154,17 +495,79 @@ auto Tensor<T>::operator=(Tensor&& other) -> Tensor& {
   return *this;
 }
 
+namespace detail {
+
+// Converting copy with vectorized conversions (see detail/Convert.h), for
+// tensors whose innermost runs are contiguous in both dest and src.
+// Returns false (leaving it to TH) for anything else.
+template <class T, class U>
+bool convertCopy(Tensor<T>& dest, const Tensor<U>& src) {
+  if (dest.size() != src.size()) {
+    return false;  // let TH complain
+  }
+  if (dest.isContiguous() && src.isContiguous()) {
+    convertElements(dest.data(), src.data(), dest.size());
+    return true;
+  }
+
+  const int ndims = dest.ndims();
+  if (src.ndims() != ndims || ndims > kMaxCollapsedDims) {
+    return false;
+  }
+  long sizes[kMaxCollapsedDims];
+  long strides[2][kMaxCollapsedDims];
+  for (int i = 0; i < ndims; ++i) {
+    sizes[i] = dest.size(i);
+    if (src.size(i) != sizes[i]) {
+      return false;
+    }
+    strides[0][i] = dest.stride(i);
+    strides[1][i] = src.stride(i);
+  }
+  CollapsedDims<2> dims;
+  collapseDims<2>(ndims, sizes, {{strides[0], strides[1]}}, dims);
+  if (dims.empty) {
+    return true;
+  }
+  const int inner = dims.ndims - 1;
+  if (dims.strides[0][inner] != 1 || dims.strides[1][inner] != 1) {
+    return false;
+  }
+  T* d = dest.data();
+  const U* s = src.data();
+  forEachRun(dims, [d, s] (const std::array<long, 2>& off, long n,
+                           const std::array<long, 2>& /*st*/) {
+    convertElements(d + off[0], s + off[1], n);
+    return true;
+  });
+  return true;
+}
+
+// Same type: TH copies are plain memcpy where possible anyway
+template <class T>
+bool convertCopy(Tensor<T>& /*dest*/, const Tensor<T>& /*src*/) {
+  return false;
+}
+
+}  // namespace detail
+
 template <class T>
 template <class U>
 void Tensor<T>::copy(const Tensor<U>& src) {
-  Ops::_copyT(this->t_, src.mut());
+  if (!detail::convertCopy(*this, src)) {
+    this->prepareWrite();
+    Ops::_copyT(this->t_, src.mut());
+  }
 }
 
 #if !defined(NO_THRIFT) && !defined(NO_FOLLY)
 template <class T>
 void Tensor<T>::serialize(ThriftTensor& out,
                           ThriftTensorEndianness endianness,
-                          SharingMode sharing) const {
+                          SharingMode sharing,
+                          folly::Executor* executor,
+                          ThriftTensorCompression compression,
+                          ThriftTensorChecksum checksum) const {
   auto buf = Storage<T>(Ops::_storage(this->mut())).getIOBuf();
   buf.trimStart(Ops::_storageOffset(this->mut()) * sizeof(T));
   detail::serialize(
@@ -175,7 +578,10 @@ void Tensor<T>::serialize(ThriftTensor& out,
       detail::dataType<T>(),
       sizeof(T),
       endianness,
-      sharing);
+      sharing,
+      executor,
+      compression,
+      checksum);
 }
 #endif
 
@@ -186,43 +592,67 @@ void Tensor<T>::serialize(ThriftTensor& out,
 template <class T, class StorageT, class Derived>
 void TensorBase<T, StorageT, Derived>::maskedFill(
     const ByteTensor& mask, T value) {
+  prepareWrite();
   Ops::_maskedFill(t_, mask.mut(), value);
 }
 
 template <class T, class StorageT, class Derived>
 void TensorBase<T, StorageT, Derived>::maskedCopy(
     const ByteTensor& mask, const TensorBase& src) {
+  prepareWrite();
   Ops::_maskedCopy(t_, mask.mut(), src.mut());
 }
 
 template <class T, class StorageT, class Derived>
 auto TensorBase<T, StorageT, Derived>::maskedSelect(
     const ByteTensor& mask) const -> Derived {
-  Derived r;
-  Ops::_maskedSelect(&r.t_, this->mut(), mask.mut());
+  Derived r = Derived::makeResult();
+  maskedSelect(mask, r);
   return r;
 }
 
+template <class T, class StorageT, class Derived>
+void TensorBase<T, StorageT, Derived>::maskedSelect(
+    const ByteTensor& mask, Derived& out) const {
+  out.prepareWrite();
+  Ops::_maskedSelect(out.t_, this->mut(), mask.mut());
+}
+
 template <class T, class StorageT, class Derived>
 auto TensorBase<T, StorageT, Derived>::indexSelect(
     int dim, const LongTensor& index) const -> Derived {
-  Derived r;
-  Ops::_indexSelect(&r.t_, this->mut(), dim, index.mut());
+  Derived r = Derived::makeResult();
+  indexSelect(dim, index, r);
   return r;
 }
 
+template <class T, class StorageT, class Derived>
+void TensorBase<T, StorageT, Derived>::indexSelect(
+    int dim, const LongTensor& index, Derived& out) const {
+  out.prepareWrite();
+  Ops::_indexSelect(out.t_, this->mut(), dim, index.mut());
+}
+
 template <class T, class StorageT, class Derived>
 void TensorBase<T, StorageT, Derived>::indexFill(
     int dim, const LongTensor& index, T val) {
+  prepareWrite();
   Ops::_indexFill(t_, dim, index.mut(), val);
 }
 
 #define TENSOR_ARGM_OP(name) \
   template <class T> \
   auto Tensor<T>::name(int dim) const -> std::pair<Tensor, LongTensor> { \
-    std::pair<Tensor, LongTensor> dest; \
-    Ops::_ ## name(dest.first.t_, dest.second.t_, this->mut(), dim); \
+    std::pair<Tensor, LongTensor> dest(makeResult(), \
+                                       LongTensor::makeResult()); \
+    name(dim, dest.first, dest.second); \
     return dest; \
+  } \
+  template <class T> \
+  void Tensor<T>::name(int dim, Tensor& out, LongTensor& indices) const { \
+    out.prepareWrite(); \
+    indices.prepareWrite(); \
+    Ops::_ ## name(out.t_, indices.t_, this->mut(), dim); \
   }
 TENSOR_ARGM_OP(min)
 TENSOR_ARGM_OP(max)
@@ -18,6 +18,7 @@
 
 #include <thpp/ForwardDeclarations.h>
 #include <thpp/Storage.h>
+#include <thpp/TensorArena.h>
 #include <thpp/TensorBase.h>
 #include <thpp/detail/Tensor.h>
 #ifndef NO_THRIFT
@@ -27,6 +28,12 @@
 #include <folly/io/IOBuf.h>
 #endif
 
+#ifndef NO_FOLLY
+namespace folly {
+class Executor;
+}  // namespace folly
+#endif
+
 namespace thpp {
 
 /**
@@ -37,7 +44,9 @@ namespace thpp {
  * manipulate metadata (select, transpose, etc) will make source and
  * destination tensors share memory. To ensure you have a unique copy, use
  * force(UNIQUE) (or set UNIQUE in the optional cloneMode argument to the copy
- * and move constructors).
+ * and move constructors). For defensive copies that are usually never
+ * modified, COPY_ON_WRITE in cloneMode defers the copy until the clone or
+ * the original is first written to.
  *
  * After metadata manipulation, the resulting tensor might not be stored
  * in the usual row-major order in memory. If you need a contiguous
@@ -95,11 +104,63 @@ class Tensor : public TensorBase<T, Storage<T>, Tensor<T>> {
   // Deserialize from Thrift. Throws if wrong type.
   explicit Tensor(const ThriftTensor& thriftTensor,
                   SharingMode sharing = SHARE_IOBUF_MANAGED);
+
+  // Deserialize from Thrift into the existing storage of this tensor, which
+  // must already have the serialized sizes (but may have any strides). Data
+  // is copied (and byte swapped if necessary) in place, so the tensor
+  // neither moves nor allocates, unless the data needs to be converted
+  // first (decompressed, widened, or dequantized). Throws if the type or
+  // sizes don't match, or if the data doesn't match its checksum (which is
+  // computed as the data is copied).
+  void deserializeInto(const ThriftTensor& thriftTensor);
+
+  // Serialize only what changed relative to base (an older version of this
+  // tensor, with the same sizes): the elements are compared (bitwise) in
+  // blocks of blockSize elements, and only the blocks that differ are
+  // included. For tensors that change one row at a time (embeddings), use
+  // the row size as the block size. See ThriftTensorDelta in Tensor.thrift;
+  // endianness and compression apply to the changed blocks, as in
+  // serialize().
+  void serializeDelta(const Tensor& base,
+                      ThriftTensorDelta& out,
+                      size_type blockSize = kDefaultDeltaBlockSize,
+                      ThriftTensorEndianness endianness =
+                         ThriftTensorEndianness::NATIVE,
+                      ThriftTensorCompression compression =
+                         ThriftTensorCompression::NONE) const;
+
+  // Apply a delta created by serializeDelta() in place. This tensor must
+  // have the same sizes and contents as the base of the delta (it may have
+  // any strides). Throws if the type or sizes don't match.
+  void applyDelta(const ThriftTensorDelta& delta);
+
+  static constexpr size_type kDefaultDeltaBlockSize = 1024;
+
+  // Describe this tensor, whose storage must have been created with
+  // Storage::createShared(), so that another process can map it with
+  // importShared(). Returns the file descriptor of the shared memory
+  // segment (owned by the storage), which must be sent along with out.
+  // Throws std::invalid_argument if the storage isn't shared.
+  int exportShared(ThriftSharedTensor& out) const;
+
+  // Map a tensor exported with exportShared() (by another process) without
+  // copying. The tensor is read-only; see Storage::mapFile for flags. fd
+  // may be closed once this returns.
+  static Tensor importShared(const ThriftSharedTensor& shared, int fd,
+                             unsigned flags = 0);
 #endif
 
+  // Map a contiguous (row-major) tensor of the given sizes, stored in
+  // native byte order at offset bytes into a file. The tensor is read-only;
+  // see Storage::mapFile for details and flags.
+  static Tensor mapFile(const std::string& path,
+                        uint64_t offset,
+                        const std::vector<size_type>& sizes,
+                        unsigned flags = 0);
+
   // Do not alias other, create separate object (with separate metadata);
-  // might still share data with other, unless UNIQUE requested in
-  // cloneMode.
+  // might still share data with other, unless UNIQUE (or COPY_ON_WRITE)
+  // requested in cloneMode.
   explicit Tensor(const THType* other, unsigned cloneMode = 0);
 
   // Move/copy constructors. Enforce requested mode.
@@ -114,13 +175,34 @@ class Tensor : public TensorBase<T, Storage<T>, Tensor<T>> {
   // Serialize to Thrift. Note that, if sharing is not SHARE_NONE, the
   // resulting ThriftTensor may share memory with *this, so changes in out.data
   // may be reflected in *this.
+  //
+  // If executor is not null and the tensor isn't contiguous, the data
+  // is gathered in parallel on the executor (which must not be the executor
+  // that's running this call, or it may deadlock). The output is the same.
+  //
+  // If compression isn't NONE, the data is byte-shuffled and compressed in
+  // blocks (see ThriftTensor in Tensor.thrift), in parallel on executor if
+  // given; the output never shares memory with *this. Deserialization
+  // decompresses automatically.
+  //
+  // If checksum isn't NONE, a checksum of the (uncompressed) serialized
+  // data is computed while gathering it, and recorded in out; see
+  // verifyChecksum().
   void serialize(ThriftTensor& out,
                  ThriftTensorEndianness endianness =
                     ThriftTensorEndianness::NATIVE,
-                 SharingMode sharing = SHARE_IOBUF_MANAGED) const;
+                 SharingMode sharing = SHARE_IOBUF_MANAGED,
+                 folly::Executor* executor = nullptr,
+                 ThriftTensorCompression compression =
+                    ThriftTensorCompression::NONE,
+                 ThriftTensorChecksum checksum =
+                    ThriftTensorChecksum::NONE) const;
 #endif
 
-  // Copy from another tensor
+  // Copy from another tensor, converting from U to T. The conversions
+  // between float and double, unsigned char, and int32 are vectorized for
+  // tensors whose innermost dimensions are contiguous. See parallelCopy()
+  // in thpp/TensorParallel.h to split big copies across threads.
   template <class U>
   void copy(const Tensor<U>& src);
 
@@ -132,19 +214,29 @@ class Tensor : public TensorBase<T, Storage<T>, Tensor<T>> {
     return this->data()[this->offsetOf(std::move(indices))];
   }
 
+  // Not through the non-const version, which would copy a copy-on-write
+  // tensor
   const T& at(std::initializer_list<offset_type> indices) const {
-    return const_cast<Tensor*>(this)->at(std::move(indices));
+    return this->data()[this->offsetOf(std::move(indices))];
   }
 
   // <max, argmax>
   std::pair<Tensor, Tensor<long>> max(int dim) const;
+  void max(int dim, Tensor& out, Tensor<long>& indices) const;
 
   // <min, argmin>
   std::pair<Tensor, Tensor<long>> min(int dim) const;
+  void min(int dim, Tensor& out, Tensor<long>& indices) const;
+
+  // See TensorBase::makeResult; allocates from TensorArena::current().
+  static Tensor makeResult();
 
  private:
   Tensor(detail::SetTH, THType* t, bool incRef);
 
+  // Handles COPY_ON_WRITE, everything else is up to TensorBase
+  static THType* cloneTH(const THType* other, unsigned cloneMode);
+
 #if !defined(NO_THRIFT) && !defined(NO_FOLLY)
   static THType* deserializeTH(const ThriftTensor& thriftTensor,
                                SharingMode sharing);
@@ -156,6 +248,69 @@ void copyTensor(Tensor<D>& dest, const Tensor<S>& src) {
   dest.copy(src);
 }
 
+#if !defined(NO_THRIFT) && !defined(NO_FOLLY)
+// Throw std::invalid_argument if in has a checksum that doesn't match its
+// data. Deserializing with the constructor doesn't check (it usually
+// doesn't even read the data; compressed data is checked as it's
+// decompressed), so call this first if you need to. Does nothing if in has
+// no checksum.
+void verifyChecksum(const ThriftTensor& in);
+
+// Serialize a float tensor as 16-bit floating point (dtype must be HALF or
+// BFLOAT16), rounding to nearest. This halves the size on the wire; the
+// result deserializes into Tensor<float> (and CudaTensor<float>). The
+// output never shares memory with src.
+void serializeAsHalf(ThriftTensor& out,
+                     const Tensor<float>& src,
+                     ThriftTensorDataType dtype = ThriftTensorDataType::HALF,
+                     ThriftTensorEndianness endianness =
+                        ThriftTensorEndianness::NATIVE);
+
+// Serialize a float tensor as QUINT8: one byte per element, with a scale
+// and zero point for each index along axis (for example, 0 for per-row
+// parameters of a matrix), or for the whole tensor if axis is -1. The
+// parameters of each slice map its [min, max] range (extended to include
+// 0, which is always represented exactly) onto [0, 255]. This cuts the
+// size on the wire by 4x; the result deserializes (dequantized) into
+// Tensor<float> and CudaTensor<float>.
+void serializeQuantized(ThriftTensor& out,
+                        const Tensor<float>& src,
+                        int axis = 0,
+                        ThriftTensorCompression compression =
+                           ThriftTensorCompression::NONE);
+
+// The data of each tensor in a bundle starts at a multiple of this many
+// bytes from the start of the bundle's storage
+constexpr size_t kTensorBundleAlignment = 64;
+
+// Serialize many tensors into one bundle: the data of all tensors is
+// packed (aligned) into a single buffer, with one offset table, instead of
+// one ThriftTensor (with its own data buffer) per tensor. The output never
+// shares memory with the tensors.
+template <class T>
+void serializeMany(ThriftTensorBundle& out,
+                   folly::Range<const Tensor<T>*> tensors,
+                   ThriftTensorEndianness endianness =
+                      ThriftTensorEndianness::NATIVE);
+
+template <class T>
+void serializeMany(ThriftTensorBundle& out,
+                   const std::vector<Tensor<T>>& tensors,
+                   ThriftTensorEndianness endianness =
+                      ThriftTensorEndianness::NATIVE) {
+  serializeMany(out, folly::range(tensors), endianness);
+}
+
+// Deserialize a bundle. The returned tensors are views into one Storage,
+// which shares memory with in.storage.data according to sharing (so, with
+// the default, deserialization doesn't copy if the data is in native byte
+// order and properly aligned). Throws if wrong type.
+template <class T>
+std::vector<Tensor<T>> deserializeMany(
+    const ThriftTensorBundle& in,
+    SharingMode sharing = SHARE_IOBUF_MANAGED);
+#endif
+
 }  // namespaces
 
 #include <thpp/Tensor-inl.h>
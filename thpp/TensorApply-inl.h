@@ -0,0 +1,170 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+#ifndef THPP_TENSORAPPLY_H_
+#error This file may only be included from thpp/TensorApply.h
+#endif
+
+#include <string>
+
+namespace thpp {
+
+namespace detail {
+
+template <class A, class B>
+void checkApplySizes(const char* name, const A& a, const B& b) {
+  if (a.ndims() != b.ndims()) {
+    throw std::invalid_argument(std::string(name) + ": dimension mismatch");
+  }
+  for (int i = 0; i < a.ndims(); ++i) {
+    if (a.size(i) != b.size(i)) {
+      throw std::invalid_argument(std::string(name) + ": size mismatch");
+    }
+  }
+}
+
+template <class A>
+void loadStrides(const A& a, long* strides) {
+  for (int i = 0; i < a.ndims(); ++i) {
+    strides[i] = a.stride(i);
+  }
+}
+
+// Collapse the dimensions of all tensors (which must have the same sizes
+// as first) into out.
+template <size_t N, class A, class... Rest>
+void collapseTensors(CollapsedDims<N>& out, const char* name,
+                     const A& first, const Rest&... rest) {
+  static_assert(sizeof...(Rest) + 1 == N, "Wrong number of tensors");
+  typedef int expand[];
+  (void) expand{0, (checkApplySizes(name, first, rest), 0)...};
+
+  const int ndims = first.ndims();
+  if (ndims > kMaxCollapsedDims) {
+    throw std::invalid_argument(std::string(name) + ": too many dimensions");
+  }
+  long sizes[kMaxCollapsedDims];
+  long strides[N][kMaxCollapsedDims];
+  for (int i = 0; i < ndims; ++i) {
+    sizes[i] = first.size(i);
+  }
+  loadStrides(first, strides[0]);
+  size_t k = 1;
+  (void) expand{0, (loadStrides(rest, strides[k++]), 0)...};
+  (void) k;
+
+  std::array<const long*, N> stridePtrs;
+  for (size_t j = 0; j < N; ++j) {
+    stridePtrs[j] = strides[j];
+  }
+  collapseDims<N>(ndims, sizes, stridePtrs, out);
+}
+
+}  // namespace detail
+
+template <class T, class F>
+void forEach(Tensor<T>& t, F&& f) {
+  detail::CollapsedDims<1> dims;
+  detail::collapseTensors<1>(dims, "forEach", t);
+  T* p = t.data();
+  detail::forEachRun(
+      dims,
+      [&] (const std::array<long, 1>& off, long n,
+           const std::array<long, 1>& st) {
+        T* a = p + off[0];
+        if (st[0] == 1) {
+          for (long i = 0; i < n; ++i) {
+            f(a[i]);
+          }
+        } else {
+          for (long i = 0; i < n; ++i) {
+            f(a[i * st[0]]);
+          }
+        }
+        return true;
+      });
+}
+
+template <class T, class F>
+void forEach(const Tensor<T>& t, F&& f) {
+  detail::CollapsedDims<1> dims;
+  detail::collapseTensors<1>(dims, "forEach", t);
+  const T* p = t.data();
+  detail::forEachRun(
+      dims,
+      [&] (const std::array<long, 1>& off, long n,
+           const std::array<long, 1>& st) {
+        const T* a = p + off[0];
+        if (st[0] == 1) {
+          for (long i = 0; i < n; ++i) {
+            f(a[i]);
+          }
+        } else {
+          for (long i = 0; i < n; ++i) {
+            f(a[i * st[0]]);
+          }
+        }
+        return true;
+      });
+}
+
+template <class T, class U, class F>
+void apply2(Tensor<T>& a, const Tensor<U>& b, F&& f) {
+  detail::CollapsedDims<2> dims;
+  detail::collapseTensors<2>(dims, "apply2", a, b);
+  T* pa = a.data();
+  const U* pb = b.data();
+  detail::forEachRun(
+      dims,
+      [&] (const std::array<long, 2>& off, long n,
+           const std::array<long, 2>& st) {
+        T* ra = pa + off[0];
+        const U* rb = pb + off[1];
+        if (st[0] == 1 && st[1] == 1) {
+          for (long i = 0; i < n; ++i) {
+            f(ra[i], rb[i]);
+          }
+        } else {
+          for (long i = 0; i < n; ++i) {
+            f(ra[i * st[0]], rb[i * st[1]]);
+          }
+        }
+        return true;
+      });
+}
+
+template <class T, class U, class V, class F>
+void apply3(Tensor<T>& a, const Tensor<U>& b, const Tensor<V>& c, F&& f) {
+  detail::CollapsedDims<3> dims;
+  detail::collapseTensors<3>(dims, "apply3", a, b, c);
+  T* pa = a.data();
+  const U* pb = b.data();
+  const V* pc = c.data();
+  detail::forEachRun(
+      dims,
+      [&] (const std::array<long, 3>& off, long n,
+           const std::array<long, 3>& st) {
+        T* ra = pa + off[0];
+        const U* rb = pb + off[1];
+        const V* rc = pc + off[2];
+        if (st[0] == 1 && st[1] == 1 && st[2] == 1) {
+          for (long i = 0; i < n; ++i) {
+            f(ra[i], rb[i], rc[i]);
+          }
+        } else {
+          for (long i = 0; i < n; ++i) {
+            f(ra[i * st[0]], rb[i * st[1]], rc[i * st[2]]);
+          }
+        }
+        return true;
+      });
+}
+
+}  // namespaces
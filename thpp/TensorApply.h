@@ -0,0 +1,61 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+#ifndef THPP_TENSORAPPLY_H_
+#define THPP_TENSORAPPLY_H_
+
+#include <thpp/Tensor.h>
+#include <thpp/detail/TensorIteration.h>
+
+namespace thpp {
+
+/**
+ * Element-wise iteration over (possibly non-contiguous) tensors, without
+ * copying or allocating.
+ *
+ * Dimensions that are laid out contiguously with respect to each other in
+ * all the tensors involved are collapsed, so that f is called in a tight
+ * loop over the longest possible runs; when the innermost run is
+ * contiguous in all tensors, the loop has unit stride and can be
+ * vectorized by the compiler (as long as f can be inlined, so prefer
+ * lambdas to std::function).
+ *
+ * Elements are visited in row-major order of the first tensor's
+ * dimensions. All tensors must have the same sizes; std::invalid_argument
+ * is thrown otherwise.
+ *
+ *   Tensor<float> t(...);
+ *   forEach(t, [] (float& x) { x = std::max(x, 0.0f); });
+ *
+ *   Tensor<float> dest(...);  // same sizes as t
+ *   apply2(dest, t, [] (float& d, float s) { d = s * s; });
+ */
+
+// f(T&) for each element of t
+template <class T, class F>
+void forEach(Tensor<T>& t, F&& f);
+
+// f(const T&) for each element of t
+template <class T, class F>
+void forEach(const Tensor<T>& t, F&& f);
+
+// f(T&, const U&) for each pair of corresponding elements
+template <class T, class U, class F>
+void apply2(Tensor<T>& a, const Tensor<U>& b, F&& f);
+
+// f(T&, const U&, const V&) for each triple of corresponding elements
+template <class T, class U, class V, class F>
+void apply3(Tensor<T>& a, const Tensor<U>& b, const Tensor<V>& c, F&& f);
+
+}  // namespaces
+
+#include <thpp/TensorApply-inl.h>
+
+#endif /* THPP_TENSORAPPLY_H_ */
@@ -0,0 +1,177 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+#include <thpp/TensorArena.h>
+#include <thpp/MemoryStats.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+
+namespace thpp {
+
+namespace detail {
+
+THAllocator arenaTHAllocator = {
+  &THAllocatorWrapper<TensorArena>::malloc,
+  &THAllocatorWrapper<TensorArena>::realloc,
+  &THAllocatorWrapper<TensorArena>::free,
+};
+
+}  // namespace detail
+
+namespace {
+
+// Stored immediately before each allocation
+struct Header {
+  size_t size;
+  char* prevCursor;  // cursor before this allocation, to roll back on free
+};
+
+Header* header(void* ptr) {
+  return reinterpret_cast<Header*>(static_cast<char*>(ptr) - sizeof(Header));
+}
+
+char* alignUp(char* p) {
+  constexpr uintptr_t mask = TensorArena::kAlignment - 1;
+  return reinterpret_cast<char*>(
+      (reinterpret_cast<uintptr_t>(p) + mask) & ~mask);
+}
+
+thread_local TensorArena* gCurrentArena = nullptr;
+
+}  // namespace
+
+constexpr size_t TensorArena::kAlignment;
+
+TensorArena::TensorArena(size_t slabSize)
+  : slabSize_(slabSize),
+    begin_(nullptr),
+    cursor_(nullptr),
+    end_(nullptr),
+    last_(nullptr),
+    used_(0),
+    capacity_(0),
+    live_(0) {
+  addSlab(slabSize_);
+}
+
+TensorArena::~TensorArena() {
+  DCHECK(live_ == 0 && "TensorArena destroyed with live allocations");
+  for (auto& slab : slabs_) {
+    detail::recordFree(MemoryKind::ARENA, -1, slab.size);
+  }
+}
+
+void TensorArena::addSlab(size_t minSize) {
+  Slab slab;
+  slab.size = std::max(slabSize_, minSize);
+  slab.data.reset(new char[slab.size]);
+  begin_ = cursor_ = slab.data.get();
+  end_ = begin_ + slab.size;
+  capacity_ += slab.size;
+  detail::recordAlloc(MemoryKind::ARENA, -1, slab.size);
+  slabs_.push_back(std::move(slab));
+}
+
+void* TensorArena::allocate(size_t size) {
+  char* p = alignUp(cursor_ + sizeof(Header));
+  if (p + size > end_) {
+    addSlab(size + sizeof(Header) + kAlignment);
+    p = alignUp(cursor_ + sizeof(Header));
+  }
+  auto h = header(p);
+  h->size = size;
+  h->prevCursor = cursor_;
+  used_ += (p + size) - cursor_;
+  cursor_ = p + size;
+  last_ = p;
+  ++live_;
+  return p;
+}
+
+void* TensorArena::malloc(long size) {
+  return allocate(size);
+}
+
+void* TensorArena::realloc(void* ptr, long size) {
+  if (!ptr) {
+    return allocate(size);
+  }
+  auto p = static_cast<char*>(ptr);
+  auto h = header(p);
+  if (p == last_ && p + size <= end_) {
+    // Most recent allocation: grow or shrink in place
+    used_ = used_ - h->size + size;
+    cursor_ = p + size;
+    h->size = size;
+    return p;
+  }
+  if (size_t(size) <= h->size) {
+    return p;
+  }
+  void* newPtr = allocate(size);
+  memcpy(newPtr, p, h->size);
+  free(p);
+  return newPtr;
+}
+
+void TensorArena::free(void* ptr) {
+  if (!ptr) {
+    return;
+  }
+  DCHECK(live_ > 0);
+  --live_;
+  if (ptr == last_) {
+    auto h = header(ptr);
+    used_ -= cursor_ - h->prevCursor;
+    cursor_ = h->prevCursor;
+    last_ = nullptr;
+  }
+}
+
+void TensorArena::reset() {
+  if (live_ != 0) {
+    throw std::logic_error("TensorArena reset with live allocations");
+  }
+  if (slabs_.size() > 1) {
+    // Replace with one slab big enough for everything
+    size_t total = capacity_;
+    for (auto& slab : slabs_) {
+      detail::recordFree(MemoryKind::ARENA, -1, slab.size);
+    }
+    slabs_.clear();
+    capacity_ = 0;
+    addSlab(total);
+  } else {
+    cursor_ = begin_;
+  }
+  last_ = nullptr;
+  used_ = 0;
+}
+
+THAllocator* TensorArena::thAllocator() {
+  return &detail::arenaTHAllocator;
+}
+
+TensorArena* TensorArena::current() {
+  return gCurrentArena;
+}
+
+TensorArena::Scope::Scope(TensorArena& arena) : prev_(gCurrentArena) {
+  gCurrentArena = &arena;
+}
+
+TensorArena::Scope::~Scope() {
+  gCurrentArena = prev_;
+}
+
+}  // namespaces
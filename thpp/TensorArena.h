@@ -0,0 +1,130 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+#ifndef THPP_TENSORARENA_H_
+#define THPP_TENSORARENA_H_
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+#include <thpp/Storage.h>
+
+namespace thpp {
+
+/**
+ * Bump allocator for short-lived (for example, request-scoped) tensors.
+ *
+ * Memory is carved sequentially out of a slab; freeing only returns memory
+ * if it was the most recent allocation (which is also the only allocation
+ * that can be grown in place). Everything is given back at once with
+ * reset(), at which point no memory allocated from the arena may still be
+ * in use. If the slab runs out, more slabs are allocated; after reset(),
+ * the arena switches to a single slab big enough for everything that was
+ * allocated since the previous reset, so a steady-state workload touches
+ * the system allocator only during warmup.
+ *
+ * Install the arena for a scope to have the results of tensor operations
+ * (sum(dim), cumsum, maskedSelect, indexSelect, max / min, the arithmetic
+ * operators, ...) on this thread allocated from it:
+ *
+ *   TensorArena arena;
+ *   for (auto& request : requests) {
+ *     {
+ *       TensorArena::Scope scope(arena);
+ *       handle(request);  // all temporaries must be gone at end of scope
+ *     }
+ *     arena.reset();
+ *   }
+ *
+ * This only applies to CPU tensors, and only to results that start out
+ * empty; tensors created explicitly (with sizes, or with a given storage)
+ * use the default allocator as usual. A storage can be explicitly
+ * allocated from an arena with arena.storage<T>().
+ *
+ * Not thread safe: an arena must only be used (including freeing tensors
+ * allocated from it) by one thread at a time.
+ */
+class TensorArena {
+ public:
+  static constexpr size_t kAlignment = 64;
+
+  explicit TensorArena(size_t slabSize = 1 << 20);
+  ~TensorArena();
+
+  TensorArena(const TensorArena&) = delete;
+  TensorArena& operator=(const TensorArena&) = delete;
+
+  void* malloc(long size);
+  void* realloc(void* ptr, long size);
+  void free(void* ptr);
+
+  // Release all memory allocated from the arena. Throws std::logic_error if
+  // any of it is still in use.
+  void reset();
+
+  // Bytes handed out since the last reset (including alignment padding)
+  size_t bytesUsed() const { return used_; }
+
+  // Total size of all slabs
+  size_t capacity() const { return capacity_; }
+
+  // Number of allocations that haven't been freed yet
+  size_t liveAllocations() const { return live_; }
+
+  // THAllocator to use with an allocator context pointing to a TensorArena
+  static THAllocator* thAllocator();
+
+  // Create an empty storage that allocates from this arena.
+  template <class T>
+  Storage<T> storage() {
+    return Storage<T>::withAllocator(thAllocator(), this);
+  }
+
+  // Arena installed for the current thread, or nullptr
+  static TensorArena* current();
+
+  // Install an arena for the current thread for the lifetime of this
+  // object. Scopes may be nested; the innermost one wins.
+  class Scope {
+   public:
+    explicit Scope(TensorArena& arena);
+    ~Scope();
+
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+
+   private:
+    TensorArena* prev_;
+  };
+
+ private:
+  struct Slab {
+    std::unique_ptr<char[]> data;
+    size_t size;
+  };
+
+  void* allocate(size_t size);
+  void addSlab(size_t minSize);
+
+  size_t slabSize_;
+  std::vector<Slab> slabs_;
+  char* begin_;   // start of usable memory in the current slab
+  char* cursor_;  // next free byte in the current slab
+  char* end_;     // end of the current slab
+  char* last_;    // most recent allocation (if still live), or nullptr
+  size_t used_;
+  size_t capacity_;
+  size_t live_;
+};
+
+}  // namespaces
+
+#endif /* THPP_TENSORARENA_H_ */
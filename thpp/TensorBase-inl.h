@@ -7,7 +7,9 @@
 #error This file may only be included from thpp/TensorBase.h
 #endif
 
+#include <algorithm>
 #include <cmath>
+#include <cstring>
 #include <type_traits>
 #ifndef NO_FOLLY
 #include <folly/Conv.h>
@@ -15,6 +17,7 @@
 #else
 #define UNLIKELY(x) (x)
 #endif
+#include <thpp/detail/TensorIteration.h>
 
 namespace thpp {
 
@@ -30,6 +33,91 @@ inline const Derived& D(const TensorBase<T, StorageT, Derived>& v) {
   return static_cast<const Derived&>(v);
 }
 
+template <class T>
+struct ExactlyEqual {
+  // Can compare contiguous runs with memcmp
+  static constexpr bool kBitwise = std::is_integral<T>::value;
+
+  bool operator()(T a, T b) const { return a == b; }
+};
+
+template <class T>
+struct ApproximatelyEqual {
+  static constexpr bool kBitwise = false;
+
+  explicit ApproximatelyEqual(float adj) : adjRelativeError(adj) { }
+
+  bool operator()(T a, T b) const {
+    // Handle special cases
+    if (a == b || (std::isnan(a) && std::isnan(b))) {
+      return true;
+    } else if (!std::isfinite(a) && !std::isfinite(b)) {
+      return std::signbit(a) == std::signbit(b);
+    }
+
+    // Compare the difference against the mean values
+    return !(std::abs(a - b) > adjRelativeError * (std::abs(a) + std::abs(b)));
+  }
+
+  float adjRelativeError;
+};
+
+// Is pred(a[i], b[i]) true for all n elements of two runs?
+template <class T, class Pred>
+bool allOf(const T* a, long sa, const T* b, long sb, long n, Pred& pred) {
+  if (sa != 1 || sb != 1) {
+    for (long i = 0; i < n; ++i) {
+      if (!pred(a[i * sa], b[i * sb])) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  if (Pred::kBitwise) {
+    return memcmp(a, b, n * sizeof(T)) == 0;
+  }
+
+  // Check fixed-size blocks without branching on every element, so the
+  // inner loop can be vectorized.
+  constexpr long kBlock = 256;
+  long i = 0;
+  for (; i + kBlock <= n; i += kBlock) {
+    bool ok = true;
+    for (long j = i; j < i + kBlock; ++j) {
+      ok &= pred(a[j], b[j]);
+    }
+    if (!ok) {
+      return false;
+    }
+  }
+  for (; i < n; ++i) {
+    if (!pred(a[i], b[i])) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Is pred true for all pairs of corresponding elements of two tensors with
+// the same sizes? Iterates over the tensors as few contiguous runs as
+// possible, without allocating.
+template <class T, class Pred>
+bool allElements(int ndims, const long* sizes,
+                 const T* a, const long* aStrides,
+                 const T* b, const long* bStrides,
+                 Pred pred) {
+  CollapsedDims<2> dims;
+  collapseDims<2>(ndims, sizes, {{aStrides, bStrides}}, dims);
+  return forEachRun(
+      dims,
+      [&] (const std::array<long, 2>& offsets, long n,
+           const std::array<long, 2>& strides) {
+        return allOf(a + offsets[0], strides[0], b + offsets[1], strides[1],
+                     n, pred);
+      });
+}
+
 }  // namespace detail
 
 template <class T, class StorageT, class Derived>
@@ -103,21 +191,7 @@ bool TensorBase<T, StorageT, Derived>::isExactlyEqual(
     }
   }
 
-  if (ndims() == 1) {
-    for (int i = 0; i < size(0); ++i) {
-      if (D()->at({i}) != other.D()->at({i})) {
-        return false;
-      }
-    }
-  } else {
-    for (int i = 0; i < size(0); ++i) {
-      if (!(*D())[i].isExactlyEqual(other[i])) {
-        return false;
-      }
-    }
-  }
-
-  return true;
+  return Derived::allElements(*D(), *other.D(), detail::ExactlyEqual<T>());
 }
 
 template <class T, class StorageT, class Derived>
@@ -138,38 +212,19 @@ bool TensorBase<T, StorageT, Derived>::isApproximatelyEqual(
     }
   }
 
-  if (ndims() == 1) {
-    const auto adjRelativeError = 0.5f * relativeError;
-
-    for (int i = 0; i < size(0); ++i) {
-      const auto a = D()->at({i});
-      const auto b = other.D()->at({i});
-
-      // Handle special cases
-      if (a == b || (std::isnan(a) && std::isnan(b))) {
-        continue;
-      } else if (!std::isfinite(a) && !std::isfinite(b)) {
-        if (std::signbit(a) == std::signbit(b)) {
-          continue;
-        } else {
-          return false;
-        }
-      }
-
-      // Compare the difference against the mean values
-      if (std::abs(a - b) > adjRelativeError * (std::abs(a) + std::abs(b))) {
-        return false;
-      }
-    }
-  } else {
-    for (int i = 0; i < size(0); ++i) {
-      if (!(*D())[i].isApproximatelyEqual(other[i], relativeError)) {
-        return false;
-      }
-    }
-  }
+  return Derived::allElements(
+      *D(), *other.D(),
+      detail::ApproximatelyEqual<T>(0.5f * relativeError));
+}
 
-  return true;
+template <class T, class StorageT, class Derived>
+template <class Pred>
+bool TensorBase<T, StorageT, Derived>::allElements(
+    const Derived& a, const Derived& b, Pred pred) {
+  return detail::allElements(a.t_->nDimension, a.t_->size,
+                             a.data(), a.t_->stride,
+                             b.data(), b.t_->stride,
+                             pred);
 }
 
 template <class T, class StorageT, class Derived>
@@ -230,10 +285,65 @@ void TensorBase<T, StorageT, Derived>::squeeze(const TensorBase& src, int dim) {
   Ops::_squeeze1d(t_, src.mut(), dim);
 }
 
+template <class T, class StorageT, class Derived>
+constexpr int TensorBase<T, StorageT, Derived>::kMaxSmallDims;
+
+template <class T, class StorageT, class Derived>
+bool TensorBase<T, StorageT, Derived>::setStorageSmall(
+    THType* th, typename StorageType::THType* storage,
+    offset_type storageOffset, const size_type* sizes, size_t nsizes,
+    const size_type* strides, size_t nstrides) {
+  // Mismatched sizes and strides are left to TH to complain about
+  if (nsizes > kMaxSmallDims || (nstrides != 0 && nstrides != nsizes)) {
+    return false;
+  }
+  // Negative strides mean contiguous to TH
+  size_type st[kMaxSmallDims] = {-1, -1, -1, -1};
+  std::copy(strides, strides + nstrides, st);
+  auto s = sizes;
+  switch (nsizes) {
+  case 0:
+    Ops::_setStorage(th, storage, storageOffset, nullptr, nullptr);
+    break;
+  case 1:
+    Ops::_setStorage1d(th, storage, storageOffset, s[0], st[0]);
+    break;
+  case 2:
+    Ops::_setStorage2d(th, storage, storageOffset, s[0], st[0], s[1], st[1]);
+    break;
+  case 3:
+    Ops::_setStorage3d(th, storage, storageOffset, s[0], st[0], s[1], st[1],
+                       s[2], st[2]);
+    break;
+  case 4:
+    Ops::_setStorage4d(th, storage, storageOffset, s[0], st[0], s[1], st[1],
+                       s[2], st[2], s[3], st[3]);
+    break;
+  }
+  return true;
+}
+
+template <class T, class StorageT, class Derived>
+bool TensorBase<T, StorageT, Derived>::resizeSmall(
+    THType* th, const size_type* sizes, size_t nsizes) {
+  auto s = sizes;
+  switch (nsizes) {
+  case 1: Ops::_resize1d(th, s[0]); return true;
+  case 2: Ops::_resize2d(th, s[0], s[1]); return true;
+  case 3: Ops::_resize3d(th, s[0], s[1], s[2]); return true;
+  case 4: Ops::_resize4d(th, s[0], s[1], s[2], s[3]); return true;
+  }
+  return false;
+}
+
 template <class T, class StorageT, class Derived>
 void TensorBase<T, StorageT, Derived>::resize(
     std::initializer_list<long> newSizes,
                        std::initializer_list<long> newStrides) {
+  if (newStrides.size() == 0 &&
+      resizeSmall(t_, newSizes.begin(), newSizes.size())) {
+    return;
+  }
   resize(LongStorage(newSizes.begin(), newSizes.end()),
          LongStorage(newStrides.begin(), newStrides.end()));
 }
@@ -248,6 +358,9 @@ void TensorBase<T, StorageT, Derived>::resize(
 template <class T, class StorageT, class Derived>
 void TensorBase<T, StorageT, Derived>::resize(
     LongRange sizes, LongRange strides) {
+  if (strides.empty() && resizeSmall(t_, sizes.data(), sizes.size())) {
+    return;
+  }
   resize(LongStorage::wrap(detail::makeMutable(sizes)),
          LongStorage::wrap(detail::makeMutable(strides)));
 }
@@ -265,6 +378,7 @@ bool TensorBase<T, StorageT, Derived>::isScalar() const {
 
 template <class T, class StorageT, class Derived>
 T* TensorBase<T, StorageT, Derived>::data() {
+  prepareWrite();
   return Ops::_data(t_);
 }
 
@@ -338,11 +452,13 @@ size_t TensorBase<T, StorageT, Derived>::offsetOf(
 
 template <class T, class StorageT, class Derived>
 void TensorBase<T, StorageT, Derived>::fill(T value) {
+  prepareWrite();
   Ops::_fill(t_, value);
 }
 
 template <class T, class StorageT, class Derived>
 void TensorBase<T, StorageT, Derived>::zero() {
+  prepareWrite();
   Ops::_zero(t_);
 }
 
@@ -366,6 +482,7 @@ TENSOR_REDUCE_OP(accurate_type, sumall)
   template <class T, class StorageT, class Derived> \
   void TensorBase<T, StorageT, Derived>::name( \
       const TensorBase& src, T value) { \
+    prepareWrite(); \
     Ops::_ ## name(t_, src.mut(), value); \
   }
 TENSOR_ST_OP(add)
@@ -377,6 +494,7 @@ TENSOR_ST_OP(div)
   template <class T, class StorageT, class Derived> \
   void TensorBase<T, StorageT, Derived>::name( \
       const TensorBase& a, T value, const TensorBase& b) { \
+    prepareWrite(); \
     Ops::_ ## name(t_, a.mut(), value, b.mut()); \
   }
 TENSOR_TST_OP(cadd)
@@ -386,6 +504,7 @@ TENSOR_TST_OP(cadd)
   template <class T, class StorageT, class Derived> \
   void TensorBase<T, StorageT, Derived>::name( \
       const TensorBase& a, const TensorBase& b) { \
+    prepareWrite(); \
     Ops::_ ## name(t_, a.mut(), b.mut()); \
   }
 TENSOR_TT_OP(cmul)
@@ -397,6 +516,7 @@ TENSOR_TT_OP(cdiv)
   void TensorBase<T, StorageT, Derived>::name( \
       const TensorBase& a, T value, const TensorBase& b, \
                        const TensorBase& c) { \
+    prepareWrite(); \
     Ops::_ ## name(t_, a.mut(), value, b.mut(), c.mut()); \
   }
 TENSOR_TSTT_OP(addcmul)
@@ -407,6 +527,7 @@ TENSOR_TSTT_OP(addcdiv)
   template <class T, class StorageT, class Derived> \
   void TensorBase<T, StorageT, Derived>::name(T val1, const TensorBase& a, \
                        T val2, const TensorBase& b, const TensorBase& c) { \
+    prepareWrite(); \
     Ops::_ ## name(t_, val1, a.mut(), val2, b.mut(), c.mut()); \
   }
 TENSOR_STSTT_OP(addmv)
@@ -417,26 +538,40 @@ TENSOR_STSTT_OP(addr)
 #define TENSOR_DIM_OP(name) \
   template <class T, class StorageT, class Derived> \
   auto TensorBase<T, StorageT, Derived>::name(int dim) const -> Derived { \
-    Derived dest; \
-    Ops::_ ## name(dest.t_, mut(), dim); \
+    Derived dest = Derived::makeResult(); \
+    name(dim, dest); \
     return dest; \
+  } \
+  template <class T, class StorageT, class Derived> \
+  void TensorBase<T, StorageT, Derived>::name(int dim, Derived& out) const { \
+    out.prepareWrite(); \
+    Ops::_ ## name(out.t_, mut(), dim); \
   }
 TENSOR_DIM_OP(sum)
 TENSOR_DIM_OP(prod)
 TENSOR_DIM_OP(cumsum)
+TENSOR_DIM_OP(cumprod)
 #undef TENSOR_DIM_OP
 
 template <class T, class StorageT, class Derived>
 auto TensorBase<T, StorageT, Derived>::sign() const -> Derived {
-  Derived dest;
-  Ops::_sign(dest.t_, mut());
+  Derived dest = Derived::makeResult();
+  sign(dest);
   return dest;
 }
 
+template <class T, class StorageT, class Derived>
+void TensorBase<T, StorageT, Derived>::sign(Derived& out) const {
+  out.prepareWrite();
+  Ops::_sign(out.t_, mut());
+}
+
 template <class T, class StorageT, class Derived>
 auto TensorBase<T, StorageT, Derived>::cloneTH(const THType* other,
                                                unsigned cloneMode) -> THType* {
-  if ((cloneMode & UNIQUE) ||
+  // Derived classes that support COPY_ON_WRITE handle it before
+  // getting here
+  if ((cloneMode & (UNIQUE | COPY_ON_WRITE)) ||
       ((cloneMode & CONTIGUOUS) && !isContiguous(other))) {
     return Ops::_newClone(mut(other));
   }
@@ -451,7 +586,7 @@ void TensorBase<T, StorageT, Derived>::clear() {
 
 template <class T, class StorageT, class Derived>
 Derived operator-(const TensorBase<T, StorageT, Derived>& a) {
-  Derived r;
+  Derived r = Derived::makeResult();
   r.mul(a, -1);
   return r;
 }
@@ -459,7 +594,7 @@ Derived operator-(const TensorBase<T, StorageT, Derived>& a) {
 template <class T, class StorageT, class Derived>
 Derived operator+(const TensorBase<T, StorageT, Derived>& a,
                   const TensorBase<T, StorageT, Derived>& b) {
-  Derived r;
+  Derived r = Derived::makeResult();
   r.cadd(a, 1, b);
   return r;
 }
@@ -474,7 +609,7 @@ Derived& operator+=(TensorBase<T, StorageT, Derived>& a,
 template <class T, class StorageT, class Derived>
 Derived operator-(const TensorBase<T, StorageT, Derived>& a,
                   const TensorBase<T, StorageT, Derived>& b) {
-  Derived r;
+  Derived r = Derived::makeResult();
   r.cadd(a, -1, b);
   return r;
 }
@@ -488,7 +623,7 @@ Derived& operator-=(TensorBase<T, StorageT, Derived>& a,
 
 template <class T, class StorageT, class Derived>
 Derived operator*(const TensorBase<T, StorageT, Derived>& a, T b) {
-  Derived r;
+  Derived r = Derived::makeResult();
   r.mul(a, b);
   return r;
 }
@@ -501,7 +636,7 @@ Derived& operator*=(TensorBase<T, StorageT, Derived>& a, T b) {
 
 template <class T, class StorageT, class Derived>
 Derived operator/(const TensorBase<T, StorageT, Derived>& a, T b) {
-  Derived r;
+  Derived r = Derived::makeResult();
   r.div(a, b);
   return r;
 }
@@ -65,9 +65,17 @@ class TensorBase {
   // UNIQUE: this tensor is unique and does not share storage with any
   //         other tensor.
   // CONTIGUOUS:  this tensor is contiguous in row-major (that is, C) order
+  //
+  // COPY_ON_WRITE is only meaningful as a clone mode (in the constructors
+  // that take one): the clone shares memory with the original, and
+  // whichever of them is written to first (through data() or any operation
+  // that modifies it) copies the data at that point. That is, the clone
+  // behaves as if it were UNIQUE, but costs nothing if neither is ever
+  // modified. Tensor types that can't share lazily copy right away.
   enum Mode : unsigned {
     UNIQUE = 1U << 0,
     CONTIGUOUS = 1U << 1,
+    COPY_ON_WRITE = 1U << 2,
   };
 
   static constexpr const char* kLuaTypeName = Ops::kLuaTypeName;
@@ -220,13 +228,20 @@ class TensorBase {
   // are 1. Returns a 1d tensor with one entry for each selected element.
   Derived maskedSelect(const Tensor<unsigned char>& mask) const;
 
-  // Select along dimension dim, copying only indices from index.
+  // Same, but store the result in out, reusing its storage if large enough
+  void maskedSelect(const Tensor<unsigned char>& mask, Derived& out) const;
+
+  // Select along dimension dim, copying only indices from index, which
+  // are 1-based (as in Lua): index 1 is the first entry.
   // Returns a tensor with matching dimensionality, but only index.size()
   // elements along dimension dim.
   Derived indexSelect(int dim, const Tensor<long>& index) const;
 
-  // Fill along dimension dim, setting entries corresponding to indices
-  // from index to val.
+  // Same, but store the result in out, reusing its storage if large enough
+  void indexSelect(int dim, const Tensor<long>& index, Derived& out) const;
+
+  // Fill along dimension dim, setting entries corresponding to (1-based)
+  // indices from index to val.
   void indexFill(int dim, const Tensor<long>& index, T val);
 
   // Dot product
@@ -311,20 +326,31 @@ class TensorBase {
   // The returned tensors will have the same shape as *this except that they
   // have a size of 1 along dimension dim. (That is, they're not squeezed)
 
+  //
+  // Each operation also has an overload that stores the result in out
+  // instead, resizing it as needed; out's storage is reused if it is large
+  // enough, so calling it repeatedly with the same out doesn't allocate.
+  // out must not share memory with *this.
+
   // sum
   Derived sum(int dim) const;
+  void sum(int dim, Derived& out) const;
 
   // product
   Derived prod(int dim) const;
+  void prod(int dim, Derived& out) const;
 
   // cumulative sum
   Derived cumsum(int dim) const;
+  void cumsum(int dim, Derived& out) const;
 
   // cumulative product
   Derived cumprod(int dim) const;
+  void cumprod(int dim, Derived& out) const;
 
   // Element-wise sign
   Derived sign() const;
+  void sign(Derived& out) const;
 
   // TODO(tudorb): TH doesn't distinguish between a 1-element 1-dimensional
   // array (aka 1-element vector) and a scalar.
@@ -334,6 +360,12 @@ class TensorBase {
   T* data();
   const T* data() const;
 
+  // Give this tensor's storage a private copy of its data now if it's
+  // copy-on-write and still shared (see COPY_ON_WRITE); modifying
+  // operations do this implicitly. Call it before writing to views of the
+  // same tensor from several threads at once.
+  void prepareWrite() { StorageType::prepareWrite(Ops::_storage(t_)); }
+
   // First element
   const T& front() const { return *data(); }
   T& front() { return *data(); }
@@ -354,6 +386,11 @@ class TensorBase {
 
   std::string str() const;
 
+  // Create an empty tensor to hold the result of an operation (sum(dim),
+  // operator+, ...). For CPU tensors, its storage is allocated from the
+  // current TensorArena, if one is installed.
+  static Derived makeResult() { return Derived(); }
+
 #if !defined(NO_THRIFT) && !defined(NO_FOLLY)
   // const version of serialize() that won't share, but will always copy
   void serializeUnshared(ThriftTensor& out,
@@ -368,6 +405,30 @@ class TensorBase {
 
   static THType* cloneTH(const THType* other, unsigned cloneMode);
 
+  // Shapes with at most this many dimensions are set without building
+  // LongStorage objects (and so without allocating) for the sizes and
+  // strides.
+  static constexpr int kMaxSmallDims = 4;
+
+  // Set th's storage and shape like Ops::_setStorage, for shapes with at
+  // most kMaxSmallDims dimensions; nstrides is 0 for contiguous strides.
+  // Return false (and do nothing) for other shapes.
+  static bool setStorageSmall(THType* th,
+                              typename StorageType::THType* storage,
+                              offset_type storageOffset,
+                              const size_type* sizes, size_t nsizes,
+                              const size_type* strides, size_t nstrides);
+
+  // Same, for Ops::_resize with contiguous strides
+  static bool resizeSmall(THType* th, const size_type* sizes, size_t nsizes);
+
+  // Is pred(x, y) true for all corresponding elements x of a and y of b?
+  // a and b must have the same sizes. Used by isExactlyEqual and
+  // isApproximatelyEqual; Derived may hide this if its data isn't directly
+  // accessible from the host.
+  template <class Pred>
+  static bool allElements(const Derived& a, const Derived& b, Pred pred);
+
   explicit TensorBase(THType* t);
   ~TensorBase();
   THType* mut() const { return mut(t_); }
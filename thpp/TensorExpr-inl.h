@@ -0,0 +1,276 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+#ifndef THPP_TENSOREXPR_H_
+#error This file may only be included from thpp/TensorExpr.h
+#endif
+
+#include <thpp/TensorApply.h>
+
+namespace thpp {
+
+template <class Op, class L, class R>
+constexpr size_t BinaryTensorExpr<Op, L, R>::kNumLeaves;
+
+template <class Op, class E>
+constexpr size_t ScalarTensorExpr<Op, E>::kNumLeaves;
+
+template <class T>
+constexpr size_t LazyTensor<T>::kNumLeaves;
+
+namespace detail {
+
+// Coefficient for mapping x + s * y and x - s * y onto cadd / addcmul /
+// addcdiv
+template <class Op> struct CaddSign {
+  static constexpr bool kEnabled = false;
+};
+template <> struct CaddSign<ExprAdd> {
+  static constexpr bool kEnabled = true;
+  template <class T> static T apply(T s) { return s; }
+};
+template <> struct CaddSign<ExprSub> {
+  static constexpr bool kEnabled = true;
+  template <class T> static T apply(T s) { return -s; }
+};
+
+template <class Op> struct AddcOp {
+  static constexpr bool kEnabled = false;
+};
+template <> struct AddcOp<ExprMul> {
+  static constexpr bool kEnabled = true;
+  template <class T>
+  static void apply(Tensor<T>& dest, const Tensor<T>& a, T s,
+                    const Tensor<T>& b, const Tensor<T>& c) {
+    dest.addcmul(a, s, b, c);
+  }
+};
+template <> struct AddcOp<ExprDiv> {
+  static constexpr bool kEnabled = true;
+  template <class T>
+  static void apply(Tensor<T>& dest, const Tensor<T>& a, T s,
+                    const Tensor<T>& b, const Tensor<T>& c) {
+    dest.addcdiv(a, s, b, c);
+  }
+};
+
+// Map expressions onto TH operations where possible. Returns false if e
+// doesn't have one of the supported shapes; overload resolution picks the
+// most specific match.
+template <class T, class E>
+bool assignFused(Tensor<T>& /*dest*/, const E& /*e*/) {
+  return false;
+}
+
+// a
+template <class T>
+bool assignFused(Tensor<T>& dest, const LazyTensor<T>& e) {
+  if (&dest != &e.tensor()) {
+    dest.resizeAs(e.tensor());
+    dest.copy(e.tensor());
+  }
+  return true;
+}
+
+// a * s, a / s, a + s, a - s
+template <class T>
+bool assignFused(Tensor<T>& dest,
+                 const ScalarTensorExpr<ExprMul, LazyTensor<T>>& e) {
+  dest.mul(e.expr().tensor(), e.scalar());
+  return true;
+}
+
+template <class T>
+bool assignFused(Tensor<T>& dest,
+                 const ScalarTensorExpr<ExprDiv, LazyTensor<T>>& e) {
+  dest.div(e.expr().tensor(), e.scalar());
+  return true;
+}
+
+template <class T>
+bool assignFused(Tensor<T>& dest,
+                 const ScalarTensorExpr<ExprAdd, LazyTensor<T>>& e) {
+  dest.add(e.expr().tensor(), e.scalar());
+  return true;
+}
+
+template <class T>
+bool assignFused(Tensor<T>& dest,
+                 const ScalarTensorExpr<ExprSub, LazyTensor<T>>& e) {
+  dest.add(e.expr().tensor(), -e.scalar());
+  return true;
+}
+
+// a +- b
+template <class T, class Op>
+typename std::enable_if<CaddSign<Op>::kEnabled, bool>::type
+assignFused(Tensor<T>& dest,
+            const BinaryTensorExpr<Op, LazyTensor<T>, LazyTensor<T>>& e) {
+  dest.cadd(e.lhs().tensor(), CaddSign<Op>::apply(T(1)), e.rhs().tensor());
+  return true;
+}
+
+// a +- b * s
+template <class T, class Op>
+typename std::enable_if<CaddSign<Op>::kEnabled, bool>::type
+assignFused(Tensor<T>& dest,
+            const BinaryTensorExpr<
+              Op, LazyTensor<T>,
+              ScalarTensorExpr<ExprMul, LazyTensor<T>>>& e) {
+  dest.cadd(e.lhs().tensor(), CaddSign<Op>::apply(e.rhs().scalar()),
+            e.rhs().expr().tensor());
+  return true;
+}
+
+// cmul(a, b), cdiv(a, b)
+template <class T>
+bool assignFused(Tensor<T>& dest,
+                 const BinaryTensorExpr<ExprMul, LazyTensor<T>,
+                                        LazyTensor<T>>& e) {
+  dest.cmul(e.lhs().tensor(), e.rhs().tensor());
+  return true;
+}
+
+template <class T>
+bool assignFused(Tensor<T>& dest,
+                 const BinaryTensorExpr<ExprDiv, LazyTensor<T>,
+                                        LazyTensor<T>>& e) {
+  dest.cdiv(e.lhs().tensor(), e.rhs().tensor());
+  return true;
+}
+
+// a +- cmul(b, c), a +- cdiv(b, c)
+template <class T, class Op, class COp>
+typename std::enable_if<CaddSign<Op>::kEnabled && AddcOp<COp>::kEnabled,
+                        bool>::type
+assignFused(Tensor<T>& dest,
+            const BinaryTensorExpr<
+              Op, LazyTensor<T>,
+              BinaryTensorExpr<COp, LazyTensor<T>, LazyTensor<T>>>& e) {
+  AddcOp<COp>::apply(dest, e.lhs().tensor(), CaddSign<Op>::apply(T(1)),
+                     e.rhs().lhs().tensor(), e.rhs().rhs().tensor());
+  return true;
+}
+
+// a +- cmul(b, c) * s, a +- cdiv(b, c) * s
+template <class T, class Op, class COp>
+typename std::enable_if<CaddSign<Op>::kEnabled && AddcOp<COp>::kEnabled,
+                        bool>::type
+assignFused(Tensor<T>& dest,
+            const BinaryTensorExpr<
+              Op, LazyTensor<T>,
+              ScalarTensorExpr<
+                ExprMul,
+                BinaryTensorExpr<COp, LazyTensor<T>, LazyTensor<T>>>>& e) {
+  auto& c = e.rhs().expr();
+  AddcOp<COp>::apply(dest, e.lhs().tensor(),
+                     CaddSign<Op>::apply(e.rhs().scalar()),
+                     c.lhs().tensor(), c.rhs().tensor());
+  return true;
+}
+
+// Everything else: one pass over all operands
+template <class T, class E>
+void assignLoop(Tensor<T>& dest, const E& e,
+                const std::array<const Tensor<T>*, E::kNumLeaves>& leaves) {
+  constexpr size_t N = E::kNumLeaves;
+  const Tensor<T>& first = *leaves[0];
+  const int ndims = first.ndims();
+  if (ndims > kMaxCollapsedDims) {
+    throw std::invalid_argument("assign: too many dimensions");
+  }
+
+  bool sameSizes = (dest.ndims() == ndims);
+  for (int i = 0; sameSizes && i < ndims; ++i) {
+    sameSizes = (dest.size(i) == first.size(i));
+  }
+  if (!sameSizes) {
+    dest.resizeAs(first);
+  }
+
+  long sizes[kMaxCollapsedDims];
+  long strides[N + 1][kMaxCollapsedDims];
+  for (int i = 0; i < ndims; ++i) {
+    sizes[i] = first.size(i);
+  }
+  loadStrides(dest, strides[0]);
+  std::array<const long*, N + 1> stridePtrs;
+  std::array<const T*, N> data;
+  stridePtrs[0] = strides[0];
+  for (size_t k = 0; k < N; ++k) {
+    loadStrides(*leaves[k], strides[k + 1]);
+    stridePtrs[k + 1] = strides[k + 1];
+    data[k] = leaves[k]->data();
+  }
+
+  CollapsedDims<N + 1> dims;
+  collapseDims<N + 1>(ndims, sizes, stridePtrs, dims);
+  T* destData = dest.data();
+  forEachRun(
+      dims,
+      [&] (const std::array<long, N + 1>& off, long n,
+           const std::array<long, N + 1>& st) {
+        T* d = destData + off[0];
+        std::array<const T*, N> ptrs;
+        std::array<long, N> runStrides;
+        bool contiguous = (st[0] == 1);
+        for (size_t k = 0; k < N; ++k) {
+          ptrs[k] = data[k] + off[k + 1];
+          runStrides[k] = st[k + 1];
+          contiguous &= (st[k + 1] == 1);
+        }
+        if (contiguous) {
+          for (long i = 0; i < n; ++i) {
+            d[i] = e.template evalContiguous<0>(ptrs, i);
+          }
+        } else {
+          for (long i = 0; i < n; ++i) {
+            d[i * st[0]] = e.template eval<0>(ptrs, runStrides, i);
+          }
+        }
+        return true;
+      });
+}
+
+}  // namespace detail
+
+template <class T, class E>
+Tensor<T>& assign(Tensor<T>& dest, const TensorExpr<E>& expr) {
+  static_assert(std::is_same<T, typename E::value_type>::value,
+                "Expression type mismatch");
+  auto& e = expr.self();
+  std::array<const Tensor<T>*, E::kNumLeaves> leaves;
+  e.template leaves<0>(leaves);
+  for (size_t k = 1; k < leaves.size(); ++k) {
+    detail::checkApplySizes("assign", *leaves[0], *leaves[k]);
+  }
+
+  if (!detail::assignFused(dest, e)) {
+    detail::assignLoop(dest, e, leaves);
+  }
+  return dest;
+}
+
+template <class E>
+Tensor<typename E::value_type> evaluate(const TensorExpr<E>& e) {
+  Tensor<typename E::value_type> result;
+  assign(result, e);
+  return result;
+}
+
+template <class E>
+template <class T>
+TensorExpr<E>::operator Tensor<T>() const {
+  static_assert(std::is_same<T, typename E::value_type>::value,
+                "Expression type mismatch");
+  return evaluate(*this);
+}
+
+}  // namespaces
@@ -0,0 +1,285 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+#ifndef THPP_TENSOREXPR_H_
+#define THPP_TENSOREXPR_H_
+
+#include <array>
+#include <cstddef>
+#include <type_traits>
+
+#include <thpp/Tensor.h>
+
+namespace thpp {
+
+/**
+ * Lazy element-wise arithmetic on Tensor<T> (opt-in).
+ *
+ * The regular operators on tensors (operator+ etc. on TensorBase) return a
+ * new tensor each, so a * 2 + b - c makes three passes over memory and
+ * allocates three temporaries. Wrapping one operand in lazy() instead
+ * builds an expression, which is evaluated in one pass when assigned:
+ *
+ *   Tensor<float> r = lazy(a) * 2 + b - c;  // one pass, one allocation
+ *   assign(r, (lazy(r) - mean) / stddev);   // in place, no allocation
+ *
+ * Simple expressions map directly to the corresponding TH operation
+ * (cadd, addcmul, addcdiv, mul, div, add), which are vectorized;
+ * everything else is evaluated by a fused loop over all operands (see
+ * TensorApply.h), which can be vectorized by the compiler when all
+ * operands are contiguous.
+ *
+ * Expressions refer to their operands, so they must not outlive them;
+ * don't store expressions (in particular, avoid auto e = lazy(a) + ...)
+ * unless all operands are guaranteed to still exist when e is evaluated.
+ * All operands must have the same sizes, and the same element type.
+ *
+ * Besides +, -, and multiplication / division by scalars, cmul(x, y) and
+ * cdiv(x, y) are element-wise multiplication and division.
+ */
+template <class E>
+struct TensorExpr {
+  const E& self() const { return static_cast<const E&>(*this); }
+
+  // Evaluate into a new tensor; see evaluate()
+  template <class T>
+  /* implicit */ operator Tensor<T>() const;
+};
+
+// Leaf of an expression tree: reference to a tensor
+template <class T>
+class LazyTensor : public TensorExpr<LazyTensor<T>> {
+ public:
+  typedef T value_type;
+  static constexpr size_t kNumLeaves = 1;
+
+  explicit LazyTensor(const Tensor<T>& t) : t_(&t) { }
+
+  const Tensor<T>& tensor() const { return *t_; }
+
+  // Evaluate at the i-th point of a run; ptrs[K] and strides[K] are the
+  // start and stride of the run in this leaf's tensor.
+  template <size_t K, size_t N>
+  T eval(const std::array<const T*, N>& ptrs,
+         const std::array<long, N>& strides, long i) const {
+    return ptrs[K][i * strides[K]];
+  }
+
+  // Same, if all runs are contiguous
+  template <size_t K, size_t N>
+  T evalContiguous(const std::array<const T*, N>& ptrs, long i) const {
+    return ptrs[K][i];
+  }
+
+  template <size_t K, size_t N>
+  void leaves(std::array<const Tensor<T>*, N>& out) const {
+    out[K] = t_;
+  }
+
+ private:
+  const Tensor<T>* t_;
+};
+
+template <class T>
+LazyTensor<T> lazy(const Tensor<T>& t) {
+  return LazyTensor<T>(t);
+}
+
+namespace detail {
+
+#define THPP_EXPR_OP(NAME, OP) \
+  struct NAME { \
+    template <class T> \
+    static T apply(T a, T b) { return a OP b; } \
+  };
+THPP_EXPR_OP(ExprAdd, +)
+THPP_EXPR_OP(ExprSub, -)
+THPP_EXPR_OP(ExprMul, *)
+THPP_EXPR_OP(ExprDiv, /)
+#undef THPP_EXPR_OP
+
+// Scalar on the left (s - x, s / x)
+template <class Op>
+struct ExprReversed {
+  template <class T>
+  static T apply(T a, T b) { return Op::apply(b, a); }
+};
+
+}  // namespace detail
+
+// Element-wise binary operation between two expressions
+template <class Op, class L, class R>
+class BinaryTensorExpr : public TensorExpr<BinaryTensorExpr<Op, L, R>> {
+ public:
+  typedef typename L::value_type value_type;
+  static constexpr size_t kNumLeaves = L::kNumLeaves + R::kNumLeaves;
+
+  BinaryTensorExpr(const L& l, const R& r) : l_(l), r_(r) { }
+
+  const L& lhs() const { return l_; }
+  const R& rhs() const { return r_; }
+
+  template <size_t K, size_t N>
+  value_type eval(const std::array<const value_type*, N>& ptrs,
+                  const std::array<long, N>& strides, long i) const {
+    return Op::apply(l_.template eval<K>(ptrs, strides, i),
+                     r_.template eval<K + L::kNumLeaves>(ptrs, strides, i));
+  }
+
+  template <size_t K, size_t N>
+  value_type evalContiguous(const std::array<const value_type*, N>& ptrs,
+                            long i) const {
+    return Op::apply(l_.template evalContiguous<K>(ptrs, i),
+                     r_.template evalContiguous<K + L::kNumLeaves>(ptrs, i));
+  }
+
+  template <size_t K, size_t N>
+  void leaves(std::array<const Tensor<value_type>*, N>& out) const {
+    l_.template leaves<K>(out);
+    r_.template leaves<K + L::kNumLeaves>(out);
+  }
+
+ private:
+  L l_;
+  R r_;
+};
+
+// Element-wise operation between an expression and a scalar
+template <class Op, class E>
+class ScalarTensorExpr : public TensorExpr<ScalarTensorExpr<Op, E>> {
+ public:
+  typedef typename E::value_type value_type;
+  static constexpr size_t kNumLeaves = E::kNumLeaves;
+
+  ScalarTensorExpr(const E& e, value_type s) : e_(e), s_(s) { }
+
+  const E& expr() const { return e_; }
+  value_type scalar() const { return s_; }
+
+  template <size_t K, size_t N>
+  value_type eval(const std::array<const value_type*, N>& ptrs,
+                  const std::array<long, N>& strides, long i) const {
+    return Op::apply(e_.template eval<K>(ptrs, strides, i), s_);
+  }
+
+  template <size_t K, size_t N>
+  value_type evalContiguous(const std::array<const value_type*, N>& ptrs,
+                            long i) const {
+    return Op::apply(e_.template evalContiguous<K>(ptrs, i), s_);
+  }
+
+  template <size_t K, size_t N>
+  void leaves(std::array<const Tensor<value_type>*, N>& out) const {
+    e_.template leaves<K>(out);
+  }
+
+ private:
+  E e_;
+  value_type s_;
+};
+
+namespace detail {
+
+template <class X>
+struct IsTensorExpr : std::is_base_of<TensorExpr<X>, X> { };
+
+// Operands of lazy expressions: expressions and tensors
+template <class X, class Enable = void>
+struct AsTensorExpr { };
+
+template <class T>
+struct AsTensorExpr<Tensor<T>> {
+  typedef LazyTensor<T> type;
+  static type get(const Tensor<T>& t) { return type(t); }
+};
+
+template <class E>
+struct AsTensorExpr<
+    E, typename std::enable_if<IsTensorExpr<E>::value>::type> {
+  typedef E type;
+  static const E& get(const E& e) { return e; }
+};
+
+template <class X>
+struct IsTensorOperand : IsTensorExpr<X> { };
+
+template <class T>
+struct IsTensorOperand<Tensor<T>> : std::true_type { };
+
+// Result of a binary operation. For operators, at least one of X and Y
+// must be an expression, so the regular (eager) operators on tensors are
+// unchanged.
+template <class Op, class X, class Y, bool IsOperator, class Enable = void>
+struct BinaryExprOf { };
+
+template <class Op, class X, class Y, bool IsOperator>
+struct BinaryExprOf<
+    Op, X, Y, IsOperator,
+    typename std::enable_if<
+      (!IsOperator || IsTensorExpr<X>::value || IsTensorExpr<Y>::value) &&
+      IsTensorOperand<X>::value && IsTensorOperand<Y>::value>::type> {
+  typedef BinaryTensorExpr<Op,
+                           typename AsTensorExpr<X>::type,
+                           typename AsTensorExpr<Y>::type> type;
+};
+
+}  // namespace detail
+
+#define THPP_EXPR_BINARY_OP(NAME, OP, IS_OPERATOR) \
+  template <class X, class Y> \
+  typename detail::BinaryExprOf<detail::OP, X, Y, IS_OPERATOR>::type \
+  NAME(const X& x, const Y& y) { \
+    return typename detail::BinaryExprOf<detail::OP, X, Y, IS_OPERATOR>::type( \
+        detail::AsTensorExpr<X>::get(x), detail::AsTensorExpr<Y>::get(y)); \
+  }
+THPP_EXPR_BINARY_OP(operator+, ExprAdd, true)
+THPP_EXPR_BINARY_OP(operator-, ExprSub, true)
+THPP_EXPR_BINARY_OP(cmul, ExprMul, false)
+THPP_EXPR_BINARY_OP(cdiv, ExprDiv, false)
+#undef THPP_EXPR_BINARY_OP
+
+#define THPP_EXPR_SCALAR_OP(OP, IMPL) \
+  template <class E> \
+  ScalarTensorExpr<detail::IMPL, E> operator OP( \
+      const TensorExpr<E>& e, typename E::value_type s) { \
+    return ScalarTensorExpr<detail::IMPL, E>(e.self(), s); \
+  } \
+  template <class E> \
+  ScalarTensorExpr<detail::ExprReversed<detail::IMPL>, E> operator OP( \
+      typename E::value_type s, const TensorExpr<E>& e) { \
+    return ScalarTensorExpr<detail::ExprReversed<detail::IMPL>, E>( \
+        e.self(), s); \
+  }
+THPP_EXPR_SCALAR_OP(+, ExprAdd)
+THPP_EXPR_SCALAR_OP(-, ExprSub)
+THPP_EXPR_SCALAR_OP(*, ExprMul)
+THPP_EXPR_SCALAR_OP(/, ExprDiv)
+#undef THPP_EXPR_SCALAR_OP
+
+template <class E>
+ScalarTensorExpr<detail::ExprMul, E> operator-(const TensorExpr<E>& e) {
+  return ScalarTensorExpr<detail::ExprMul, E>(e.self(), -1);
+}
+
+// Evaluate e into dest, resizing dest to the operands' sizes if needed
+// (which reallocates, unless dest already has the right size). dest may
+// be one of the operands, but must not otherwise overlap with them.
+template <class T, class E>
+Tensor<T>& assign(Tensor<T>& dest, const TensorExpr<E>& e);
+
+// Evaluate e into a new, contiguous tensor
+template <class E>
+Tensor<typename E::value_type> evaluate(const TensorExpr<E>& e);
+
+}  // namespaces
+
+#include <thpp/TensorExpr-inl.h>
+
+#endif /* THPP_TENSOREXPR_H_ */
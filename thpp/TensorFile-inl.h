@@ -0,0 +1,52 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+#ifndef THPP_TENSORFILE_H_
+#error This file may only be included from thpp/TensorFile.h
+#endif
+
+namespace thpp {
+
+template <class T>
+void TensorFileWriter::add(const std::string& name, const Tensor<T>& tensor) {
+  // No copy if already contiguous
+  Tensor<T> src(tensor, Tensor<T>::CONTIGUOUS);
+  addRaw(name, detail::dataType<T>(), src.sizes(), src.data(),
+         src.size() * sizeof(T));
+}
+
+template <class T>
+Tensor<T> TensorFileReader::read(const std::string& name) const {
+  auto& entry = get(name, detail::dataType<T>());
+  if (entry.sizes.empty()) {
+    return Tensor<T>();
+  }
+  Tensor<T> out(std::vector<typename Tensor<T>::size_type>(
+      entry.sizes.begin(), entry.sizes.end()));
+  readRaw(entry, out.data());
+  return out;
+}
+
+template <class T>
+Tensor<T> TensorFileReader::map(const std::string& name,
+                                unsigned flags) const {
+  auto& entry = get(name, detail::dataType<T>());
+  if (entry.endianness != detail::gMachineEndianness) {
+    throw std::invalid_argument(folly::sformat(
+        "Tensor {} is not in native byte order, and can't be mapped", name));
+  }
+  return Tensor<T>::mapFile(
+      path_, entry.offset,
+      std::vector<typename Tensor<T>::size_type>(
+          entry.sizes.begin(), entry.sizes.end()),
+      flags);
+}
+
+}  // namespaces
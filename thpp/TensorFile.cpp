@@ -0,0 +1,270 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+#include <thpp/TensorFile.h>
+
+#if !defined(NO_THRIFT) && !defined(NO_FOLLY)
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <system_error>
+
+#include <folly/Bits.h>
+#include <glog/logging.h>
+#include <thrift/lib/cpp2/protocol/Serializer.h>
+#include <thpp/detail/ByteSwap.h>
+
+namespace thpp {
+
+namespace {
+
+constexpr char kMagic[8] = {'T', 'H', 'P', 'P', 'T', 'F', '0', '1'};
+
+struct Trailer {
+  uint64_t indexOffset;
+  uint64_t indexLength;
+  char magic[8];
+};
+static_assert(sizeof(Trailer) == 24, "Unexpected padding in Trailer");
+
+[[noreturn]] void throwSystemError(const char* what, const std::string& path) {
+  throw std::system_error(errno, std::system_category(),
+                          folly::sformat("{} {}", what, path));
+}
+
+void preadAll(int fd, void* dest, uint64_t length, uint64_t offset,
+              const std::string& path) {
+  auto p = static_cast<char*>(dest);
+  while (length != 0) {
+    ssize_t n = pread(fd, p, length, offset);
+    if (n == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      throwSystemError("pread", path);
+    }
+    if (n == 0) {
+      throw std::invalid_argument(folly::sformat(
+          "Truncated tensor file {}", path));
+    }
+    p += n;
+    length -= n;
+    offset += n;
+  }
+}
+
+uint64_t alignUp(uint64_t n) {
+  return (n + kTensorFileAlignment - 1) & ~uint64_t(kTensorFileAlignment - 1);
+}
+
+}  // namespace
+
+TensorFileWriter::TensorFileWriter(const std::string& path)
+  : path_(path),
+    fd_(::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666)) {
+  if (fd_ == -1) {
+    throwSystemError("open", path_);
+  }
+  try {
+    writeAll(kMagic, sizeof(kMagic));
+  } catch (...) {
+    ::close(fd_);
+    throw;
+  }
+}
+
+TensorFileWriter::~TensorFileWriter() {
+  if (fd_ != -1) {
+    try {
+      finish();
+    } catch (const std::exception& e) {
+      LOG(ERROR) << "Error finishing tensor file " << path_ << ": "
+                 << e.what();
+    }
+  }
+}
+
+void TensorFileWriter::writeAll(const void* data, uint64_t length) {
+  auto p = static_cast<const char*>(data);
+  while (length != 0) {
+    ssize_t n = ::write(fd_, p, length);
+    if (n == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      throwSystemError("write", path_);
+    }
+    p += n;
+    length -= n;
+    offset_ += n;
+  }
+}
+
+void TensorFileWriter::addRaw(const std::string& name,
+                              ThriftTensorDataType dataType,
+                              LongRange sizes,
+                              const void* data,
+                              uint64_t length) {
+  CHECK_NE(fd_, -1) << "Tensor file " << path_ << " already finished";
+  if (!byName_.emplace(name, index_.entries.size()).second) {
+    throw std::invalid_argument(folly::sformat(
+        "Duplicate tensor {} in tensor file", name));
+  }
+
+  // Pad to alignment. Seeking would leave a hole, but then a failed write
+  // could leave garbage that looks like a valid file.
+  static const char zeros[kTensorFileAlignment] = {0};
+  writeAll(zeros, alignUp(offset_) - offset_);
+
+  ThriftTensorFileEntry entry;
+  entry.name = name;
+  entry.dataType = dataType;
+  entry.endianness = detail::gMachineEndianness;
+  entry.sizes.assign(sizes.begin(), sizes.end());
+  entry.offset = offset_;
+  entry.length = length;
+
+  writeAll(data, length);
+  index_.entries.push_back(std::move(entry));
+}
+
+void TensorFileWriter::finish() {
+  CHECK_NE(fd_, -1) << "Tensor file " << path_ << " already finished";
+  auto index = apache::thrift::CompactSerializer::serialize<std::string>(
+      index_);
+
+  Trailer trailer;
+  trailer.indexOffset = folly::Endian::little(offset_);
+  trailer.indexLength = folly::Endian::little(uint64_t(index.size()));
+  memcpy(trailer.magic, kMagic, sizeof(kMagic));
+
+  writeAll(index.data(), index.size());
+  writeAll(&trailer, sizeof(trailer));
+
+  int fd = fd_;
+  fd_ = -1;
+  if (::close(fd) == -1) {
+    throwSystemError("close", path_);
+  }
+}
+
+TensorFileReader::TensorFileReader(const std::string& path)
+  : path_(path),
+    fd_(::open(path.c_str(), O_RDONLY | O_CLOEXEC)) {
+  if (fd_ == -1) {
+    throwSystemError("open", path_);
+  }
+  try {
+    off_t size = lseek(fd_, 0, SEEK_END);
+    if (size == -1) {
+      throwSystemError("lseek", path_);
+    }
+    if (uint64_t(size) < sizeof(kMagic) + sizeof(Trailer)) {
+      throw std::invalid_argument(folly::sformat(
+          "{} is not a tensor file", path_));
+    }
+
+    char magic[sizeof(kMagic)];
+    Trailer trailer;
+    preadAll(fd_, magic, sizeof(magic), 0, path_);
+    preadAll(fd_, &trailer, sizeof(trailer), size - sizeof(trailer), path_);
+    if (memcmp(magic, kMagic, sizeof(kMagic)) != 0 ||
+        memcmp(trailer.magic, kMagic, sizeof(kMagic)) != 0) {
+      throw std::invalid_argument(folly::sformat(
+          "{} is not a tensor file", path_));
+    }
+
+    auto indexOffset = folly::Endian::little(trailer.indexOffset);
+    auto indexLength = folly::Endian::little(trailer.indexLength);
+    if (indexOffset > uint64_t(size) - sizeof(trailer) ||
+        indexLength != uint64_t(size) - sizeof(trailer) - indexOffset) {
+      throw std::invalid_argument(folly::sformat(
+          "Corrupt index in tensor file {}", path_));
+    }
+
+    std::string index(indexLength, '\0');
+    preadAll(fd_, &index[0], indexLength, indexOffset, path_);
+    apache::thrift::CompactSerializer::deserialize(index, index_);
+
+    for (size_t i = 0; i < index_.entries.size(); ++i) {
+      auto& entry = index_.entries[i];
+      if (entry.offset < 0 || entry.length < 0 ||
+          uint64_t(entry.offset) + entry.length > indexOffset) {
+        throw std::invalid_argument(folly::sformat(
+            "Corrupt entry {} in tensor file {}", entry.name, path_));
+      }
+      byName_.emplace(entry.name, i);
+    }
+  } catch (...) {
+    ::close(fd_);
+    throw;
+  }
+}
+
+TensorFileReader::~TensorFileReader() {
+  ::close(fd_);
+}
+
+const ThriftTensorFileEntry* TensorFileReader::find(
+    const std::string& name) const {
+  auto pos = byName_.find(name);
+  return pos == byName_.end() ? nullptr : &index_.entries[pos->second];
+}
+
+const ThriftTensorFileEntry& TensorFileReader::get(
+    const std::string& name,
+    ThriftTensorDataType dataType) const {
+  auto entry = find(name);
+  if (!entry) {
+    throw std::invalid_argument(folly::sformat(
+        "No tensor {} in tensor file {}", name, path_));
+  }
+  if (entry->dataType != dataType) {
+    throw std::invalid_argument(folly::sformat(
+        "Invalid data type {} for tensor {}, expected {}",
+        int(entry->dataType), name, int(dataType)));
+  }
+  // The constructor checked that the payload lies within the file; make sure
+  // that the sizes describe exactly that payload before anything is mapped
+  uint64_t length = entry->sizes.empty() ? 0 : detail::dataTypeSize(dataType);
+  for (auto s : entry->sizes) {
+    if (s < 0 || __builtin_mul_overflow(length, uint64_t(s), &length)) {
+      throw std::invalid_argument(folly::sformat(
+          "Invalid sizes for tensor {}", name));
+    }
+  }
+  if (length != uint64_t(entry->length)) {
+    throw std::invalid_argument(folly::sformat(
+        "Invalid length {} for tensor {}", entry->length, name));
+  }
+  return *entry;
+}
+
+void TensorFileReader::readRaw(const ThriftTensorFileEntry& entry,
+                               void* dest) const {
+  preadAll(fd_, dest, entry.length, entry.offset, path_);
+  if (entry.endianness == detail::gMachineEndianness) {
+    return;
+  }
+  if (entry.endianness != ThriftTensorEndianness::LITTLE &&
+      entry.endianness != ThriftTensorEndianness::BIG) {
+    throw std::invalid_argument(folly::sformat(
+        "Invalid endianness {} for tensor {}", int(entry.endianness),
+        entry.name));
+  }
+  auto elementSize = detail::dataTypeSize(entry.dataType);
+  detail::byteSwap(dest, dest, entry.length / elementSize, elementSize);
+}
+
+}  // namespaces
+
+#endif  // !NO_THRIFT && !NO_FOLLY
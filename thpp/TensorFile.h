@@ -0,0 +1,118 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+#ifndef THPP_TENSORFILE_H_
+#define THPP_TENSORFILE_H_
+
+#if !defined(NO_THRIFT) && !defined(NO_FOLLY)
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <thpp/Tensor.h>
+
+namespace thpp {
+
+/**
+ * Container file holding a number of named tensors, with an index at the
+ * end so that readers can load any subset of the tensors by reading (or
+ * mapping) only the bytes they need.
+ *
+ * Layout:
+ *
+ *   header     magic (8 bytes)
+ *   payloads   raw contiguous data of each tensor, zero-padded so that each
+ *              one starts at a multiple of kTensorFileAlignment
+ *   index      ThriftTensorFileIndex, Compact protocol
+ *   trailer    index offset (8 bytes), index length (8 bytes), magic;
+ *              the integers are little-endian
+ *
+ * Payloads are written in native byte order; the index records it, and
+ * readers on machines of the other endianness swap on read.
+ */
+constexpr size_t kTensorFileAlignment = 4096;
+
+class TensorFileWriter {
+ public:
+  // Create (or truncate) the file at path.
+  explicit TensorFileWriter(const std::string& path);
+
+  // Calls finish() if it hasn't been called yet, but errors are only
+  // logged; call finish() explicitly to see them.
+  ~TensorFileWriter();
+
+  TensorFileWriter(const TensorFileWriter&) = delete;
+  TensorFileWriter& operator=(const TensorFileWriter&) = delete;
+
+  // Append a tensor. Names must be unique within a file.
+  template <class T>
+  void add(const std::string& name, const Tensor<T>& tensor);
+
+  // Write the index and close the file. No more tensors may be added.
+  void finish();
+
+ private:
+  void addRaw(const std::string& name, ThriftTensorDataType dataType,
+              LongRange sizes, const void* data, uint64_t length);
+  void writeAll(const void* data, uint64_t length);
+
+  std::string path_;
+  int fd_;
+  uint64_t offset_ = 0;
+  ThriftTensorFileIndex index_;
+  std::unordered_map<std::string, size_t> byName_;
+};
+
+class TensorFileReader {
+ public:
+  // Open the file at path and read its index.
+  explicit TensorFileReader(const std::string& path);
+  ~TensorFileReader();
+
+  TensorFileReader(const TensorFileReader&) = delete;
+  TensorFileReader& operator=(const TensorFileReader&) = delete;
+
+  const std::vector<ThriftTensorFileEntry>& entries() const {
+    return index_.entries;
+  }
+
+  // Return the index entry for name, or nullptr if there is none.
+  const ThriftTensorFileEntry* find(const std::string& name) const;
+
+  // Read the named tensor into freshly allocated memory, with a single
+  // pread(). Throws std::invalid_argument if the tensor doesn't exist or
+  // has a different type.
+  template <class T>
+  Tensor<T> read(const std::string& name) const;
+
+  // Map the named tensor read-only (see Storage::mapFile for flags). Only
+  // supported if the tensor was written in native byte order.
+  template <class T>
+  Tensor<T> map(const std::string& name, unsigned flags = 0) const;
+
+ private:
+  const ThriftTensorFileEntry& get(const std::string& name,
+                                   ThriftTensorDataType dataType) const;
+  void readRaw(const ThriftTensorFileEntry& entry, void* dest) const;
+
+  std::string path_;
+  int fd_;
+  ThriftTensorFileIndex index_;
+  std::unordered_map<std::string, size_t> byName_;
+};
+
+}  // namespaces
+
+#include <thpp/TensorFile-inl.h>
+
+#endif  // !NO_THRIFT && !NO_FOLLY
+
+#endif /* THPP_TENSORFILE_H_ */
@@ -0,0 +1,291 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+#ifndef THPP_TENSORFOREACH_H_
+#error This file may only be included from thpp/TensorForeach.h
+#endif
+
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+
+#include <thpp/detail/Parallel.h>
+
+namespace thpp {
+
+namespace detail {
+
+// CPU tensors may be split into pieces; CUDA tensors (where each piece
+// would be a kernel launch) aren't.
+template <class TensorT> struct ForeachSplit : std::false_type { };
+template <class T> struct ForeachSplit<Tensor<T>> : std::true_type { };
+
+// If the non-empty tensors in tensors are contiguous and laid out back to
+// back in one storage, set out to a 1d view of all of them and return true.
+template <class TensorT>
+bool flattenAdjacent(const std::vector<TensorT>& tensors, TensorT& out) {
+  const void* th = nullptr;
+  long offset = 0;
+  long next = 0;
+  for (auto& t : tensors) {
+    if (t.size() == 0) {
+      continue;
+    }
+    if (!t.isContiguous()) {
+      return false;
+    }
+    typename TensorT::StorageBuffer buf;
+    auto tth = t.storageRef(&buf).th();
+    if (!th) {
+      th = tth;
+      offset = next = t.storageOffset();
+    } else if (tth != th || t.storageOffset() != next) {
+      return false;
+    }
+    next += t.size();
+  }
+  if (!th) {
+    return false;
+  }
+  for (auto& t : tensors) {
+    if (t.size() != 0) {
+      out = TensorT(t.storage(), offset, LongStorage({next - offset}));
+      break;
+    }
+  }
+  return true;
+}
+
+// 1d view of elements [begin, begin + n) of contiguous tensor t
+template <class TensorT>
+TensorT flatSlice(const TensorT& t, long begin, long n) {
+  return TensorT(t.storage(), t.storageOffset() + begin, LongStorage({n}));
+}
+
+// Call fn(self[i], b[i], c[i]) (b and c are nullptr if not given) for all
+// i, or for the flattened lists, or for pieces of them; see the comment at
+// the top of TensorForeach.h.
+template <class TensorT, class F>
+void foreachApply(const char* name,
+                  std::vector<TensorT>& self,
+                  const std::vector<TensorT>* b,
+                  const std::vector<TensorT>* c,
+                  folly::Executor* executor,
+                  size_t grainSize,
+                  F fn) {
+  for (auto list : {b, c}) {
+    if (!list) {
+      continue;
+    }
+    if (list->size() != self.size()) {
+      throw std::invalid_argument(
+          std::string(name) + ": tensor list size mismatch");
+    }
+    for (size_t i = 0; i < self.size(); ++i) {
+      if ((*list)[i].size() != self[i].size()) {
+        throw std::invalid_argument(
+            std::string(name) + ": tensor size mismatch");
+      }
+    }
+  }
+
+  // Several pieces may share a storage, so unshare them (if
+  // copy-on-write) before the tasks race to do so.
+  for (auto& t : self) {
+    t.prepareWrite();
+  }
+
+  struct Operands {
+    TensorT* self;
+    const TensorT* b;
+    const TensorT* c;
+  };
+  std::vector<Operands> operands;
+
+  TensorT flatSelf;
+  TensorT flatB;
+  TensorT flatC;
+  if (flattenAdjacent(self, flatSelf) &&
+      (!b || flattenAdjacent(*b, flatB)) &&
+      (!c || flattenAdjacent(*c, flatC))) {
+    operands.push_back({&flatSelf, b ? &flatB : nullptr,
+                        c ? &flatC : nullptr});
+  } else {
+    operands.reserve(self.size());
+    for (size_t i = 0; i < self.size(); ++i) {
+      if (self[i].size() != 0) {
+        operands.push_back({&self[i], b ? &(*b)[i] : nullptr,
+                            c ? &(*c)[i] : nullptr});
+      }
+    }
+  }
+
+  if (!ForeachSplit<TensorT>::value || !executor) {
+    for (auto& op : operands) {
+      fn(*op.self, op.b, op.c);
+    }
+    return;
+  }
+
+  // Split contiguous operands into pieces of at most grainSize elements,
+  // and group consecutive pieces into tasks of about grainSize elements.
+  grainSize = std::max(grainSize, size_t(1));
+  struct Piece {
+    const Operands* op;
+    long begin;
+    long n;  // -1 = all of it (not contiguous)
+  };
+  std::vector<std::vector<Piece>> tasks(1);
+  size_t taskSize = 0;
+  auto add = [&] (Piece piece, size_t n) {
+    if (taskSize != 0 && taskSize + n > grainSize) {
+      tasks.emplace_back();
+      taskSize = 0;
+    }
+    tasks.back().push_back(piece);
+    taskSize += n;
+  };
+  for (auto& op : operands) {
+    size_t size = op.self->size();
+    if (!op.self->isContiguous() ||
+        (op.b && !op.b->isContiguous()) ||
+        (op.c && !op.c->isContiguous())) {
+      add(Piece{&op, 0, -1}, size);
+      continue;
+    }
+    for (size_t begin = 0; begin < size; begin += grainSize) {
+      size_t n = std::min(grainSize, size - begin);
+      add(Piece{&op, long(begin), long(n)}, n);
+    }
+  }
+
+  runTasks(executor, tasks.size(), [&] (size_t i) {
+    for (auto& piece : tasks[i]) {
+      auto& op = *piece.op;
+      if (piece.n == -1) {
+        fn(*op.self, op.b, op.c);
+        continue;
+      }
+      auto s = flatSlice(*op.self, piece.begin, piece.n);
+      TensorT sb;
+      TensorT sc;
+      if (op.b) {
+        sb = flatSlice(*op.b, piece.begin, piece.n);
+      }
+      if (op.c) {
+        sc = flatSlice(*op.c, piece.begin, piece.n);
+      }
+      fn(s, op.b ? &sb : nullptr, op.c ? &sc : nullptr);
+    }
+  });
+}
+
+}  // namespace detail
+
+template <class TensorT>
+void foreachAdd(std::vector<TensorT>& self,
+                typename TensorT::value_type value,
+                folly::Executor* executor,
+                size_t grainSize) {
+  detail::foreachApply(
+      "foreachAdd", self, nullptr, nullptr, executor, grainSize,
+      [value] (TensorT& s, const TensorT*, const TensorT*) {
+        s.add(s, value);
+      });
+}
+
+template <class TensorT>
+void foreachMul(std::vector<TensorT>& self,
+                typename TensorT::value_type value,
+                folly::Executor* executor,
+                size_t grainSize) {
+  detail::foreachApply(
+      "foreachMul", self, nullptr, nullptr, executor, grainSize,
+      [value] (TensorT& s, const TensorT*, const TensorT*) {
+        s.mul(s, value);
+      });
+}
+
+template <class TensorT>
+void foreachCadd(std::vector<TensorT>& self,
+                 typename TensorT::value_type value,
+                 const std::vector<TensorT>& b,
+                 folly::Executor* executor,
+                 size_t grainSize) {
+  detail::foreachApply(
+      "foreachCadd", self, &b, nullptr, executor, grainSize,
+      [value] (TensorT& s, const TensorT* sb, const TensorT*) {
+        s.cadd(s, value, *sb);
+      });
+}
+
+template <class TensorT>
+void foreachCmul(std::vector<TensorT>& self,
+                 const std::vector<TensorT>& b,
+                 folly::Executor* executor,
+                 size_t grainSize) {
+  detail::foreachApply(
+      "foreachCmul", self, &b, nullptr, executor, grainSize,
+      [] (TensorT& s, const TensorT* sb, const TensorT*) {
+        s.cmul(s, *sb);
+      });
+}
+
+template <class TensorT>
+void foreachAddcmul(std::vector<TensorT>& self,
+                    typename TensorT::value_type value,
+                    const std::vector<TensorT>& b,
+                    const std::vector<TensorT>& c,
+                    folly::Executor* executor,
+                    size_t grainSize) {
+  detail::foreachApply(
+      "foreachAddcmul", self, &b, &c, executor, grainSize,
+      [value] (TensorT& s, const TensorT* sb, const TensorT* sc) {
+        s.addcmul(s, value, *sb, *sc);
+      });
+}
+
+template <class TensorT>
+void foreachAddcdiv(std::vector<TensorT>& self,
+                    typename TensorT::value_type value,
+                    const std::vector<TensorT>& b,
+                    const std::vector<TensorT>& c,
+                    folly::Executor* executor,
+                    size_t grainSize) {
+  detail::foreachApply(
+      "foreachAddcdiv", self, &b, &c, executor, grainSize,
+      [value] (TensorT& s, const TensorT* sb, const TensorT* sc) {
+        s.addcdiv(s, value, *sb, *sc);
+      });
+}
+
+template <class TensorT>
+void packTensors(std::vector<TensorT>& tensors) {
+  long total = 0;
+  for (auto& t : tensors) {
+    total += t.size();
+  }
+  if (total == 0) {
+    return;
+  }
+  TensorT flat(LongStorage({total}));
+  long offset = 0;
+  for (auto& t : tensors) {
+    if (t.size() == 0) {
+      continue;
+    }
+    TensorT packed(flat.storage(), offset, LongStorage(t.sizes()));
+    packed.copy(t);
+    offset += t.size();
+    t = std::move(packed);
+  }
+}
+
+}  // namespaces
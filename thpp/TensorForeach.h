@@ -0,0 +1,100 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+#ifndef THPP_TENSORFOREACH_H_
+#define THPP_TENSORFOREACH_H_
+
+#include <vector>
+
+#include <thpp/TensorParallel.h>
+
+#include <folly/Executor.h>
+
+namespace thpp {
+
+/**
+ * In-place element-wise operations on lists of tensors, as used by
+ * optimizers to update all parameters (and their state) at once:
+ *
+ *   foreachMul(momentum, 0.9);
+ *   foreachCadd(momentum, 1, grads);
+ *   foreachCadd(params, -lr, momentum);
+ *
+ * The lists must have the same length, and corresponding tensors the same
+ * number of elements (throws std::invalid_argument otherwise).
+ *
+ * Lists whose tensors are contiguous and laid out back to back in one
+ * storage (see packTensors() below) are handled as one tensor, which is a
+ * single kernel launch on CUDA. Otherwise, CUDA tensors are handled one at
+ * a time, and CPU tensors are split into pieces of about grainSize
+ * elements (small tensors are grouped), run on executor if not null.
+ * Works with Tensor and CudaTensor (executor is ignored for the latter).
+ */
+
+// self[i] += value
+template <class TensorT>
+void foreachAdd(std::vector<TensorT>& self,
+                typename TensorT::value_type value,
+                folly::Executor* executor = nullptr,
+                size_t grainSize = kDefaultParallelGrainSize);
+
+// self[i] *= value
+template <class TensorT>
+void foreachMul(std::vector<TensorT>& self,
+                typename TensorT::value_type value,
+                folly::Executor* executor = nullptr,
+                size_t grainSize = kDefaultParallelGrainSize);
+
+// self[i] += value * b[i]
+template <class TensorT>
+void foreachCadd(std::vector<TensorT>& self,
+                 typename TensorT::value_type value,
+                 const std::vector<TensorT>& b,
+                 folly::Executor* executor = nullptr,
+                 size_t grainSize = kDefaultParallelGrainSize);
+
+// self[i] *= b[i]
+template <class TensorT>
+void foreachCmul(std::vector<TensorT>& self,
+                 const std::vector<TensorT>& b,
+                 folly::Executor* executor = nullptr,
+                 size_t grainSize = kDefaultParallelGrainSize);
+
+// self[i] += value * b[i] * c[i]
+template <class TensorT>
+void foreachAddcmul(std::vector<TensorT>& self,
+                    typename TensorT::value_type value,
+                    const std::vector<TensorT>& b,
+                    const std::vector<TensorT>& c,
+                    folly::Executor* executor = nullptr,
+                    size_t grainSize = kDefaultParallelGrainSize);
+
+// self[i] += value * b[i] / c[i]
+template <class TensorT>
+void foreachAddcdiv(std::vector<TensorT>& self,
+                    typename TensorT::value_type value,
+                    const std::vector<TensorT>& b,
+                    const std::vector<TensorT>& c,
+                    folly::Executor* executor = nullptr,
+                    size_t grainSize = kDefaultParallelGrainSize);
+
+// Copy all tensors (keeping their sizes) into one new storage, back to
+// back, and replace the elements of tensors with the copies, so that
+// foreach operations on them are fused. Other references to the original
+// tensors still point to the old memory, so do this when creating
+// optimizer state, or before handing out the parameters.
+template <class TensorT>
+void packTensors(std::vector<TensorT>& tensors);
+
+}  // namespaces
+
+#include <thpp/TensorForeach-inl.h>
+
+#endif /* THPP_TENSORFOREACH_H_ */
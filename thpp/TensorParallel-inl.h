@@ -0,0 +1,93 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+#ifndef THPP_TENSORPARALLEL_H_
+#error This file may only be included from thpp/TensorParallel.h
+#endif
+
+#include <algorithm>
+#include <cstring>
+
+#include <thpp/detail/Convert.h>
+#include <thpp/detail/Parallel.h>
+
+namespace thpp {
+
+template <class T>
+void parallelFill(Tensor<T>& dest, T value, folly::Executor* executor,
+                  size_t grainSize) {
+  if (!executor || !dest.isContiguous() || dest.size() <= grainSize) {
+    dest.fill(value);
+    return;
+  }
+  T* data = dest.data();
+  detail::parallelFor(executor, dest.size(), grainSize,
+                      [data, value] (size_t begin, size_t end) {
+    std::fill(data + begin, data + end, value);
+  });
+}
+
+template <class T>
+void parallelZero(Tensor<T>& dest, folly::Executor* executor,
+                  size_t grainSize) {
+  if (!executor || !dest.isContiguous() || dest.size() <= grainSize) {
+    dest.zero();
+    return;
+  }
+  T* data = dest.data();
+  detail::parallelFor(executor, dest.size(), grainSize,
+                      [data] (size_t begin, size_t end) {
+    memset(data + begin, 0, (end - begin) * sizeof(T));
+  });
+}
+
+template <class T, class U>
+void parallelCopy(Tensor<T>& dest, const Tensor<U>& src,
+                  folly::Executor* executor, size_t grainSize) {
+  if (dest.size() != src.size()) {
+    throw std::invalid_argument("parallelCopy: size mismatch");
+  }
+  if (!executor || dest.size() <= grainSize) {
+    dest.copy(src);
+    return;
+  }
+
+  if (dest.isContiguous() && src.isContiguous()) {
+    T* d = dest.data();
+    const U* s = src.data();
+    detail::parallelFor(executor, dest.size(), grainSize,
+                        [d, s] (size_t begin, size_t end) {
+      detail::convertElements(d + begin, s + begin, end - begin);
+    });
+    return;
+  }
+
+  if (dest.sizes() != src.sizes() || dest.size(0) == 1) {
+    dest.copy(src);
+    return;
+  }
+  // Each task copies a slice along the first dimension, which copy()
+  // handles as well as it can (vectorized if the rows are contiguous).
+  // The slices share dest's storage, so unshare it (if copy-on-write)
+  // before the tasks race to do so.
+  dest.prepareWrite();
+  size_t rows = dest.size(0);
+  size_t rowSize = dest.size() / rows;
+  detail::parallelFor(executor, rows, grainSize / rowSize,
+                      [&dest, &src] (size_t begin, size_t end) {
+    Tensor<T> d(dest);
+    d.narrow(0, begin, end - begin);
+    Tensor<U> s(src);
+    s.narrow(0, begin, end - begin);
+    d.copy(s);
+  });
+}
+
+}  // namespaces
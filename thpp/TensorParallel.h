@@ -0,0 +1,58 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+#ifndef THPP_TENSORPARALLEL_H_
+#define THPP_TENSORPARALLEL_H_
+
+#include <thpp/Tensor.h>
+
+#include <folly/Executor.h>
+
+namespace thpp {
+
+/**
+ * Element-wise initialization split into tasks on an executor.
+ *
+ * Besides using more than one core, this controls which threads touch the
+ * memory first, which (for storages allocated with the default allocator or
+ * with NumaAllocator::firstTouch(), see thpp/NumaAllocator.h) is what puts
+ * each page on a NUMA node: give an executor whose threads run on the
+ * node(s) that will use the tensor, and each page ends up on the node of
+ * the thread that initialized it.
+ *
+ * The tensors must be contiguous to be split (but see parallelCopy()
+ * below); anything else, or a tensor of at most grainSize elements, or a
+ * null executor, is handled on the calling thread. Each task handles about
+ * grainSize elements; tune it so that a task takes at least a few tens of
+ * microseconds.
+ */
+constexpr size_t kDefaultParallelGrainSize = 1 << 18;
+
+template <class T>
+void parallelFill(Tensor<T>& dest, T value, folly::Executor* executor,
+                  size_t grainSize = kDefaultParallelGrainSize);
+
+template <class T>
+void parallelZero(Tensor<T>& dest, folly::Executor* executor,
+                  size_t grainSize = kDefaultParallelGrainSize);
+
+// Copy (converting from U to T, as dest.copy(src)); dest and src must have
+// the same number of elements. Tensors that aren't both contiguous, but
+// have the same sizes, are split along the first dimension.
+template <class T, class U>
+void parallelCopy(Tensor<T>& dest, const Tensor<U>& src,
+                  folly::Executor* executor,
+                  size_t grainSize = kDefaultParallelGrainSize);
+
+}  // namespaces
+
+#include <thpp/TensorParallel-inl.h>
+
+#endif /* THPP_TENSORPARALLEL_H_ */
@@ -105,6 +105,11 @@ Tensor* TensorPtr<Tensor>::get() const noexcept {
   return hasTensor_ ? &tensor_ : nullptr;
 }
 
+template <class Tensor>
+auto TensorPtr<Tensor>::th() const noexcept -> THType* {
+  return hasTensor_ ? tensor_.mut() : nullptr;
+}
+
 template <class Tensor>
 auto TensorPtr<Tensor>::moveAsTH() noexcept -> THType* {
   auto p = hasTensor_ ? tensor_.mut() : nullptr;
@@ -118,5 +123,27 @@ bool TensorPtr<Tensor>::operator==(const TensorPtr& other) const noexcept {
           (!hasTensor_ || tensor_.mut() == other.tensor_.mut()));
 }
 
+template <class Tensor>
+FrozenTensorPtr<Tensor> TensorPtr<Tensor>::freeze() && {
+  if (!hasTensor_) {
+    return FrozenTensorPtr<Tensor>();
+  }
+  // Other references to the THTensor could change the metadata, and
+  // other users of the storage could change the data.
+  if (th()->refcount != 1 || !tensor_.isUnique()) {
+    auto copy = makeTensorPtr<Tensor>(tensor_, Tensor::UNIQUE);
+    destroy();
+    return FrozenTensorPtr<Tensor>(std::move(copy));
+  }
+  return FrozenTensorPtr<Tensor>(std::move(*this));
+}
+
+template <class Tensor>
+TensorPtr<Tensor> FrozenTensorPtr<Tensor>::thaw() const {
+  if (!ptr_) {
+    return TensorPtr<Tensor>();
+  }
+  return makeTensorPtr<Tensor>(*ptr_, Tensor::UNIQUE);
+}
 
 }  // namespaces
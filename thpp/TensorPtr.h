@@ -40,6 +40,8 @@ struct SetTH {};
  * [1] TensorPtr<Tensor> is very similar to std::shared_ptr<Tensor>, except
  * that TensorPtr uses Torch's TH*Tensor internal reference counting mechanism.
  */
+template <class Tensor> class FrozenTensorPtr;
+
 template <class Tensor>
 class TensorPtr {
   template <class T, class... Args>
@@ -93,6 +95,12 @@ class TensorPtr {
   // Do two TensorPtr objects point to the same tensor?
   bool operator==(const TensorPtr& other) const noexcept;
 
+  // Make the tensor immutable, so it can be shared (read-only) between
+  // threads; see FrozenTensorPtr. If anything else refers to the tensor or
+  // shares its storage, a unique copy is frozen instead. The TensorPtr is
+  // empty at the end of this operation.
+  FrozenTensorPtr<Tensor> freeze() &&;
+
  private:
   void destroy() noexcept;
   void construct(THType* th, bool incRef) noexcept;
@@ -119,6 +127,59 @@ class TensorPtr {
   }
 };
 
+/**
+ * Shared, read-only tensor, created with TensorPtr::freeze().
+ *
+ * Nothing else can modify the tensor (including its metadata): the frozen
+ * tensor doesn't share its storage or header with any mutable tensor, and
+ * FrozenTensorPtr only gives const access.
+ *
+ * Copying a FrozenTensorPtr changes a (shared) reference count, as with
+ * TensorPtr. Readers that access the same tensor from many threads should
+ * instead borrow it: get() / operator* return a reference to the tensor
+ * that doesn't change any reference count, and is valid for as long as any
+ * FrozenTensorPtr to the tensor exists. For example, keep one
+ * FrozenTensorPtr per model (or per thread) and borrow in the hot path.
+ * Reading sizes, strides, and elements (at(), data(), view<N>() from
+ * TensorView.h) from a borrowed tensor never writes to shared memory;
+ * don't create new Tensor objects from it (by copying, operator[], etc)
+ * in hot paths, as those change the storage reference count.
+ */
+template <class Tensor>
+class FrozenTensorPtr {
+  friend class TensorPtr<Tensor>;
+  explicit FrozenTensorPtr(TensorPtr<Tensor>&& ptr) noexcept
+    : ptr_(std::move(ptr)) { }
+ public:
+  typedef Tensor element_type;
+  typedef typename Tensor::THType THType;
+
+  // Create an empty FrozenTensorPtr
+  FrozenTensorPtr() noexcept { }
+
+  // Borrow
+  const Tensor& operator*() const noexcept { return *ptr_; }
+  const Tensor* operator->() const noexcept { return ptr_.get(); }
+  const Tensor* get() const noexcept { return ptr_.get(); }
+
+  // True iff non-empty
+  explicit operator bool() const noexcept { return bool(ptr_); }
+
+  // Return a new, mutable copy of the tensor, which doesn't share memory
+  // with the frozen tensor.
+  TensorPtr<Tensor> thaw() const;
+
+  bool operator==(const FrozenTensorPtr& other) const noexcept {
+    return ptr_ == other.ptr_;
+  }
+  bool operator!=(const FrozenTensorPtr& other) const noexcept {
+    return !(ptr_ == other.ptr_);
+  }
+
+ private:
+  TensorPtr<Tensor> ptr_;
+};
+
 template <class Tensor, class... Args>
 inline TensorPtr<Tensor> makeTensorPtr(Args&&... args) {
   return TensorPtr<Tensor>(
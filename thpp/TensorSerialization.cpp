@@ -9,9 +9,18 @@
  */
 
 #include <thpp/Tensor.h>
+#include <thpp/Half.h>
+#include <thpp/detail/Quantize.h>
+#include <thpp/detail/TensorIteration.h>
+
+#include <cmath>
 #ifndef NO_FOLLY
+#include <folly/Executor.h>
 #include <folly/Format.h>
+#include <folly/compression/Compression.h>
+#include <folly/hash/Checksum.h>
 #include <folly/io/Cursor.h>
+#include <thpp/detail/Parallel.h>
 #endif
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -33,9 +42,273 @@ std::unique_ptr<folly::IOBuf> partialCloneOne(const folly::IOBuf& buf,
   return cloned;
 }
 
+// Copy (and optionally byte swap) nRuns contiguous runs of runSize bytes
+// each, starting with run number firstRun (in row-major order across
+// dimensions [0, ndims)), into dest.
+void gatherRuns(uint8_t* dest,
+                const uint8_t* base,
+                LongRange sizes,
+                LongRange strides,
+                int ndims,
+                uint64_t runSize,
+                size_t elementSize,
+                bool swap,
+                uint64_t firstRun,
+                uint64_t nRuns) {
+  const ptrdiff_t esize = elementSize;
+  std::vector<uint64_t> counter(ndims);
+  const uint8_t* src = base;
+  for (int i = ndims - 1; i >= 0; --i) {
+    counter[i] = firstRun % sizes[i];
+    firstRun /= sizes[i];
+    src += counter[i] * strides[i] * esize;
+  }
+
+  for (uint64_t k = 0; k < nRuns; ++k) {
+    if (swap) {
+      byteSwap(dest, src, runSize / elementSize, elementSize);
+    } else {
+      memcpy(dest, src, runSize);
+    }
+    dest += runSize;
+
+    for (int i = ndims - 1; i >= 0; --i) {
+      src += strides[i] * esize;
+      if (++counter[i] != sizes[i]) {
+        break;
+      }
+      src -= sizes[i] * strides[i] * esize;
+      counter[i] = 0;
+    }
+  }
+}
+
+std::unique_ptr<folly::io::Codec> getCodec(
+    ThriftTensorCompression compression) {
+  switch (compression) {
+  case ThriftTensorCompression::LZ4:
+    return folly::io::getCodec(folly::io::CodecType::LZ4);
+  case ThriftTensorCompression::ZSTD:
+    return folly::io::getCodec(folly::io::CodecType::ZSTD);
+  case ThriftTensorCompression::NONE:
+    break;
+  }
+  throw std::invalid_argument(folly::sformat(
+      "Invalid Thrift tensor compression {}", int(compression)));
+}
+
+// Uncompressed size of each block; a multiple of all element sizes
+constexpr uint64_t kCompressionBlockSize = 1 << 20;
+
+// Shuffle and compress out.data in place, one block at a time.
+void compress(ThriftTensor& out,
+              size_t elementSize,
+              ThriftTensorCompression compression,
+              folly::Executor* executor) {
+  getCodec(compression);  // validate before touching out
+
+  const uint64_t len = out.data.computeChainDataLength();
+  const uint64_t blockSize = kCompressionBlockSize;
+  const size_t nBlocks = (len + blockSize - 1) / blockSize;
+
+  // Cloning is cheap, and only copies if a block straddles buffers
+  std::vector<folly::IOBuf> blocks(nBlocks);
+  folly::io::Cursor cursor(&out.data);
+  for (size_t b = 0; b < nBlocks; ++b) {
+    cursor.clone(blocks[b], std::min(blockSize, len - b * blockSize));
+  }
+
+  std::vector<std::unique_ptr<folly::IOBuf>> compressed(nBlocks);
+  runTasks(executor, nBlocks, [&] (size_t b) {
+    auto& block = blocks[b];
+    block.coalesce();
+    folly::IOBuf shuffled(folly::IOBuf::CREATE, block.length());
+    byteShuffle(shuffled.writableData(), block.data(),
+                block.length() / elementSize, elementSize);
+    shuffled.append(block.length());
+    block = folly::IOBuf();  // may free the gathered copy early
+    compressed[b] = getCodec(compression)->compress(&shuffled);
+  });
+
+  folly::IOBufQueue queue;
+  out.compressedBlockSizes.clear();
+  out.compressedBlockSizes.reserve(nBlocks);
+  for (auto& buf : compressed) {
+    out.compressedBlockSizes.push_back(buf->computeChainDataLength());
+    queue.append(std::move(buf));
+  }
+  out.compression = compression;
+  out.compressionBlockSize = blockSize;
+  if (nBlocks == 0) {
+    out.data = folly::IOBuf();
+  } else {
+    queue.move()->cloneInto(out.data);
+  }
+}
+
 }  // namespace
 
-void serialize(
+folly::IOBuf uncompressedData(const ThriftTensor& in) {
+  if (in.compression == ThriftTensorCompression::NONE) {
+    return in.data;
+  }
+  auto codec = getCodec(in.compression);
+
+  const size_t elementSize = dataTypeSize(in.dataType);
+  uint64_t len = in.sizes.empty() ? 0 : elementSize;
+  for (auto s : in.sizes) {
+    // The sizes are untrusted, don't let them wrap around
+    if (s < 0 || __builtin_mul_overflow(len, uint64_t(s), &len)) {
+      throw std::invalid_argument("Invalid tensor size");
+    }
+  }
+  const uint64_t blockSize = in.compressionBlockSize;
+  if (len != 0 && (blockSize <= 0 || blockSize % elementSize != 0)) {
+    throw std::invalid_argument(folly::sformat(
+        "Invalid compression block size {}", blockSize));
+  }
+  const size_t nBlocks = len == 0 ? 0 : (len + blockSize - 1) / blockSize;
+  if (in.compressedBlockSizes.size() != nBlocks) {
+    throw std::invalid_argument("Compressed block count doesn't match sizes");
+  }
+
+  // Decompress each block, and unshuffle it into its place in the output,
+  // checksumming it while it's in cache
+  const bool verify = (in.checksumType != ThriftTensorChecksum::NONE);
+  uint32_t crc = 0;
+  folly::IOBuf out(folly::IOBuf::CREATE, len);
+  folly::io::Cursor cursor(&in.data);
+  for (size_t b = 0; b < nBlocks; ++b) {
+    auto n = in.compressedBlockSizes[b];
+    if (n < 0 || !cursor.canAdvance(n)) {
+      throw std::invalid_argument("Compressed data is truncated");
+    }
+    folly::IOBuf block;
+    cursor.clone(block, n);
+    uint64_t blockLen = std::min(blockSize, len - b * blockSize);
+    auto uncompressed = codec->uncompress(&block, blockLen);
+    uncompressed->coalesce();
+    DCHECK_EQ(uncompressed->length(), blockLen);
+    byteUnshuffle(out.writableTail(), uncompressed->data(),
+                  blockLen / elementSize, elementSize);
+    if (verify) {
+      crc = folly::crc32c(out.writableTail(), blockLen, crc);
+    }
+    out.append(blockLen);
+  }
+  if (!cursor.isAtEnd()) {
+    throw std::invalid_argument("Compressed data doesn't match sizes");
+  }
+  if (verify) {
+    checkChecksum(in, crc);
+  }
+  return out;
+}
+
+namespace {
+
+// Quantized elements, in row-major order, form outer blocks of channels
+// slices of inner elements each; all elements in a slice share parameters.
+struct QuantizationLayout {
+  uint64_t outer;
+  uint64_t channels;
+  uint64_t inner;
+};
+
+QuantizationLayout quantizationLayout(LongRange sizes, int axis) {
+  if (axis < -1 || axis >= int(sizes.size())) {
+    throw std::invalid_argument(folly::sformat(
+        "Invalid quantization axis {}", axis));
+  }
+  // The sizes may be untrusted (when dequantizing), don't let the products
+  // wrap around, even once multiplied by sizeof(float)
+  QuantizationLayout layout{1, 1, sizes.empty() ? 0U : 1U};
+  bool overflow = false;
+  for (int i = 0; i < int(sizes.size()); ++i) {
+    if (sizes[i] < 0) {
+      throw std::invalid_argument("Invalid tensor size");
+    }
+    if (i < axis) {
+      overflow |= __builtin_mul_overflow(layout.outer, uint64_t(sizes[i]),
+                                         &layout.outer);
+    } else if (i == axis) {
+      layout.channels = sizes[i];
+    } else {
+      overflow |= __builtin_mul_overflow(layout.inner, uint64_t(sizes[i]),
+                                         &layout.inner);
+    }
+  }
+  uint64_t bytes;
+  overflow |= __builtin_mul_overflow(layout.outer, layout.channels, &bytes);
+  overflow |= __builtin_mul_overflow(bytes, layout.inner, &bytes);
+  overflow |= __builtin_mul_overflow(bytes, uint64_t(sizeof(float)), &bytes);
+  if (overflow) {
+    throw std::invalid_argument("Invalid tensor size");
+  }
+  return layout;
+}
+
+// Apply fn(offset, n, channel, stride) over all elements: n elements
+// starting at offset use the parameters of channel (stride 0), or, if
+// the quantization axis is the innermost dimension, of consecutive
+// channels starting at channel (stride 1).
+template <class F>
+void forEachQuantizationRun(const QuantizationLayout& layout, F fn) {
+  if (layout.inner == 1) {
+    for (uint64_t o = 0; o < layout.outer; ++o) {
+      fn(o * layout.channels, layout.channels, 0, 1);
+    }
+    return;
+  }
+  uint64_t offset = 0;
+  for (uint64_t o = 0; o < layout.outer; ++o) {
+    for (uint64_t c = 0; c < layout.channels; ++c) {
+      fn(offset, layout.inner, c, 0);
+      offset += layout.inner;
+    }
+  }
+}
+
+}  // namespace
+
+folly::IOBuf dequantize(const ThriftTensor& in) {
+  auto layout = quantizationLayout(
+      LongRange(in.sizes.data(), in.sizes.size()), in.quantizationAxis);
+  const uint64_t n = layout.outer * layout.channels * layout.inner;
+  if (in.scales.size() != layout.channels ||
+      in.zeroPoints.size() != layout.channels) {
+    throw std::invalid_argument(
+        "Quantization parameters don't match sizes");
+  }
+
+  folly::IOBuf data(uncompressedData(in));
+  data.coalesce();
+  if (data.length() != n) {
+    throw std::invalid_argument("Thrift tensor data doesn't match sizes");
+  }
+
+  std::vector<float> scale(layout.channels);
+  std::vector<float> offset(layout.channels);
+  for (uint64_t c = 0; c < layout.channels; ++c) {
+    scale[c] = in.scales[c];
+    offset[c] = -in.zeroPoints[c] * scale[c];
+  }
+
+  folly::IOBuf out(folly::IOBuf::CREATE, n * sizeof(float));
+  auto dest = reinterpret_cast<float*>(out.writableData());
+  forEachQuantizationRun(
+      layout,
+      [&] (uint64_t off, uint64_t len, uint64_t c, size_t stride) {
+        detail::dequantize(dest + off, data.data() + off, len,
+                           &scale[c], &offset[c], stride);
+      });
+  out.append(n * sizeof(float));
+  return out;
+}
+
+namespace {
+
+void serializeUncompressed(
     ThriftTensor& out,
     LongRange sizes,
     LongRange strides,
@@ -43,14 +316,18 @@ void serialize(
     ThriftTensorDataType dtype,
     size_t elementSize,
     ThriftTensorEndianness endianness,
-    SharingMode sharing) {
+    SharingMode sharing,
+    folly::Executor* executor,
+    uint32_t* crc) {
   DCHECK(!data.isChained());
   if (endianness == ThriftTensorEndianness::NATIVE) {
     endianness = gMachineEndianness;
   } else {
-    CHECK(endianness == gMachineEndianness)
-      << "Non-native endianness not yet implemented";
+    CHECK(endianness == ThriftTensorEndianness::LITTLE ||
+          endianness == ThriftTensorEndianness::BIG)
+      << "Invalid endianness " << int(endianness);
   }
+  const bool swap = (endianness != gMachineEndianness);
 
   int ndims = sizes.size();
   uint64_t dataSize = 1;
@@ -104,8 +381,16 @@ void serialize(
     // We're done.
     DCHECK_GE(data.length(), dataSize);
     data.trimEnd(data.length() - dataSize);
-    detail::applySharingMode(data, sharing);
-    out.data = std::move(data);
+    if (swap) {
+      // Always unshared, see byteSwapped()
+      out.data = byteSwapped(std::move(data), elementSize);
+    } else {
+      detail::applySharingMode(data, sharing);
+      out.data = std::move(data);
+    }
+    if (crc) {
+      *crc = crc32c(out.data, *crc);
+    }
     return;
   }
 
@@ -119,13 +404,7 @@ void serialize(
   // Don't allocate huge contiguous buffers.
   // jemalloc defers to mmap() for buffers of 4MiB or more.
   static constexpr uint64_t kMaxBlockSize = 2 << 20;
-  folly::io::QueueAppender appender(&outQueue,
-                                    std::min(dataSize, kMaxBlockSize));
 
-  std::vector<uint64_t> counter;
-  counter.resize(firstContiguousDim);
-  int idx = firstContiguousDim;
-  const uint8_t* src = data.data();
   bool mayShare = false;
   switch (sharing) {
   case SHARE_NONE:
@@ -137,13 +416,103 @@ void serialize(
     mayShare = true;
     break;
   };
+  // Swapped data must be copied, so we swap while gathering rather than
+  // making a second pass over the output.
+  if (swap) {
+    mayShare = false;
+  }
+
+  // A single run is a plain copy (or byte swap) of contiguous data, which
+  // the stats keep apart from strided gathers.
+  const CopyReason copyReason = dataSize != contiguousSize ?
+    CopyReason::GATHER : swap ? CopyReason::BYTE_SWAP : CopyReason::COPY;
+
+  // Cloning is cheap, only parallelize if we're going to copy.
+  if (executor && !(mayShare && contiguousSize >= kMinCloneSize)) {
+    // Split the runs into blocks of at most kMaxBlockSize bytes (but at
+    // least one run), gather each block into its own buffer on the executor,
+    // and chain the buffers in order; the output is the same as below.
+    const uint64_t nRuns = dataSize / contiguousSize;
+    const uint64_t runsPerBlock =
+      std::max(kMaxBlockSize / contiguousSize, uint64_t(1));
+    const uint64_t nBlocks = (nRuns + runsPerBlock - 1) / runsPerBlock;
+
+    std::vector<std::unique_ptr<folly::IOBuf>> blocks(nBlocks);
+    std::vector<uint32_t> blockCrcs(crc ? nBlocks : 0);
+    TaskLatch latch(nBlocks);
+    for (uint64_t b = 0; b < nBlocks; ++b) {
+      const uint64_t firstRun = b * runsPerBlock;
+      const uint64_t n = std::min(runsPerBlock, nRuns - firstRun);
+      blocks[b] = folly::IOBuf::create(n * contiguousSize);
+      executor->add([&, b, firstRun, n] {
+        latch.run([&, b, firstRun, n] {
+          auto& block = blocks[b];
+          gatherRuns(block->writableData(), data.data(), sizes, strides,
+                     firstContiguousDim, contiguousSize, elementSize, swap,
+                     firstRun, n);
+          block->append(n * contiguousSize);
+          if (crc) {
+            // While the block is still in cache
+            blockCrcs[b] = folly::crc32c(block->data(), block->length(), 0);
+          }
+        });
+      });
+    }
+    latch.wait();
+    recordCopy(copyReason, dataSize);
+    if (crc) {
+      for (uint64_t b = 0; b < nBlocks; ++b) {
+        *crc = folly::crc32c_combine(*crc, blockCrcs[b],
+                                     blocks[b]->length());
+      }
+    }
+
+    for (auto& block : blocks) {
+      outQueue.append(std::move(block));
+    }
+    outQueue.move()->cloneInto(out.data);
+    return;
+  }
+
+  folly::io::QueueAppender appender(&outQueue,
+                                    std::min(dataSize, kMaxBlockSize));
+
+  std::vector<uint64_t> counter;
+  counter.resize(firstContiguousDim);
+  int idx = firstContiguousDim;
+  const uint8_t* src = data.data();
+  // Largest number of bytes that we swap into the appender in one go
+  const uint64_t maxSwapSize = kMaxBlockSize - kMaxBlockSize % elementSize;
+  // Bytes copied rather than cloned, recorded once at the end
+  uint64_t copied = 0;
   while (idx >= 0) {
     if (idx == firstContiguousDim) {
-      if (mayShare && contiguousSize >= kMinCloneSize) {
+      if (swap) {
+        const uint8_t* p = src;
+        for (uint64_t left = contiguousSize; left != 0;) {
+          uint64_t n = std::min(left, maxSwapSize);
+          appender.ensure(n);
+          byteSwap(appender.writableData(), p, n / elementSize, elementSize);
+          if (crc) {
+            *crc = folly::crc32c(appender.writableData(), n, *crc);
+          }
+          appender.append(n);
+          p += n;
+          left -= n;
+        }
+        copied += contiguousSize;
+      } else if (mayShare && contiguousSize >= kMinCloneSize) {
         appender.insert(partialCloneOne(data, src - data.data(),
                                         contiguousSize));
+        if (crc) {
+          *crc = folly::crc32c(src, contiguousSize, *crc);
+        }
       } else {
         appender.push(src, contiguousSize);
+        copied += contiguousSize;
+        if (crc) {
+          *crc = folly::crc32c(src, contiguousSize, *crc);
+        }
       }
       --idx;
       continue;
@@ -157,15 +526,321 @@ void serialize(
       idx = firstContiguousDim;
     }
   }
+  if (copied != 0) {
+    recordCopy(copyReason, copied);
+  }
 
   outQueue.move()->cloneInto(out.data);
 }
 
+}  // namespace
+
+void serialize(
+    ThriftTensor& out,
+    LongRange sizes,
+    LongRange strides,
+    folly::IOBuf&& data,
+    ThriftTensorDataType dtype,
+    size_t elementSize,
+    ThriftTensorEndianness endianness,
+    SharingMode sharing,
+    folly::Executor* executor,
+    ThriftTensorCompression compression,
+    ThriftTensorChecksum checksum) {
+  if (compression != ThriftTensorCompression::NONE) {
+    // The gathered data is only an intermediate, no need to share
+    sharing = SHARE_NONE;
+  }
+  if (checksum != ThriftTensorChecksum::NONE &&
+      checksum != ThriftTensorChecksum::CRC32C) {
+    throw std::invalid_argument(folly::sformat(
+        "Invalid Thrift tensor checksum type {}", int(checksum)));
+  }
+  out.compression = ThriftTensorCompression::NONE;
+  out.compressionBlockSize = 0;
+  out.compressedBlockSizes.clear();
+  out.quantizationAxis = 0;
+  out.scales.clear();
+  out.zeroPoints.clear();
+  out.checksumType = checksum;
+  out.checksum = 0;
+
+  // Computed as the data is gathered, while it's in cache
+  uint32_t crc = 0;
+  const bool wantCrc = (checksum == ThriftTensorChecksum::CRC32C);
+  serializeUncompressed(out, sizes, strides, std::move(data), dtype,
+                        elementSize, endianness, sharing, executor,
+                        wantCrc ? &crc : nullptr);
+  out.checksum = crc;
+  if (compression != ThriftTensorCompression::NONE) {
+    compress(out, elementSize, compression, executor);
+  }
+}
+
+void checkDeserializeSizes(LongRange sizes, const ThriftTensor& in) {
+  if (sizes.size() != in.sizes.size() ||
+      !std::equal(sizes.begin(), sizes.end(), in.sizes.begin())) {
+    throw std::invalid_argument(
+        "deserializeInto: destination sizes don't match");
+  }
+}
+
+void scatter(void* dest,
+             LongRange sizes,
+             LongRange strides,
+             const folly::IOBuf& data,
+             size_t elementSize,
+             bool swap,
+             uint32_t* crc) {
+  DCHECK_EQ(sizes.size(), strides.size());
+  CollapsedDims<1> dims;
+  collapseDims<1>(sizes.size(), sizes.data(), {{strides.data()}}, dims);
+  uint64_t len = dims.empty ? 0 : elementSize;
+  for (int i = 0; i < dims.ndims; ++i) {
+    len *= dims.sizes[i];
+  }
+  if (data.computeChainDataLength() != len) {
+    throw std::invalid_argument("Thrift tensor data doesn't match sizes");
+  }
+
+  // Mirror image of the gather in serialize(): one pull per contiguous
+  // run, swapped in place while it's still in cache.
+  folly::io::Cursor cursor(&data);
+  auto base = static_cast<uint8_t*>(dest);
+  const ptrdiff_t esize = elementSize;
+  forEachRun(
+      dims,
+      [&] (const std::array<long, 1>& off, long n,
+           const std::array<long, 1>& st) {
+        uint8_t* p = base + off[0] * esize;
+        if (st[0] == 1) {
+          cursor.pull(p, n * esize);
+          if (crc) {
+            *crc = folly::crc32c(p, n * esize, *crc);
+          }
+          if (swap) {
+            byteSwap(p, p, n, elementSize);
+          }
+        } else {
+          for (long i = 0; i < n; ++i, p += st[0] * esize) {
+            cursor.pull(p, esize);
+            if (crc) {
+              *crc = folly::crc32c(p, esize, *crc);
+            }
+            if (swap) {
+              byteSwap(p, p, 1, elementSize);
+            }
+          }
+        }
+        return true;
+      });
+}
+
+void serializeDelta(ThriftTensorDelta& out,
+                    LongRange sizes,
+                    const void* data,
+                    const void* base,
+                    ThriftTensorDataType dtype,
+                    size_t elementSize,
+                    int64_t blockSize,
+                    ThriftTensorEndianness endianness,
+                    ThriftTensorCompression compression) {
+  if (blockSize <= 0) {
+    throw std::invalid_argument(folly::sformat(
+        "Invalid delta block size {}", blockSize));
+  }
+  uint64_t n = sizes.empty() ? 0 : 1;
+  for (auto s : sizes) {
+    n *= s;
+  }
+  const uint64_t nBlocks = (n + blockSize - 1) / blockSize;
+  const uint64_t blockBytes = blockSize * elementSize;
+  auto src = static_cast<const uint8_t*>(data);
+  auto old = static_cast<const uint8_t*>(base);
+
+  out.sizes.assign(sizes.begin(), sizes.end());
+  out.blockSize = blockSize;
+  out.changed.assign((nBlocks + 7) / 8, '\0');
+
+  // Compare, and gather the changed blocks (if any) into one buffer.
+  // memcmp is vectorized, and bails out at the first difference.
+  folly::IOBufQueue queue;
+  folly::io::QueueAppender appender(&queue, std::min<uint64_t>(
+      n * elementSize, 1 << 20));
+  uint64_t nChanged = 0;
+  for (uint64_t b = 0; b < nBlocks; ++b) {
+    const uint64_t offset = b * blockBytes;
+    const uint64_t len = std::min(blockBytes, n * elementSize - offset);
+    if (memcmp(src + offset, old + offset, len) != 0) {
+      out.changed[b / 8] |= 1 << (b % 8);
+      appender.push(src + offset, len);
+      nChanged += len / elementSize;
+    }
+  }
+
+  folly::IOBuf changed;
+  if (nChanged != 0) {
+    queue.move()->cloneInto(changed);
+    changed.coalesce();
+  }
+  int64_t changedSize = nChanged;
+  serialize(out.changedBlocks, LongRange(&changedSize, nChanged ? 1 : 0),
+            LongRange(), std::move(changed), dtype, elementSize, endianness,
+            SHARE_ALL, nullptr, compression, ThriftTensorChecksum::NONE);
+}
+
+void applyDelta(void* data,
+                LongRange sizes,
+                const ThriftTensorDelta& delta,
+                ThriftTensorDataType dtype,
+                size_t elementSize) {
+  if (sizes.size() != delta.sizes.size() ||
+      !std::equal(sizes.begin(), sizes.end(), delta.sizes.begin())) {
+    throw std::invalid_argument("applyDelta: destination sizes don't match");
+  }
+  const int64_t blockSize = delta.blockSize;
+  if (blockSize <= 0) {
+    throw std::invalid_argument(folly::sformat(
+        "Invalid delta block size {}", blockSize));
+  }
+  uint64_t n = sizes.empty() ? 0 : 1;
+  for (auto s : sizes) {
+    n *= s;
+  }
+  const uint64_t nBlocks = (n + blockSize - 1) / blockSize;
+  if (delta.changed.size() != (nBlocks + 7) / 8) {
+    throw std::invalid_argument("Delta bitmap doesn't match sizes");
+  }
+
+  auto isChanged = [&delta] (uint64_t b) {
+    return delta.changed[b / 8] & (1 << (b % 8));
+  };
+  const uint64_t blockBytes = blockSize * elementSize;
+  auto blockLength = [&] (uint64_t b) {
+    return std::min(blockBytes, n * elementSize - b * blockBytes);
+  };
+
+  // Native byte order, decompressed. Check before touching data, so a bad
+  // delta doesn't leave it half patched.
+  auto changed = deserialize(delta.changedBlocks, dtype);
+  uint64_t expected = 0;
+  for (uint64_t b = 0; b < nBlocks; ++b) {
+    if (isChanged(b)) {
+      expected += blockLength(b);
+    }
+  }
+  if (changed.computeChainDataLength() != expected) {
+    throw std::invalid_argument("Delta data doesn't match bitmap");
+  }
+
+  folly::io::Cursor cursor(&changed);
+  auto dest = static_cast<uint8_t*>(data);
+  for (uint64_t b = 0; b < nBlocks; ++b) {
+    if (isChanged(b)) {
+      cursor.pull(dest + b * blockBytes, blockLength(b));
+    }
+  }
+}
 
 template folly::IOBuf deserialize(const ThriftTensor& in,
                                   ThriftTensorDataType dtype);
 
-}}  // namespaces
+}  // namespace detail
+
+void verifyChecksum(const ThriftTensor& in) {
+  if (in.checksumType == ThriftTensorChecksum::NONE) {
+    return;
+  }
+  if (in.compression != ThriftTensorCompression::NONE) {
+    detail::uncompressedData(in);  // verifies as it decompresses
+  } else {
+    detail::checkChecksum(in, detail::crc32c(in.data));
+  }
+}
+
+void serializeAsHalf(ThriftTensor& out,
+                     const Tensor<float>& src,
+                     ThriftTensorDataType dtype,
+                     ThriftTensorEndianness endianness) {
+  if (!detail::isHalfDataType(dtype)) {
+    throw std::invalid_argument(folly::sformat(
+        "Invalid 16-bit floating point data type {}", int(dtype)));
+  }
+  Tensor<float> contig(src, Tensor<float>::CONTIGUOUS);
+  size_t n = contig.size();
+  folly::IOBuf buf(folly::IOBuf::CREATE, n * sizeof(uint16_t));
+  auto dest = reinterpret_cast<uint16_t*>(buf.writableData());
+  if (dtype == ThriftTensorDataType::HALF) {
+    floatToHalf(dest, contig.data(), n);
+  } else {
+    floatToBFloat16(dest, contig.data(), n);
+  }
+  buf.append(n * sizeof(uint16_t));
+  detail::serialize(out, contig.sizes(), LongRange(), std::move(buf), dtype,
+                    sizeof(uint16_t), endianness, SHARE_ALL, nullptr,
+                    ThriftTensorCompression::NONE, ThriftTensorChecksum::NONE);
+}
+
+void serializeQuantized(ThriftTensor& out,
+                        const Tensor<float>& src,
+                        int axis,
+                        ThriftTensorCompression compression) {
+  Tensor<float> contig(src, Tensor<float>::CONTIGUOUS);
+  auto layout = detail::quantizationLayout(contig.sizes(), axis);
+  const float* data = contig.data();
+
+  // Range of each slice, always including 0
+  std::vector<float> lo(layout.channels, 0);
+  std::vector<float> hi(layout.channels, 0);
+  detail::forEachQuantizationRun(
+      layout,
+      [&] (uint64_t off, uint64_t len, uint64_t c, size_t stride) {
+        for (uint64_t i = 0; i < len; ++i) {
+          float x = data[off + i];
+          if (!std::isfinite(x)) {
+            throw std::invalid_argument(
+                "serializeQuantized: tensor has non-finite values");
+          }
+          uint64_t k = c + i * stride;
+          lo[k] = std::min(lo[k], x);
+          hi[k] = std::max(hi[k], x);
+        }
+      });
+
+  std::vector<float> scale(layout.channels);
+  std::vector<float> invScale(layout.channels);
+  std::vector<float> zeroPoint(layout.channels);
+  for (uint64_t c = 0; c < layout.channels; ++c) {
+    scale[c] = (hi[c] - lo[c]) / 255;
+    if (scale[c] == 0) {
+      scale[c] = 1;  // all zeros
+    }
+    invScale[c] = 1 / scale[c];
+    zeroPoint[c] = std::min(std::max(std::nearbyint(-lo[c] / scale[c]),
+                                     0.0f), 255.0f);
+  }
+
+  const uint64_t n = layout.outer * layout.channels * layout.inner;
+  folly::IOBuf buf(folly::IOBuf::CREATE, n);
+  uint8_t* dest = buf.writableData();
+  detail::forEachQuantizationRun(
+      layout,
+      [&] (uint64_t off, uint64_t len, uint64_t c, size_t stride) {
+        detail::quantize(dest + off, data + off, len, &invScale[c],
+                         &zeroPoint[c], stride);
+      });
+  buf.append(n);
+
+  detail::serialize(out, contig.sizes(), LongRange(), std::move(buf),
+                    ThriftTensorDataType::QUINT8, 1,
+                    ThriftTensorEndianness::NATIVE, SHARE_ALL, nullptr,
+                    compression, ThriftTensorChecksum::NONE);
+  out.quantizationAxis = axis;
+  out.scales.assign(scale.begin(), scale.end());
+  out.zeroPoints.assign(zeroPoint.begin(), zeroPoint.end());
+}
+
+}  // namespaces
 
 ////////////////////////////////////////////////////////////////////////////////
 #endif // !NO_THRIFT && !NO_FOLLY
@@ -0,0 +1,64 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+#ifndef THPP_TENSORSTREAM_H_
+#error This file may only be included from thpp/TensorStream.h
+#endif
+
+namespace thpp {
+
+template <class T>
+void serializeStreaming(ThriftTensor& header,
+                        const Tensor<T>& src,
+                        const TensorChunkSink& sink,
+                        ThriftTensorEndianness endianness,
+                        size_t chunkSize) {
+  detail::serializeStreaming(header, src.sizes(), src.strides(), src.data(),
+                             detail::dataType<T>(), sizeof(T), endianness,
+                             sink, chunkSize);
+}
+
+template <class T>
+TensorStreamReader<T>::TensorStreamReader(Tensor<T>& dest,
+                                          const ThriftTensor& header) {
+  if (header.dataType != detail::dataType<T>()) {
+    throw std::invalid_argument(folly::sformat(
+        "Invalid Thrift tensor data type {}, expected {}",
+        int(header.dataType), int(detail::dataType<T>())));
+  }
+  if (header.endianness != ThriftTensorEndianness::LITTLE &&
+      header.endianness != ThriftTensorEndianness::BIG) {
+    throw std::invalid_argument(folly::sformat(
+        "Invalid Thrift tensor endianness {}", int(header.endianness)));
+  }
+  if (header.compression != ThriftTensorCompression::NONE) {
+    throw std::invalid_argument("Streamed tensors can't be compressed");
+  }
+
+  LongRange sizes(header.sizes.data(), header.sizes.size());
+  if (!dest.isContiguous()) {
+    dest = Tensor<T>(sizes);
+  } else {
+    dest.resize(sizes);
+  }
+  filler_.reset(new detail::StreamFiller(
+      dest.data(), sizes.empty() ? 0 : dest.size() * sizeof(T), sizeof(T),
+      header.endianness != detail::gMachineEndianness));
+}
+
+template <class T>
+void TensorStreamReader<T>::finish() const {
+  if (!done()) {
+    throw std::invalid_argument(folly::sformat(
+        "Tensor stream ended {} bytes early", remaining()));
+  }
+}
+
+}  // namespaces
@@ -0,0 +1,177 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+#include <thpp/TensorStream.h>
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+////////////////////////////////////////////////////////////////////////////////
+#if !defined(NO_THRIFT) && !defined(NO_FOLLY)
+////////////////////////////////////////////////////////////////////////////////
+
+namespace thpp {
+namespace detail {
+
+void serializeStreaming(ThriftTensor& header,
+                        LongRange sizes,
+                        LongRange strides,
+                        const void* data,
+                        ThriftTensorDataType dtype,
+                        size_t elementSize,
+                        ThriftTensorEndianness endianness,
+                        const TensorChunkSink& sink,
+                        size_t chunkSize) {
+  if (endianness == ThriftTensorEndianness::NATIVE) {
+    endianness = gMachineEndianness;
+  } else {
+    CHECK(endianness == ThriftTensorEndianness::LITTLE ||
+          endianness == ThriftTensorEndianness::BIG)
+      << "Invalid endianness " << int(endianness);
+  }
+  const bool swap = (endianness != gMachineEndianness);
+
+  header = ThriftTensor();
+  header.dataType = dtype;
+  header.endianness = endianness;
+  header.sizes.assign(sizes.begin(), sizes.end());
+
+  const int ndims = sizes.size();
+  uint64_t total = ndims == 0 ? 0 : elementSize;
+  for (auto s : sizes) {
+    total *= s;
+  }
+  if (total == 0) {
+    return;
+  }
+
+  // Dimensions [firstContiguousDim, ndims) form contiguous runs of runSize
+  // bytes each.
+  int firstContiguousDim = ndims;
+  uint64_t runSize = elementSize;
+  while (firstContiguousDim > 0 &&
+         (sizes[firstContiguousDim - 1] == 1 ||
+          strides[firstContiguousDim - 1] * elementSize == runSize)) {
+    --firstContiguousDim;
+    runSize *= sizes[firstContiguousDim];
+  }
+
+  // Whole elements only, so that swapping never straddles chunks
+  chunkSize = std::max(chunkSize - chunkSize % elementSize, elementSize);
+
+  // Fill chunks up to the capacity asked for, not their tailroom, which may
+  // be rounded up to a size that's neither a whole number of elements nor
+  // within chunkSize
+  uint64_t left = total;
+  uint64_t capacity;
+  auto newChunk = [&] {
+    capacity = std::min(uint64_t(chunkSize), left);
+    return folly::IOBuf::create(capacity);
+  };
+  auto chunk = newChunk();
+
+  std::vector<long> counter(firstContiguousDim);
+  const uint8_t* src = static_cast<const uint8_t*>(data);
+  const ptrdiff_t esize = elementSize;
+  for (;;) {
+    // Copy one run, emitting chunks as they fill up
+    const uint8_t* p = src;
+    for (uint64_t runLeft = runSize; runLeft != 0;) {
+      uint64_t n = std::min(runLeft, capacity - chunk->length());
+      if (swap) {
+        byteSwap(chunk->writableTail(), p, n / elementSize, elementSize);
+      } else {
+        memcpy(chunk->writableTail(), p, n);
+      }
+      chunk->append(n);
+      p += n;
+      runLeft -= n;
+      left -= n;
+      if (chunk->length() == capacity || left == 0) {
+        sink(std::move(chunk));
+        if (left == 0) {
+          return;
+        }
+        chunk = newChunk();
+      }
+    }
+
+    // Next run
+    int i = firstContiguousDim - 1;
+    for (; i >= 0; --i) {
+      src += strides[i] * esize;
+      if (++counter[i] != sizes[i]) {
+        break;
+      }
+      src -= sizes[i] * strides[i] * esize;
+      counter[i] = 0;
+    }
+    DCHECK_GE(i, 0);  // or we'd have returned above
+  }
+}
+
+StreamFiller::StreamFiller(void* dest, size_t length, size_t elementSize,
+                           bool swap)
+  : dest_(static_cast<uint8_t*>(dest)),
+    length_(length),
+    pos_(0),
+    elementSize_(elementSize),
+    swap_(swap && elementSize != 1),
+    carryLength_(0) {
+  DCHECK_LE(elementSize, sizeof(carry_));
+}
+
+void StreamFiller::append(const folly::IOBuf& chunk) {
+  for (auto range : chunk) {
+    appendBytes(range.data(), range.size());
+  }
+}
+
+void StreamFiller::appendBytes(const uint8_t* src, size_t n) {
+  if (n > remaining()) {
+    throw std::invalid_argument("Tensor stream has more data than expected");
+  }
+  if (!swap_) {
+    memcpy(dest_ + pos_, src, n);
+    pos_ += n;
+    return;
+  }
+
+  // Complete the element that straddled the previous chunk, if any
+  if (carryLength_ != 0) {
+    size_t k = std::min(n, elementSize_ - carryLength_);
+    memcpy(carry_ + carryLength_, src, k);
+    carryLength_ += k;
+    src += k;
+    n -= k;
+    if (carryLength_ != elementSize_) {
+      return;
+    }
+    byteSwap(dest_ + pos_, carry_, 1, elementSize_);
+    pos_ += elementSize_;
+    carryLength_ = 0;
+  }
+
+  size_t count = n / elementSize_;
+  byteSwap(dest_ + pos_, src, count, elementSize_);
+  pos_ += count * elementSize_;
+  n -= count * elementSize_;
+  if (n != 0) {
+    memcpy(carry_, src + count * elementSize_, n);
+    carryLength_ = n;
+  }
+}
+
+}}  // namespaces
+
+////////////////////////////////////////////////////////////////////////////////
+#endif // !NO_THRIFT && !NO_FOLLY
+////////////////////////////////////////////////////////////////////////////////
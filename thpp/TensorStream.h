@@ -0,0 +1,125 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+#ifndef THPP_TENSORSTREAM_H_
+#define THPP_TENSORSTREAM_H_
+
+#if !defined(NO_THRIFT) && !defined(NO_FOLLY)
+
+#include <functional>
+#include <memory>
+
+#include <folly/io/IOBuf.h>
+#include <thpp/Tensor.h>
+
+namespace thpp {
+
+/**
+ * Streaming serialization, for tensors too large to hold a second copy
+ * of in memory.
+ *
+ * serializeStreaming fills in the metadata of header (everything except
+ * data, which is left empty), and passes the data to sink, in row-major
+ * order, in chunks of at most chunkSize bytes. The next chunk isn't
+ * gathered until sink returns, so a sink that blocks until the previous
+ * chunk has been written (to a socket, file, ...) applies backpressure, and
+ * memory use is bounded by the chunk size and what the sink holds on to.
+ * The same bytes would be in data if the tensor had been serialized with
+ * Tensor::serialize.
+ *
+ *   ThriftTensor header;
+ *   serializeStreaming(header, tensor, [&] (std::unique_ptr<IOBuf> chunk) {
+ *     writeFully(fd, *chunk);
+ *   });
+ *
+ * On the receiving side, TensorStreamReader fills a tensor as data
+ * arrives, in chunks of any size:
+ *
+ *   TensorStreamReader<float> reader(tensor, header);
+ *   while (!reader.done()) {
+ *     reader.append(*readSome(fd));
+ *   }
+ */
+typedef std::function<void(std::unique_ptr<folly::IOBuf>)> TensorChunkSink;
+
+constexpr size_t kDefaultTensorChunkSize = 2 << 20;
+
+template <class T>
+void serializeStreaming(ThriftTensor& header,
+                        const Tensor<T>& src,
+                        const TensorChunkSink& sink,
+                        ThriftTensorEndianness endianness =
+                           ThriftTensorEndianness::NATIVE,
+                        size_t chunkSize = kDefaultTensorChunkSize);
+
+namespace detail {
+
+void serializeStreaming(ThriftTensor& header,
+                        LongRange sizes,
+                        LongRange strides,
+                        const void* data,
+                        ThriftTensorDataType dtype,
+                        size_t elementSize,
+                        ThriftTensorEndianness endianness,
+                        const TensorChunkSink& sink,
+                        size_t chunkSize);
+
+// Copies a stream of bytes into a fixed-size buffer, optionally reversing
+// the byte order of each element (which may straddle chunks).
+class StreamFiller {
+ public:
+  StreamFiller(void* dest, size_t length, size_t elementSize, bool swap);
+
+  void append(const folly::IOBuf& chunk);
+  size_t remaining() const { return length_ - pos_ - carryLength_; }
+
+ private:
+  void appendBytes(const uint8_t* src, size_t n);
+
+  uint8_t* dest_;
+  size_t length_;
+  size_t pos_;
+  size_t elementSize_;
+  bool swap_;
+  uint8_t carry_[8];
+  size_t carryLength_;
+};
+
+}  // namespace detail
+
+template <class T>
+class TensorStreamReader {
+ public:
+  // Check header, and resize dest to header.sizes (reusing its memory if
+  // it is contiguous and large enough). dest must outlive the reader.
+  TensorStreamReader(Tensor<T>& dest, const ThriftTensor& header);
+
+  // Append the next bytes of data. Throws if there are more bytes than
+  // the tensor holds.
+  void append(const folly::IOBuf& chunk) { filler_->append(chunk); }
+
+  // Number of bytes still expected
+  size_t remaining() const { return filler_->remaining(); }
+  bool done() const { return remaining() == 0; }
+
+  // Throw if not done
+  void finish() const;
+
+ private:
+  std::unique_ptr<detail::StreamFiller> filler_;
+};
+
+}  // namespaces
+
+#include <thpp/TensorStream-inl.h>
+
+#endif  // !NO_THRIFT && !NO_FOLLY
+
+#endif /* THPP_TENSORSTREAM_H_ */
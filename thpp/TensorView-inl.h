@@ -0,0 +1,171 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+#ifndef THPP_TENSORVIEW_H_
+#error This file may only be included from thpp/TensorView.h
+#endif
+
+namespace thpp {
+
+namespace detail {
+
+template <class T, int N>
+struct TensorViewSlice {
+  typedef TensorView<T, N - 1> type;
+
+  static type get(const TensorView<T, N>& v, long i) {
+    DCHECK(i >= 0 && i < v.size(0));
+    std::array<long, N - 1> sizes;
+    std::array<long, N - 1> strides;
+    for (int k = 1; k < N; ++k) {
+      sizes[k - 1] = v.size(k);
+      strides[k - 1] = v.stride(k);
+    }
+    return type(v.data() + i * v.stride(0), sizes, strides);
+  }
+};
+
+template <class T>
+struct TensorViewSlice<T, 1> {
+  typedef T& type;
+
+  static type get(const TensorView<T, 1>& v, long i) {
+    DCHECK(i >= 0 && i < v.size(0));
+    return v.data()[i * v.stride(0)];
+  }
+};
+
+}  // namespace detail
+
+template <class T, int N>
+constexpr int TensorView<T, N>::kNumDims;
+
+template <class T, int N>
+auto TensorView<T, N>::size() const -> size_type {
+  size_type n = 1;
+  for (int k = 0; k < N; ++k) {
+    n *= sizes_[k];
+  }
+  return n;
+}
+
+template <class T, int N>
+bool TensorView<T, N>::isContiguous() const {
+  offset_type expected = 1;
+  for (int k = N - 1; k >= 0; --k) {
+    if (sizes_[k] != 1 && strides_[k] != expected) {
+      return false;
+    }
+    expected *= sizes_[k];
+  }
+  return true;
+}
+
+template <class T, int N>
+auto TensorView<T, N>::offsetOf(const offset_type (&indices)[N]) const
+  -> offset_type {
+  offset_type offset = 0;
+  for (int k = 0; k < N; ++k) {
+    offset += indices[k] * strides_[k];
+  }
+  return offset;
+}
+
+template <class T, int N>
+template <class... Indices>
+T& TensorView<T, N>::operator()(Indices... indices) const {
+  static_assert(sizeof...(Indices) == N, "must provide ndims() indices");
+  const offset_type idx[N] = {offset_type(indices)...};
+#ifndef NDEBUG
+  for (int k = 0; k < N; ++k) {
+    DCHECK(idx[k] >= 0 && idx[k] < sizes_[k]);
+  }
+#endif
+  return data_[offsetOf(idx)];
+}
+
+template <class T, int N>
+template <class... Indices>
+T& TensorView<T, N>::at(Indices... indices) const {
+  static_assert(sizeof...(Indices) == N, "must provide ndims() indices");
+  const offset_type idx[N] = {offset_type(indices)...};
+  for (int k = 0; k < N; ++k) {
+    if (idx[k] < 0 || idx[k] >= sizes_[k]) {
+      throw std::invalid_argument("index out of range");
+    }
+  }
+  return data_[offsetOf(idx)];
+}
+
+template <class T, int N>
+TensorView<T, N - 1> TensorView<T, N>::select(int dim, size_type index) const {
+  static_assert(N > 1, "cannot select from a one-dimensional view");
+  if (dim < 0 || dim >= N) {
+    throw std::invalid_argument("invalid dimension");
+  }
+  if (index < 0 || index >= sizes_[dim]) {
+    throw std::invalid_argument("index out of range");
+  }
+  std::array<size_type, N - 1> sizes;
+  std::array<offset_type, N - 1> strides;
+  for (int k = 0, j = 0; k < N; ++k) {
+    if (k != dim) {
+      sizes[j] = sizes_[k];
+      strides[j] = strides_[k];
+      ++j;
+    }
+  }
+  return TensorView<T, N - 1>(data_ + index * strides_[dim], sizes, strides);
+}
+
+template <class T, int N>
+TensorView<T, N> TensorView<T, N>::narrow(int dim, size_type first,
+                                          size_type size) const {
+  if (dim < 0 || dim >= N) {
+    throw std::invalid_argument("invalid dimension");
+  }
+  if (first < 0 || size < 0 || first + size > sizes_[dim]) {
+    throw std::invalid_argument("index out of range");
+  }
+  TensorView result(*this);
+  result.data_ += first * strides_[dim];
+  result.sizes_[dim] = size;
+  return result;
+}
+
+namespace detail {
+
+template <int N, class T, class Tens>
+TensorView<T, N> makeView(T* data, const Tens& tensor) {
+  if (tensor.ndims() != N) {
+    throw std::invalid_argument("view: dimension mismatch");
+  }
+  std::array<long, N> sizes;
+  std::array<long, N> strides;
+  for (int k = 0; k < N; ++k) {
+    sizes[k] = tensor.size(k);
+    strides[k] = tensor.stride(k);
+  }
+  return TensorView<T, N>(data, sizes, strides);
+}
+
+}  // namespace detail
+
+template <int N, class T>
+TensorView<T, N> view(Tensor<T>& tensor) {
+  return detail::makeView<N>(tensor.data(), tensor);
+}
+
+template <int N, class T>
+TensorView<const T, N> view(const Tensor<T>& tensor) {
+  return detail::makeView<N>(tensor.data(), tensor);
+}
+
+}  // namespaces
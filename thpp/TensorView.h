@@ -0,0 +1,121 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+#ifndef THPP_TENSORVIEW_H_
+#define THPP_TENSORVIEW_H_
+
+#include <array>
+#include <type_traits>
+
+#include <thpp/Tensor.h>
+
+namespace thpp {
+
+template <class T, int N> class TensorView;
+
+namespace detail {
+template <class T, int N> struct TensorViewSlice;
+}  // namespace detail
+
+/**
+ * Non-owning view of a tensor with rank N known at compile time, for fast
+ * element access in inner loops.
+ *
+ * The data pointer, sizes, and strides are copied out of the tensor when
+ * the view is created, so indexing doesn't go through the THTensor header,
+ * and the offset computation is fully unrolled. The view doesn't keep the
+ * tensor alive, and doesn't see later changes to the tensor's shape (but
+ * does see changes to its data); it must not outlive the tensor's storage.
+ *
+ *   auto v = view<2>(tensor);  // TensorView<float, 2>
+ *   for (long i = 0; i < v.size(0); ++i) {
+ *     auto row = v[i];  // TensorView<float, 1>
+ *     for (long j = 0; j < row.size(0); ++j) {
+ *       row[j] += v(i, 0);
+ *     }
+ *   }
+ *
+ * Use a const tensor (or TensorView<const T, N>) for a read-only view.
+ */
+template <class T, int N>
+class TensorView {
+  static_assert(N >= 1, "TensorView must have at least one dimension");
+ public:
+  typedef typename std::remove_const<T>::type value_type;
+  typedef long size_type;
+  typedef long offset_type;
+  static constexpr int kNumDims = N;
+
+  TensorView(T* data,
+             const std::array<size_type, N>& sizes,
+             const std::array<offset_type, N>& strides)
+    : data_(data), sizes_(sizes), strides_(strides) { }
+
+  // Conversion from TensorView<U, N>, e.g. to TensorView<const U, N>
+  template <class U, class = typename std::enable_if<
+      std::is_convertible<U*, T*>::value>::type>
+  /* implicit */ TensorView(const TensorView<U, N>& other)
+    : data_(other.data()), sizes_(other.sizes()), strides_(other.strides()) { }
+
+  static constexpr int ndims() { return N; }
+  size_type size(int dim) const { return sizes_[dim]; }
+  offset_type stride(int dim) const { return strides_[dim]; }
+  const std::array<size_type, N>& sizes() const { return sizes_; }
+  const std::array<offset_type, N>& strides() const { return strides_; }
+  T* data() const { return data_; }
+
+  // Number of elements
+  size_type size() const;
+
+  bool isContiguous() const;
+
+  // Element access, without bounds checking (except in debug mode).
+  template <class... Indices>
+  T& operator()(Indices... indices) const;
+
+  // Element access, with bounds checking; throws std::invalid_argument if
+  // any index is out of range.
+  template <class... Indices>
+  T& at(Indices... indices) const;
+
+  // Select along the first dimension: TensorView<T, N-1> for N > 1, or a
+  // reference to the element for N == 1. Not bounds checked (except in
+  // debug mode).
+  typename detail::TensorViewSlice<T, N>::type operator[](size_type i) const {
+    return detail::TensorViewSlice<T, N>::get(*this, i);
+  }
+
+  // Select the given index along dimension dim; bounds checked.
+  TensorView<T, N - 1> select(int dim, size_type index) const;
+
+  // Restrict dimension dim to [first, first + size); bounds checked.
+  TensorView narrow(int dim, size_type first, size_type size) const;
+
+ private:
+  offset_type offsetOf(const offset_type (&indices)[N]) const;
+
+  T* data_;
+  std::array<size_type, N> sizes_;
+  std::array<offset_type, N> strides_;
+};
+
+// Create a view of a tensor, which must have exactly N dimensions
+// (std::invalid_argument otherwise).
+template <int N, class T>
+TensorView<T, N> view(Tensor<T>& tensor);
+
+template <int N, class T>
+TensorView<const T, N> view(const Tensor<T>& tensor);
+
+}  // namespaces
+
+#include <thpp/TensorView-inl.h>
+
+#endif /* THPP_TENSORVIEW_H_ */
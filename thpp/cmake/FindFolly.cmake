@@ -10,6 +10,7 @@
 # FOLLY_FOUND
 # FOLLY_INCLUDE_DIR
 # FOLLY_LIBRARIES
+# FOLLY_BENCHMARK_LIBRARY (if found)
 
 CMAKE_MINIMUM_REQUIRED(VERSION 2.8.7 FATAL_ERROR)
 
@@ -20,5 +21,7 @@ FIND_PATH(FOLLY_INCLUDE_DIR "folly/String.h")
 
 SET(FOLLY_LIBRARIES ${FOLLY_LIBRARY})
 
+FIND_LIBRARY(FOLLY_BENCHMARK_LIBRARY follybenchmark)
+
 FIND_PACKAGE_HANDLE_STANDARD_ARGS(Folly
   REQUIRED_ARGS FOLLY_INCLUDE_DIR FOLLY_LIBRARIES)
@@ -0,0 +1,241 @@
+/*
+ * Copyright 2016 Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <thpp/cuda/CachingAllocator.h>
+
+#include <algorithm>
+
+namespace thpp {
+
+namespace {
+
+constexpr size_t kSmallRound = 512;
+constexpr size_t kLargeRound = 1 << 20;
+
+size_t roundSize(size_t size) {
+  size_t round = size < kLargeRound ? kSmallRound : kLargeRound;
+  return (size + round - 1) / round * round;
+}
+
+// Largest cached block that we're willing to hand out for a request of
+// the given (rounded) size
+size_t maxReuseSize(size_t size) {
+  return size < kLargeRound ? 2 * size : size + (size >> 3);
+}
+
+}  // namespace
+
+CudaCachingAllocator::CudaCachingAllocator() { }
+
+CudaCachingAllocator::~CudaCachingAllocator() {
+  trim();
+}
+
+void* CudaCachingAllocator::findFree(int device, cudaStream_t stream,
+                                     size_t size) {
+  auto pos = free_.find(FreeListKey(device, stream));
+  if (pos == free_.end()) {
+    return nullptr;
+  }
+  auto& list = pos->second;
+  auto it = list.lower_bound(size);
+  if (it == list.end() || it->first > maxReuseSize(size)) {
+    return nullptr;
+  }
+  void* ptr = it->second;
+  stats_.cachedBytes -= it->first;
+  stats_.allocatedBytes += it->first;
+  list.erase(it);
+  return ptr;
+}
+
+void CudaCachingAllocator::processPending() {
+  auto keep = pending_.begin();
+  for (auto ptr : pending_) {
+    auto& block = blocks_.at(ptr);
+    auto& events = block.pendingEvents;
+    while (!events.empty() &&
+           cudaEventQuery(events.back()) != cudaErrorNotReady) {
+      cudaEventDestroy(events.back());
+      events.pop_back();
+    }
+    if (events.empty()) {
+      free_[FreeListKey(block.device, block.stream)].emplace(block.size, ptr);
+    } else {
+      *keep++ = ptr;
+    }
+  }
+  pending_.erase(keep, pending_.end());
+}
+
+void CudaCachingAllocator::freeCached() {
+  for (auto& p : free_) {
+    for (auto& q : p.second) {
+      cudaFree(q.second);
+      detail::recordFree(MemoryKind::CUDA_CACHING, p.first.first, q.first);
+      stats_.cachedBytes -= q.first;
+      blocks_.erase(q.second);
+    }
+  }
+  free_.clear();
+}
+
+cudaError_t CudaCachingAllocator::malloc(void* /*ctx*/, void** ptr,
+                                         size_t size, cudaStream_t stream) {
+  if (size == 0) {
+    *ptr = nullptr;
+    return cudaSuccess;
+  }
+  int device;
+  auto err = cudaGetDevice(&device);
+  if (err != cudaSuccess) {
+    return err;
+  }
+  size = roundSize(size);
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    processPending();
+    if (auto p = findFree(device, stream, size)) {
+      ++stats_.hits;
+      *ptr = p;
+      return cudaSuccess;
+    }
+  }
+
+  void* p;
+  err = cudaMalloc(&p, size);
+  if (err == cudaErrorMemoryAllocation) {
+    // Give the cache back and try again
+    cudaGetLastError();
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      freeCached();
+    }
+    err = cudaMalloc(&p, size);
+  }
+  if (err != cudaSuccess) {
+    return err;
+  }
+
+  detail::recordAlloc(MemoryKind::CUDA_CACHING, device, size);
+  std::lock_guard<std::mutex> lock(mutex_);
+  blocks_.emplace(p, Block{p, size, device, stream, {}, {}});
+  ++stats_.misses;
+  stats_.allocatedBytes += size;
+  *ptr = p;
+  return cudaSuccess;
+}
+
+cudaError_t CudaCachingAllocator::realloc(void* ctx, void** ptr,
+                                          size_t oldSize, size_t newSize,
+                                          cudaStream_t stream) {
+  void* newPtr;
+  auto err = malloc(ctx, &newPtr, newSize, stream);
+  if (err != cudaSuccess) {
+    return err;
+  }
+  if (*ptr) {
+    err = cudaMemcpyAsync(newPtr, *ptr, std::min(oldSize, newSize),
+                          cudaMemcpyDeviceToDevice, stream);
+    if (err != cudaSuccess) {
+      free(ctx, newPtr);
+      return err;
+    }
+    // The copy reads the old block on stream
+    recordStream(*ptr, stream);
+    free(ctx, *ptr);
+  }
+  *ptr = newPtr;
+  return cudaSuccess;
+}
+
+cudaError_t CudaCachingAllocator::free(void* /*ctx*/, void* ptr) {
+  if (!ptr) {
+    return cudaSuccess;
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto pos = blocks_.find(ptr);
+  CHECK(pos != blocks_.end()) << "Invalid pointer " << ptr;
+  auto& block = pos->second;
+  stats_.allocatedBytes -= block.size;
+  stats_.cachedBytes += block.size;
+
+  if (block.otherStreams.empty()) {
+    free_[FreeListKey(block.device, block.stream)].emplace(block.size, ptr);
+    return cudaSuccess;
+  }
+
+  // Events must be recorded on the block's device
+  int prevDevice = block.device;
+  auto err = cudaGetDevice(&prevDevice);
+  if (err == cudaSuccess && prevDevice != block.device) {
+    err = cudaSetDevice(block.device);
+  }
+  for (auto stream : block.otherStreams) {
+    if (err != cudaSuccess) {
+      break;
+    }
+    cudaEvent_t event;
+    err = cudaEventCreateWithFlags(&event, cudaEventDisableTiming);
+    if (err == cudaSuccess) {
+      block.pendingEvents.push_back(event);
+      err = cudaEventRecord(event, stream);
+    }
+  }
+  block.otherStreams.clear();
+  pending_.push_back(ptr);
+  if (prevDevice != block.device) {
+    cudaSetDevice(prevDevice);
+  }
+  return err;
+}
+
+void CudaCachingAllocator::recordStream(void* ptr, cudaStream_t stream) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto pos = blocks_.find(ptr);
+  CHECK(pos != blocks_.end()) << "Invalid pointer " << ptr;
+  auto& block = pos->second;
+  if (stream != block.stream &&
+      std::find(block.otherStreams.begin(), block.otherStreams.end(),
+                stream) == block.otherStreams.end()) {
+    block.otherStreams.push_back(stream);
+  }
+}
+
+void CudaCachingAllocator::trim() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (auto ptr : pending_) {
+    for (auto event : blocks_.at(ptr).pendingEvents) {
+      cudaEventSynchronize(event);
+    }
+  }
+  processPending();
+  freeCached();
+}
+
+auto CudaCachingAllocator::stats() const -> Stats {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return stats_;
+}
+
+CudaCachingAllocator& CudaCachingAllocator::defaultInstance() {
+  // Leaked on purpose; memory may be freed during static destruction.
+  static auto instance = new CudaCachingAllocator();
+  return *instance;
+}
+
+}  // namespaces
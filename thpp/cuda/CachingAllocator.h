@@ -0,0 +1,102 @@
+/*
+ * Copyright 2016 Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <map>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <folly/io/IOBuf.h>
+#include <thpp/cuda/Storage.h>
+
+namespace thpp {
+
+// Device memory allocator that caches freed blocks instead of returning
+// them to cudaFree (which, like cudaMalloc, synchronizes the device).
+//
+// Free blocks are binned by device, stream, and (rounded) size. A block is
+// only reused for allocations on the stream it was last allocated on, so
+// reuse is ordered after all earlier work on that stream without any
+// synchronization. If a block is also used on other streams, call
+// recordStream(); the block then only becomes reusable once the work
+// enqueued on those streams (at the time of free) has completed.
+//
+// Use with CudaStorage through THCAllocatorWrapper:
+//
+//   CudaStorage<float>::withAllocator(allocator.thcAllocator(), &allocator)
+//
+// or with createCudaIOBuf(capacity, allocator). The allocator must outlive
+// all memory allocated from it.
+class CudaCachingAllocator {
+ public:
+  CudaCachingAllocator();
+
+  // Frees all cached blocks. Blocks that are still allocated are leaked.
+  ~CudaCachingAllocator();
+
+  // THCDeviceAllocator interface (see THCAllocatorWrapper)
+  cudaError_t malloc(void* ctx, void** ptr, size_t size, cudaStream_t stream);
+  cudaError_t realloc(void* ctx, void** ptr, size_t oldSize, size_t newSize,
+                      cudaStream_t stream);
+  cudaError_t free(void* ctx, void* ptr);
+
+  // Note that the block containing ptr is used on stream, besides the stream
+  // it was allocated on.
+  void recordStream(void* ptr, cudaStream_t stream);
+
+  // Release all cached (free) blocks on all devices with cudaFree.
+  void trim();
+
+  struct Stats {
+    size_t allocatedBytes = 0;  // in use
+    size_t cachedBytes = 0;     // free, cached
+    uint64_t hits = 0;          // allocations served from the cache
+    uint64_t misses = 0;        // allocations that called cudaMalloc
+  };
+  Stats stats() const;
+
+  THCDeviceAllocator* thcAllocator() {
+    return &THCAllocatorWrapper<CudaCachingAllocator>::thcAllocator;
+  }
+
+  static CudaCachingAllocator& defaultInstance();
+
+ private:
+  struct Block {
+    void* ptr;
+    size_t size;
+    int device;
+    cudaStream_t stream;
+    std::vector<cudaStream_t> otherStreams;
+    std::vector<cudaEvent_t> pendingEvents;
+  };
+  typedef std::pair<int, cudaStream_t> FreeListKey;
+
+  void* findFree(int device, cudaStream_t stream, size_t size);
+  void processPending();
+  void freeCached();
+
+  mutable std::mutex mutex_;
+  std::unordered_map<void*, Block> blocks_;  // all blocks we own
+  std::map<FreeListKey, std::multimap<size_t, void*>> free_;
+  std::vector<void*> pending_;  // freed, waiting for events
+  Stats stats_;
+};
+
+}  // namespaces
@@ -15,14 +15,32 @@
  */
 
 #include <thpp/cuda/CudaIOBuf.h>
+
+#include <memory>
+
+#include <thpp/MemoryStats.h>
+#include <thpp/cuda/CachingAllocator.h>
 #include <thpp/cuda/State.h>
 
 namespace thpp {
 
 namespace {
 
-void freeCudaIOBuf(void* ptr, void* /*userData*/) {
+// Passed to the free function, for MemoryStats
+struct CudaIOBufInfo {
+  uint64_t capacity;
+  int device;
+};
+
+void freeCudaIOBuf(void* ptr, void* userData) {
+  std::unique_ptr<CudaIOBufInfo> info(static_cast<CudaIOBufInfo*>(userData));
   cuda::check(cudaFree(ptr));
+  detail::recordFree(MemoryKind::CUDA_IOBUF, info->device, info->capacity);
+}
+
+void freeCachedCudaIOBuf(void* ptr, void* userData) {
+  cuda::check(static_cast<CudaCachingAllocator*>(userData)->free(
+      nullptr, ptr));
 }
 
 }  // namespace
@@ -33,12 +51,34 @@ folly::IOBuf createCudaIOBuf(uint64_t capacity, int device) {
     cuda::setDevice(device);
   }
 
+  std::unique_ptr<CudaIOBufInfo> info(
+      new CudaIOBufInfo{capacity, cuda::getDevice()});
   void* ptr;
   cuda::check(cudaMalloc(&ptr, capacity));
+  detail::recordAlloc(MemoryKind::CUDA_IOBUF, info->device, capacity);
+
+  folly::IOBuf iob(folly::IOBuf::TAKE_OWNERSHIP,
+                   ptr, capacity, 0 /* initial length */,
+                   freeCudaIOBuf, info.get());
+  info.release();
+  return iob;
+}
+
+folly::IOBuf createCudaIOBuf(uint64_t capacity,
+                             CudaCachingAllocator& allocator,
+                             int device,
+                             cudaStream_t stream) {
+  cuda::DeviceGuard guard;
+  if (device != -1) {
+    cuda::setDevice(device);
+  }
+
+  void* ptr;
+  cuda::check(allocator.malloc(nullptr, &ptr, capacity, stream));
 
   return folly::IOBuf(folly::IOBuf::TAKE_OWNERSHIP,
                       ptr, capacity, 0 /* initial length */,
-                      freeCudaIOBuf);
+                      freeCachedCudaIOBuf, &allocator);
 }
 
 }  // namespaces
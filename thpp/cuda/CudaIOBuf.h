@@ -16,6 +16,7 @@
 
 #pragma once
 
+#include <cuda_runtime.h>
 #include <folly/io/IOBuf.h>
 
 namespace thpp {
@@ -26,4 +27,14 @@ namespace thpp {
 // is 0). Use IOBuf::append() to increase the length.
 folly::IOBuf createCudaIOBuf(uint64_t capacity, int device = -1);
 
+class CudaCachingAllocator;
+
+// Same, but allocate from a caching allocator, for use on the given stream
+// (see CudaCachingAllocator). The memory goes back to the allocator's cache
+// when the IOBuf is freed.
+folly::IOBuf createCudaIOBuf(uint64_t capacity,
+                             CudaCachingAllocator& allocator,
+                             int device = -1,
+                             cudaStream_t stream = nullptr);
+
 }  // namespaces
@@ -0,0 +1,101 @@
+/*
+ * Copyright 2016 Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <thpp/cuda/ManagedAllocator.h>
+
+#include <algorithm>
+
+namespace thpp {
+
+namespace detail {
+
+bool isManagedAllocator(const THCDeviceAllocator* allocator) {
+  return allocator ==
+    &THCAllocatorWrapper<CudaManagedAllocator>::thcAllocator;
+}
+
+}  // namespace detail
+
+CudaManagedAllocator::CudaManagedAllocator(unsigned flags) : flags_(flags) { }
+
+cudaError_t CudaManagedAllocator::malloc(void* /*ctx*/, void** ptr,
+                                         size_t size,
+                                         cudaStream_t /*stream*/) {
+  if (size == 0) {
+    *ptr = nullptr;
+    return cudaSuccess;
+  }
+  int device;
+  auto err = cudaGetDevice(&device);
+  if (err != cudaSuccess) {
+    return err;
+  }
+  err = cudaMallocManaged(ptr, size, flags_);
+  if (err != cudaSuccess) {
+    return err;
+  }
+  detail::recordAlloc(MemoryKind::CUDA_MANAGED, device, size);
+  std::lock_guard<std::mutex> lock(mutex_);
+  allocations_.emplace(*ptr, std::make_pair(size, device));
+  return cudaSuccess;
+}
+
+cudaError_t CudaManagedAllocator::realloc(void* ctx, void** ptr,
+                                          size_t oldSize, size_t newSize,
+                                          cudaStream_t stream) {
+  void* newPtr;
+  auto err = malloc(ctx, &newPtr, newSize, stream);
+  if (err != cudaSuccess) {
+    return err;
+  }
+  if (*ptr) {
+    // cudaMemcpyDefault: the pages may currently be on the host or on any
+    // device. cudaFree waits for the copy.
+    err = cudaMemcpyAsync(newPtr, *ptr, std::min(oldSize, newSize),
+                          cudaMemcpyDefault, stream);
+    if (err != cudaSuccess) {
+      free(ctx, newPtr);
+      return err;
+    }
+    free(ctx, *ptr);
+  }
+  *ptr = newPtr;
+  return cudaSuccess;
+}
+
+cudaError_t CudaManagedAllocator::free(void* /*ctx*/, void* ptr) {
+  if (!ptr) {
+    return cudaSuccess;
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto pos = allocations_.find(ptr);
+    if (pos != allocations_.end()) {
+      detail::recordFree(MemoryKind::CUDA_MANAGED, pos->second.second,
+                         pos->second.first);
+      allocations_.erase(pos);
+    }
+  }
+  return cudaFree(ptr);
+}
+
+CudaManagedAllocator& CudaManagedAllocator::defaultInstance() {
+  // Leaked on purpose; memory may be freed during static destruction.
+  static auto instance = new CudaManagedAllocator();
+  return *instance;
+}
+
+}  // namespaces
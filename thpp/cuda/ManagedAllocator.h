@@ -0,0 +1,74 @@
+/*
+ * Copyright 2016 Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <mutex>
+#include <unordered_map>
+
+#include <thpp/cuda/Storage.h>
+
+namespace thpp {
+
+// Device allocator backed by managed (unified) memory from
+// cudaMallocManaged. The memory is accessible from the host and from all
+// devices, and pages migrate on demand to wherever they're used, so a
+// storage may be bigger than device memory. Use CudaStorage::prefetchTo()
+// and CudaStorage::advise() to move the hot parts ahead of time rather
+// than take page faults.
+//
+// Use with CudaStorage through THCAllocatorWrapper:
+//
+//   CudaStorage<float>::withAllocator(allocator.thcAllocator(), &allocator)
+//
+// or just managedStorage<float>(n).
+class CudaManagedAllocator {
+ public:
+  // flags as for cudaMallocManaged
+  explicit CudaManagedAllocator(unsigned flags = cudaMemAttachGlobal);
+
+  // THCDeviceAllocator interface (see THCAllocatorWrapper)
+  cudaError_t malloc(void* ctx, void** ptr, size_t size, cudaStream_t stream);
+  cudaError_t realloc(void* ctx, void** ptr, size_t oldSize, size_t newSize,
+                      cudaStream_t stream);
+  cudaError_t free(void* ctx, void* ptr);
+
+  THCDeviceAllocator* thcAllocator() {
+    return &THCAllocatorWrapper<CudaManagedAllocator>::thcAllocator;
+  }
+
+  static CudaManagedAllocator& defaultInstance();
+
+ private:
+  unsigned flags_;
+
+  // Size and allocating device of each allocation, for MemoryStats
+  std::mutex mutex_;
+  std::unordered_map<void*, std::pair<size_t, int>> allocations_;
+};
+
+// Create a storage of n (uninitialized) elements in managed memory
+template <class T>
+CudaStorage<T> managedStorage(
+    size_t n,
+    CudaManagedAllocator& allocator = CudaManagedAllocator::defaultInstance()) {
+  auto storage = CudaStorage<T>::withAllocator(allocator.thcAllocator(),
+                                               &allocator);
+  storage.resizeUninitialized(n);
+  return storage;
+}
+
+}  // namespaces
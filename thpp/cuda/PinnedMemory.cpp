@@ -0,0 +1,118 @@
+/*
+ * Copyright 2016 Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <thpp/cuda/PinnedMemory.h>
+#include <thpp/cuda/State.h>
+
+namespace thpp {
+
+namespace {
+
+// Round up to a power of two (at least one page), so that buffers may be
+// reused for similar sizes.
+size_t roundUp(size_t size) {
+  size_t capacity = 4096;
+  while (capacity < size) {
+    capacity <<= 1;
+  }
+  return capacity;
+}
+
+}  // namespace
+
+PinnedMemoryPool::PinnedMemoryPool(size_t maxCachedBytes)
+  : maxCachedBytes_(maxCachedBytes) { }
+
+PinnedMemoryPool::~PinnedMemoryPool() {
+  trim();
+  DCHECK(capacities_.empty())
+    << "PinnedMemoryPool destroyed with outstanding buffers";
+}
+
+folly::IOBuf PinnedMemoryPool::allocate(size_t size) {
+  size_t capacity = roundUp(size);
+  void* ptr = nullptr;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto pos = free_.find(capacity);
+    if (pos != free_.end()) {
+      ptr = pos->second;
+      free_.erase(pos);
+      cachedBytes_ -= capacity;
+    }
+  }
+
+  if (!ptr) {
+    cuda::check(cudaHostAlloc(&ptr, capacity, cudaHostAllocPortable));
+    detail::recordAlloc(MemoryKind::PINNED, -1, capacity);
+    std::lock_guard<std::mutex> lock(mutex_);
+    capacities_.emplace(ptr, capacity);
+  }
+
+  return folly::IOBuf(folly::IOBuf::TAKE_OWNERSHIP,
+                      ptr, capacity, 0 /* initial length */,
+                      &PinnedMemoryPool::freeBuffer, this);
+}
+
+void PinnedMemoryPool::freeBuffer(void* ptr, void* userData) {
+  static_cast<PinnedMemoryPool*>(userData)->release(ptr);
+}
+
+void PinnedMemoryPool::release(void* ptr) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto pos = capacities_.find(ptr);
+    CHECK(pos != capacities_.end()) << "Unknown pinned buffer " << ptr;
+    size_t capacity = pos->second;
+    if (cachedBytes_ + capacity <= maxCachedBytes_) {
+      free_.emplace(capacity, ptr);
+      cachedBytes_ += capacity;
+      return;
+    }
+    capacities_.erase(pos);
+    detail::recordFree(MemoryKind::PINNED, -1, capacity);
+  }
+  cuda::check(cudaFreeHost(ptr));
+}
+
+void PinnedMemoryPool::trim() {
+  std::multimap<size_t, void*> toFree;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    toFree.swap(free_);
+    for (auto& p : toFree) {
+      capacities_.erase(p.second);
+      detail::recordFree(MemoryKind::PINNED, -1, p.first);
+    }
+    cachedBytes_ = 0;
+  }
+  for (auto& p : toFree) {
+    cuda::check(cudaFreeHost(p.second));
+  }
+}
+
+size_t PinnedMemoryPool::cachedBytes() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return cachedBytes_;
+}
+
+PinnedMemoryPool& PinnedMemoryPool::defaultInstance() {
+  // Leaked on purpose; buffers may be freed during static destruction.
+  static auto instance = new PinnedMemoryPool();
+  return *instance;
+}
+
+}  // namespaces
@@ -0,0 +1,78 @@
+/*
+ * Copyright 2016 Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <map>
+#include <mutex>
+#include <unordered_map>
+
+#include <folly/io/IOBuf.h>
+#include <thpp/Storage.h>
+
+namespace thpp {
+
+// Pool of pinned (page-locked) host buffers, used to stage device-to-host
+// and host-to-device copies at full bandwidth without paying for
+// cudaHostAlloc / cudaFreeHost (which are expensive and synchronize the
+// device) on every copy.
+//
+// Buffers are handed out as IOBufs whose free function returns the memory
+// to the pool, so they may be passed around (and shared with Storage
+// objects or Thrift structures) freely. The pool must outlive all buffers
+// allocated from it; defaultInstance() is never destroyed.
+class PinnedMemoryPool {
+ public:
+  // At most maxCachedBytes of free buffers are kept around.
+  explicit PinnedMemoryPool(size_t maxCachedBytes = 256 << 20);
+  ~PinnedMemoryPool();
+
+  // Allocate a buffer with a capacity of at least size bytes. Just like
+  // IOBuf::CREATE, the buffer is created empty (the initial length is 0).
+  folly::IOBuf allocate(size_t size);
+
+  // Release all cached buffers.
+  void trim();
+
+  size_t cachedBytes() const;
+
+  static PinnedMemoryPool& defaultInstance();
+
+ private:
+  static void freeBuffer(void* ptr, void* userData);
+  void release(void* ptr);
+
+  const size_t maxCachedBytes_;
+  mutable std::mutex mutex_;
+  size_t cachedBytes_ = 0;
+  std::multimap<size_t, void*> free_;  // capacity -> buffer
+  std::unordered_map<void*, size_t> capacities_;  // all outstanding buffers
+};
+
+// Create a Storage of n (uninitialized) elements backed by pinned memory.
+template <class T>
+Storage<T> pinnedStorage(
+    size_t n,
+    PinnedMemoryPool& pool = PinnedMemoryPool::defaultInstance()) {
+  if (n == 0) {
+    return Storage<T>();
+  }
+  auto buf = pool.allocate(n * sizeof(T));
+  buf.append(n * sizeof(T));
+  return Storage<T>(std::move(buf), SHARE_IOBUF_MANAGED);
+}
+
+}  // namespaces
@@ -4,6 +4,11 @@
  */
 
 #include <thpp/cuda/State.h>
+
+#include <atomic>
+#include <map>
+#include <mutex>
+
 #include <folly/ThreadLocal.h>
 
 namespace thpp {
@@ -43,6 +48,24 @@ THCStateHolder::~THCStateHolder() {
 
 folly::ThreadLocal<THCStateHolder> gDefaultTHCState;
 
+std::atomic<bool> gUseSharedTHCState{false};
+std::atomic<int> gSharedNumStreams{0};
+std::atomic<bool> gSharedNonBlocking{true};
+
+THCState* sharedTHCState() {
+  // Leaked on purpose; threads may still use it during static destruction.
+  static THCStateHolder* holder = [] {
+    auto h = new THCStateHolder();
+    int numStreams = gSharedNumStreams.load();
+    if (numStreams > 0) {
+      THCState_reserveStreams(h->state(), numStreams,
+                              gSharedNonBlocking.load());
+    }
+    return h;
+  }();
+  return holder->state();
+}
+
 }  // namespace
 
 namespace detail {
@@ -50,6 +73,60 @@ folly::ThreadLocal<THCState*> gCurrentTHCState;
 }  // namespace detail
 
 void setDefaultTHCState() {
-  setTHCState(gDefaultTHCState->state());
+  if (gUseSharedTHCState.load(std::memory_order_acquire)) {
+    setTHCState(sharedTHCState());
+  } else {
+    setTHCState(gDefaultTHCState->state());
+  }
+}
+
+void useSharedTHCState(int numStreams, bool nonBlocking) {
+  gSharedNumStreams = numStreams;
+  gSharedNonBlocking = nonBlocking;
+  gUseSharedTHCState.store(true, std::memory_order_release);
+}
+
+void warmup(const std::vector<int>& devices) {
+  getTHCState();
+  cuda::DeviceGuard guard;
+  for (int device : devices) {
+    cuda::setDevice(device);
+    cuda::check(cudaFree(nullptr));  // forces context creation
+  }
 }
+
+namespace cuda {
+
+bool enablePeerAccess(int device, int peerDevice) {
+  if (device == peerDevice) {
+    return true;
+  }
+
+  static std::mutex mutex;
+  static std::map<std::pair<int, int>, bool> peerAccess;
+
+  std::lock_guard<std::mutex> lock(mutex);
+  auto key = std::make_pair(device, peerDevice);
+  auto pos = peerAccess.find(key);
+  if (pos != peerAccess.end()) {
+    return pos->second;
+  }
+
+  int canAccess = 0;
+  check(cudaDeviceCanAccessPeer(&canAccess, device, peerDevice));
+  if (canAccess) {
+    DeviceGuard guard;
+    setDevice(device);
+    auto err = cudaDeviceEnablePeerAccess(peerDevice, 0);
+    if (err == cudaErrorPeerAccessAlreadyEnabled) {
+      cudaGetLastError();  // clear it; someone else (cutorch?) enabled it
+    } else {
+      check(err);
+    }
+  }
+  peerAccess.emplace(key, bool(canAccess));
+  return canAccess;
+}
+
+}  // namespace cuda
 }  // namespaces
@@ -6,6 +6,9 @@
 #ifndef THPP_CUDA_STATE_H_
 #define THPP_CUDA_STATE_H_
 
+#include <utility>
+#include <vector>
+
 #include <THC.h>
 #include <folly/Exception.h>
 #include <folly/ThreadLocal.h>
@@ -19,6 +22,12 @@ namespace thpp {
 // You may associate the current thread with a different THCState object if
 // you wish (for example, so that Lua code using cutorch will use the same
 // state)
+//
+// Creating a THCState is expensive (it initializes resources on every
+// device), so processes with many threads (thread pools) should call
+// useSharedTHCState() at startup: all threads that haven't been associated
+// with a state yet will then share one process-wide THCState. Each thread
+// still selects its own current stream (see cuda::setCurrentStreamIndex).
 
 namespace detail {
 extern folly::ThreadLocal<THCState*> gCurrentTHCState;
@@ -31,6 +40,18 @@ inline void setTHCState(THCState* state) {
 
 void setDefaultTHCState();
 
+// Use one process-wide THCState as the default state, instead of one per
+// thread. Reserve numStreams additional streams in it (see
+// THCState_reserveStreams). Must be called before threads that should use
+// the shared state first touch CUDA through thpp; threads that already
+// have a state keep it.
+void useSharedTHCState(int numStreams = 0, bool nonBlocking = true);
+
+// Eagerly create the default state for the current thread (the shared
+// one, if enabled), and a CUDA context on each of the given devices, so
+// that the first real work doesn't pay for initialization.
+void warmup(const std::vector<int>& devices);
+
 inline THCState* getTHCState() {
   auto& state = *detail::gCurrentTHCState;
   if (!state) {
@@ -58,6 +79,22 @@ inline void setDevice(int dev) {
   check(cudaSetDevice(dev));
 }
 
+// Can device access memory on peerDevice directly? Enables peer access
+// on first use; the result is cached per (device, peerDevice) pair.
+bool enablePeerAccess(int device, int peerDevice);
+
+// Select the stream (by index; 0 is the default stream) that THC operations
+// on the current thread are issued on. With a shared THCState, each thread
+// has its own current stream.
+inline void setCurrentStreamIndex(int index) {
+  THCState_setCurrentStreamIndex(getTHCState(), index);
+}
+
+// The stream that THC operations on the current thread are issued on
+inline cudaStream_t getCurrentStream() {
+  return THCState_getCurrentStream(getTHCState());
+}
+
 class DeviceGuard {
  public:
   explicit DeviceGuard() : device_(getDevice()) { }
@@ -72,6 +109,98 @@ class DeviceGuard {
   int device_;
 };
 
+// Owning wrapper around a cudaStream_t, created on the current device.
+class Stream {
+ public:
+  explicit Stream(unsigned flags = cudaStreamNonBlocking) {
+    check(cudaStreamCreateWithFlags(&stream_, flags));
+  }
+  ~Stream() {
+    if (stream_) {
+      cudaStreamDestroy(stream_);
+    }
+  }
+
+  Stream(Stream&& other) noexcept : stream_(other.stream_) {
+    other.stream_ = nullptr;
+  }
+  Stream& operator=(Stream&& other) {
+    std::swap(stream_, other.stream_);
+    return *this;
+  }
+
+  cudaStream_t get() const { return stream_; }
+  /* implicit */ operator cudaStream_t() const { return stream_; }
+
+  void synchronize() const { check(cudaStreamSynchronize(stream_)); }
+
+ private:
+  Stream(const Stream&) = delete;
+  Stream& operator=(const Stream&) = delete;
+
+  cudaStream_t stream_;
+};
+
+// Owning wrapper around a cudaEvent_t, used as a completion handle for
+// asynchronous operations. Timing is disabled, which makes recording and
+// waiting cheaper.
+class Event {
+ public:
+  Event() {
+    check(cudaEventCreateWithFlags(&event_, cudaEventDisableTiming));
+  }
+  ~Event() {
+    if (event_) {
+      cudaEventDestroy(event_);
+    }
+  }
+
+  Event(Event&& other) noexcept : event_(other.event_) {
+    other.event_ = nullptr;
+  }
+  Event& operator=(Event&& other) {
+    std::swap(event_, other.event_);
+    return *this;
+  }
+
+  cudaEvent_t get() const { return event_; }
+
+  // Capture all work currently enqueued on stream
+  void record(cudaStream_t stream) { check(cudaEventRecord(event_, stream)); }
+
+  // Has all captured work completed?
+  bool ready() const {
+    auto err = cudaEventQuery(event_);
+    if (err == cudaErrorNotReady) {
+      return false;
+    }
+    check(err);
+    return true;
+  }
+
+  // Block the calling thread until all captured work has completed
+  void wait() const { check(cudaEventSynchronize(event_)); }
+
+  // Make all future work on stream wait for the captured work, without
+  // blocking the calling thread
+  void block(cudaStream_t stream) const {
+    check(cudaStreamWaitEvent(stream, event_, 0));
+  }
+
+ private:
+  Event(const Event&) = delete;
+  Event& operator=(const Event&) = delete;
+
+  cudaEvent_t event_;
+};
+
+// Record a new event on stream
+inline Event recordEvent(cudaStream_t stream) {
+  Event event;
+  event.record(stream);
+  return event;
+}
+
 }  // namespace cuda
 
 }  // namespaces
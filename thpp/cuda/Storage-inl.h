@@ -7,6 +7,9 @@
 #error This file may only be included from thpp/cuda/Storage.h
 #endif
 
+#include <thpp/cuda/CudaIOBuf.h>
+#include <thpp/cuda/PinnedMemory.h>
+
 namespace thpp {
 
 template <class T>
@@ -17,6 +20,15 @@ CudaStorage<T>::CudaStorage(THType* t) : Base(t) {
   this->up();
 }
 
+template <class T>
+CudaStorage<T> CudaStorage<T>::withAllocator(THCDeviceAllocator* allocator,
+                                             void* allocatorContext) {
+  CudaStorage<T> s;
+  s.t_ = Ops::_newWithDataAndAllocator(
+      nullptr, 0, allocator, allocatorContext);
+  return s;
+}
+
 template <class T>
 CudaStorage<T>::~CudaStorage() {
   this->down();
@@ -34,8 +46,8 @@ CudaStorage<T>::CudaStorage(const CudaStorage& other) : CudaStorage(other.t_) {
 template <class T>
 CudaStorage<T>::CudaStorage(const Storage<T>& cpuStorage) : CudaStorage() {
   if (cpuStorage.data()) {
-    resizeUninitialized(cpuStorage.size());
-    this->read(0, cpuStorage.data(), cpuStorage.size());
+    this->resizeUninitialized(cpuStorage.size());
+    this->write(0, cpuStorage.data(), cpuStorage.size());
   }
 }
 
@@ -65,6 +77,24 @@ void CudaStorage<T>::write(size_t offset, T value) {
   this->write(offset, &value, 1);
 }
 
+template <class T>
+cuda::Event CudaStorage<T>::readAsync(size_t offset, T* dest, size_t n,
+                                      cudaStream_t stream) const {
+  DCHECK_LE(offset + n, this->size());
+  cuda::check(cudaMemcpyAsync(dest, this->data() + offset, n * sizeof(T),
+                              cudaMemcpyDeviceToHost, stream));
+  return cuda::recordEvent(stream);
+}
+
+template <class T>
+cuda::Event CudaStorage<T>::writeAsync(size_t offset, const T* src, size_t n,
+                                       cudaStream_t stream) {
+  DCHECK_LE(offset + n, this->size());
+  cuda::check(cudaMemcpyAsync(this->data() + offset, src, n * sizeof(T),
+                              cudaMemcpyHostToDevice, stream));
+  return cuda::recordEvent(stream);
+}
+
 template <class T>
 CudaStorage<T>& CudaStorage<T>::operator=(CudaStorage&& other) {
   if (&other != this) {
@@ -85,11 +115,41 @@ CudaStorage<T>& CudaStorage<T>::operator=(const CudaStorage& other) {
   return *this;
 }
 
+namespace detail {
+// Copy all data in a (possibly chained) host or device IOBuf to dest, on
+// stream
+void cudaCopyFromIOBuf(void* dest, const folly::IOBuf& buf,
+                       cudaStream_t stream);
+}  // namespace detail
+
 template <class T>
 CudaStorage<T>::CudaStorage(
     const ThriftStorage& thriftStorage,
     SharingMode /*sharing*/)
-    : CudaStorage(Storage<T>(thriftStorage, SHARE_ALL)) {}
+    : CudaStorage() {
+  deserializeAsync(thriftStorage, cuda::getCurrentStream()).wait();
+}
+
+template <class T>
+cuda::Event CudaStorage<T>::deserializeAsync(const ThriftStorage& in,
+                                             cudaStream_t stream) {
+  // Shares memory with in.data, unless byte swapped or widened
+  auto data = detail::deserializeAs<T>(in);
+  size_t len = data.computeChainDataLength();
+  if (len % sizeof(T) != 0) {
+    throw std::invalid_argument("IOBuf size must be multiple of data size");
+  }
+  if (this->size() != len / sizeof(T)) {
+    this->resizeUninitialized(len / sizeof(T));
+  }
+  detail::cudaCopyFromIOBuf(this->data(), data, stream);
+  auto event = cuda::recordEvent(stream);
+  if (in.endianness != detail::gMachineEndianness ||
+      in.dataType != detail::dataType<T>()) {
+    event.wait();  // data is about to go away
+  }
+  return event;
+}
 
 template <class T>
 CudaStorage<T>::CudaStorage(folly::IOBuf&& iob,
@@ -100,10 +160,32 @@ CudaStorage<T>::CudaStorage(folly::IOBuf&& iob,
 }
 
 namespace detail {
+
+// Fill in out for device-resident data (see CudaStorage::serializeOnDevice):
+// native byte order, no checksum.
 void cudaStorageSerialize(ThriftStorage& out,
-                          const void* src, size_t size,
-                          ThriftTensorDataType dtype,
-                          ThriftTensorEndianness endianness);
+                          folly::IOBuf&& data,
+                          ThriftTensorDataType dtype);
+
+template <class T>
+void freeSharedCudaStorage(void* /*ptr*/, void* userData) {
+  delete static_cast<CudaStorage<T>*>(userData);
+}
+
+// Wrap n elements of storage's device memory, starting at offset, in an
+// IOBuf that keeps a reference to the storage.
+template <class T>
+folly::IOBuf shareCudaStorage(const CudaStorage<T>& storage,
+                              size_t offset, size_t n) {
+  DCHECK_LE(offset + n, storage.size());
+  std::unique_ptr<CudaStorage<T>> ref(new CudaStorage<T>(storage));
+  folly::IOBuf iob(folly::IOBuf::TAKE_OWNERSHIP,
+                   const_cast<T*>(storage.data() + offset), n * sizeof(T),
+                   &freeSharedCudaStorage<T>, ref.get());
+  ref.release();
+  return iob;
+}
+
 }  // namespace detail
 
 template <class T>
@@ -111,24 +193,89 @@ void CudaStorage<T>::serialize(
     ThriftStorage& out,
     ThriftTensorEndianness endianness,
     bool /*mayShare*/) const {
-  toCPU().serialize(out, endianness, true);
+  // The CPU copy is temporary, and its pinned buffer goes back to the pool
+  // when out.data is destroyed.
+  toCPU().serialize(out, endianness, SHARE_ALL);
+}
+
+template <class T>
+cuda::Event CudaStorage<T>::serializeOnDevice(ThriftStorage& out,
+                                              SharingMode sharing) const {
+  auto stream = cuda::getCurrentStream();
+  folly::IOBuf data;
+  if (this->size() != 0) {
+    if (sharing != SHARE_NONE) {
+      data = detail::shareCudaStorage(*this, 0, this->size());
+    } else {
+      cudaPointerAttributes attr;
+      cuda::check(cudaPointerGetAttributes(&attr, this->data()));
+      size_t len = this->size() * sizeof(T);
+      data = createCudaIOBuf(len, attr.device);
+      cuda::check(cudaMemcpyAsync(data.writableData(), this->data(), len,
+                                  cudaMemcpyDeviceToDevice, stream));
+      data.append(len);
+    }
+  }
+  detail::cudaStorageSerialize(out, std::move(data), detail::dataType<T>());
+  return cuda::recordEvent(stream);
 }
 
+// The copy is made into pinned memory from PinnedMemoryPool, which is twice
+// as fast as copying into pageable memory.
 template <class T>
 Storage<T> CudaStorage<T>::toCPU() const {
   Storage<T> cpuStorage;
   if (this->data()) {
-    cpuStorage.resizeUninitialized(this->size());
-    this->write(0, cpuStorage.data(), this->size());
+    cpuStorage = pinnedStorage<T>(this->size());
+    this->read(0, cpuStorage.data(), this->size());
   }
   return cpuStorage;
 }
 
 namespace detail {
 
+// Byte range of elements [offset, offset + n) of storage, which must be
+// managed; n is clamped to the end of the storage.
+template <class T>
+std::pair<const T*, size_t> managedRange(const CudaStorage<T>& storage,
+                                         size_t offset, size_t n) {
+  if (!storage.isManaged()) {
+    throw std::invalid_argument("Storage is not in managed memory");
+  }
+  if (offset > storage.size()) {
+    throw std::invalid_argument("Offset out of range");
+  }
+  n = std::min(n, storage.size() - offset);
+  return std::make_pair(storage.data() + offset, n * sizeof(T));
+}
+
+}  // namespace detail
+
+template <class T>
+cuda::Event CudaStorage<T>::prefetchTo(int device, cudaStream_t stream,
+                                       size_t offset, size_t n) const {
+  auto range = detail::managedRange(*this, offset, n);
+  if (range.second != 0) {
+    cuda::check(cudaMemPrefetchAsync(range.first, range.second, device,
+                                     stream));
+  }
+  return cuda::recordEvent(stream);
+}
+
+template <class T>
+void CudaStorage<T>::advise(cudaMemoryAdvise advice, int device,
+                            size_t offset, size_t n) const {
+  auto range = detail::managedRange(*this, offset, n);
+  if (range.second != 0) {
+    cuda::check(cudaMemAdvise(range.first, range.second, advice, device));
+  }
+}
+
+namespace detail {
+
 class CudaIOBufAllocator {
  public:
-  explicit CudaIOBufAllocator(folly::IOBuf&& iob);
+  CudaIOBufAllocator(folly::IOBuf&& iob, int device);
 
   cudaError_t malloc(void* ctx, void** ptr, size_t size, cudaStream_t);
   cudaError_t realloc(void* ctx, void** ptr,
@@ -137,6 +284,8 @@ class CudaIOBufAllocator {
 
  private:
   folly::IOBuf iob_;
+  int device_;
+  uint64_t maxLength_;
 };
 
 }  // namespace detail
@@ -165,10 +314,6 @@ void CudaStorage<T>::setFromIOBuf(folly::IOBuf&& iob, SharingMode sharing,
     break;
   }
 
-  if (resizable) {
-    throw std::invalid_argument("NYI: Resizable IOBuf CUDA storage");
-  }
-
   // Ensure properly aligned
   if ((reinterpret_cast<uintptr_t>(iob.data()) % alignof(T)) != 0) {
     throw std::invalid_argument("IOBuf is not properly aligned");
@@ -185,8 +330,10 @@ void CudaStorage<T>::setFromIOBuf(folly::IOBuf&& iob, SharingMode sharing,
   this->t_ = Ops::_newWithDataAndAllocator(
       p, len,
       &THCAllocatorWrapper<detail::CudaIOBufAllocator>::thcAllocator,
-      new detail::CudaIOBufAllocator(std::move(iob)));
-  Ops::_clearFlag(this->t_, TH_STORAGE_RESIZABLE);
+      new detail::CudaIOBufAllocator(std::move(iob), attr.device));
+  if (!resizable) {
+    Ops::_clearFlag(this->t_, TH_STORAGE_RESIZABLE);
+  }
 }
 
 template <class A>
@@ -16,12 +16,21 @@
 
 #include <thpp/cuda/Storage.h>
 
+#include <limits>
+
+#include <thpp/cuda/CudaIOBuf.h>
+
 namespace thpp {
 
 namespace detail {
 
-CudaIOBufAllocator::CudaIOBufAllocator(folly::IOBuf&& iob)
-  : iob_(std::move(iob)) { }
+CudaIOBufAllocator::CudaIOBufAllocator(folly::IOBuf&& iob, int device)
+  : iob_(std::move(iob)),
+    device_(device),
+    maxLength_(iob_.isSharedOne() ? iob_.length() :
+               std::numeric_limits<uint64_t>::max()) {
+  DCHECK(!iob_.isChained());
+}
 
 cudaError_t CudaIOBufAllocator::malloc(
     void* /*ctx*/,
@@ -32,14 +41,48 @@ cudaError_t CudaIOBufAllocator::malloc(
   return cudaSuccess;  // not reached
 }
 
+// Same semantics as IOBufAllocator::realloc in thpp/Storage.cpp, except
+// that we can't use IOBuf::unshareOne() / reserve() on device memory.
 cudaError_t CudaIOBufAllocator::realloc(
     void* /*ctx*/,
-    void** /*ptr*/,
+    void** ptr,
     size_t /*oldSize*/,
-    size_t /*newSize*/,
-    cudaStream_t /*stream*/) {
-  LOG(FATAL) << "CudaIOBufAllocator::realloc should never be called";
-  return cudaSuccess;  // not reached
+    size_t newSize,
+    cudaStream_t stream) {
+  CHECK_EQ(*ptr, iob_.writableData());
+  if (newSize <= iob_.length()) {
+    iob_.trimEnd(iob_.length() - newSize);
+  } else {
+    auto extra = newSize - iob_.length();
+    // If the buffer is shared, we may only use up to the original length;
+    // the tailroom might belong to someone else.
+    if (newSize > maxLength_ || extra > iob_.tailroom()) {
+      folly::IOBuf newBuf;
+      try {
+        newBuf = createCudaIOBuf(newSize, device_);
+      } catch (const std::exception&) {
+        return cudaErrorMemoryAllocation;
+      }
+      auto err = cudaMemcpyAsync(newBuf.writableData(), iob_.data(),
+                                 iob_.length(), cudaMemcpyDeviceToDevice,
+                                 stream);
+      if (err != cudaSuccess) {
+        return err;
+      }
+      newBuf.append(iob_.length());
+      // The old buffer may come from a caching allocator, which could hand
+      // it out again as soon as it's released, so wait for the copy first.
+      err = cudaStreamSynchronize(stream);
+      if (err != cudaSuccess) {
+        return err;
+      }
+      iob_ = std::move(newBuf);
+      maxLength_ = std::numeric_limits<uint64_t>::max();
+    }
+    iob_.append(extra);
+  }
+  *ptr = iob_.writableData();
+  return cudaSuccess;
 }
 
 cudaError_t CudaIOBufAllocator::free(void* /*stat*/, void* ptr) {
@@ -48,6 +91,20 @@ cudaError_t CudaIOBufAllocator::free(void* /*stat*/, void* ptr) {
   return cudaSuccess;
 }
 
+void cudaCopyFromIOBuf(void* dest, const folly::IOBuf& buf,
+                       cudaStream_t stream) {
+  auto p = static_cast<char*>(dest);
+  for (auto& range : buf) {
+    if (!range.empty()) {
+      // cudaMemcpyDefault, as buf may point to device memory (see
+      // CudaStorage::serializeOnDevice)
+      cuda::check(cudaMemcpyAsync(p, range.data(), range.size(),
+                                  cudaMemcpyDefault, stream));
+      p += range.size();
+    }
+  }
+}
+
 }  // namespace detail
 
 }  // namespaces
@@ -6,7 +6,10 @@
 #ifndef THPP_CUDA_STORAGE_H_
 #define THPP_CUDA_STORAGE_H_
 
+#include <limits>
+
 #include <thpp/Storage.h>
+#include <thpp/cuda/State.h>
 #include <thpp/cuda/detail/Storage.h>
 #include <folly/memory/Malloc.h>
 #include <folly/Range.h>
@@ -15,6 +18,11 @@ namespace thpp {
 
 template <class T> class CudaTensor;
 
+namespace detail {
+// Is this CudaManagedAllocator's THCDeviceAllocator?
+bool isManagedAllocator(const THCDeviceAllocator* allocator);
+}  // namespace detail
+
 template <class T>
 class CudaStorage : public StorageBase<T, CudaStorage<T>> {
   typedef StorageBase<T, CudaStorage<T>> Base;
@@ -28,12 +36,16 @@ class CudaStorage : public StorageBase<T, CudaStorage<T>> {
 
   explicit CudaStorage(const Storage<T>& cpuStorage);
 
-  // Deserialize from Thrift. Throws if wrong type.
+  // Deserialize from Thrift. Throws if wrong type. The data is copied
+  // straight from thriftStorage.data to the device, without an
+  // intermediate CPU Storage.
   explicit CudaStorage(const ThriftStorage& thriftStorage,
                        SharingMode sharing = SHARE_IOBUF_MANAGED);
 
-  // Note that, despite being default (for consistency with the Storage
-  // constructors), resizable == true is not yet implemented.
+  // Create a storage that shares memory with an IOBuf that points to CUDA
+  // memory (see createCudaIOBuf). If resizable, the storage grows in place
+  // while the IOBuf has tailroom (and isn't shared with anyone else), and
+  // moves to a new device buffer otherwise.
   explicit CudaStorage(folly::IOBuf&& iob,
                        SharingMode sharing = SHARE_IOBUF_MANAGED,
                        bool resizable = true);
@@ -42,6 +54,11 @@ class CudaStorage : public StorageBase<T, CudaStorage<T>> {
                        bool resizable = true)
     : CudaStorage(folly::IOBuf(iob), sharing, resizable) { }
 
+  // Use a custom allocator (for example, CudaCachingAllocator through
+  // THCAllocatorWrapper). The allocator is managed by the caller.
+  static CudaStorage withAllocator(THCDeviceAllocator* allocator,
+                                   void* allocatorContext);
+
   ~CudaStorage();
 
   CudaStorage(CudaStorage&& other) noexcept;
@@ -55,13 +72,64 @@ class CudaStorage : public StorageBase<T, CudaStorage<T>> {
                      ThriftTensorEndianness::NATIVE,
                  bool mayShare = true) const;
 
+  // Serialize to Thrift without staging the data in host memory:
+  // out.data points to device memory, so that transports that can read GPU
+  // memory directly (RDMA with GPUDirect, for example) can send it as is.
+  // The data is in native byte order, with no checksum; deserialize it with
+  // the CudaStorage / CudaTensor constructors or deserializeAsync(). Unless
+  // sharing is SHARE_NONE, out.data shares memory with this storage (and
+  // keeps it allocated); otherwise, it's a copy made on the current stream.
+  // Don't read out.data until the returned event has completed.
+  cuda::Event serializeOnDevice(ThriftStorage& out,
+                                SharingMode sharing = SHARE_IOBUF_MANAGED)
+    const;
+
+  // Copy to CPU. The result is backed by pinned memory.
   Storage<T> toCPU() const;
 
+  // Deserialize from Thrift into this storage, asynchronously on stream.
+  // The existing device memory is reused if it has the right size.
+  // thriftStorage.data must remain valid and unmodified until the returned
+  // event has completed. (If the data isn't in native byte order, it must
+  // be swapped on the host first, and the call waits for the copy.) For the
+  // copy to be truly asynchronous, the data should be in pinned memory.
+  cuda::Event deserializeAsync(const ThriftStorage& thriftStorage,
+                               cudaStream_t stream);
+
   T read(size_t offset) const;
   void read(size_t offset, T* dest, size_t n) const;
   void write(size_t offset, T value);
   void write(size_t offset, const T* src, size_t n);
 
+  // Asynchronous versions of read() and write(), ordered with respect to
+  // other work on stream. The host memory must remain valid (and, for
+  // writeAsync, unmodified) until the returned event has completed.
+  // The copy only overlaps with other work if the host memory is pinned;
+  // with pageable memory, CUDA may stage it synchronously.
+  cuda::Event readAsync(size_t offset, T* dest, size_t n,
+                        cudaStream_t stream) const;
+  cuda::Event writeAsync(size_t offset, const T* src, size_t n,
+                         cudaStream_t stream);
+
+  // Is this storage in managed memory (see CudaManagedAllocator)?
+  bool isManaged() const {
+    return this->t_ && detail::isManagedAllocator(this->t_->allocator);
+  }
+
+  // Managed memory only (throw std::invalid_argument otherwise): migrate
+  // the pages of elements [offset, offset + n) to device (cudaCpuDeviceId
+  // for the host) asynchronously on stream, so that they're resident there
+  // when work on stream uses them. n is clamped to the end of the storage.
+  cuda::Event prefetchTo(int device, cudaStream_t stream, size_t offset = 0,
+                         size_t n = std::numeric_limits<size_t>::max()) const;
+
+  // Managed memory only: hint how elements [offset, offset + n) will be
+  // used (cudaMemAdviseSetReadMostly, cudaMemAdviseSetPreferredLocation,
+  // cudaMemAdviseSetAccessedBy, or the matching Unset advice). device is
+  // ignored by the read-mostly advice.
+  void advise(cudaMemoryAdvise advice, int device, size_t offset = 0,
+              size_t n = std::numeric_limits<size_t>::max()) const;
+
   bool isUnique() const { return isUnique(this->t_); }
   // No CUDA support for custom allocators.
   static bool isUnique(const THType* th) {
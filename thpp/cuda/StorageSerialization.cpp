@@ -0,0 +1,36 @@
+/*
+ * Copyright 2016 Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <thpp/cuda/Storage.h>
+
+namespace thpp {
+
+namespace detail {
+
+void cudaStorageSerialize(ThriftStorage& out,
+                          folly::IOBuf&& data,
+                          ThriftTensorDataType dtype) {
+  DCHECK(!data.isChained());
+  out.dataType = dtype;
+  out.endianness = gMachineEndianness;
+  out.checksumType = ThriftTensorChecksum::NONE;
+  out.checksum = 0;
+  out.data = std::move(data);
+}
+
+}  // namespace detail
+
+}  // namespaces
@@ -51,12 +51,13 @@ CudaTensor<T>::CudaTensor(const Tensor<T>& cpuTensor)
   copy(cpuTensor);
 }
 
-// The CPU tensor is temporary, it may always share memory with Thrift
 template <class T>
 CudaTensor<T>::CudaTensor(
     const ThriftTensor& thriftTensor,
     SharingMode /*sharing*/)
-    : CudaTensor(Tensor<T>(thriftTensor, SHARE_ALL)) {}
+    : CudaTensor() {
+  deserializeAsync(thriftTensor, cuda::getCurrentStream()).wait();
+}
 
 template <class T>
 CudaTensor<T>::CudaTensor(detail::SetTH, THType* t, bool incRef)
@@ -105,6 +106,132 @@ T CudaTensor<T>::at(std::initializer_list<offset_type> indices) const {
   return this->storageRef(&buf).read(offset);
 }
 
+namespace detail {
+
+// Storage offsets of the elements of a tensor of the given shape at the
+// given positions: linear (row-major) positions, or, if multiIndex, one
+// full index per row. The offsets are 1-based, as indexSelect wants them.
+inline Tensor<long> elementOffsets(LongRange sizes, LongRange strides,
+                                   long storageOffset,
+                                   const Tensor<long>& indices,
+                                   bool multiIndex) {
+  const Tensor<long> idx(indices, Tensor<long>::CONTIGUOUS);
+  const size_t ndims = sizes.size();
+  long n = idx.size();
+  if (multiIndex && n != 0) {
+    if (idx.ndims() != 2 || idx.size(1) != ndims) {
+      throw std::invalid_argument("Multi-index gather requires indices of "
+                                  "sizes [n, ndims]");
+    }
+    n = idx.size(0);
+  }
+  long total = ndims == 0 ? 0 : 1;
+  for (auto s : sizes) {
+    total *= s;
+  }
+
+  Tensor<long> offsets({n});
+  const long* in = idx.data();
+  long* out = offsets.data();
+  for (long i = 0; i < n; ++i) {
+    long offset = storageOffset;
+    if (multiIndex) {
+      for (size_t d = 0; d < ndims; ++d) {
+        long v = *in++;
+        if (v < 0 || v >= sizes[d]) {
+          throw std::invalid_argument("Gather index out of range");
+        }
+        offset += v * strides[d];
+      }
+    } else {
+      long v = *in++;
+      if (v < 0 || v >= total) {
+        throw std::invalid_argument("Gather index out of range");
+      }
+      for (size_t d = ndims; d-- > 0;) {
+        offset += (v % sizes[d]) * strides[d];
+        v /= sizes[d];
+      }
+    }
+    out[i] = offset + 1;
+  }
+  return offsets;
+}
+
+}  // namespace detail
+
+template <class T>
+void CudaTensor<T>::gatherInto(const Tensor<long>& offsets, Tensor<T>& out,
+                               cudaStream_t stream) const {
+  if (!out.isContiguous() || out.size() != offsets.size()) {
+    throw std::invalid_argument(
+        "Gather output must be contiguous, with one element per index");
+  }
+  if (offsets.size() == 0) {
+    return;
+  }
+  // Gather from a 1d view of the whole storage, by (1-based) storage
+  // offset, into a compact temporary on the device. THC runs it on the
+  // current stream, which the transfer follows.
+  CudaTensor flat;
+  auto storage = Ops::_storage(this->mut());
+  Ops::_setStorage1d(flat.t_, storage, 0, storage->size, 1);
+  CudaTensor compact;
+  Ops::_indexSelect(compact.t_, flat.t_, 0,
+                    const_cast<Tensor<long>&>(offsets).asTH());
+  cuda::check(cudaMemcpyAsync(out.data(), compact.data(),
+                              out.size() * sizeof(T),
+                              cudaMemcpyDeviceToHost, stream));
+}
+
+template <class T>
+Tensor<T> CudaTensor<T>::gather(const Tensor<long>& indices) const {
+  auto offsets = detail::elementOffsets(this->sizes(), this->strides(),
+                                        this->storageOffset(), indices, false);
+  if (offsets.size() == 0) {
+    return Tensor<T>();
+  }
+  Tensor<T> out(pinnedStorage<T>(offsets.size()), 0, indices.sizes());
+  auto stream = cuda::getCurrentStream();
+  gatherInto(offsets, out, stream);
+  cuda::recordEvent(stream).wait();
+  return out;
+}
+
+template <class T>
+Tensor<T> CudaTensor<T>::gatherAt(const Tensor<long>& indices) const {
+  auto offsets = detail::elementOffsets(this->sizes(), this->strides(),
+                                        this->storageOffset(), indices, true);
+  if (offsets.size() == 0) {
+    return Tensor<T>();
+  }
+  Tensor<T> out(pinnedStorage<T>(offsets.size()), 0, {offsets.size()});
+  auto stream = cuda::getCurrentStream();
+  gatherInto(offsets, out, stream);
+  cuda::recordEvent(stream).wait();
+  return out;
+}
+
+template <class T>
+cuda::Event CudaTensor<T>::gatherAsync(const Tensor<long>& indices,
+                                       Tensor<T>& out) const {
+  auto stream = cuda::getCurrentStream();
+  gatherInto(detail::elementOffsets(this->sizes(), this->strides(),
+                                    this->storageOffset(), indices, false),
+             out, stream);
+  return cuda::recordEvent(stream);
+}
+
+template <class T>
+cuda::Event CudaTensor<T>::gatherAtAsync(const Tensor<long>& indices,
+                                         Tensor<T>& out) const {
+  auto stream = cuda::getCurrentStream();
+  gatherInto(detail::elementOffsets(this->sizes(), this->strides(),
+                                    this->storageOffset(), indices, true),
+             out, stream);
+  return cuda::recordEvent(stream);
+}
+
 template <class T>
 void CudaTensor<T>::copy(const CudaTensor& src) {
   Ops::_copy(this->t_, src.mut());
@@ -122,13 +249,117 @@ void CudaTensor<T>::copyTo(Tensor<U>& dest) const {
   Ops::_copyTo(dest.mut(), this->mut());
 }
 
+namespace detail {
+
+template <class A, class B>
+void checkAsyncCopy(const A& dest, const B& src) {
+  if (!dest.isContiguous() || !src.isContiguous()) {
+    throw std::invalid_argument(
+        "Asynchronous copy requires contiguous tensors");
+  }
+  if (dest.size() != src.size()) {
+    throw std::invalid_argument("Asynchronous copy size mismatch");
+  }
+}
+
+}  // namespace detail
+
+template <class T>
+cuda::Event CudaTensor<T>::copyAsync(const CudaTensor& src,
+                                     cudaStream_t stream) {
+  detail::checkAsyncCopy(*this, src);
+  cuda::check(cudaMemcpyAsync(this->data(), src.data(),
+                              this->size() * sizeof(T),
+                              cudaMemcpyDeviceToDevice, stream));
+  return cuda::recordEvent(stream);
+}
+
+template <class T>
+cuda::Event CudaTensor<T>::copyAsync(const Tensor<T>& src,
+                                     cudaStream_t stream) {
+  detail::checkAsyncCopy(*this, src);
+  cuda::check(cudaMemcpyAsync(this->data(), src.data(),
+                              this->size() * sizeof(T),
+                              cudaMemcpyHostToDevice, stream));
+  return cuda::recordEvent(stream);
+}
+
+template <class T>
+cuda::Event CudaTensor<T>::copyToAsync(Tensor<T>& dest,
+                                       cudaStream_t stream) const {
+  detail::checkAsyncCopy(dest, *this);
+  cuda::check(cudaMemcpyAsync(dest.data(), this->data(),
+                              this->size() * sizeof(T),
+                              cudaMemcpyDeviceToHost, stream));
+  return cuda::recordEvent(stream);
+}
+
+// As with CudaStorage::toCPU, the destination is pinned memory.
 template <class T>
 typename Tensor<T>::Ptr CudaTensor<T>::toCPU() const {
-  auto cpuTensor = Tensor<T>::makePtr(this->sizes());
+  auto cpuTensor = Tensor<T>::makePtr(
+      pinnedStorage<T>(this->size()), 0, this->sizes());
   copyTo(*cpuTensor);
   return cpuTensor;
 }
 
+template <class T>
+template <class Pred>
+bool CudaTensor<T>::allElements(const CudaTensor& a, const CudaTensor& b,
+                                Pred pred) {
+  if (a.size() == 0) {
+    return true;
+  }
+  auto ca = a.toCPU();
+  auto cb = b.toCPU();
+  return detail::allElements(ca->ndims(), ca->sizes().data(),
+                             ca->data(), ca->strides().data(),
+                             cb->data(), cb->strides().data(),
+                             pred);
+}
+
+template <class T>
+void CudaTensor<T>::deserializeInto(const ThriftTensor& in) {
+  detail::checkDeserializeSizes(this->sizes(), in);
+  if (!this->isContiguous()) {
+    // Let THC scatter on the device
+    this->copy(Tensor<T>(in));
+    return;
+  }
+  auto data = detail::deserializeAs<T>(in);
+  if (data.computeChainDataLength() != this->size() * sizeof(T)) {
+    throw std::invalid_argument("Thrift tensor data doesn't match sizes");
+  }
+  auto stream = cuda::getCurrentStream();
+  detail::cudaCopyFromIOBuf(this->data(), data, stream);
+  cuda::recordEvent(stream).wait();
+}
+
+template <class T>
+cuda::Event CudaTensor<T>::deserializeAsync(const ThriftTensor& in,
+                                            cudaStream_t stream) {
+  // Shares memory with in.data, unless byte swapped, widened, or
+  // decompressed
+  auto data = detail::deserializeAs<T>(in);
+  LongRange sizes(in.sizes.data(), in.sizes.size());
+  if (!this->isContiguous()) {
+    *this = CudaTensor(sizes);
+  } else {
+    this->resize(sizes);
+  }
+  if (data.computeChainDataLength() != this->size() * sizeof(T)) {
+    throw std::invalid_argument("Thrift tensor data doesn't match sizes");
+  }
+  detail::cudaCopyFromIOBuf(this->data(), data, stream);
+  auto event = cuda::recordEvent(stream);
+  if (in.endianness != detail::gMachineEndianness ||
+      in.dataType != detail::dataType<T>() ||
+      in.compression != ThriftTensorCompression::NONE) {
+    event.wait();  // data is about to go away
+  }
+  return event;
+}
+
 template <class T>
 auto CudaTensor<T>::toDevice(int device) const -> Ptr {
   int currentDevice = getDevice();
@@ -143,13 +374,110 @@ auto CudaTensor<T>::toDevice(int device) const -> Ptr {
   return result;
 }
 
+namespace detail {
+
+// Contiguous tensor on device with the same sizes as src, or nullptr if src
+// is already there
+template <class T>
+typename CudaTensor<T>::Ptr allocateOnDevice(const CudaTensor<T>& src,
+                                             int device) {
+  int srcDevice = src.getDevice();
+  if (srcDevice == -1 || srcDevice == device) {
+    return typename CudaTensor<T>::Ptr();
+  }
+  cuda::enablePeerAccess(device, srcDevice);
+  auto result = CudaTensor<T>::makePtr();
+  result->resize(src.sizes());
+  return result;
+}
+
+// Enqueue the copy of src into dest on stream, after the work pending on
+// THC's stream on the source device (which may still be writing src). Peer
+// copies are plain memcpys, so a non-contiguous src is compacted first, into
+// the returned temporary; as it may go back to a caching allocator (and be
+// reused) as soon as it's freed, it must outlive the copy.
+template <class T>
+CudaTensor<T> copyPeerAsync(CudaTensor<T>& dest, int device,
+                            const CudaTensor<T>& src, cudaStream_t stream) {
+  CudaTensor<T> csrc(src);
+  {
+    cuda::DeviceGuard guard;
+    cuda::setDevice(src.getDevice());
+    csrc.force(CudaTensor<T>::CONTIGUOUS);
+    cuda::recordEvent(cuda::getCurrentStream()).block(stream);
+  }
+  cuda::check(cudaMemcpyPeerAsync(dest.data(), device,
+                                  csrc.data(), csrc.getDevice(),
+                                  csrc.size() * sizeof(T), stream));
+  return csrc;
+}
+
+}  // namespace detail
+
+template <class T>
+auto CudaTensor<T>::toDevice(int device, cudaStream_t stream) const -> Ptr {
+  Ptr result;
+  {
+    cuda::DeviceGuard guard;
+    cuda::setDevice(device);
+    result = detail::allocateOnDevice(*this, device);
+  }
+  if (!result) {
+    return this->copyPtr();
+  }
+  // Keeps the compacted temporary, if any, alive until the copy is done
+  auto csrc = detail::copyPeerAsync(*result, device, *this, stream);
+  if (!this->isContiguous()) {
+    cuda::recordEvent(stream).wait();
+  }
+  return result;
+}
+
+template <class T>
+std::vector<typename CudaTensor<T>::Ptr> toDevice(
+    const std::vector<typename CudaTensor<T>::Ptr>& tensors,
+    int device,
+    cudaStream_t stream) {
+  std::vector<typename CudaTensor<T>::Ptr> results;
+  results.reserve(tensors.size());
+  {
+    cuda::DeviceGuard guard;
+    cuda::setDevice(device);
+    for (auto& t : tensors) {
+      results.push_back(detail::allocateOnDevice(*t, device));
+    }
+  }
+  std::vector<CudaTensor<T>> temporaries;
+  for (size_t i = 0; i < tensors.size(); ++i) {
+    if (results[i]) {
+      auto csrc = detail::copyPeerAsync(*results[i], device, *tensors[i],
+                                        stream);
+      if (!tensors[i]->isContiguous()) {
+        temporaries.push_back(std::move(csrc));
+      }
+    } else {
+      results[i] = tensors[i]->copyPtr();
+    }
+  }
+  // Once for all compacted tensors, after all copies are enqueued
+  if (!temporaries.empty()) {
+    cuda::recordEvent(stream).wait();
+  }
+  return results;
+}
+
 #define TENSOR_ARGM_OP(name) \
   template <class T> \
   auto CudaTensor<T>::name(int dim) const \
   -> std::pair<CudaTensor, CudaTensor> { \
     std::pair<CudaTensor, CudaTensor> dest; \
-    Ops::_ ## name(dest.first.t_, dest.second.t_, this->mut(), dim); \
+    name(dim, dest.first, dest.second); \
     return dest; \
+  } \
+  template <class T> \
+  void CudaTensor<T>::name(int dim, CudaTensor& out, \
+                           CudaTensor& indices) const { \
+    Ops::_ ## name(out.t_, indices.t_, this->mut(), dim); \
   }
 TENSOR_ARGM_OP(min)
 TENSOR_ARGM_OP(max)
@@ -161,22 +489,82 @@ int CudaTensor<T>::getDevice() const {
 }
 
 namespace detail {
+
+// Number of storage elements from the first element of t to its last
+template <class T>
+size_t storageSpan(const CudaTensor<T>& t) {
+  if (t.size() == 0) {
+    return 0;
+  }
+  size_t span = 1;
+  for (int i = 0; i < t.ndims(); ++i) {
+    span += (t.size(i) - 1) * t.stride(i);
+  }
+  return span;
+}
+
+}  // namespace detail
+
+template <class T>
+cuda::Event CudaTensor<T>::prefetchTo(int device, cudaStream_t stream) const {
+  typename Base::StorageBuffer buf;
+  return this->storageRef(&buf).prefetchTo(device, stream,
+                                           this->storageOffset(),
+                                           detail::storageSpan(*this));
+}
+
+template <class T>
+void CudaTensor<T>::advise(cudaMemoryAdvise advice, int device) const {
+  typename Base::StorageBuffer buf;
+  this->storageRef(&buf).advise(advice, device, this->storageOffset(),
+                                detail::storageSpan(*this));
+}
+
+namespace detail {
+// Fill in out for contiguous device-resident data (see
+// CudaTensor::serializeOnDevice): native byte order, uncompressed, no
+// checksum.
 void cudaTensorSerialize(
     ThriftTensor& out,
     LongRange sizes,
-    LongRange strides,
-    const void* data,
-    ThriftTensorDataType dtype,
-    size_t elementSize,
-    ThriftTensorEndianness endianness);
+    folly::IOBuf&& data,
+    ThriftTensorDataType dtype);
 }  // namespace detail
 
 template <class T>
 void CudaTensor<T>::serialize(
     ThriftTensor& out,
     ThriftTensorEndianness endianness,
-    SharingMode /*sharing*/) const {
-  toCPU()->serialize(out, endianness, SHARE_ALL);
+    SharingMode /*sharing*/,
+    ThriftTensorCompression compression,
+    ThriftTensorChecksum checksum) const {
+  toCPU()->serialize(out, endianness, SHARE_ALL, nullptr, compression,
+                     checksum);
+}
+
+template <class T>
+cuda::Event CudaTensor<T>::serializeOnDevice(ThriftTensor& out,
+                                             SharingMode sharing) const {
+  auto stream = cuda::getCurrentStream();
+  folly::IOBuf data;
+  if (this->size() != 0) {
+    if (this->isContiguous() && sharing != SHARE_NONE) {
+      typename Base::StorageBuffer buf;
+      data = detail::shareCudaStorage(this->storageRef(&buf),
+                                      this->storageOffset(), this->size());
+    } else {
+      // Gather on the device, straight into the buffer that we return
+      size_t len = this->size() * sizeof(T);
+      data = createCudaIOBuf(len, getDevice());
+      data.append(len);
+      CudaTensor<T> dest(CudaStorage<T>(data, SHARE_ALL, false), 0,
+                         LongStorage(this->sizes()));
+      dest.copy(*this);
+    }
+  }
+  detail::cudaTensorSerialize(out, this->sizes(), std::move(data),
+                              detail::dataType<T>());
+  return cuda::recordEvent(stream);
 }
 
 }  // namespaces
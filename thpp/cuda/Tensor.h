@@ -17,6 +17,7 @@ class CudaTensor : public TensorBase<T, CudaStorage<T>, CudaTensor<T>> {
   typedef TensorBase<T, CudaStorage<T>, CudaTensor<T>> Base;
   typedef typename Base::Ops Ops;
   friend class TensorPtr<CudaTensor>;
+  friend Base;
  public:
   typedef typename Base::StorageType StorageType;
   typedef typename Base::offset_type offset_type;
@@ -45,7 +46,9 @@ class CudaTensor : public TensorBase<T, CudaStorage<T>, CudaTensor<T>> {
 
   explicit CudaTensor(const Tensor<T>& cpuTensor);
 
-  // Deserialize from Thrift. Throws if wrong type.
+  // Deserialize from Thrift. Throws if wrong type. The data is copied
+  // straight from thriftTensor.data to the device, without an intermediate
+  // CPU Tensor.
   explicit CudaTensor(const ThriftTensor& thriftTensor,
                       SharingMode sharing = SHARE_IOBUF_MANAGED);
 
@@ -63,9 +66,32 @@ class CudaTensor : public TensorBase<T, CudaStorage<T>, CudaTensor<T>> {
   CudaTensor& operator=(const CudaTensor& other);
   /* noexcept override */ CudaTensor& operator=(CudaTensor&& other);
 
+  // Each call is a synchronous transfer from the device; use gather() to
+  // read more than a few elements.
   T at(offset_type idx) const { return at({idx}); }
   T at(std::initializer_list<offset_type> indices) const;
 
+  // Read the elements at the given positions with one gather on the device
+  // and a single transfer of the (compact) result to the host. indices
+  // holds linear positions in [0, size()), as in a contiguous (row-major)
+  // copy of this tensor; the result has the sizes of indices, and is backed
+  // by pinned memory. Throws std::invalid_argument if an index is out of
+  // range.
+  Tensor<T> gather(const Tensor<long>& indices) const;
+
+  // Same, but each row of indices (which has sizes [n, ndims()]) is a full
+  // index, as in at({i, j, ...}). The result has n elements.
+  Tensor<T> gatherAt(const Tensor<long>& indices) const;
+
+  // Asynchronous versions, ordered with respect to other THC work on the
+  // current stream (see cuda::getCurrentStream()). out must be contiguous
+  // and have as many elements as the result would; it's filled in once the
+  // returned event has completed, and should be pinned for the transfer to
+  // be asynchronous.
+  cuda::Event gatherAsync(const Tensor<long>& indices, Tensor<T>& out) const;
+  cuda::Event gatherAtAsync(const Tensor<long>& indices,
+                            Tensor<T>& out) const;
+
   // Copy from another tensor
   void copy(const CudaTensor& src);
 
@@ -76,31 +102,107 @@ class CudaTensor : public TensorBase<T, CudaStorage<T>, CudaTensor<T>> {
   template <class U>
   void copyTo(Tensor<U>& dest) const;
 
+  // Asynchronous copies, ordered with respect to other work on stream.
+  // Both tensors must be contiguous and have the same number of elements
+  // (throws std::invalid_argument otherwise). The CPU tensor must remain
+  // allocated (and, when copying from it, unmodified) until the returned
+  // event has completed; see CudaStorage::readAsync for pinned memory.
+  cuda::Event copyAsync(const CudaTensor& src, cudaStream_t stream);
+  cuda::Event copyAsync(const Tensor<T>& src, cudaStream_t stream);
+  cuda::Event copyToAsync(Tensor<T>& dest, cudaStream_t stream) const;
+
   // <max, argmax>
   std::pair<CudaTensor, CudaTensor> max(int dim) const;
+  void max(int dim, CudaTensor& out, CudaTensor& indices) const;
 
   // <min, argmin>
   std::pair<CudaTensor, CudaTensor> min(int dim) const;
+  void min(int dim, CudaTensor& out, CudaTensor& indices) const;
 
   // Return the CUDA device that this tensor is based on
   int getDevice() const;
 
-  // Serialize to Thrift. Won't ever share CUDA memory.
+  // For tensors in managed memory (see CudaManagedAllocator): prefetch /
+  // advise the part of the storage that this tensor spans, for example
+  // the hot rows of an embedding table; see CudaStorage::prefetchTo() and
+  // CudaStorage::advise().
+  cuda::Event prefetchTo(int device, cudaStream_t stream) const;
+  void advise(cudaMemoryAdvise advice, int device) const;
+
+  // Serialize to Thrift. Won't ever share CUDA memory. See
+  // Tensor::serialize for compression and checksums.
   void serialize(ThriftTensor& out,
                  ThriftTensorEndianness endianness =
                      ThriftTensorEndianness::NATIVE,
-                 SharingMode sharing = SHARE_IOBUF_MANAGED) const;
-
-  // Copy to CPU
+                 SharingMode sharing = SHARE_IOBUF_MANAGED,
+                 ThriftTensorCompression compression =
+                     ThriftTensorCompression::NONE,
+                 ThriftTensorChecksum checksum =
+                     ThriftTensorChecksum::NONE) const;
+
+  // Serialize to Thrift without staging the data in host memory, for
+  // transports that can read GPU memory directly; see
+  // CudaStorage::serializeOnDevice. Contiguous tensors share memory with
+  // out.data (unless sharing is SHARE_NONE); others are gathered on the
+  // device, on the current stream. Don't read out.data until the returned
+  // event has completed.
+  cuda::Event serializeOnDevice(ThriftTensor& out,
+                                SharingMode sharing = SHARE_IOBUF_MANAGED)
+    const;
+
+  // Deserialize from Thrift into the existing device memory of this tensor,
+  // which must already have the serialized sizes (but may have any
+  // strides); see Tensor::deserializeInto.
+  void deserializeInto(const ThriftTensor& thriftTensor);
+
+  // Deserialize from Thrift into this tensor, asynchronously on stream.
+  // The tensor is resized to the serialized sizes; the existing device
+  // memory is reused if it is large enough and the tensor is contiguous.
+  // See CudaStorage::deserializeAsync for lifetime requirements.
+  cuda::Event deserializeAsync(const ThriftTensor& thriftTensor,
+                               cudaStream_t stream);
+
+  // Copy to CPU. The result is contiguous, and backed by pinned memory.
   typename Tensor<T>::Ptr toCPU() const;
 
   // Copy to given CUDA device, unless already there.
   Ptr toDevice(int device) const;
 
+  // Same, but copy directly between devices (peer to peer), asynchronously
+  // on stream, enabling peer access if needed. If the devices can't access
+  // each other, the copy is staged through the host by the CUDA driver.
+  // The result is contiguous. The tensor must not be modified until stream
+  // has finished the copy, which is ordered after the work already enqueued
+  // on the source device's current stream. Non-contiguous tensors are compacted into a
+  // temporary first, and the call then waits for the copy to complete.
+  Ptr toDevice(int device, cudaStream_t stream) const;
+
+ protected:
+  // Bulk-copy both tensors to the host (one transfer each) and compare
+  // there, rather than reading individual elements from the device.
+  template <class Pred>
+  static bool allElements(const CudaTensor& a, const CudaTensor& b,
+                          Pred pred);
+
  private:
   CudaTensor(detail::SetTH, THType* t, bool incRef);
+
+  // Enqueue the gather and the transfer into out on stream. offsets are
+  // 1-based storage offsets, from detail::elementOffsets.
+  void gatherInto(const Tensor<long>& offsets, Tensor<T>& out,
+                  cudaStream_t stream) const;
 };
 
+// Copy a batch of tensors to the given device, as in
+// CudaTensor::toDevice(device, stream). All destinations are allocated up
+// front, and all copies are then enqueued back to back on stream; if any
+// tensors had to be compacted, the call waits once, for all copies.
+template <class T>
+std::vector<typename CudaTensor<T>::Ptr> toDevice(
+    const std::vector<typename CudaTensor<T>::Ptr>& tensors,
+    int device,
+    cudaStream_t stream);
+
 template <class D, class S>
 void copyTensor(Tensor<D>& dest, const CudaTensor<S>& src) {
   src.copyTo(dest);
@@ -0,0 +1,114 @@
+/*
+ * Copyright 2016 Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <deque>
+
+#include <thpp/TensorStream.h>
+#include <thpp/cuda/PinnedMemory.h>
+#include <thpp/cuda/Tensor.h>
+#include <thpp/detail/ByteSwap.h>
+
+namespace thpp {
+
+// Streaming serialization of a CUDA tensor (see serializeStreaming in
+// thpp/TensorStream.h). The data is copied to the host in chunks of at most
+// chunkSize bytes, on a separate stream, into pinned buffers from pool;
+// the copy of the next chunk is in flight while sink handles the current
+// one, so that sending a large tensor takes about as long as the slower of
+// the device-to-host copy and the sink, rather than their sum.
+//
+// The chunks handed to sink are pinned buffers, which go back to the pool
+// when sink is done with them. Non-contiguous tensors are first made
+// contiguous on the device (which is much faster than the host transfer).
+// The copies wait for work already enqueued on the current stream.
+template <class T>
+void serializeStreaming(ThriftTensor& header,
+                        const CudaTensor<T>& src,
+                        const TensorChunkSink& sink,
+                        ThriftTensorEndianness endianness =
+                           ThriftTensorEndianness::NATIVE,
+                        size_t chunkSize = kDefaultTensorChunkSize,
+                        PinnedMemoryPool& pool =
+                           PinnedMemoryPool::defaultInstance()) {
+  if (endianness == ThriftTensorEndianness::NATIVE) {
+    endianness = detail::gMachineEndianness;
+  } else {
+    CHECK(endianness == ThriftTensorEndianness::LITTLE ||
+          endianness == ThriftTensorEndianness::BIG)
+      << "Invalid endianness " << int(endianness);
+  }
+  const bool swap = (endianness != detail::gMachineEndianness);
+
+  header = ThriftTensor();
+  header.dataType = detail::dataType<T>();
+  header.endianness = endianness;
+  header.sizes.assign(src.sizes().begin(), src.sizes().end());
+  if (src.ndims() == 0 || src.size() == 0) {
+    return;
+  }
+
+  CudaTensor<T> contig(src, CudaTensor<T>::CONTIGUOUS);
+  cuda::Stream copyStream;
+  cuda::recordEvent(cuda::getCurrentStream()).block(copyStream);
+
+  const size_t chunkElements = std::max(chunkSize / sizeof(T), size_t(1));
+  const T* p = contig.data();
+  size_t left = contig.size();
+
+  struct Chunk {
+    folly::IOBuf buf;
+    cuda::Event copied;
+  };
+  // Two chunks in flight: one being copied, one being handled by sink
+  constexpr size_t kDepth = 2;
+  std::deque<Chunk> chunks;
+
+  try {
+    while (left != 0 || !chunks.empty()) {
+      while (left != 0 && chunks.size() < kDepth) {
+        size_t n = std::min(left, chunkElements);
+        auto buf = pool.allocate(n * sizeof(T));
+        cuda::check(cudaMemcpyAsync(buf.writableData(), p, n * sizeof(T),
+                                    cudaMemcpyDeviceToHost, copyStream));
+        buf.append(n * sizeof(T));
+        chunks.push_back(Chunk{std::move(buf),
+                               cuda::recordEvent(copyStream)});
+        p += n;
+        left -= n;
+      }
+
+      auto& chunk = chunks.front();
+      chunk.copied.wait();
+      if (swap) {
+        detail::byteSwap(chunk.buf.writableData(), chunk.buf.data(),
+                         chunk.buf.length() / sizeof(T), sizeof(T));
+      }
+      std::unique_ptr<folly::IOBuf> out(new folly::IOBuf(
+          std::move(chunk.buf)));
+      chunks.pop_front();
+      sink(std::move(out));
+    }
+  } catch (...) {
+    // Don't return buffers to the pool while copies into them are pending
+    cudaStreamSynchronize(copyStream);
+    throw;
+  }
+}
+
+}  // namespaces
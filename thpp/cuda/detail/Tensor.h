@@ -7,6 +7,7 @@
 #define THPP_CUDA_DETAIL_TENSOR_H_
 
 #include <THC.h>
+#include <thpp/OpStats.h>
 #include <thpp/cuda/detail/Storage.h>
 
 namespace thpp {
@@ -73,6 +74,44 @@ template <> struct TensorOps<CudaTensor<float>> {
     THCudaTensor_setStorage1d(
         getTHCState(), self, storage, offset, size0, stride0);
   }
+  static void _setStorage2d(THCudaTensor* self, THCudaStorage* storage,
+                            long offset, long size0, long stride0,
+                            long size1, long stride1) {
+    THCudaTensor_setStorage2d(
+        getTHCState(), self, storage, offset, size0, stride0,
+        size1, stride1);
+  }
+  static void _setStorage3d(THCudaTensor* self, THCudaStorage* storage,
+                            long offset, long size0, long stride0,
+                            long size1, long stride1,
+                            long size2, long stride2) {
+    THCudaTensor_setStorage3d(
+        getTHCState(), self, storage, offset, size0, stride0,
+        size1, stride1, size2, stride2);
+  }
+  static void _setStorage4d(THCudaTensor* self, THCudaStorage* storage,
+                            long offset, long size0, long stride0,
+                            long size1, long stride1,
+                            long size2, long stride2,
+                            long size3, long stride3) {
+    THCudaTensor_setStorage4d(
+        getTHCState(), self, storage, offset, size0, stride0,
+        size1, stride1, size2, stride2, size3, stride3);
+  }
+  static void _resize1d(THCudaTensor* self, long size0) {
+    THCudaTensor_resize1d(getTHCState(), self, size0);
+  }
+  static void _resize2d(THCudaTensor* self, long size0, long size1) {
+    THCudaTensor_resize2d(getTHCState(), self, size0, size1);
+  }
+  static void _resize3d(THCudaTensor* self, long size0, long size1,
+                        long size2) {
+    THCudaTensor_resize3d(getTHCState(), self, size0, size1, size2);
+  }
+  static void _resize4d(THCudaTensor* self, long size0, long size1,
+                        long size2, long size3) {
+    THCudaTensor_resize4d(getTHCState(), self, size0, size1, size2, size3);
+  }
   static void _narrow(THCudaTensor* self, THCudaTensor* src, int dim,
                       long firstIndex, long size) {
     THCudaTensor_narrow(getTHCState(), self, src, dim, firstIndex, size);
@@ -104,7 +143,18 @@ template <> struct TensorOps<CudaTensor<float>> {
     return THCudaTensor_free(getTHCState(), self);
   }
 
+  // Operand sizes for THPP_OP_STATS
+  static uint64_t _bytes(const THCudaTensor* t) {
+    return uint64_t(_nElement(t)) * sizeof(float);
+  }
+  static uint64_t _indexedElements(const THCudaTensor* t, int dim,
+                                   THLongTensor* index) {
+    long n = THCudaTensor_size(getTHCState(), t, dim);
+    return n == 0 ? 0 : _nElement(t) / n * THLongTensor_nElement(index);
+  }
+
   static void _copy(THCudaTensor* self, THCudaTensor* src) {
+    THPP_OP_STATS(copy, kLuaTypeName, _nElement(src), 2 * _bytes(src));
     THCudaTensor_copy(getTHCState(), self, src);
   }
 
@@ -116,124 +166,173 @@ template <> struct TensorOps<CudaTensor<float>> {
 
   // THCudaTensorMath.h
   static void _fill(THCudaTensor* r, float value) {
+    THPP_OP_STATS(fill, kLuaTypeName, _nElement(r), _bytes(r));
     THCudaTensor_fill(getTHCState(), r, value);
   }
   static void _zero(THCudaTensor* r) {
+    THPP_OP_STATS(zero, kLuaTypeName, _nElement(r), _bytes(r));
     THCudaTensor_zero(getTHCState(), r);
   }
   // Two overloads each: with data on device (as THCudaTensor) or on host
   // (as THByteTensor)
   static void _maskedFill(THCudaTensor* tensor, THByteTensor* mask,
                           float value) {
+    THPP_OP_STATS(maskedFill, kLuaTypeName, _nElement(tensor),
+                  _bytes(tensor) + _nElement(tensor));
     THCudaTensor_maskedFillByte(getTHCState(), tensor, mask, value);
   }
   static void _maskedFill(THCudaTensor* tensor, THCudaByteTensor* mask,
                           float value) {
+    THPP_OP_STATS(maskedFill, kLuaTypeName, _nElement(tensor),
+                  _bytes(tensor) + _nElement(tensor));
     THCudaTensor_maskedFill(getTHCState(), tensor, mask, value);
   }
   static void _maskedCopy(THCudaTensor* tensor, THByteTensor* mask,
                           THCudaTensor* src) {
+    THPP_OP_STATS(maskedCopy, kLuaTypeName, _nElement(tensor),
+                  _bytes(tensor) + _bytes(src) + _nElement(tensor));
     THCudaTensor_maskedCopyByte(getTHCState(), tensor, mask, src);
   }
   static void _maskedCopy(THCudaTensor* tensor, THCudaByteTensor* mask,
                           THCudaTensor* src) {
+    THPP_OP_STATS(maskedCopy, kLuaTypeName, _nElement(tensor),
+                  _bytes(tensor) + _bytes(src) + _nElement(tensor));
     THCudaTensor_maskedCopy(getTHCState(), tensor, mask, src);
   }
   static void _maskedSelect(THCudaTensor* tensor, THCudaTensor* src,
                             THByteTensor* mask) {
+    THPP_OP_STATS(maskedSelect, kLuaTypeName, _nElement(src),
+                  2 * _bytes(src) + _nElement(src));
     THCudaTensor_maskedSelectByte(getTHCState(), tensor, src, mask);
   }
   static void _maskedSelect(THCudaTensor* tensor, THCudaTensor* src,
                             THCudaByteTensor* mask) {
+    THPP_OP_STATS(maskedSelect, kLuaTypeName, _nElement(src),
+                  2 * _bytes(src) + _nElement(src));
     THCudaTensor_maskedSelect(getTHCState(), tensor, src, mask);
   }
   static void _indexSelect(THCudaTensor* tensor, THCudaTensor* src, int dim,
                            THLongTensor* index) {
+    THPP_OP_STATS(indexSelect, kLuaTypeName, _indexedElements(src, dim, index),
+                  2 * sizeof(float) * _indexedElements(src, dim, index) +
+                    sizeof(long) * THLongTensor_nElement(index));
     THCudaTensor_indexSelect_long(getTHCState(), tensor, src, dim, index);
   }
   static void _indexCopy(THCudaTensor* tensor, int dim, THLongTensor* index,
                          THCudaTensor* src) {
+    THPP_OP_STATS(indexCopy, kLuaTypeName, _nElement(src),
+                  2 * _bytes(src) +
+                    sizeof(long) * THLongTensor_nElement(index));
     THCudaTensor_indexCopy_long(getTHCState(), tensor, dim, index, src);
   }
   static void _indexFill(THCudaTensor* tensor, int dim, THLongTensor* index,
                          float val) {
+    THPP_OP_STATS(indexFill, kLuaTypeName, _indexedElements(tensor, dim, index),
+                  sizeof(float) * _indexedElements(tensor, dim, index) +
+                    sizeof(long) * THLongTensor_nElement(index));
     THCudaTensor_indexFill_long(getTHCState(), tensor, dim, index, val);
   }
   static float _dot(THCudaTensor* t, THCudaTensor* src) {
+    THPP_OP_STATS(dot, kLuaTypeName, _nElement(t), 2 * _bytes(t));
     return THCudaTensor_dot(getTHCState(), t, src);
   }
   static float _minall(THCudaTensor* t) {
+    THPP_OP_STATS(minall, kLuaTypeName, _nElement(t), _bytes(t));
     return THCudaTensor_minall(getTHCState(), t);
   }
   static float _maxall(THCudaTensor* t) {
+    THPP_OP_STATS(maxall, kLuaTypeName, _nElement(t), _bytes(t));
     return THCudaTensor_maxall(getTHCState(), t);
   }
   static float _sumall(THCudaTensor* t) {
+    THPP_OP_STATS(sumall, kLuaTypeName, _nElement(t), _bytes(t));
     return THCudaTensor_sumall(getTHCState(), t);
   }
   static float _prodall(THCudaTensor* t) {
+    THPP_OP_STATS(prodall, kLuaTypeName, _nElement(t), _bytes(t));
     return THCudaTensor_prodall(getTHCState(), t);
   }
   static void _add(THCudaTensor* r, THCudaTensor* t, float value) {
+    THPP_OP_STATS(add, kLuaTypeName, _nElement(t), 2 * _bytes(t));
     return THCudaTensor_add(getTHCState(), r, t, value);
   }
   static void _mul(THCudaTensor* r, THCudaTensor* t, float value) {
+    THPP_OP_STATS(mul, kLuaTypeName, _nElement(t), 2 * _bytes(t));
     return THCudaTensor_mul(getTHCState(), r, t, value);
   }
   static void _div(THCudaTensor* r, THCudaTensor* t, float value) {
+    THPP_OP_STATS(div, kLuaTypeName, _nElement(t), 2 * _bytes(t));
     return THCudaTensor_div(getTHCState(), r, t, value);
   }
   static void _cadd(THCudaTensor* r, THCudaTensor* t, float value,
                     THCudaTensor* src) {
+    THPP_OP_STATS(cadd, kLuaTypeName, _nElement(t), 3 * _bytes(t));
     return THCudaTensor_cadd(getTHCState(), r, t, value, src);
   }
   static void _cmul(THCudaTensor* r, THCudaTensor* t, THCudaTensor* src) {
+    THPP_OP_STATS(cmul, kLuaTypeName, _nElement(t), 3 * _bytes(t));
     return THCudaTensor_cmul(getTHCState(), r, t, src);
   }
   static void _cdiv(THCudaTensor* r, THCudaTensor* t, THCudaTensor* src) {
+    THPP_OP_STATS(cdiv, kLuaTypeName, _nElement(t), 3 * _bytes(t));
     return THCudaTensor_cdiv(getTHCState(), r, t, src);
   }
   static void _addcmul(THCudaTensor* r, THCudaTensor* t, float value,
                        THCudaTensor* src1, THCudaTensor* src2) {
+    THPP_OP_STATS(addcmul, kLuaTypeName, _nElement(t), 4 * _bytes(t));
     return THCudaTensor_addcmul(getTHCState(), r, t, value, src1, src2);
   }
   static void _addcdiv(THCudaTensor* r, THCudaTensor* t, float value,
                        THCudaTensor* src1, THCudaTensor* src2) {
+    THPP_OP_STATS(addcdiv, kLuaTypeName, _nElement(t), 4 * _bytes(t));
     return THCudaTensor_addcdiv(getTHCState(), r, t, value, src1, src2);
   }
   static void _addmv(THCudaTensor* r, float beta, THCudaTensor* t, float alpha,
                      THCudaTensor* mat, THCudaTensor* vec) {
+    THPP_OP_STATS(addmv, kLuaTypeName, _nElement(t),
+                  2 * _bytes(t) + _bytes(mat) + _bytes(vec));
     return THCudaTensor_addmv(getTHCState(), r, beta, t, alpha, mat, vec);
   }
   static void _addmm(THCudaTensor* r, float beta, THCudaTensor* t, float alpha,
                      THCudaTensor* m1, THCudaTensor* m2) {
+    THPP_OP_STATS(addmm, kLuaTypeName, _nElement(t),
+                  2 * _bytes(t) + _bytes(m1) + _bytes(m2));
     return THCudaTensor_addmm(getTHCState(), r, beta, t, alpha, m1, m2);
   }
   static void _addr(THCudaTensor* r, float beta, THCudaTensor* t, float alpha,
                     THCudaTensor* vec1, THCudaTensor* vec2) {
+    THPP_OP_STATS(addr, kLuaTypeName, _nElement(t),
+                  2 * _bytes(t) + _bytes(vec1) + _bytes(vec2));
     return THCudaTensor_addr(getTHCState(), r, beta, t, alpha, vec1, vec2);
   }
   static void _max(THCudaTensor* values, THCudaLongTensor* indices,
                    THCudaTensor* t, int dim) {
+    THPP_OP_STATS(max, kLuaTypeName, _nElement(t), _bytes(t));
     return THCudaTensor_max(getTHCState(), values, indices, t, dim);
   }
   static void _min(THCudaTensor* values, THCudaLongTensor* indices,
                    THCudaTensor* t, int dim) {
+    THPP_OP_STATS(min, kLuaTypeName, _nElement(t), _bytes(t));
     return THCudaTensor_min(getTHCState(), values, indices, t, dim);
   }
   static void _sum(THCudaTensor* r, THCudaTensor* t, int dim) {
+    THPP_OP_STATS(sum, kLuaTypeName, _nElement(t), _bytes(t));
     return THCudaTensor_sum(getTHCState(), r, t, dim);
   }
   static void _prod(THCudaTensor* r, THCudaTensor* t, int dim) {
+    THPP_OP_STATS(prod, kLuaTypeName, _nElement(t), _bytes(t));
     return THCudaTensor_prod(getTHCState(), r, t, dim);
   }
   static void _cumsum(THCudaTensor* r, THCudaTensor* t, int dim) {
+    THPP_OP_STATS(cumsum, kLuaTypeName, _nElement(t), 2 * _bytes(t));
     return THCudaTensor_cumsum(getTHCState(), r, t, dim);
   }
   static void _cumprod(THCudaTensor* r, THCudaTensor* t, int dim) {
+    THPP_OP_STATS(cumprod, kLuaTypeName, _nElement(t), 2 * _bytes(t));
     return THCudaTensor_cumprod(getTHCState(), r, t, dim);
   }
   static void _sign(THCudaTensor* r, THCudaTensor* t) {
+    THPP_OP_STATS(sign, kLuaTypeName, _nElement(t), 2 * _bytes(t));
     return THCudaTensor_sign(getTHCState(), r, t);
   }
 
@@ -247,10 +346,14 @@ template <> struct TensorOps<CudaTensor<float>> {
 #define S(TYPE) \
   template <> inline void TensorOps<CudaTensor<float>>::_copyFrom< \
       TH##TYPE##Tensor>(THCudaTensor* self, TH##TYPE##Tensor* src) { \
+        THPP_OP_STATS(copyFromHost, kLuaTypeName, _nElement(self), \
+                      2 * _bytes(self)); \
         return THCudaTensor_copy##TYPE(getTHCState(), self, src); \
       } \
   template <> inline void TensorOps<CudaTensor<float>>::_copyTo< \
       TH##TYPE##Tensor>(TH##TYPE##Tensor* dest, THCudaTensor* src) { \
+        THPP_OP_STATS(copyToHost, kLuaTypeName, _nElement(src), \
+                      2 * _bytes(src)); \
         return TH##TYPE##Tensor_copyCudaFloat(getTHCState(), dest, src); \
       }
 
@@ -0,0 +1,112 @@
+/*
+ * Copyright 2016 Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Benchmarks for host <-> device transfers. As in thpp/test/Benchmark.cpp,
+// every benchmark returns the number of bytes it transferred, so
+// "iters/s" is bytes per second.
+
+#include <thpp/cuda/Storage.h>
+#include <thpp/cuda/Tensor.h>
+
+#include <map>
+#include <vector>
+
+#include <folly/Benchmark.h>
+#include <folly/init/Init.h>
+
+namespace thpp { namespace {
+
+constexpr long kSmall = 1L << 12;  // elements
+constexpr long kLarge = 1L << 24;
+
+// Fixtures are built once per set of parameters, with the timer suspended;
+// see thpp/test/Benchmark.cpp.
+template <class Value, class Key, class Make>
+Value& fixture(const Key& key, Make make) {
+  static std::map<Key, Value> fixtures;
+  auto pos = fixtures.find(key);
+  if (pos == fixtures.end()) {
+    BENCHMARK_SUSPEND {
+      pos = fixtures.emplace(key, make()).first;
+    }
+  }
+  return pos->second;
+}
+
+size_t toCPU(long n) {
+  auto& t = fixture<CudaTensor<float>>(n, [n] {
+    CudaTensor<float> t({n});
+    t.fill(1);
+    return t;
+  });
+  auto cpu = t.toCPU();
+  folly::doNotOptimizeAway(cpu->data());
+  return n * sizeof(float);
+}
+
+size_t toGPU(long n) {
+  auto& t = fixture<Tensor<float>>(n, [n] {
+    Tensor<float> t({n});
+    t.fill(1);
+    return t;
+  });
+  CudaTensor<float> gpu(t);
+  folly::doNotOptimizeAway(gpu.data());
+  return n * sizeof(float);
+}
+
+BENCHMARK_MULTI(ToCPU_Small) { return toCPU(kSmall); }
+BENCHMARK_MULTI(ToCPU_Large) { return toCPU(kLarge); }
+BENCHMARK_MULTI(ToGPU_Small) { return toGPU(kSmall); }
+BENCHMARK_MULTI(ToGPU_Large) { return toGPU(kLarge); }
+
+BENCHMARK_MULTI(ToDevice_Large) {
+  int numDevices = 0;
+  cudaGetDeviceCount(&numDevices);
+  static CudaTensor<float> t({kLarge});
+  auto other = t.toDevice(numDevices > 1 ? 1 : 0);
+  folly::doNotOptimizeAway(other->data());
+  return kLarge * sizeof(float);
+}
+
+BENCHMARK_DRAW_LINE();
+
+static std::vector<float> gHost(kLarge, 1.0f);
+
+size_t storageRead(size_t n) {
+  static CudaStorage<float> s(Storage<float>(kLarge, 1.0f));
+  s.read(0, gHost.data(), n);
+  return n * sizeof(float);
+}
+
+size_t storageWrite(size_t n) {
+  static CudaStorage<float> s(Storage<float>(kLarge, 1.0f));
+  s.write(0, gHost.data(), n);
+  return n * sizeof(float);
+}
+
+BENCHMARK_MULTI(CudaStorageRead_Small) { return storageRead(kSmall); }
+BENCHMARK_MULTI(CudaStorageRead_Large) { return storageRead(kLarge); }
+BENCHMARK_MULTI(CudaStorageWrite_Small) { return storageWrite(kSmall); }
+BENCHMARK_MULTI(CudaStorageWrite_Large) { return storageWrite(kLarge); }
+
+}}  // namespaces
+
+int main(int argc, char* argv[]) {
+  folly::init(&argc, &argv);
+  folly::runBenchmarks();
+  return 0;
+}
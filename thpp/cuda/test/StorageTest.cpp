@@ -3,10 +3,15 @@
  * @author Tudor Bosman (tudorb@fb.com)
  */
 
+#include <thpp/cuda/CachingAllocator.h>
 #include <thpp/cuda/CudaIOBuf.h>
+#include <thpp/cuda/ManagedAllocator.h>
+#include <thpp/cuda/PinnedMemory.h>
 #include <thpp/cuda/Storage.h>
 #include <cuda_runtime.h>
 
+#include <thread>
+
 #include <glog/logging.h>
 #include <gtest/gtest.h>
 
@@ -55,4 +60,132 @@ TEST(Storage, CudaIOBuf) {
   testStorage(storage);
 }
 
+TEST(Storage, CudaIOBufResizable) {
+  constexpr size_t n = 100;
+  auto buf = createCudaIOBuf(2 * n * sizeof(float));
+  buf.append(n * sizeof(float));
+  CudaStorage<float> storage(std::move(buf), SHARE_IOBUF_MANAGED, true);
+  auto ptr = storage.data();
+  storage.write(n - 1, 42.0f);
+
+  // Fits in the tailroom
+  storage.resizeUninitialized(2 * n);
+  EXPECT_EQ(2 * n, storage.size());
+  EXPECT_EQ(ptr, storage.data());
+  testStorage(storage);
+
+  // Doesn't fit; must move, and preserve the contents
+  storage.write(n - 1, 42.0f);
+  storage.resizeUninitialized(4 * n);
+  EXPECT_EQ(4 * n, storage.size());
+  EXPECT_NE(ptr, storage.data());
+  EXPECT_EQ(42.0f, storage.read(n - 1));
+  testStorage(storage);
+}
+
+TEST(Storage, CachingAllocator) {
+  constexpr size_t n = 1000;
+  CudaCachingAllocator allocator;
+  void* ptr;
+  {
+    auto storage = CudaStorage<float>::withAllocator(
+        allocator.thcAllocator(), &allocator);
+    storage.resizeUninitialized(n);
+    testStorage(storage);
+    ptr = storage.data();
+  }
+  auto stats = allocator.stats();
+  EXPECT_EQ(0, stats.allocatedBytes);
+  EXPECT_LE(n * sizeof(float), stats.cachedBytes);
+
+  // Same stream, same size: reused
+  {
+    auto buf = createCudaIOBuf(n * sizeof(float), allocator, -1,
+                               cuda::getCurrentStream());
+    EXPECT_EQ(ptr, buf.data());
+  }
+  EXPECT_EQ(1, allocator.stats().hits);
+
+  // Used on another stream: only reused once that stream is done
+  cuda::Stream stream;
+  void* p;
+  ASSERT_EQ(cudaSuccess, allocator.malloc(nullptr, &p, 4096, stream));
+  allocator.recordStream(p, cuda::getCurrentStream());
+  ASSERT_EQ(cudaSuccess, allocator.free(nullptr, p));
+  EXPECT_EQ(cudaSuccess, cudaDeviceSynchronize());
+  void* q;
+  ASSERT_EQ(cudaSuccess, allocator.malloc(nullptr, &q, 4096, stream));
+  EXPECT_EQ(p, q);
+  ASSERT_EQ(cudaSuccess, allocator.free(nullptr, q));
+
+  allocator.trim();
+  EXPECT_EQ(0, allocator.stats().cachedBytes);
+}
+
+TEST(Storage, ManagedMemory) {
+  constexpr size_t n = 1000;
+  auto storage = managedStorage<float>(n);
+  EXPECT_TRUE(storage.isManaged());
+  EXPECT_EQ(n, storage.size());
+  testStorage(storage);
+
+  cuda::Stream stream;
+  storage.advise(cudaMemAdviseSetReadMostly, 0);
+  storage.prefetchTo(getDevice(), stream, 100, 200).wait();
+  storage.prefetchTo(cudaCpuDeviceId, stream).wait();
+  // Accessible from the host
+  EXPECT_EQ(storage.read(7), storage.data()[7]);
+
+  // Grows like any other storage, preserving the contents
+  storage.write(n - 1, 42.0f);
+  storage.resizeUninitialized(2 * n);
+  EXPECT_TRUE(storage.isManaged());
+  EXPECT_EQ(42.0f, storage.data()[n - 1]);
+
+  EXPECT_THROW(storage.prefetchTo(0, stream, 2 * n + 1), std::invalid_argument);
+  CudaStorage<float> device;
+  device.resizeUninitialized(n);
+  EXPECT_FALSE(device.isManaged());
+  EXPECT_THROW(device.prefetchTo(0, stream), std::invalid_argument);
+}
+
+TEST(Storage, PinnedMemoryPool) {
+  PinnedMemoryPool pool;
+  void* ptr;
+  {
+    auto buf = pool.allocate(1000);
+    EXPECT_LE(1000, buf.capacity());
+    ptr = buf.writableData();
+    cudaPointerAttributes attr;
+    EXPECT_EQ(cudaSuccess, cudaPointerGetAttributes(&attr, ptr));
+    EXPECT_EQ(cudaMemoryTypeHost, attr.memoryType);
+  }
+  EXPECT_LT(0, pool.cachedBytes());
+  EXPECT_EQ(ptr, pool.allocate(2000).writableData());
+  pool.trim();
+  EXPECT_EQ(0, pool.cachedBytes());
+}
+
+TEST(Storage, ToCPU) {
+  constexpr size_t n = 100;
+  CudaStorage<float> storage;
+  storage.resizeUninitialized(n);
+  EXPECT_EQ(cudaSuccess, cudaMemset(storage.data(), 0, n * sizeof(float)));
+  storage.write(42, 1.0f);
+  auto cpu = storage.toCPU();
+  EXPECT_EQ(n, cpu.size());
+  EXPECT_EQ(1.0f, cpu.at(42));
+  EXPECT_EQ(0.0f, cpu.at(41));
+}
+
+TEST(State, Shared) {
+  useSharedTHCState();
+  THCState* states[2];
+  std::thread t1([&] { warmup({0}); states[0] = getTHCState(); });
+  std::thread t2([&] { states[1] = getTHCState(); });
+  t1.join();
+  t2.join();
+  EXPECT_EQ(states[0], states[1]);
+}
+
 }}}  // namespaces
@@ -4,6 +4,7 @@
  */
 
 #include <thpp/cuda/Tensor.h>
+#include <thpp/cuda/TensorStream.h>
 
 #include <vector>
 
@@ -82,4 +83,124 @@ TEST(SerializationTest, Simple) {
   runTest({20, 30}, {8192 * 30, 8192});
 }
 
+TEST(SerializationTest, DeserializeAsyncChained) {
+  Tensor<float> src = createTensor({20, 30});
+  ThriftTensor serialized;
+  src.serialize(serialized);
+
+  // Split the data so that an element straddles two buffers
+  auto tail = serialized.data.clone();
+  serialized.data.trimEnd(serialized.data.length() - 1001);
+  tail->trimStart(1001);
+  serialized.data.prependChain(std::move(tail));
+
+  cuda::Stream stream;
+  CudaTensor<float> dest({20, 30});
+  auto ptr = dest.data();
+  dest.deserializeAsync(serialized, stream).wait();
+  EXPECT_EQ(ptr, dest.data());  // reused the device memory
+  EXPECT_TRUE(src.isExactlyEqual(*dest.toCPU()));
+}
+
+TEST(SerializationTest, DeserializeInto) {
+  Tensor<float> src = createTensor({20, 30});
+  ThriftTensor serialized;
+  src.serialize(serialized, ThriftTensorEndianness::BIG);
+
+  CudaTensor<float> contig({20, 30});
+  CudaTensor<float> strided({30, 20});
+  strided.transpose(0, 1);
+  for (auto dest : {&contig, &strided}) {
+    auto ptr = dest->data();
+    dest->deserializeInto(serialized);
+    EXPECT_EQ(ptr, dest->data());
+    EXPECT_TRUE(src.isExactlyEqual(*dest->toCPU()));
+  }
+
+  CudaTensor<float> wrongSize({20, 31});
+  EXPECT_THROW(wrongSize.deserializeInto(serialized), std::invalid_argument);
+}
+
+TEST(SerializationTest, OnDevice) {
+  Tensor<float> src = createTensor({20, 30});
+  CudaTensor<float> contig(src);
+  CudaTensor<float> strided({30, 20});
+  strided.transpose(0, 1);
+  strided.copy(src);
+
+  auto isDevice = [] (const folly::IOBuf& buf) {
+    cudaPointerAttributes attr;
+    cuda::check(cudaPointerGetAttributes(&attr, buf.data()));
+    return attr.memoryType == cudaMemoryTypeDevice;
+  };
+
+  for (auto cudaSrc : {&contig, &strided}) {
+    for (auto sharing : {SHARE_NONE, SHARE_IOBUF_MANAGED}) {
+      ThriftTensor serialized;
+      cudaSrc->serializeOnDevice(serialized, sharing).wait();
+      EXPECT_TRUE(isDevice(serialized.data));
+      EXPECT_EQ(sizeof(float) * src.size(),
+                serialized.data.computeChainDataLength());
+      EXPECT_EQ(cudaSrc == &contig && sharing != SHARE_NONE,
+                serialized.data.data() ==
+                  reinterpret_cast<const uint8_t*>(cudaSrc->data()));
+
+      CudaTensor<float> deserialized(serialized);
+      EXPECT_TRUE(src.isExactlyEqual(*deserialized.toCPU()));
+    }
+  }
+
+  CudaStorage<float> storage(Storage<float>({1, 2, 3}));
+  ThriftStorage serializedStorage;
+  storage.serializeOnDevice(serializedStorage).wait();
+  EXPECT_TRUE(isDevice(serializedStorage.data));
+  CudaStorage<float> deserializedStorage(serializedStorage);
+  EXPECT_EQ(3, deserializedStorage.read(2));
+}
+
+TEST(SerializationTest, Streaming) {
+  Tensor<float> src = createTensor({20, 30});
+  CudaTensor<float> strided({30, 20});
+  strided.transpose(0, 1);
+  strided.copy(src);
+
+  for (auto endianness : {ThriftTensorEndianness::NATIVE,
+                          ThriftTensorEndianness::BIG}) {
+    ThriftTensor header;
+    std::vector<std::unique_ptr<folly::IOBuf>> chunks;
+    serializeStreaming(header, strided,
+                       [&] (std::unique_ptr<folly::IOBuf> chunk) {
+                         chunks.push_back(std::move(chunk));
+                       },
+                       endianness, 1001);
+    EXPECT_TRUE(header.data.empty());
+
+    size_t total = 0;
+    for (auto& chunk : chunks) {
+      EXPECT_LE(chunk->length(), 1000);
+      EXPECT_EQ(0, chunk->length() % sizeof(float));
+      total += chunk->length();
+    }
+    EXPECT_EQ(src.size() * sizeof(float), total);
+
+    Tensor<float> dest;
+    TensorStreamReader<float> reader(dest, header);
+    for (auto& chunk : chunks) {
+      reader.append(*chunk);
+    }
+    reader.finish();
+    EXPECT_TRUE(src.isExactlyEqual(dest));
+  }
+
+  // Nothing was left behind in flight
+  ThriftTensor header;
+  EXPECT_THROW(
+      serializeStreaming(header, strided,
+                         [] (std::unique_ptr<folly::IOBuf>) {
+                           throw std::runtime_error("sink failed");
+                         },
+                         ThriftTensorEndianness::NATIVE, 1000),
+      std::runtime_error);
+}
+
 }}  // namespaces
@@ -5,6 +5,7 @@
 
 #include <thpp/cuda/Tensor.h>
 
+#include <glog/logging.h>
 #include <gtest/gtest.h>
 
 #include <thpp/test/CommonTestLib.h>
@@ -89,6 +90,55 @@ TEST_F(TensorTest, At) {
   EXPECT_EQ(50403, a.at({2, 3, 4}));
 }
 
+TEST_F(TensorTest, Gather) {
+  // Linear positions in a transposed (non-contiguous) tensor
+  CudaFloatTensor t(a);
+  t.transpose(0, 2);  // sizes [30, 20, 10]
+  LongTensor linear({2, 2});
+  linear.at({0, 0}) = 0;  // the first element of the storage
+  linear.at({0, 1}) = 1;
+  linear.at({1, 0}) = 3 * 200 + 2 * 10 + 1;
+  linear.at({1, 1}) = 5999;
+  auto values = t.gather(linear);
+  EXPECT_EQ((std::vector<long>{2, 2}),
+            std::vector<long>(values.sizes().begin(), values.sizes().end()));
+  EXPECT_EQ(t.at({0, 0, 0}), values.at({0, 0}));
+  EXPECT_EQ(t.at({0, 0, 1}), values.at({0, 1}));
+  EXPECT_EQ(t.at({3, 2, 1}), values.at({1, 0}));
+  EXPECT_EQ(t.at({29, 19, 9}), values.at({1, 1}));
+
+  LongTensor multi({2, 3});
+  long idx[] = {1, 2, 3, 29, 0, 9};
+  std::copy(idx, idx + 6, multi.data());
+  auto atValues = t.gatherAt(multi);
+  EXPECT_EQ(2, atValues.size());
+  EXPECT_EQ(t.at({1, 2, 3}), atValues.at(0));
+  EXPECT_EQ(t.at({29, 0, 9}), atValues.at(1));
+
+  FloatTensor out({2});
+  t.gatherAtAsync(multi, out).wait();
+  EXPECT_TRUE(out.isExactlyEqual(atValues));
+
+  linear.at({1, 1}) = 6000;
+  EXPECT_THROW(t.gather(linear), std::invalid_argument);
+  EXPECT_THROW(t.gatherAt(linear), std::invalid_argument);
+  FloatTensor wrongSize({3});
+  EXPECT_THROW(t.gatherAtAsync(multi, wrongSize), std::invalid_argument);
+  EXPECT_EQ(0, t.gather(LongTensor()).size());
+}
+
+TEST_F(TensorTest, Equal) {
+  EXPECT_TRUE(a.isExactlyEqual(a));
+  EXPECT_FALSE(a.isExactlyEqual(b));
+  EXPECT_FALSE(a.isApproximatelyEqual(b));
+
+  CudaFloatTensor c(a, CudaFloatTensor::UNIQUE);
+  c.transpose();
+  CudaFloatTensor d(c, CudaFloatTensor::CONTIGUOUS);
+  EXPECT_TRUE(c.isExactlyEqual(d));
+  EXPECT_TRUE(d.isApproximatelyEqual(c));
+}
+
 TEST_F(TensorTest, UniqueMove) {
   testUniqueMove<CudaTensor<float>>();
 }
@@ -97,4 +147,51 @@ TEST_F(TensorTest, TensorPtr) {
   testTensorPtr<CudaTensor<float>>();
 }
 
+TEST_F(TensorTest, FrozenTensorPtr) {
+  testFrozenTensorPtr<CudaTensor<float>>();
+}
+
+TEST_F(TensorTest, CopyAsync) {
+  cuda::Stream stream;
+  auto cpuA = a.toCPU();
+  CudaFloatTensor c({10, 20, 30});
+  FloatTensor d({10, 20, 30});
+
+  auto e1 = c.copyAsync(*cpuA, stream);
+  auto e2 = b.copyAsync(c, stream);
+  auto e3 = b.copyToAsync(d, stream);
+  e3.wait();
+  EXPECT_TRUE(e1.ready());
+  EXPECT_TRUE(e2.ready());
+  EXPECT_TRUE(cpuA->isExactlyEqual(d));
+
+  CudaFloatTensor t(a);
+  t.transpose();
+  EXPECT_THROW(t.copyToAsync(d, stream), std::invalid_argument);
+}
+
+TEST_F(TensorTest, ToDevicePeer) {
+  int numDevices = 0;
+  ASSERT_EQ(cudaSuccess, cudaGetDeviceCount(&numDevices));
+  if (numDevices < 2) {
+    LOG(INFO) << "Need at least two devices, skipping";
+    return;
+  }
+  int device = (a.getDevice() + 1) % numDevices;
+  cuda::Stream stream;
+
+  auto c = a.toDevice(device, stream);
+  CudaFloatTensor bt(b);
+  bt.transpose();
+  auto batch = toDevice<float>({a.copyPtr(), bt.copyPtr()}, device, stream);
+  stream.synchronize();
+
+  EXPECT_EQ(device, c->getDevice());
+  EXPECT_TRUE(a.toCPU()->isExactlyEqual(*c->toCPU()));
+  ASSERT_EQ(2, batch.size());
+  EXPECT_EQ(device, batch[1]->getDevice());
+  EXPECT_TRUE(a.toCPU()->isExactlyEqual(*batch[0]->toCPU()));
+  EXPECT_TRUE(bt.toCPU()->isExactlyEqual(*batch[1]->toCPU()));
+}
+
 }}  // namespaces
@@ -0,0 +1,317 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+#include <thpp/detail/ByteSwap.h>
+#include <thpp/CopyStats.h>
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#ifndef NO_FOLLY
+#include <glog/logging.h>
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define THPP_BYTESWAP_X86 1
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define THPP_BYTESWAP_NEON 1
+#endif
+
+namespace thpp { namespace detail {
+
+namespace {
+
+template <class U> U bswap(U x);
+template <> inline uint16_t bswap(uint16_t x) { return __builtin_bswap16(x); }
+template <> inline uint32_t bswap(uint32_t x) { return __builtin_bswap32(x); }
+template <> inline uint64_t bswap(uint64_t x) { return __builtin_bswap64(x); }
+
+template <class U>
+void byteSwapScalar(uint8_t* dest, const uint8_t* src, size_t n) {
+  for (size_t i = 0; i < n; ++i) {
+    U v;
+    memcpy(&v, src + i * sizeof(U), sizeof(U));
+    v = bswap(v);
+    memcpy(dest + i * sizeof(U), &v, sizeof(U));
+  }
+}
+
+typedef void (*SwapFn)(uint8_t*, const uint8_t*, size_t);
+
+#ifdef THPP_BYTESWAP_X86
+
+// Shuffle masks reversing each 2-, 4-, or 8-byte group within a 16-byte lane
+alignas(32) const uint8_t kMask2[32] = {
+  1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14,
+  1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14,
+};
+alignas(32) const uint8_t kMask4[32] = {
+  3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+  3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+};
+alignas(32) const uint8_t kMask8[32] = {
+  7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8,
+  7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8,
+};
+
+template <class U>
+const uint8_t* maskFor() {
+  return sizeof(U) == 2 ? kMask2 : sizeof(U) == 4 ? kMask4 : kMask8;
+}
+
+template <class U>
+__attribute__((__target__("ssse3")))
+void byteSwapSSSE3(uint8_t* dest, const uint8_t* src, size_t n) {
+  const __m128i mask =
+    _mm_load_si128(reinterpret_cast<const __m128i*>(maskFor<U>()));
+  size_t nbytes = n * sizeof(U);
+  size_t i = 0;
+  for (; i + 16 <= nbytes; i += 16) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dest + i),
+                     _mm_shuffle_epi8(v, mask));
+  }
+  byteSwapScalar<U>(dest + i, src + i, (nbytes - i) / sizeof(U));
+}
+
+template <class U>
+__attribute__((__target__("avx2")))
+void byteSwapAVX2(uint8_t* dest, const uint8_t* src, size_t n) {
+  const __m256i mask =
+    _mm256_load_si256(reinterpret_cast<const __m256i*>(maskFor<U>()));
+  size_t nbytes = n * sizeof(U);
+  size_t i = 0;
+  // Two vectors per iteration to keep both load ports busy
+  for (; i + 64 <= nbytes; i += 64) {
+    __m256i v0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+    __m256i v1 =
+      _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i + 32));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dest + i),
+                        _mm256_shuffle_epi8(v0, mask));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dest + i + 32),
+                        _mm256_shuffle_epi8(v1, mask));
+  }
+  for (; i + 32 <= nbytes; i += 32) {
+    __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dest + i),
+                        _mm256_shuffle_epi8(v, mask));
+  }
+  byteSwapScalar<U>(dest + i, src + i, (nbytes - i) / sizeof(U));
+}
+
+template <class U>
+SwapFn selectSwapFn() {
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    return &byteSwapAVX2<U>;
+  }
+  if (__builtin_cpu_supports("ssse3")) {
+    return &byteSwapSSSE3<U>;
+  }
+  return &byteSwapScalar<U>;
+}
+
+#elif defined(THPP_BYTESWAP_NEON)
+
+template <class U> uint8x16_t reverse(uint8x16_t v);
+template <> inline uint8x16_t reverse<uint16_t>(uint8x16_t v) {
+  return vrev16q_u8(v);
+}
+template <> inline uint8x16_t reverse<uint32_t>(uint8x16_t v) {
+  return vrev32q_u8(v);
+}
+template <> inline uint8x16_t reverse<uint64_t>(uint8x16_t v) {
+  return vrev64q_u8(v);
+}
+
+template <class U>
+void byteSwapNEON(uint8_t* dest, const uint8_t* src, size_t n) {
+  size_t nbytes = n * sizeof(U);
+  size_t i = 0;
+  for (; i + 16 <= nbytes; i += 16) {
+    vst1q_u8(dest + i, reverse<U>(vld1q_u8(src + i)));
+  }
+  byteSwapScalar<U>(dest + i, src + i, (nbytes - i) / sizeof(U));
+}
+
+template <class U>
+SwapFn selectSwapFn() {
+  return &byteSwapNEON<U>;
+}
+
+#else
+
+template <class U>
+SwapFn selectSwapFn() {
+  return &byteSwapScalar<U>;
+}
+
+#endif
+
+// One pass over the elements, writing K sequential output streams
+template <size_t K>
+void byteShuffleImpl(uint8_t* dest, const uint8_t* src, size_t n) {
+  for (size_t i = 0; i < n; ++i) {
+    for (size_t j = 0; j < K; ++j) {
+      dest[j * n + i] = src[i * K + j];
+    }
+  }
+}
+
+template <size_t K>
+void byteUnshuffleImpl(uint8_t* dest, const uint8_t* src, size_t n) {
+  for (size_t i = 0; i < n; ++i) {
+    for (size_t j = 0; j < K; ++j) {
+      dest[i * K + j] = src[j * n + i];
+    }
+  }
+}
+
+template <class U>
+void byteSwapDispatch(uint8_t* dest, const uint8_t* src, size_t n) {
+  static const SwapFn fn = selectSwapFn<U>();
+  fn(dest, src, n);
+}
+
+}  // namespace
+
+void byteSwap(void* dest, const void* src, size_t n, size_t elementSize) {
+  auto d = static_cast<uint8_t*>(dest);
+  auto s = static_cast<const uint8_t*>(src);
+  switch (elementSize) {
+  case 1:
+    if (d != s) {
+      memcpy(d, s, n);
+    }
+    break;
+  case 2:
+    byteSwapDispatch<uint16_t>(d, s, n);
+    break;
+  case 4:
+    byteSwapDispatch<uint32_t>(d, s, n);
+    break;
+  case 8:
+    byteSwapDispatch<uint64_t>(d, s, n);
+    break;
+  default:
+    throw std::invalid_argument("Invalid element size for byte swap");
+  }
+}
+
+void byteShuffle(void* dest, const void* src, size_t n, size_t elementSize) {
+  auto d = static_cast<uint8_t*>(dest);
+  auto s = static_cast<const uint8_t*>(src);
+  switch (elementSize) {
+  case 1:
+    memcpy(d, s, n);
+    break;
+  case 2:
+    byteShuffleImpl<2>(d, s, n);
+    break;
+  case 4:
+    byteShuffleImpl<4>(d, s, n);
+    break;
+  case 8:
+    byteShuffleImpl<8>(d, s, n);
+    break;
+  default:
+    throw std::invalid_argument("Invalid element size for byte shuffle");
+  }
+}
+
+void byteUnshuffle(void* dest, const void* src, size_t n,
+                   size_t elementSize) {
+  auto d = static_cast<uint8_t*>(dest);
+  auto s = static_cast<const uint8_t*>(src);
+  switch (elementSize) {
+  case 1:
+    memcpy(d, s, n);
+    break;
+  case 2:
+    byteUnshuffleImpl<2>(d, s, n);
+    break;
+  case 4:
+    byteUnshuffleImpl<4>(d, s, n);
+    break;
+  case 8:
+    byteUnshuffleImpl<8>(d, s, n);
+    break;
+  default:
+    throw std::invalid_argument("Invalid element size for byte shuffle");
+  }
+}
+
+#ifndef NO_FOLLY
+
+folly::IOBuf byteSwapped(folly::IOBuf&& data, size_t elementSize) {
+  if (elementSize == 1) {
+    return std::move(data);
+  }
+
+  if (!data.isChained() && !data.isSharedOne()) {
+    if (data.length() % elementSize != 0) {
+      throw std::invalid_argument("IOBuf size must be multiple of data size");
+    }
+    byteSwap(data.writableData(), data.data(), data.length() / elementSize,
+             elementSize);
+    return std::move(data);
+  }
+
+  size_t len = data.computeChainDataLength();
+  if (len % elementSize != 0) {
+    throw std::invalid_argument("IOBuf size must be multiple of data size");
+  }
+
+  recordCopy(CopyReason::BYTE_SWAP, len);
+  folly::IOBuf out(folly::IOBuf::CREATE, len);
+  uint8_t* dest = out.writableTail();
+
+  // Elements that straddle buffer boundaries are assembled here
+  uint8_t carry[8];
+  size_t carryLen = 0;
+
+  const folly::IOBuf* p = &data;
+  do {
+    const uint8_t* src = p->data();
+    size_t n = p->length();
+    if (carryLen != 0) {
+      size_t k = std::min(n, elementSize - carryLen);
+      memcpy(carry + carryLen, src, k);
+      carryLen += k;
+      src += k;
+      n -= k;
+      if (carryLen == elementSize) {
+        byteSwap(dest, carry, 1, elementSize);
+        dest += elementSize;
+        carryLen = 0;
+      }
+    }
+    size_t count = n / elementSize;
+    byteSwap(dest, src, count, elementSize);
+    dest += count * elementSize;
+    src += count * elementSize;
+    n -= count * elementSize;
+    if (n != 0) {
+      memcpy(carry, src, n);
+      carryLen = n;
+    }
+    p = p->next();
+  } while (p != &data);
+
+  DCHECK_EQ(carryLen, 0);
+  out.append(len);
+  return out;
+}
+
+#endif  // !NO_FOLLY
+
+}}  // namespaces
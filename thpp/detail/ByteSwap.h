@@ -0,0 +1,49 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+#ifndef THPP_DETAIL_BYTESWAP_H_
+#define THPP_DETAIL_BYTESWAP_H_
+
+#include <cstddef>
+#include <cstdint>
+#ifndef NO_FOLLY
+#include <folly/io/IOBuf.h>
+#endif
+
+namespace thpp { namespace detail {
+
+// Copy n elements of elementSize bytes each from src to dest, reversing the
+// byte order of every element. src and dest may be equal (swap in place),
+// but may not otherwise overlap. Neither needs to be aligned.
+// elementSize must be 1, 2, 4, or 8.
+//
+// Uses SSSE3 / AVX2 shuffles (selected at runtime) on x86 and NEON on ARM.
+void byteSwap(void* dest, const void* src, size_t n, size_t elementSize);
+
+// Transpose the bytes of n elements of elementSize bytes each: dest gets
+// the first byte of every element, then the second byte of every element,
+// and so on. Floating point data with similar exponents (and integers with
+// similar magnitudes) compresses much better in this layout.
+// byteUnshuffle is the inverse. src and dest may not overlap.
+void byteShuffle(void* dest, const void* src, size_t n, size_t elementSize);
+void byteUnshuffle(void* dest, const void* src, size_t n, size_t elementSize);
+
+#ifndef NO_FOLLY
+// Return an IOBuf containing the same elements as data, with the byte order
+// of each element reversed. data may be chained, and elements may straddle
+// buffer boundaries. If data is a single buffer that isn't shared, the
+// swap happens in place; otherwise, the data is swapped into a fresh buffer
+// in one pass, so the result never shares memory with anything else.
+folly::IOBuf byteSwapped(folly::IOBuf&& data, size_t elementSize);
+#endif
+
+}}  // namespaces
+
+#endif /* THPP_DETAIL_BYTESWAP_H_ */
@@ -0,0 +1,123 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+#include <thpp/detail/Convert.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define THPP_CONVERT_X86 1
+#endif
+
+namespace thpp { namespace detail {
+
+namespace {
+
+template <class D, class S>
+void convertScalar(D* dest, const S* src, size_t n) {
+  for (size_t i = 0; i < n; ++i) {
+    dest[i] = static_cast<D>(src[i]);
+  }
+}
+
+template <class D, class S>
+using ConvertFn = void (*)(D*, const S*, size_t);
+
+#ifdef THPP_CONVERT_X86
+
+__attribute__((__target__("avx2")))
+void convertAVX2(float* dest, const double* src, size_t n) {
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m128 lo = _mm256_cvtpd_ps(_mm256_loadu_pd(src + i));
+    __m128 hi = _mm256_cvtpd_ps(_mm256_loadu_pd(src + i + 4));
+    _mm_storeu_ps(dest + i, lo);
+    _mm_storeu_ps(dest + i + 4, hi);
+  }
+  convertScalar(dest + i, src + i, n - i);
+}
+
+__attribute__((__target__("avx2")))
+void convertAVX2(double* dest, const float* src, size_t n) {
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m128 lo = _mm_loadu_ps(src + i);
+    __m128 hi = _mm_loadu_ps(src + i + 4);
+    _mm256_storeu_pd(dest + i, _mm256_cvtps_pd(lo));
+    _mm256_storeu_pd(dest + i + 4, _mm256_cvtps_pd(hi));
+  }
+  convertScalar(dest + i, src + i, n - i);
+}
+
+__attribute__((__target__("avx2")))
+void convertAVX2(float* dest, const unsigned char* src, size_t n) {
+  size_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+    __m256i lo = _mm256_cvtepu8_epi32(v);
+    __m256i hi = _mm256_cvtepu8_epi32(_mm_srli_si128(v, 8));
+    _mm256_storeu_ps(dest + i, _mm256_cvtepi32_ps(lo));
+    _mm256_storeu_ps(dest + i + 8, _mm256_cvtepi32_ps(hi));
+  }
+  convertScalar(dest + i, src + i, n - i);
+}
+
+__attribute__((__target__("avx2")))
+void convertAVX2(float* dest, const int32_t* src, size_t n) {
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+    _mm256_storeu_ps(dest + i, _mm256_cvtepi32_ps(v));
+  }
+  convertScalar(dest + i, src + i, n - i);
+}
+
+template <class D, class S>
+ConvertFn<D, S> selectConvertFn() {
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    return static_cast<ConvertFn<D, S>>(&convertAVX2);
+  }
+  return &convertScalar<D, S>;
+}
+
+#else
+
+template <class D, class S>
+ConvertFn<D, S> selectConvertFn() {
+  return &convertScalar<D, S>;
+}
+
+#endif
+
+template <class D, class S>
+void convert(D* dest, const S* src, size_t n) {
+  static const ConvertFn<D, S> fn = selectConvertFn<D, S>();
+  fn(dest, src, n);
+}
+
+}  // namespace
+
+void convertElements(float* dest, const double* src, size_t n) {
+  convert(dest, src, n);
+}
+
+void convertElements(double* dest, const float* src, size_t n) {
+  convert(dest, src, n);
+}
+
+void convertElements(float* dest, const unsigned char* src, size_t n) {
+  convert(dest, src, n);
+}
+
+void convertElements(float* dest, const int32_t* src, size_t n) {
+  convert(dest, src, n);
+}
+
+}}  // namespaces
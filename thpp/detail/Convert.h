@@ -0,0 +1,43 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+#ifndef THPP_DETAIL_CONVERT_H_
+#define THPP_DETAIL_CONVERT_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace thpp { namespace detail {
+
+// dest[i] = D(src[i]) for i in [0, n). The common conversions to and from
+// float below use AVX2 (selected at runtime) on x86, with the same results
+// (round to nearest) as the scalar conversion; everything else is a plain
+// loop.
+void convertElements(float* dest, const double* src, size_t n);
+void convertElements(double* dest, const float* src, size_t n);
+void convertElements(float* dest, const unsigned char* src, size_t n);
+void convertElements(float* dest, const int32_t* src, size_t n);
+
+template <class D, class S>
+void convertElements(D* dest, const S* src, size_t n) {
+  for (size_t i = 0; i < n; ++i) {
+    dest[i] = static_cast<D>(src[i]);
+  }
+}
+
+template <class T>
+void convertElements(T* dest, const T* src, size_t n) {
+  memcpy(dest, src, n * sizeof(T));
+}
+
+}}  // namespaces
+
+#endif /* THPP_DETAIL_CONVERT_H_ */
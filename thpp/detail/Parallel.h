@@ -0,0 +1,116 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+#ifndef THPP_DETAIL_PARALLEL_H_
+#define THPP_DETAIL_PARALLEL_H_
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <mutex>
+
+#include <folly/Executor.h>
+
+namespace thpp { namespace detail {
+
+// Wait until a fixed number of tasks have completed, rethrowing the first
+// exception that any of them threw.
+class TaskLatch {
+ public:
+  explicit TaskLatch(size_t n) : count_(n) { }
+
+  template <class F>
+  void run(F&& fn) noexcept {
+    std::exception_ptr ex;
+    try {
+      fn();
+    } catch (...) {
+      ex = std::current_exception();
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (ex && !exception_) {
+      exception_ = ex;
+    }
+    if (--count_ == 0) {
+      cv_.notify_all();
+    }
+  }
+
+  // Count down n tasks that will never run
+  void cancel(size_t n) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    count_ -= n;
+    if (count_ == 0) {
+      cv_.notify_all();
+    }
+  }
+
+  void wait() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    cv_.wait(lock, [this] { return count_ == 0; });
+    if (exception_) {
+      std::rethrow_exception(exception_);
+    }
+  }
+
+ private:
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  size_t count_;
+  std::exception_ptr exception_;
+};
+
+// Run fn(i) for i in [0, n), on executor if not null
+template <class F>
+void runTasks(folly::Executor* executor, size_t n, F fn) {
+  if (!executor || n <= 1) {
+    for (size_t i = 0; i < n; ++i) {
+      fn(i);
+    }
+    return;
+  }
+  TaskLatch latch(n);
+  for (size_t i = 0; i < n; ++i) {
+    try {
+      executor->add([&latch, &fn, i] { latch.run([&fn, i] { fn(i); }); });
+    } catch (...) {
+      // The tasks already queued refer to latch and fn, so wait for them
+      // before rethrowing (the executor's error, not theirs)
+      latch.cancel(n - i);
+      try {
+        latch.wait();
+      } catch (...) { }
+      throw;
+    }
+  }
+  latch.wait();
+}
+
+// Split [0, n) into ranges of about grainSize (but at least 1) elements
+// and run fn(begin, end) for each, on executor if not null
+template <class F>
+void parallelFor(folly::Executor* executor, size_t n, size_t grainSize,
+                 F fn) {
+  if (n == 0) {
+    return;
+  }
+  grainSize = std::max(grainSize, size_t(1));
+  size_t nTasks = (n + grainSize - 1) / grainSize;
+  size_t chunk = (n + nTasks - 1) / nTasks;
+  runTasks(executor, nTasks, [&] (size_t i) {
+    size_t begin = i * chunk;
+    fn(begin, std::min(begin + chunk, n));
+  });
+}
+
+}}  // namespaces
+
+#endif /* THPP_DETAIL_PARALLEL_H_ */
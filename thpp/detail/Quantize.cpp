@@ -0,0 +1,143 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+#include <thpp/detail/Quantize.h>
+
+#include <cmath>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define THPP_QUANTIZE_X86 1
+#endif
+
+namespace thpp { namespace detail {
+
+namespace {
+
+void quantizeScalar(uint8_t* dest, const float* src, size_t n,
+                    const float* invScale, const float* zeroPoint,
+                    size_t paramStride) {
+  for (size_t i = 0; i < n; ++i) {
+    size_t p = i * paramStride;
+    float v = src[i] * invScale[p] + zeroPoint[p];
+    // Written so that NaNs compare false and end up as 0
+    v = v > 0 ? v : 0;
+    v = v < 255 ? v : 255;
+    dest[i] = static_cast<uint8_t>(std::nearbyint(v));
+  }
+}
+
+void dequantizeScalar(float* dest, const uint8_t* src, size_t n,
+                      const float* scale, const float* offset,
+                      size_t paramStride) {
+  for (size_t i = 0; i < n; ++i) {
+    size_t p = i * paramStride;
+    dest[i] = float(src[i]) * scale[p] + offset[p];
+  }
+}
+
+typedef void (*QuantizeFn)(uint8_t*, const float*, size_t,
+                           const float*, const float*, size_t);
+typedef void (*DequantizeFn)(float*, const uint8_t*, size_t,
+                             const float*, const float*, size_t);
+
+#ifdef THPP_QUANTIZE_X86
+
+__attribute__((__target__("avx2")))
+void quantizeAVX2(uint8_t* dest, const float* src, size_t n,
+                  const float* invScale, const float* zeroPoint,
+                  size_t paramStride) {
+  const __m256 lo = _mm256_setzero_ps();
+  const __m256 hi = _mm256_set1_ps(255);
+  __m256 inv = _mm256_set1_ps(invScale[0]);
+  __m256 zp = _mm256_set1_ps(zeroPoint[0]);
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    if (paramStride != 0) {
+      inv = _mm256_loadu_ps(invScale + i);
+      zp = _mm256_loadu_ps(zeroPoint + i);
+    }
+    __m256 v = _mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(src + i), inv),
+                             zp);
+    // max returns its second operand if either is NaN
+    v = _mm256_min_ps(_mm256_max_ps(v, lo), hi);
+    __m256i q = _mm256_cvtps_epi32(v);  // nearest even
+    __m128i q16 = _mm_packus_epi32(_mm256_castsi256_si128(q),
+                                   _mm256_extracti128_si256(q, 1));
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(dest + i),
+                     _mm_packus_epi16(q16, q16));
+  }
+  quantizeScalar(dest + i, src + i, n - i, invScale + i * paramStride,
+                 zeroPoint + i * paramStride, paramStride);
+}
+
+__attribute__((__target__("avx2")))
+void dequantizeAVX2(float* dest, const uint8_t* src, size_t n,
+                    const float* scale, const float* offset,
+                    size_t paramStride) {
+  __m256 s = _mm256_set1_ps(scale[0]);
+  __m256 o = _mm256_set1_ps(offset[0]);
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    if (paramStride != 0) {
+      s = _mm256_loadu_ps(scale + i);
+      o = _mm256_loadu_ps(offset + i);
+    }
+    __m128i q = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(src + i));
+    __m256 v = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(q));
+    _mm256_storeu_ps(dest + i, _mm256_add_ps(_mm256_mul_ps(v, s), o));
+  }
+  dequantizeScalar(dest + i, src + i, n - i, scale + i * paramStride,
+                   offset + i * paramStride, paramStride);
+}
+
+bool hasAVX2() {
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("avx2");
+}
+
+QuantizeFn selectQuantizeFn() {
+  return hasAVX2() ? &quantizeAVX2 : &quantizeScalar;
+}
+
+DequantizeFn selectDequantizeFn() {
+  return hasAVX2() ? &dequantizeAVX2 : &dequantizeScalar;
+}
+
+#else
+
+QuantizeFn selectQuantizeFn() { return &quantizeScalar; }
+DequantizeFn selectDequantizeFn() { return &dequantizeScalar; }
+
+#endif
+
+}  // namespace
+
+void quantize(uint8_t* dest, const float* src, size_t n,
+              const float* invScale, const float* zeroPoint,
+              size_t paramStride) {
+  if (n == 0) {
+    return;
+  }
+  static const QuantizeFn fn = selectQuantizeFn();
+  fn(dest, src, n, invScale, zeroPoint, paramStride);
+}
+
+void dequantize(float* dest, const uint8_t* src, size_t n,
+                const float* scale, const float* offset,
+                size_t paramStride) {
+  if (n == 0) {
+    return;
+  }
+  static const DequantizeFn fn = selectDequantizeFn();
+  fn(dest, src, n, scale, offset, paramStride);
+}
+
+}}  // namespaces
@@ -0,0 +1,40 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+#ifndef THPP_DETAIL_QUANTIZE_H_
+#define THPP_DETAIL_QUANTIZE_H_
+
+#include <cstddef>
+#include <cstdint>
+
+namespace thpp { namespace detail {
+
+// Affine 8-bit quantization kernels. Parameters are read from
+// scale[i * paramStride] (and similarly for the others), so paramStride
+// is 0 to use the same parameters for all n elements, or 1 to use separate
+// parameters for each element.
+//
+// quantize: dest[i] = clamp(round(src[i] * invScale + zeroPoint), 0, 255),
+// rounding to nearest even; NaNs become 0. zeroPoint must be integral.
+//
+// dequantize: dest[i] = src[i] * scale + offset, where offset is
+// -zeroPoint * scale.
+//
+// Both use AVX2 (selected at runtime) on x86, with identical results.
+void quantize(uint8_t* dest, const float* src, size_t n,
+              const float* invScale, const float* zeroPoint,
+              size_t paramStride);
+void dequantize(float* dest, const uint8_t* src, size_t n,
+                const float* scale, const float* offset,
+                size_t paramStride);
+
+}}  // namespaces
+
+#endif /* THPP_DETAIL_QUANTIZE_H_ */
@@ -12,6 +12,7 @@
 #define THPP_DETAIL_TENSOR_H_
 
 #include <TH.h>
+#include <thpp/OpStats.h>
 #include <thpp/detail/Storage.h>
 #ifndef NO_FOLLY
 #include <folly/Preprocessor.h>
@@ -24,6 +25,56 @@ template <class T> class Tensor;
 
 namespace detail {
 template <class T> struct TensorOps;
+
+/**
+ * Per-thread cache of THTensor headers, so that creating and destroying
+ * tensors (views, results of small operations, ...) reuses the headers
+ * instead of going to the heap each time. Cached headers don't hold a
+ * storage, and have no dimensions (but keep their size / stride arrays,
+ * which TH reallocates only when the number of dimensions changes), so
+ * they are indistinguishable from new ones.
+ *
+ * freeFn really frees headers when the cache is full, and at thread exit.
+ */
+template <class THType, void (*freeFn)(THType*)>
+class TensorHeaderCache {
+ public:
+  static constexpr int kMaxHeaders = 64;
+
+  // Return a cached header, or nullptr
+  static THType* pop() {
+    auto& c = cache();
+    return c.size > 0 ? c.headers[--c.size] : nullptr;
+  }
+
+  static bool hasRoom() {
+    auto& c = cache();
+    return c.size >= 0 && c.size < kMaxHeaders;
+  }
+
+  // Caller must check hasRoom() first
+  static void push(THType* t) {
+    auto& c = cache();
+    c.headers[c.size++] = t;
+  }
+
+ private:
+  struct Cache {
+    ~Cache() {
+      for (int i = 0; i < size; ++i) {
+        freeFn(headers[i]);
+      }
+      size = -1;  // thread exiting; don't cache any more
+    }
+    THType* headers[kMaxHeaders];
+    int size = 0;
+  };
+
+  static Cache& cache() {
+    static thread_local Cache c;
+    return c;
+  }
+};
 }  // namespace detail
 
 #include <thpp/detail/TensorGeneric.h>
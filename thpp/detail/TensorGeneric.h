@@ -20,6 +20,7 @@ template <> struct TensorOps<Tensor<real>> {
   typedef accreal accurate_type;
   typedef THTensor type;
   typedef Tensor<long> ArgTensorType;
+  typedef TensorHeaderCache<THTensor, &THTensor_(free)> HeaderCache;
 
   static real* _data(THTensor* t) {
     return THTensor_(data)(t);
@@ -31,16 +32,21 @@ template <> struct TensorOps<Tensor<real>> {
     return THTensor_(storageOffset)(t);
   }
   static THTensor* _new() {
-    return THTensor_(new)();
+    auto t = HeaderCache::pop();
+    return t ? t : THTensor_(new)();
   }
   static THTensor* _newWithTensor(THTensor* other) {
-    return THTensor_(newWithTensor)(other);
+    auto t = _new();
+    THTensor_(set)(t, other);
+    return t;
   }
   static THTensor* _newWithStorage(THStorage* storage,
                                    long storageOffset,
                                    THLongStorage* size,
                                    THLongStorage* stride) {
-    return THTensor_(newWithStorage)(storage, storageOffset, size, stride);
+    auto t = _new();
+    THTensor_(setStorage)(t, storage, storageOffset, size, stride);
+    return t;
   }
   static THTensor* _newClone(THTensor* self) {
     return THTensor_(newClone)(self);
@@ -67,6 +73,40 @@ template <> struct TensorOps<Tensor<real>> {
                             long offset, long size0, long stride0) {
     THTensor_(setStorage1d)(self, storage, offset, size0, stride0);
   }
+  static void _setStorage2d(THTensor* self, THStorage* storage,
+                            long offset, long size0, long stride0,
+                            long size1, long stride1) {
+    THTensor_(setStorage2d)(self, storage, offset, size0, stride0,
+                            size1, stride1);
+  }
+  static void _setStorage3d(THTensor* self, THStorage* storage,
+                            long offset, long size0, long stride0,
+                            long size1, long stride1,
+                            long size2, long stride2) {
+    THTensor_(setStorage3d)(self, storage, offset, size0, stride0,
+                            size1, stride1, size2, stride2);
+  }
+  static void _setStorage4d(THTensor* self, THStorage* storage,
+                            long offset, long size0, long stride0,
+                            long size1, long stride1,
+                            long size2, long stride2,
+                            long size3, long stride3) {
+    THTensor_(setStorage4d)(self, storage, offset, size0, stride0,
+                            size1, stride1, size2, stride2, size3, stride3);
+  }
+  static void _resize1d(THTensor* self, long size0) {
+    THTensor_(resize1d)(self, size0);
+  }
+  static void _resize2d(THTensor* self, long size0, long size1) {
+    THTensor_(resize2d)(self, size0, size1);
+  }
+  static void _resize3d(THTensor* self, long size0, long size1, long size2) {
+    THTensor_(resize3d)(self, size0, size1, size2);
+  }
+  static void _resize4d(THTensor* self, long size0, long size1, long size2,
+                        long size3) {
+    THTensor_(resize4d)(self, size0, size1, size2, size3);
+  }
   static void _narrow(THTensor* self, THTensor* src, int dim,
                       long firstIndex, long size) {
     THTensor_(narrow)(self, src, dim, firstIndex, size);
@@ -93,11 +133,36 @@ template <> struct TensorOps<Tensor<real>> {
     return THTensor_(retain)(self);
   }
   static void _free(THTensor* self) {
-    return THTensor_(free)(self);
+    // Our reference is the only one, so nothing else can see the header
+    // any more; drop the storage and cache the header for _new().
+    if (self && (self->flag & TH_TENSOR_REFCOUNTED) && self->refcount == 1 &&
+        HeaderCache::hasRoom()) {
+      auto storage = self->storage;
+      self->storage = nullptr;
+      self->storageOffset = 0;
+      self->nDimension = 0;
+      HeaderCache::push(self);
+      if (storage) {
+        THStorage_(free)(storage);
+      }
+      return;
+    }
+    THTensor_(free)(self);
+  }
+
+  // Operand sizes for THPP_OP_STATS
+  static uint64_t _bytes(const THTensor* t) {
+    return uint64_t(_nElement(t)) * sizeof(real);
+  }
+  static uint64_t _indexedElements(const THTensor* t, int dim,
+                                   THLongTensor* index) {
+    long n = THTensor_(size)(t, dim);
+    return n == 0 ? 0 : _nElement(t) / n * THLongTensor_nElement(index);
   }
 
   // THTensorCopy.h
   static void _copy(THTensor* self, THTensor* src) {
+    THPP_OP_STATS(copy, kLuaTypeName, _nElement(src), 2 * _bytes(src));
     return THTensor_(copy)(self, src);
   }
 
@@ -106,107 +171,150 @@ template <> struct TensorOps<Tensor<real>> {
 
   // THTensorMath.h
   static void _fill(THTensor* r, real value) {
+    THPP_OP_STATS(fill, kLuaTypeName, _nElement(r), _bytes(r));
     THTensor_(fill)(r, value);
   }
   static void _zero(THTensor* r) {
+    THPP_OP_STATS(zero, kLuaTypeName, _nElement(r), _bytes(r));
     THTensor_(zero)(r);
   }
   static void _maskedFill(THTensor* tensor, THByteTensor* mask, real value) {
+    THPP_OP_STATS(maskedFill, kLuaTypeName, _nElement(tensor),
+                  _bytes(tensor) + _nElement(tensor));
     THTensor_(maskedFill)(tensor, mask, value);
   }
   static void _maskedCopy(THTensor* tensor, THByteTensor* mask, THTensor* src) {
+    THPP_OP_STATS(maskedCopy, kLuaTypeName, _nElement(tensor),
+                  _bytes(tensor) + _bytes(src) + _nElement(tensor));
     THTensor_(maskedCopy)(tensor, mask, src);
   }
   static void _maskedSelect(THTensor* tensor, THTensor* src,
                             THByteTensor* mask) {
+    THPP_OP_STATS(maskedSelect, kLuaTypeName, _nElement(src),
+                  2 * _bytes(src) + _nElement(src));
     THTensor_(maskedSelect)(tensor, src, mask);
   }
   static void _indexSelect(THTensor* tensor, THTensor* src, int dim,
                            THLongTensor* index) {
+    THPP_OP_STATS(indexSelect, kLuaTypeName, _indexedElements(src, dim, index),
+                  2 * sizeof(real) * _indexedElements(src, dim, index) +
+                    sizeof(long) * THLongTensor_nElement(index));
     THTensor_(indexSelect)(tensor, src, dim, index);
   }
   static void _indexCopy(THTensor* tensor, int dim, THLongTensor* index,
                          THTensor* src) {
+    THPP_OP_STATS(indexCopy, kLuaTypeName, _nElement(src),
+                  2 * _bytes(src) +
+                    sizeof(long) * THLongTensor_nElement(index));
     THTensor_(indexCopy)(tensor, dim, index, src);
   }
   static void _indexFill(THTensor* tensor, int dim, THLongTensor* index,
                          real val) {
+    THPP_OP_STATS(indexFill, kLuaTypeName, _indexedElements(tensor, dim, index),
+                  sizeof(real) * _indexedElements(tensor, dim, index) +
+                    sizeof(long) * THLongTensor_nElement(index));
     THTensor_(indexFill)(tensor, dim, index, val);
   }
   static accreal _dot(THTensor* t, THTensor* src) {
+    THPP_OP_STATS(dot, kLuaTypeName, _nElement(t), 2 * _bytes(t));
     return THTensor_(dot)(t, src);
   }
   static real _minall(THTensor* t) {
+    THPP_OP_STATS(minall, kLuaTypeName, _nElement(t), _bytes(t));
     return THTensor_(minall)(t);
   }
   static real _maxall(THTensor* t) {
+    THPP_OP_STATS(maxall, kLuaTypeName, _nElement(t), _bytes(t));
     return THTensor_(maxall)(t);
   }
   static accreal _sumall(THTensor* t) {
+    THPP_OP_STATS(sumall, kLuaTypeName, _nElement(t), _bytes(t));
     return THTensor_(sumall)(t);
   }
   static accreal _prodall(THTensor* t) {
+    THPP_OP_STATS(prodall, kLuaTypeName, _nElement(t), _bytes(t));
     return THTensor_(prodall)(t);
   }
   static void _add(THTensor* r, THTensor* t, real value) {
+    THPP_OP_STATS(add, kLuaTypeName, _nElement(t), 2 * _bytes(t));
     return THTensor_(add)(r, t, value);
   }
   static void _mul(THTensor* r, THTensor* t, real value) {
+    THPP_OP_STATS(mul, kLuaTypeName, _nElement(t), 2 * _bytes(t));
     return THTensor_(mul)(r, t, value);
   }
   static void _div(THTensor* r, THTensor* t, real value) {
+    THPP_OP_STATS(div, kLuaTypeName, _nElement(t), 2 * _bytes(t));
     return THTensor_(div)(r, t, value);
   }
   static void _cadd(THTensor* r, THTensor* t, real value, THTensor* src) {
+    THPP_OP_STATS(cadd, kLuaTypeName, _nElement(t), 3 * _bytes(t));
     return THTensor_(cadd)(r, t, value, src);
   }
   static void _cmul(THTensor* r, THTensor* t, THTensor* src) {
+    THPP_OP_STATS(cmul, kLuaTypeName, _nElement(t), 3 * _bytes(t));
     return THTensor_(cmul)(r, t, src);
   }
   static void _cdiv(THTensor* r, THTensor* t, THTensor* src) {
+    THPP_OP_STATS(cdiv, kLuaTypeName, _nElement(t), 3 * _bytes(t));
     return THTensor_(cdiv)(r, t, src);
   }
   static void _addcmul(THTensor* r, THTensor* t, real value, THTensor* src1,
                       THTensor* src2) {
+    THPP_OP_STATS(addcmul, kLuaTypeName, _nElement(t), 4 * _bytes(t));
     return THTensor_(addcmul)(r, t, value, src1, src2);
   }
   static void _addcdiv(THTensor* r, THTensor* t, real value, THTensor* src1,
                       THTensor* src2) {
+    THPP_OP_STATS(addcdiv, kLuaTypeName, _nElement(t), 4 * _bytes(t));
     return THTensor_(addcdiv)(r, t, value, src1, src2);
   }
   static void _addmv(THTensor* r, real beta, THTensor* t, real alpha,
                     THTensor* mat, THTensor* vec) {
+    THPP_OP_STATS(addmv, kLuaTypeName, _nElement(t),
+                  2 * _bytes(t) + _bytes(mat) + _bytes(vec));
     return THTensor_(addmv)(r, beta, t, alpha, mat, vec);
   }
   static void _addmm(THTensor* r, real beta, THTensor* t, real alpha,
                     THTensor* m1, THTensor* m2) {
+    THPP_OP_STATS(addmm, kLuaTypeName, _nElement(t),
+                  2 * _bytes(t) + _bytes(m1) + _bytes(m2));
     return THTensor_(addmm)(r, beta, t, alpha, m1, m2);
   }
   static void _addr(THTensor* r, real beta, THTensor* t, real alpha,
                    THTensor* vec1, THTensor* vec2) {
+    THPP_OP_STATS(addr, kLuaTypeName, _nElement(t),
+                  2 * _bytes(t) + _bytes(vec1) + _bytes(vec2));
     return THTensor_(addr)(r, beta, t, alpha, vec1, vec2);
   }
   static void _max(THTensor* values, THLongTensor* indices,
                    THTensor* t, int dim) {
+    THPP_OP_STATS(max, kLuaTypeName, _nElement(t), _bytes(t));
     return THTensor_(max)(values, indices, t, dim);
   }
   static void _min(THTensor* values, THLongTensor* indices,
                    THTensor* t, int dim) {
+    THPP_OP_STATS(min, kLuaTypeName, _nElement(t), _bytes(t));
     return THTensor_(min)(values, indices, t, dim);
   }
   static void _sum(THTensor* r, THTensor* t, int dim) {
+    THPP_OP_STATS(sum, kLuaTypeName, _nElement(t), _bytes(t));
     return THTensor_(sum)(r, t, dim);
   }
   static void _prod(THTensor* r, THTensor* t, int dim) {
+    THPP_OP_STATS(prod, kLuaTypeName, _nElement(t), _bytes(t));
     return THTensor_(prod)(r, t, dim);
   }
   static void _cumsum(THTensor* r, THTensor* t, int dim) {
+    THPP_OP_STATS(cumsum, kLuaTypeName, _nElement(t), 2 * _bytes(t));
     return THTensor_(cumsum)(r, t, dim);
   }
   static void _cumprod(THTensor* r, THTensor* t, int dim) {
+    THPP_OP_STATS(cumprod, kLuaTypeName, _nElement(t), 2 * _bytes(t));
     return THTensor_(cumprod)(r, t, dim);
   }
   static void _sign(THTensor* r, THTensor* t) {
+    THPP_OP_STATS(sign, kLuaTypeName, _nElement(t), 2 * _bytes(t));
     return THTensor_(sign)(r, t);
   }
 
@@ -221,6 +329,7 @@ template <> struct TensorOps<Tensor<real>> {
 #define S(TYPE) \
   template <> inline void TensorOps<Tensor<real>>::_copyT<TH##TYPE##Tensor>( \
       THTensor* self, TH##TYPE##Tensor* src) { \
+    THPP_OP_STATS(copy, kLuaTypeName, _nElement(self), 2 * _bytes(self)); \
     return THTensor_(copy##TYPE)(self, src); \
   }
 
@@ -0,0 +1,138 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+#ifndef THPP_DETAIL_TENSORITERATION_H_
+#define THPP_DETAIL_TENSORITERATION_H_
+
+#include <array>
+#include <cstddef>
+#include <stdexcept>
+
+namespace thpp { namespace detail {
+
+// Maximum number of dimensions after collapsing (see below); anything
+// beyond this would be a very strange tensor.
+constexpr int kMaxCollapsedDims = 32;
+
+/**
+ * Shape of N tensors with the same sizes (but possibly different strides),
+ * simplified for iteration: dimensions of size 1 are dropped, and adjacent
+ * dimensions that are laid out contiguously with respect to each other in
+ * all N tensors are merged. The innermost dimension (the longest run that
+ * can be handled in one loop) is last.
+ */
+template <size_t N>
+struct CollapsedDims {
+  int ndims = 0;
+  bool empty = true;
+  long sizes[kMaxCollapsedDims];
+  long strides[N][kMaxCollapsedDims];
+};
+
+// Collapse dimensions; sizes and strides are as in THTensor (size, stride).
+template <size_t N>
+void collapseDims(int ndims, const long* sizes,
+                  const std::array<const long*, N>& strides,
+                  CollapsedDims<N>& out) {
+  out.ndims = 0;
+  out.empty = (ndims == 0);
+  for (int i = 0; i < ndims; ++i) {
+    if (sizes[i] == 0) {
+      out.empty = true;
+      out.ndims = 0;
+      return;
+    }
+    if (sizes[i] == 1) {
+      continue;
+    }
+    if (out.ndims != 0) {
+      int last = out.ndims - 1;
+      bool merge = true;
+      for (size_t k = 0; k < N; ++k) {
+        if (out.strides[k][last] != strides[k][i] * sizes[i]) {
+          merge = false;
+          break;
+        }
+      }
+      if (merge) {
+        out.sizes[last] *= sizes[i];
+        for (size_t k = 0; k < N; ++k) {
+          out.strides[k][last] = strides[k][i];
+        }
+        continue;
+      }
+    }
+    if (out.ndims == kMaxCollapsedDims) {
+      throw std::invalid_argument("Too many dimensions");
+    }
+    out.sizes[out.ndims] = sizes[i];
+    for (size_t k = 0; k < N; ++k) {
+      out.strides[k][out.ndims] = strides[k][i];
+    }
+    ++out.ndims;
+  }
+
+  // All dimensions have size 1: one element.
+  if (!out.empty && out.ndims == 0) {
+    out.ndims = 1;
+    out.sizes[0] = 1;
+    for (size_t k = 0; k < N; ++k) {
+      out.strides[k][0] = 1;
+    }
+  }
+}
+
+/**
+ * Call f(offsets, n, innerStrides) for each run along the innermost
+ * collapsed dimension, where offsets[k] is the (element) offset of the
+ * start of the run in tensor k, n is the run length, and innerStrides[k]
+ * is tensor k's stride within the run. Runs are visited in row-major
+ * order. Stops early (and returns false) if f returns false.
+ */
+template <size_t N, class F>
+bool forEachRun(const CollapsedDims<N>& dims, F&& f) {
+  if (dims.empty) {
+    return true;
+  }
+  const int inner = dims.ndims - 1;
+  std::array<long, N> innerStrides;
+  for (size_t k = 0; k < N; ++k) {
+    innerStrides[k] = dims.strides[k][inner];
+  }
+
+  long counter[kMaxCollapsedDims] = {0};
+  std::array<long, N> offsets;
+  offsets.fill(0);
+  for (;;) {
+    if (!f(offsets, dims.sizes[inner], innerStrides)) {
+      return false;
+    }
+    int i = inner - 1;
+    for (; i >= 0; --i) {
+      for (size_t k = 0; k < N; ++k) {
+        offsets[k] += dims.strides[k][i];
+      }
+      if (++counter[i] < dims.sizes[i]) {
+        break;
+      }
+      for (size_t k = 0; k < N; ++k) {
+        offsets[k] -= dims.strides[k][i] * dims.sizes[i];
+      }
+      counter[i] = 0;
+    }
+    if (i < 0) {
+      return true;
+    }
+  }
+}
+
+}}  // namespaces
+
+#endif /* THPP_DETAIL_TENSORITERATION_H_ */
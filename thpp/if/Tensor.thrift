@@ -10,6 +10,9 @@ enum ThriftTensorDataType {
   INT64 = 3,
   FLOAT = 4,   // IEEE-754 "binary32"
   DOUBLE = 5,  // IEEE-754 "binary64"
+  HALF = 6,    // IEEE-754 "binary16"
+  BFLOAT16 = 7,  // upper 16 bits of a "binary32"
+  QUINT8 = 8,  // quantized floating point, see ThriftTensor
 }
 
 enum ThriftTensorEndianness {
@@ -21,15 +24,118 @@ enum ThriftTensorEndianness {
   NATIVE = 3,
 }
 
+enum ThriftTensorCompression {
+  NONE = 1,
+  LZ4 = 2,
+  ZSTD = 3,
+}
+
+enum ThriftTensorChecksum {
+  NONE = 1,
+  // folly::crc32c() of the (uncompressed) data as serialized, with a
+  // starting checksum of 0
+  CRC32C = 2,
+}
+
 struct ThriftTensor {
   1: required ThriftTensorDataType dataType,
   2: required ThriftTensorEndianness endianness,
   3: required list<i64> sizes,
   4: IOBuf data,
+
+  // If compression isn't NONE, the (uncompressed) data is split into blocks
+  // of compressionBlockSize bytes (the last one may be shorter), the bytes
+  // of the elements in each block are shuffled (the first byte of every
+  // element, then the second byte of every element, ...), and each block
+  // is compressed separately; data is the concatenation of the compressed
+  // blocks, whose lengths are in compressedBlockSizes.
+  5: ThriftTensorCompression compression = ThriftTensorCompression.NONE,
+  6: i64 compressionBlockSize,
+  7: list<i64> compressedBlockSizes,
+
+  // For QUINT8 data: the element with index c along quantizationAxis
+  // represents scales[c] * (data - zeroPoints[c]). If quantizationAxis is
+  // -1, there is one scale and zero point for the whole tensor.
+  8: i32 quantizationAxis,
+  9: list<double> scales,
+  10: list<i32> zeroPoints,
+
+  // Checksum of the data, before compression
+  11: ThriftTensorChecksum checksumType = ThriftTensorChecksum.NONE,
+  12: i32 checksum,
+}
+
+// Sparse tensor of the given sizes (see thpp/SparseTensor.h): only the
+// slices along the first indexedDims dimensions that aren't all zero are
+// stored. indexedDims is 1 for row-sparse tensors, and the number of
+// dimensions for element-wise (COO) sparse tensors. indices (INT64) has
+// sizes [n, indexedDims], and values has sizes [n] + sizes[indexedDims:];
+// both are empty (no dimensions) if n is 0.
+struct ThriftSparseTensor {
+  1: required list<i64> sizes,
+  2: required i32 indexedDims,
+  3: required ThriftTensor indices,
+  4: required ThriftTensor values,
+}
+
+// Changes to a tensor relative to a previous version of it (see
+// Tensor::serializeDelta() in thpp/Tensor.h). The elements (in row-major
+// order) are split into blocks of blockSize elements, the last one possibly
+// shorter; bit (i % 8) of byte (i / 8) of changed is set if block i
+// changed, and changedBlocks (a 1-dimensional tensor) holds the new
+// contents of the changed blocks, in order.
+struct ThriftTensorDelta {
+  1: required list<i64> sizes,
+  2: required i64 blockSize,
+  3: required binary changed,
+  4: required ThriftTensor changedBlocks,
 }
 
 struct ThriftStorage {
   1: required ThriftTensorDataType dataType,
   2: required ThriftTensorEndianness endianness,
   3: IOBuf data,
+  4: ThriftTensorChecksum checksumType = ThriftTensorChecksum.NONE,
+  5: i32 checksum,
+}
+
+// Many (typically small) tensors of the same type packed into one storage,
+// which avoids the per-tensor framing of separate ThriftTensor objects (see
+// serializeMany() in thpp/Tensor.h). Tensor i has ndims[i] dimensions,
+// whose sizes are the next ndims[i] entries of sizes, and its (contiguous,
+// row-major) data starts at element offsets[i] of storage.
+struct ThriftTensorBundle {
+  1: required ThriftStorage storage,
+  2: required list<i32> ndims,
+  3: required list<i64> sizes,
+  4: required list<i64> offsets,
+}
+
+// A tensor whose storage is in a shared memory segment (see
+// Tensor::exportShared() in thpp/Tensor.h). The file descriptor of the
+// segment is passed separately; the storage is the first storageSize
+// elements of the segment, and the tensor starts at element storageOffset
+// of the storage.
+struct ThriftSharedTensor {
+  1: required ThriftTensorDataType dataType,
+  2: required list<i64> sizes,
+  3: required list<i64> strides,
+  4: required i64 storageOffset,
+  5: required i64 storageSize,
+}
+
+// Index entry of a tensor container file (see thpp/TensorFile.h)
+struct ThriftTensorFileEntry {
+  1: required string name,
+  2: required ThriftTensorDataType dataType,
+  3: required ThriftTensorEndianness endianness,
+  4: required list<i64> sizes,
+  // Byte offset of the (contiguous, row-major) data from the start of
+  // the file; always page aligned
+  5: required i64 offset,
+  6: required i64 length,
+}
+
+struct ThriftTensorFileIndex {
+  1: required list<ThriftTensorFileEntry> entries,
 }
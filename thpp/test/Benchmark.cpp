@@ -0,0 +1,230 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+// Benchmarks for the storage, tensor, and serialization hot paths.
+//
+// Every benchmark returns the number of bytes it processed, so the
+// "iters/s" column is bytes per second, which compares directly across
+// machines and sizes. Run with --bm_min_usec=100000 (or more) for stable
+// results on the large sizes.
+
+#include <thpp/Storage.h>
+#include <thpp/Tensor.h>
+
+#include <map>
+#include <utility>
+
+#include <folly/Benchmark.h>
+#include <folly/init/Init.h>
+#include <folly/io/IOBuf.h>
+
+namespace thpp { namespace {
+
+constexpr long kSmall = 1L << 12;  // elements
+constexpr long kLarge = 1L << 24;
+
+template <class T>
+Tensor<T> makeTensor(long n, bool strided) {
+  // Square-ish matrix; strided is the transpose of a contiguous one
+  long rows = 1L << 6;
+  long cols = n / rows;
+  Tensor<T> t({strided ? cols : rows, strided ? rows : cols});
+  auto data = t.data();
+  for (long i = 0; i < n; ++i) {
+    data[i] = T(i % 100);
+  }
+  if (strided) {
+    t.transpose();
+  }
+  return t;
+}
+
+// Fixtures are built once per set of parameters (with the timer
+// suspended), rather than once per benchmark function: function-local
+// statics would keep whatever the first caller asked for.
+template <class Value, class Key, class Make>
+Value& fixture(const Key& key, Make make) {
+  static std::map<Key, Value> fixtures;
+  auto pos = fixtures.find(key);
+  if (pos == fixtures.end()) {
+    BENCHMARK_SUSPEND {
+      pos = fixtures.emplace(key, make()).first;
+    }
+  }
+  return pos->second;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Storage
+
+size_t storageFromIOBuf(SharingMode sharing) {
+  constexpr size_t bytes = kLarge * sizeof(float);
+  folly::IOBuf buf;
+  BENCHMARK_SUSPEND {
+    buf = folly::IOBuf(folly::IOBuf::CREATE, bytes);
+    buf.append(bytes);
+  }
+  Storage<float> s(std::move(buf), sharing);
+  folly::doNotOptimizeAway(s.data());
+  BENCHMARK_SUSPEND {
+    s = Storage<float>();
+  }
+  return bytes;
+}
+
+BENCHMARK_MULTI(StorageFromIOBuf_ShareNone) {
+  return storageFromIOBuf(SHARE_NONE);
+}
+
+BENCHMARK_MULTI(StorageFromIOBuf_ShareManaged) {
+  return storageFromIOBuf(SHARE_IOBUF_MANAGED);
+}
+
+BENCHMARK_MULTI(StorageFromIOBuf_ShareAll) {
+  return storageFromIOBuf(SHARE_ALL);
+}
+
+BENCHMARK_MULTI(StorageGetIOBuf) {
+  constexpr size_t bytes = kLarge * sizeof(float);
+  Storage<float> s;
+  BENCHMARK_SUSPEND {
+    s = Storage<float>(size_t(kLarge), 0.0f);  // default allocator
+  }
+  auto buf = s.getIOBuf();  // switches to the IOBuf allocator
+  folly::doNotOptimizeAway(buf.data());
+  BENCHMARK_SUSPEND {
+    buf = folly::IOBuf();
+    s = Storage<float>();
+  }
+  return bytes;
+}
+
+BENCHMARK_DRAW_LINE();
+
+////////////////////////////////////////////////////////////////////////////////
+// Serialization
+
+template <class T>
+size_t serialize(long n, bool strided, ThriftTensorEndianness endianness) {
+  auto& t = fixture<Tensor<T>>(std::make_pair(n, strided), [=] {
+    return makeTensor<T>(n, strided);
+  });
+  ThriftTensor out;
+  t.serialize(out, endianness, SHARE_NONE);
+  folly::doNotOptimizeAway(out.data.data());
+  return n * sizeof(T);
+}
+
+template <class T>
+size_t deserialize(long n, bool into) {
+  auto& in = fixture<ThriftTensor>(n, [n] {
+    ThriftTensor out;
+    makeTensor<T>(n, false).serialize(out);
+    return out;
+  });
+  auto& dest = fixture<Tensor<T>>(n, [n] { return makeTensor<T>(n, false); });
+  if (into) {
+    dest.deserializeInto(in);
+  } else {
+    Tensor<T> t(in, SHARE_NONE);
+    folly::doNotOptimizeAway(t.data());
+  }
+  return n * sizeof(T);
+}
+
+#define X(T, N, STRIDED, NAME) \
+  BENCHMARK_MULTI(Serialize_ ## NAME) { \
+    return serialize<T>(N, STRIDED, ThriftTensorEndianness::NATIVE); \
+  }
+
+X(float, kSmall, false, Float_Small_Contiguous)
+X(float, kSmall, true, Float_Small_Strided)
+X(float, kLarge, false, Float_Large_Contiguous)
+X(float, kLarge, true, Float_Large_Strided)
+X(double, kLarge, false, Double_Large_Contiguous)
+X(double, kLarge, true, Double_Large_Strided)
+X(long, kLarge, false, Long_Large_Contiguous)
+X(unsigned char, kLarge, false, Byte_Large_Contiguous)
+X(unsigned char, kLarge, true, Byte_Large_Strided)
+#undef X
+
+BENCHMARK_MULTI(Serialize_Float_Large_Contiguous_Swapped) {
+  return serialize<float>(
+      kLarge, false,
+      detail::gMachineEndianness == ThriftTensorEndianness::LITTLE ?
+        ThriftTensorEndianness::BIG : ThriftTensorEndianness::LITTLE);
+}
+
+BENCHMARK_MULTI(Deserialize_Float_Small) {
+  return deserialize<float>(kSmall, false);
+}
+
+BENCHMARK_MULTI(Deserialize_Float_Large) {
+  return deserialize<float>(kLarge, false);
+}
+
+BENCHMARK_MULTI(DeserializeInto_Float_Large) {
+  return deserialize<float>(kLarge, true);
+}
+
+BENCHMARK_MULTI(Deserialize_Double_Large) {
+  return deserialize<double>(kLarge, false);
+}
+
+BENCHMARK_DRAW_LINE();
+
+////////////////////////////////////////////////////////////////////////////////
+// Comparison and conversion
+
+template <class T>
+size_t approximatelyEqual(bool strided) {
+  auto& ab = fixture<std::pair<Tensor<T>, Tensor<T>>>(strided, [strided] {
+    auto a = makeTensor<T>(kLarge, strided);
+    Tensor<T> b(a, Tensor<T>::UNIQUE);
+    return std::make_pair(std::move(a), std::move(b));
+  });
+  folly::doNotOptimizeAway(ab.first.isApproximatelyEqual(ab.second));
+  return 2 * kLarge * sizeof(T);
+}
+
+BENCHMARK_MULTI(IsApproximatelyEqual_Float_Contiguous) {
+  return approximatelyEqual<float>(false);
+}
+
+BENCHMARK_MULTI(IsApproximatelyEqual_Float_Strided) {
+  return approximatelyEqual<float>(true);
+}
+
+BENCHMARK_MULTI(IsApproximatelyEqual_Double_Contiguous) {
+  return approximatelyEqual<double>(false);
+}
+
+// Bytes read + written
+template <class D, class S>
+size_t copy() {
+  static auto src = makeTensor<S>(kLarge, false);
+  static Tensor<D> dest({kLarge});
+  dest.copy(src);
+  return kLarge * (sizeof(S) + sizeof(D));
+}
+
+BENCHMARK_MULTI(Copy_FloatToFloat) { return copy<float, float>(); }
+BENCHMARK_MULTI(Copy_FloatToDouble) { return copy<double, float>(); }
+BENCHMARK_MULTI(Copy_DoubleToFloat) { return copy<float, double>(); }
+BENCHMARK_MULTI(Copy_ByteToFloat) { return copy<float, unsigned char>(); }
+BENCHMARK_MULTI(Copy_LongToDouble) { return copy<double, long>(); }
+
+}}  // namespaces
+
+int main(int argc, char* argv[]) {
+  folly::init(&argc, &argv);
+  folly::runBenchmarks();
+  return 0;
+}
@@ -66,5 +66,37 @@ void testTensorPtr() {
   EXPECT_EQ(18, z.sumall());
 }
 
+template <class T>
+void testFrozenTensorPtr() {
+  // Unique: frozen in place
+  auto p = T::makePtr({2});
+  p->fill(1);
+  auto th = p.th();
+  auto f = std::move(p).freeze();
+  EXPECT_FALSE(p);
+  EXPECT_EQ(th, f->asTH());
+  EXPECT_EQ(2, f->sumall());
+
+  // Borrowing doesn't change the reference count
+  auto refcount = f->asTH()->refcount;
+  const T& borrowed = *f;
+  EXPECT_EQ(2, borrowed.size());
+  EXPECT_EQ(refcount, f->asTH()->refcount);
+
+  // Shared: a copy is frozen
+  auto q = T::makePtr({3});
+  q->fill(2);
+  auto r = q;
+  auto g = std::move(q).freeze();
+  EXPECT_NE(r.th(), g->asTH());
+  r->fill(3);
+  EXPECT_EQ(6, g->sumall());
+
+  auto h = g.thaw();
+  h->fill(4);
+  EXPECT_EQ(6, g->sumall());
+  EXPECT_EQ(12, h->sumall());
+}
+
 
 }}  // namespaces
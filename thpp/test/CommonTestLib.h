@@ -23,6 +23,9 @@ void testUniqueMove();
 template <class T>
 void testTensorPtr();
 
+template <class T>
+void testFrozenTensorPtr();
+
 }}  // namespaces
 
 #include <thpp/test/CommonTestLib-inl.h>
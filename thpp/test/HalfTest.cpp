@@ -0,0 +1,100 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+#include <thpp/Half.h>
+
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace thpp {
+namespace test {
+
+TEST(Half, Exact) {
+  EXPECT_EQ(0x0000, floatToHalf(0.0f));
+  EXPECT_EQ(0x8000, floatToHalf(-0.0f));
+  EXPECT_EQ(0x3c00, floatToHalf(1.0f));
+  EXPECT_EQ(0xc000, floatToHalf(-2.0f));
+  EXPECT_EQ(0x7bff, floatToHalf(65504.0f));          // largest normal
+  EXPECT_EQ(0x0400, floatToHalf(std::ldexp(1.0f, -14)));  // smallest normal
+  EXPECT_EQ(0x0001, floatToHalf(std::ldexp(1.0f, -24)));  // smallest denormal
+
+  // Every half value converts to float and back unchanged
+  for (uint32_t h = 0; h < 0x10000; ++h) {
+    float f = halfToFloat(uint16_t(h));
+    if (std::isnan(f)) {
+      EXPECT_EQ(0x7c00, h & 0x7c00);
+    } else {
+      EXPECT_EQ(h, floatToHalf(f));
+    }
+  }
+}
+
+TEST(Half, Rounding) {
+  // Halfway between 1 and the next half (1 + 2^-10): ties to even
+  EXPECT_EQ(0x3c00, floatToHalf(1.0f + std::ldexp(1.0f, -11)));
+  EXPECT_EQ(0x3c02, floatToHalf(1.0f + 3 * std::ldexp(1.0f, -11)));
+  EXPECT_EQ(0x3c01, floatToHalf(1.0f + std::ldexp(1.0f, -11) +
+                                std::ldexp(1.0f, -20)));
+  // Overflow to infinity, underflow to zero
+  EXPECT_EQ(0x7c00, floatToHalf(65520.0f));
+  EXPECT_EQ(0x0000, floatToHalf(std::ldexp(1.0f, -26)));
+}
+
+TEST(Half, Special) {
+  float inf = std::numeric_limits<float>::infinity();
+  EXPECT_EQ(0x7c00, floatToHalf(inf));
+  EXPECT_EQ(0xfc00, floatToHalf(-inf));
+  EXPECT_EQ(inf, halfToFloat(0x7c00));
+  EXPECT_TRUE(std::isnan(halfToFloat(
+      floatToHalf(std::numeric_limits<float>::quiet_NaN()))));
+
+  EXPECT_EQ(0x7f80, floatToBFloat16(inf));
+  EXPECT_TRUE(std::isnan(bfloat16ToFloat(
+      floatToBFloat16(std::numeric_limits<float>::quiet_NaN()))));
+}
+
+TEST(Half, BFloat16) {
+  EXPECT_EQ(0x3f80, floatToBFloat16(1.0f));
+  EXPECT_EQ(1.0f, bfloat16ToFloat(0x3f80));
+  EXPECT_EQ(-3.0f, bfloat16ToFloat(floatToBFloat16(-3.0f)));
+  // Ties to even
+  EXPECT_EQ(0x3f80, floatToBFloat16(1.0f + std::ldexp(1.0f, -8)));
+  EXPECT_EQ(0x3f82, floatToBFloat16(1.0f + 3 * std::ldexp(1.0f, -8)));
+}
+
+TEST(Half, Bulk) {
+  // Odd size, so that both the vector and the scalar paths are used
+  const size_t n = 1027;
+  std::vector<float> src(n);
+  for (size_t i = 0; i < n; ++i) {
+    src[i] = (float(i) - 500) * 0.37f;
+  }
+
+  std::vector<uint16_t> h(n);
+  std::vector<float> back(n);
+  floatToHalf(h.data(), src.data(), n);
+  halfToFloat(back.data(), h.data(), n);
+  for (size_t i = 0; i < n; ++i) {
+    EXPECT_EQ(floatToHalf(src[i]), h[i]);
+    EXPECT_EQ(halfToFloat(h[i]), back[i]);
+  }
+
+  floatToBFloat16(h.data(), src.data(), n);
+  bfloat16ToFloat(back.data(), h.data(), n);
+  for (size_t i = 0; i < n; ++i) {
+    EXPECT_EQ(floatToBFloat16(src[i]), h[i]);
+    EXPECT_EQ(bfloat16ToFloat(h[i]), back[i]);
+  }
+}
+
+}}  // namespaces
@@ -9,7 +9,14 @@
  */
 
 #include <thpp/Storage.h>
+#include <thpp/NumaAllocator.h>
+#include <thpp/PooledAllocator.h>
 
+#include <unistd.h>
+#include <cstdio>
+#include <thread>
+
+#include <folly/ScopeGuard.h>
 #include <glog/logging.h>
 #include <gtest/gtest.h>
 
@@ -84,4 +91,300 @@ TEST(Storage, CustomAllocator) {
 
 }
 
+TEST(Storage, IOBufChainSingleBuffer) {
+  // Empty buffers in the chain shouldn't force a copy
+  auto buf = folly::IOBuf::create(10 * sizeof(float));
+  buf->append(10 * sizeof(float));
+  auto ptr = buf->data();
+  auto chain = folly::IOBuf::create(0);
+  chain->prependChain(std::move(buf));
+  chain->prependChain(folly::IOBuf::create(0));
+
+  FloatStorage s(std::move(*chain));
+  EXPECT_EQ(10, s.size());
+  EXPECT_TRUE(static_cast<const void*>(s.data()) == ptr);
+}
+
+TEST(Storage, IOBufChainSegments) {
+  constexpr size_t n = 1000;
+  FloatStorage src(size_t(n), 0.0f);
+  for (size_t i = 0; i < n; ++i) {
+    src.at(i) = i;
+  }
+  auto full = src.getIOBuf();
+
+  // Three buffers; both boundaries split an element.
+  auto a = full.cloneOne();
+  auto b = full.cloneOne();
+  auto c = full.cloneOne();
+  a->trimEnd(a->length() - 402);
+  b->trimStart(402);
+  b->trimEnd(b->length() - 800);
+  c->trimStart(1202);
+  a->prependChain(std::move(b));
+  a->prependChain(std::move(c));
+
+  auto segments = FloatStorage::fromIOBufChain(std::move(*a));
+  size_t total = 0;
+  bool shared = false;
+  for (auto& seg : segments) {
+    for (size_t i = 0; i < seg.size(); ++i) {
+      EXPECT_EQ(float(total + i), seg.at(i));
+    }
+    if (seg.data() == src.data()) {
+      shared = true;  // the first segment doesn't need fixing up
+    }
+    total += seg.size();
+  }
+  EXPECT_EQ(n, total);
+  EXPECT_TRUE(shared);
+}
+
+namespace {
+size_t gHookCalls = 0;
+void countingHook(CopyReason /*reason*/, size_t /*bytes*/) {
+  ++gHookCalls;
+}
+}  // namespace
+
+TEST(Storage, CopyStats) {
+  resetCopyStats();
+  auto prevHook = setCopyHook(&countingHook);
+  SCOPE_EXIT { setCopyHook(prevHook); };
+  gHookCalls = 0;
+
+  auto buf = folly::IOBuf::create(11 * sizeof(float));
+  buf->append(11 * sizeof(float));
+
+  // Sharing a managed buffer doesn't copy
+  { FloatStorage s(*buf); }
+  EXPECT_EQ(0, getTotalCopyStats().count);
+
+  { FloatStorage s(*buf, SHARE_NONE); }
+  EXPECT_EQ(1, getCopyStats(CopyReason::UNSHARE).count);
+  EXPECT_EQ(11 * sizeof(float), getCopyStats(CopyReason::UNSHARE).bytes);
+
+  auto misaligned = buf->cloneOne();
+  misaligned->trimStart(2);
+  misaligned->trimEnd(2);
+  { FloatStorage s(std::move(*misaligned)); }
+  EXPECT_EQ(1, getCopyStats(CopyReason::MISALIGNED).count);
+  EXPECT_EQ(10 * sizeof(float), getCopyStats(CopyReason::MISALIGNED).bytes);
+
+  auto chain = buf->cloneOne();
+  chain->prependChain(buf->cloneOne());
+  { FloatStorage s(std::move(*chain)); }
+  EXPECT_EQ(1, getCopyStats(CopyReason::UNCHAIN).count);
+  EXPECT_EQ(22 * sizeof(float), getCopyStats(CopyReason::UNCHAIN).bytes);
+
+  auto total = getTotalCopyStats();
+  EXPECT_EQ(3, total.count);
+  EXPECT_EQ(3, gHookCalls);
+  EXPECT_STREQ("unchain", copyReasonName(CopyReason::UNCHAIN));
+
+  resetCopyStats();
+  EXPECT_EQ(0, getTotalCopyStats().bytes);
+}
+
+namespace {
+folly::IOBuf floatBuffer(size_t n) {
+  auto buf = folly::IOBuf::create(n * sizeof(float));
+  buf->append(n * sizeof(float));
+  return std::move(*buf);
+}
+}  // namespace
+
+TEST(Storage, MemoryStats) {
+  auto before = getMemoryStats(MemoryKind::IOBUF);
+  {
+    FloatStorage s(floatBuffer(1000));
+    auto stats = getMemoryStats(MemoryKind::IOBUF);
+    EXPECT_EQ(before.liveBytes + 4000, stats.liveBytes);
+    EXPECT_EQ(before.liveAllocations + 1, stats.liveAllocations);
+    EXPECT_EQ(before.totalAllocations + 1, stats.totalAllocations);
+
+    s.resizeUninitialized(2000);
+    stats = getMemoryStats(MemoryKind::IOBUF);
+    EXPECT_EQ(before.liveBytes + 8000, stats.liveBytes);
+    EXPECT_EQ(before.liveAllocations + 1, stats.liveAllocations);
+  }
+  auto after = getMemoryStats(MemoryKind::IOBUF);
+  EXPECT_EQ(before.liveBytes, after.liveBytes);
+  EXPECT_EQ(before.liveAllocations, after.liveAllocations);
+  EXPECT_EQ(before.totalAllocations + 1, after.totalAllocations);
+  EXPECT_LE(before.liveBytes + 8000, after.peakBytes);
+
+  resetPeakMemoryStats();
+  after = getMemoryStats(MemoryKind::IOBUF);
+  EXPECT_EQ(after.liveBytes, after.peakBytes);
+
+  // Counts survive the exit of the allocating thread
+  FloatStorage fromThread;
+  std::thread([&fromThread] {
+    fromThread = FloatStorage(floatBuffer(100));
+  }).join();
+  EXPECT_EQ(before.liveBytes + 400,
+            getMemoryStats(MemoryKind::IOBUF).liveBytes);
+  fromThread = FloatStorage();
+  EXPECT_EQ(before.liveBytes, getMemoryStats(MemoryKind::IOBUF).liveBytes);
+
+  // Free blocks cached by a pool are still held by it
+  auto pooledBefore = getMemoryStats(MemoryKind::POOLED);
+  {
+    PooledAllocator pool;
+    { pooledStorage<float>(pool).resizeUninitialized(1000); }
+    EXPECT_EQ(pooledBefore.liveAllocations + 1,
+              getMemoryStats(MemoryKind::POOLED).liveAllocations);
+  }
+  EXPECT_EQ(pooledBefore.liveBytes,
+            getMemoryStats(MemoryKind::POOLED).liveBytes);
+
+  ASSERT_TRUE(enableDefaultAllocatorAccounting());
+  auto defaultBefore = getMemoryStats(MemoryKind::DEFAULT);
+  {
+    FloatStorage s(1000, 1.0f);
+    EXPECT_LE(defaultBefore.liveBytes + 4000,
+              getMemoryStats(MemoryKind::DEFAULT).liveBytes);
+  }
+  EXPECT_EQ(defaultBefore.liveBytes,
+            getMemoryStats(MemoryKind::DEFAULT).liveBytes);
+  // Still freed through THDefaultAllocator once shared with an IOBuf
+  {
+    FloatStorage s(1000, 1.0f);
+    auto buf = s.getIOBuf();
+  }
+  EXPECT_EQ(defaultBefore.liveBytes,
+            getMemoryStats(MemoryKind::DEFAULT).liveBytes);
+
+  bool found = false;
+  for (auto& entry : getAllMemoryStats()) {
+    if (entry.kind == MemoryKind::IOBUF) {
+      EXPECT_EQ(-1, entry.device);
+      found = true;
+    }
+  }
+  EXPECT_TRUE(found);
+  EXPECT_STREQ("iobuf", memoryKindName(MemoryKind::IOBUF));
+  EXPECT_EQ(0, getMemoryStats(MemoryKind::IOBUF, 1000).totalAllocations);
+}
+
+TEST(Storage, PooledAllocator) {
+  PooledAllocator pool(128);
+  void* data;
+  {
+    auto s = pooledStorage<float>(pool);
+    s.resizeUninitialized(1000);
+    data = s.data();
+    EXPECT_EQ(0, reinterpret_cast<uintptr_t>(data) % 128);
+    EXPECT_TRUE(s.isUnique());
+  }
+  auto stats = pool.stats();
+  EXPECT_EQ(0, stats.hits);
+
+  // Same size class, so the block freed above is reused
+  auto s = pooledStorage<float>(pool);
+  s.resize(900, 1.0f);
+  EXPECT_EQ(data, s.data());
+  EXPECT_EQ(1.0f, s.at(899));
+  stats = pool.stats();
+  EXPECT_EQ(1, stats.hits);
+
+  // Storages built from values, once the pool is the storage allocator
+  setStorageAllocator(PooledAllocator::thAllocator(), &pool);
+  {
+    FloatStorage values(1000, 2.0f);
+    EXPECT_EQ(0, reinterpret_cast<uintptr_t>(values.data()) % 128);
+    EXPECT_EQ(2.0f, values.at(999));
+    FloatStorage more({1, 2, 3});
+    EXPECT_EQ(0, reinterpret_cast<uintptr_t>(more.data()) % 128);
+  }
+  setStorageAllocator(&THDefaultAllocator, nullptr);
+  stats = pool.stats();
+  EXPECT_EQ(1, stats.hits);  // s still holds the block of the 4000-byte class
+  EXPECT_EQ(3, stats.misses);
+}
+
+TEST(Storage, NumaAllocator) {
+  EXPECT_LE(1, NumaAllocator::numNodes());
+  EXPECT_LE(0, NumaAllocator::currentNode());
+  EXPECT_THROW(NumaAllocator(NumaAllocator::Policy::NODE, -1),
+               std::invalid_argument);
+
+  for (auto alloc : {&NumaAllocator::firstTouch(),
+                     &NumaAllocator::onNode(0),
+                     &NumaAllocator::interleaved()}) {
+    auto s = numaStorage<float>(*alloc);
+    s.resize(1000, 1.0f);
+    EXPECT_EQ(0, reinterpret_cast<uintptr_t>(s.data()) % 64);
+    // Grow beyond the initial mapping
+    s.resize(1 << 20, 2.0f);
+    EXPECT_EQ(1.0f, s.at(999));
+    EXPECT_EQ(2.0f, s.at(1000));
+    EXPECT_EQ(2.0f, s.at((1 << 20) - 1));
+  }
+}
+
+TEST(Storage, MapFile) {
+  std::vector<float> data(10000);
+  for (size_t i = 0; i < data.size(); ++i) {
+    data[i] = i;
+  }
+  char path[] = "/tmp/thpp_storage_test.XXXXXX";
+  int fd = mkstemp(path);
+  ASSERT_NE(-1, fd);
+  SCOPE_EXIT { unlink(path); };
+  auto nbytes = data.size() * sizeof(float);
+  ASSERT_EQ(nbytes, write(fd, data.data(), nbytes));
+  close(fd);
+
+  auto all = FloatStorage::mapFile(path, 0, kMapToEnd, MAPPED_POPULATE);
+  EXPECT_EQ(data.size(), all.size());
+  EXPECT_FALSE(all.isUnique());
+  for (size_t i = 0; i < data.size(); ++i) {
+    EXPECT_EQ(data[i], all.at(i));
+  }
+
+  // Offset that isn't page aligned, with huge page placement
+  auto part = FloatStorage::mapFile(path, 1001 * sizeof(float),
+                                    100 * sizeof(float),
+                                    MAPPED_HUGEPAGES | MAPPED_RANDOM);
+  EXPECT_EQ(100, part.size());
+  EXPECT_EQ(1001.0f, part.at(0));
+  EXPECT_EQ(1100.0f, part.at(99));
+
+  EXPECT_THROW(FloatStorage::mapFile(path, 2, 4), std::invalid_argument);
+  EXPECT_THROW(FloatStorage::mapFile(path, 0, nbytes + 4),
+               std::invalid_argument);
+  EXPECT_THROW(FloatStorage::mapFile("/nonexistent/thpp"), std::system_error);
+}
+
+TEST(Storage, SharedMemory) {
+  auto shared = FloatStorage::createShared(10000);
+  EXPECT_EQ(10000, shared.size());
+  EXPECT_EQ(0.0f, shared.at(9999));
+  int fd = shared.sharedMemoryFd();
+  ASSERT_NE(-1, fd);
+  EXPECT_FALSE(shared.isUnique());
+  EXPECT_EQ(-1, FloatStorage(10, 1.0f).sharedMemoryFd());
+  EXPECT_EQ(-1, FloatStorage::createShared(0).sharedMemoryFd());
+
+  // The mapping shares the memory, even after the descriptor is closed.
+  int peerFd = dup(fd);
+  ASSERT_NE(-1, peerFd);
+  auto peer = FloatStorage::mapFile(peerFd);
+  close(peerFd);
+  EXPECT_EQ(10000, peer.size());
+  EXPECT_NE(shared.data(), peer.data());
+  shared.write(1234, 42.0f);
+  EXPECT_EQ(42.0f, peer.at(1234));
+
+  // ... and outlives the creator
+  shared = FloatStorage();
+  EXPECT_EQ(42.0f, peer.at(1234));
+
+  // The segment is sealed against shrinking
+  auto other = FloatStorage::createShared(100);
+  EXPECT_EQ(-1, ftruncate(other.sharedMemoryFd(), 0));
+}
+
 }}  // namespaces
@@ -0,0 +1,129 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+#include <thpp/TensorApply.h>
+#include <thpp/TensorExpr.h>
+
+#include <glog/logging.h>
+#include <gtest/gtest.h>
+
+namespace thpp {
+namespace test {
+
+template <class T>
+Tensor<T> iota(std::initializer_list<long> sizes) {
+  Tensor<T> t{LongStorage(sizes.begin(), sizes.end())};
+  for (long i = 0; i < t.size(); ++i) {
+    t.data()[i] = T(i % 100);
+  }
+  return t;
+}
+
+template <class T>
+void testApply() {
+  auto a = iota<T>({4, 5, 6});
+
+  // Transposed: nothing can be collapsed
+  Tensor<T> b(a);
+  b.transpose();
+  Tensor<T> c({6, 5, 4});
+  apply2(c, b, [] (T& x, T y) { x = y; });
+  EXPECT_TRUE(c.isExactlyEqual(b));
+
+  // Narrowed: inner dimension is a run, outer ones are strided
+  Tensor<T> n;
+  n.narrow(a, 2, 1, 3);
+  double sum = 0;
+  long count = 0;
+  forEach(static_cast<const Tensor<T>&>(n), [&] (const T& x) {
+    sum += x;
+    ++count;
+  });
+  EXPECT_EQ(n.size(), count);
+  EXPECT_EQ(n.sumall(), sum);
+
+  Tensor<T> d({6, 5, 4});
+  apply3(d, b, c, [] (T& x, T y, T z) { x = y + z; });
+  Tensor<T> e;
+  e.cadd(b, 1, c);
+  EXPECT_TRUE(d.isExactlyEqual(e));
+
+  forEach(d, [] (T& x) { x = 1; });
+  EXPECT_EQ(d.size(), d.sumall());
+
+  EXPECT_THROW(apply2(c, a, [] (T&, T) { }), std::invalid_argument);
+}
+
+TEST(TensorApply, Byte) {
+  testApply<unsigned char>();
+}
+
+TEST(TensorApply, Int) {
+  testApply<int>();
+}
+
+TEST(TensorApply, Long) {
+  testApply<long>();
+}
+
+TEST(TensorApply, Float) {
+  testApply<float>();
+}
+
+TEST(TensorApply, Double) {
+  testApply<double>();
+}
+
+TEST(TensorApply, Empty) {
+  Tensor<float> t;
+  long count = 0;
+  forEach(t, [&] (float&) { ++count; });
+  EXPECT_EQ(0, count);
+}
+
+TEST(TensorExpr, Fused) {
+  auto a = iota<float>({4, 5});
+  auto b = iota<float>({4, 5});
+  auto c = iota<float>({4, 5});
+  b.add(1);
+  c.mul(3);
+
+  Tensor<float> r = lazy(a) * 2 + b - c;
+  Tensor<float> e = a * 2.0f + b - c;
+  EXPECT_TRUE(r.isApproximatelyEqual(e));
+
+  // Shapes that map onto TH operations
+  Tensor<float> r1 = lazy(a) - b * 3.0f;
+  e.cadd(a, -3, b);
+  EXPECT_TRUE(r1.isApproximatelyEqual(e));
+
+  Tensor<float> r2 = a + cdiv(b, c) * 0.5f;
+  e.addcdiv(a, 0.5f, b, c);
+  EXPECT_TRUE(r2.isApproximatelyEqual(e));
+
+  // In place, with a transposed operand
+  Tensor<float> at(a);
+  at.transpose();
+  Tensor<float> t({5, 4});
+  t.fill(1);
+  Tensor<float> r3 = (lazy(at) + t) / 2;
+  at.add(1);
+  at.div(2);
+  EXPECT_TRUE(r3.isApproximatelyEqual(at));
+
+  assign(r3, 1 - lazy(r3));
+  at.mul(-1);
+  at.add(1);
+  EXPECT_TRUE(r3.isApproximatelyEqual(at));
+
+  EXPECT_THROW(assign(r3, lazy(a) + t), std::invalid_argument);
+}
+
+}}  // namespaces
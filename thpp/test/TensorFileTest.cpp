@@ -0,0 +1,146 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+#include <thpp/TensorFile.h>
+
+#include <unistd.h>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <limits>
+
+#include <folly/Bits.h>
+#include <glog/logging.h>
+#include <gtest/gtest.h>
+#include <thrift/lib/cpp2/protocol/Serializer.h>
+
+namespace thpp {
+namespace test {
+
+class TensorFileTest : public testing::Test {
+ protected:
+  void SetUp() override {
+    char path[] = "/tmp/thpp_tensor_file_test.XXXXXX";
+    int fd = mkstemp(path);
+    ASSERT_NE(-1, fd);
+    close(fd);
+    path_ = path;
+  }
+
+  void TearDown() override {
+    unlink(path_.c_str());
+  }
+
+  // Rewrite the index of the file at path_, keeping everything else
+  void rewriteIndex(std::function<void(ThriftTensorFileIndex&)> fn) {
+    std::string data;
+    {
+      std::ifstream in(path_, std::ios::binary);
+      data.assign(std::istreambuf_iterator<char>(in),
+                  std::istreambuf_iterator<char>());
+    }
+    ASSERT_LE(24, data.size());
+    std::string trailer = data.substr(data.size() - 24);
+    uint64_t indexOffset;
+    memcpy(&indexOffset, trailer.data(), sizeof(indexOffset));
+    indexOffset = folly::Endian::little(indexOffset);
+    ThriftTensorFileIndex index;
+    apache::thrift::CompactSerializer::deserialize(
+        data.substr(indexOffset, data.size() - 24 - indexOffset), index);
+    fn(index);
+    auto newIndex =
+      apache::thrift::CompactSerializer::serialize<std::string>(index);
+    uint64_t indexLength = folly::Endian::little(uint64_t(newIndex.size()));
+    memcpy(&trailer[8], &indexLength, sizeof(indexLength));
+    std::ofstream out(path_, std::ios::binary | std::ios::trunc);
+    out << data.substr(0, indexOffset) << newIndex << trailer;
+  }
+
+  std::string path_;
+};
+
+TEST_F(TensorFileTest, RoundTrip) {
+  Tensor<float> a({3, 5});
+  Tensor<double> b({7});
+  Tensor<long> c({2, 3, 4});
+  for (long i = 0; i < a.size(); ++i) {
+    a.data()[i] = i * 0.5f;
+  }
+  for (long i = 0; i < b.size(); ++i) {
+    b.data()[i] = -i;
+  }
+  for (long i = 0; i < c.size(); ++i) {
+    c.data()[i] = i * 1000;
+  }
+  // Not contiguous
+  Tensor<float> at(a);
+  at.transpose();
+
+  {
+    TensorFileWriter writer(path_);
+    writer.add("a", a);
+    writer.add("b", b);
+    writer.add("c", c);
+    writer.add("at", at);
+    writer.add("empty", Tensor<float>());
+    EXPECT_THROW(writer.add("a", a), std::invalid_argument);
+    writer.finish();
+  }
+
+  TensorFileReader reader(path_);
+  EXPECT_EQ(5, reader.entries().size());
+  for (auto& entry : reader.entries()) {
+    EXPECT_EQ(0, entry.offset % kTensorFileAlignment);
+  }
+  EXPECT_EQ(nullptr, reader.find("missing"));
+  EXPECT_THROW(reader.read<float>("missing"), std::invalid_argument);
+  EXPECT_THROW(reader.read<double>("a"), std::invalid_argument);
+
+  EXPECT_TRUE(a.isExactlyEqual(reader.read<float>("a")));
+  EXPECT_TRUE(b.isExactlyEqual(reader.read<double>("b")));
+  EXPECT_TRUE(c.isExactlyEqual(reader.read<long>("c")));
+  EXPECT_TRUE(at.isExactlyEqual(reader.read<float>("at")));
+  EXPECT_EQ(0, reader.read<float>("empty").size());
+
+  auto mapped = reader.map<double>("b", MAPPED_WILLNEED);
+  EXPECT_TRUE(b.isExactlyEqual(mapped));
+}
+
+TEST_F(TensorFileTest, CorruptEntries) {
+  {
+    TensorFileWriter writer(path_);
+    writer.add("a", Tensor<float>({3, 5}));
+    writer.add("b", Tensor<float>({7}));
+    writer.finish();
+  }
+  // Sizes larger than the payload, or overflowing
+  rewriteIndex([] (ThriftTensorFileIndex& index) {
+    index.entries[0].sizes = {1000, 1000};
+    index.entries[1].sizes = {1L << 62, 4};
+  });
+  {
+    TensorFileReader reader(path_);
+    EXPECT_THROW(reader.map<float>("a"), std::invalid_argument);
+    EXPECT_THROW(reader.read<float>("a"), std::invalid_argument);
+    EXPECT_THROW(reader.map<float>("b"), std::invalid_argument);
+  }
+  // Payload past the end of the data
+  rewriteIndex([] (ThriftTensorFileIndex& index) {
+    index.entries[0].offset = std::numeric_limits<int64_t>::max();
+  });
+  EXPECT_THROW(TensorFileReader reader(path_), std::invalid_argument);
+}
+
+TEST_F(TensorFileTest, NotATensorFile) {
+  EXPECT_THROW(TensorFileReader reader(path_), std::invalid_argument);
+}
+
+}}  // namespaces
@@ -8,14 +8,19 @@
  *
  */
 
+#include <thpp/SparseTensor.h>
 #include <thpp/Tensor.h>
+#include <thpp/TensorStream.h>
+#include <thpp/detail/Parallel.h>
 
 #include <vector>
 
 #include <glog/logging.h>
 #include <gtest/gtest.h>
 
+#include <folly/executors/CPUThreadPoolExecutor.h>
 #include <folly/io/IOBuf.h>
+#include <folly/io/IOBufQueue.h>
 #include <folly/io/TypedIOBuf.h>
 
 namespace thpp {
@@ -85,6 +90,122 @@ TEST(SerializationTest, Simple) {
   runTest({20, 30}, {8192 * 30, 8192});
 }
 
+void runParallelTest(folly::Executor* executor,
+                     std::vector<long> sizes,
+                     std::vector<long> strides = {}) {
+  Tensor<float> src = createTensor(sizes, strides);
+
+  ThriftTensor serial;
+  src.serialize(serial, ThriftTensorEndianness::NATIVE, SHARE_NONE);
+  ThriftTensor parallel;
+  src.serialize(parallel, ThriftTensorEndianness::NATIVE, SHARE_NONE,
+                executor);
+
+  EXPECT_EQ(serial.sizes, parallel.sizes);
+  auto a = serial.data.cloneCoalescedAsValue();
+  auto b = parallel.data.cloneCoalescedAsValue();
+  ASSERT_EQ(a.length(), b.length());
+  EXPECT_EQ(0, memcmp(a.data(), b.data(), a.length()));
+}
+
+TEST(SerializationTest, CopyStats) {
+  resetCopyStats();
+  ThriftTensor out;
+  // One contiguous run, too small to share
+  createTensor({1, 5}, {1000, 1}).serialize(out);
+  EXPECT_EQ(1, getCopyStats(CopyReason::COPY).count);
+  EXPECT_EQ(5 * sizeof(float), getCopyStats(CopyReason::COPY).bytes);
+  EXPECT_EQ(0, getCopyStats(CopyReason::GATHER).count);
+
+  createTensor({20, 10}, {40, 4}).serialize(out);
+  EXPECT_EQ(1, getCopyStats(CopyReason::GATHER).count);
+  EXPECT_EQ(200 * sizeof(float), getCopyStats(CopyReason::GATHER).bytes);
+  resetCopyStats();
+}
+
+TEST(SerializationTest, ParallelGather) {
+  folly::CPUThreadPoolExecutor executor(4);
+  runParallelTest(&executor, {20, 10}, {40, 4});
+  runParallelTest(&executor, {20, 30, 10}, {10, 200, 1});
+  runParallelTest(&executor, {20, 30, 10}, {1, 20, 600});
+  runParallelTest(&executor, {20, 30}, {8192 * 30, 8192});
+  runParallelTest(&executor, {300, 1000}, {1, 300});
+}
+
+// Runs the first capacity tasks inline, then refuses the rest
+class RefusingExecutor : public folly::Executor {
+ public:
+  explicit RefusingExecutor(size_t capacity) : capacity_(capacity) { }
+
+  void add(folly::Func fn) override {
+    if (capacity_ == 0) {
+      throw std::runtime_error("queue full");
+    }
+    --capacity_;
+    fn();
+  }
+
+ private:
+  size_t capacity_;
+};
+
+TEST(SerializationTest, ExecutorRefusesTasks) {
+  RefusingExecutor executor(2);
+  size_t ran = 0;
+  EXPECT_THROW(detail::runTasks(&executor, 5, [&ran] (size_t) { ++ran; }),
+               std::runtime_error);
+  EXPECT_EQ(2, ran);
+}
+
+TEST(SerializationTest, Compression) {
+  folly::CPUThreadPoolExecutor executor(4);
+  // Non-contiguous, and more than one compression block
+  auto t = createTensor({300, 1000}, {1, 300});
+  for (auto codec : {ThriftTensorCompression::LZ4,
+                     ThriftTensorCompression::ZSTD}) {
+    for (auto endianness : {ThriftTensorEndianness::LITTLE,
+                            ThriftTensorEndianness::BIG}) {
+      for (auto ex : {static_cast<folly::Executor*>(nullptr),
+                      static_cast<folly::Executor*>(&executor)}) {
+        ThriftTensor serialized;
+        t.serialize(serialized, endianness, SHARE_ALL, ex, codec);
+        EXPECT_EQ(codec, serialized.compression);
+        EXPECT_GT(serialized.compressedBlockSizes.size(), 1);
+        EXPECT_LT(serialized.data.computeChainDataLength(),
+                  t.size() * sizeof(float));
+
+        Tensor<float> deserialized(serialized);
+        EXPECT_TRUE(deserialized.isExactlyEqual(t));
+
+        // Reusing the output resets the compression fields
+        t.serialize(serialized, endianness);
+        EXPECT_EQ(ThriftTensorCompression::NONE, serialized.compression);
+        EXPECT_TRUE(serialized.compressedBlockSizes.empty());
+        EXPECT_TRUE(Tensor<float>(serialized).isExactlyEqual(t));
+      }
+    }
+  }
+
+  Tensor<long> empty;
+  ThriftTensor serialized;
+  empty.serialize(serialized, ThriftTensorEndianness::NATIVE, SHARE_ALL,
+                  nullptr, ThriftTensorCompression::LZ4);
+  EXPECT_EQ(0, Tensor<long>(serialized).ndims());
+
+  // Truncated data
+  t.serialize(serialized, ThriftTensorEndianness::NATIVE, SHARE_ALL, nullptr,
+              ThriftTensorCompression::ZSTD);
+  serialized.compressedBlockSizes.pop_back();
+  EXPECT_THROW(Tensor<float>{serialized}, std::invalid_argument);
+
+  // Sizes whose byte count wraps around (4 * 2^62 is 0 mod 2^64)
+  t.serialize(serialized, ThriftTensorEndianness::NATIVE, SHARE_ALL, nullptr,
+              ThriftTensorCompression::ZSTD);
+  serialized.sizes = {1L << 31, 1L << 31};
+  serialized.compressedBlockSizes.clear();
+  EXPECT_THROW(Tensor<float>{serialized}, std::invalid_argument);
+}
+
 TEST(SerializationTest, SmallerThanStorage) {
   Tensor<long> t({10L});
   for (long i = 0; i < 10L; ++i) {
@@ -283,6 +404,507 @@ TEST(SerializationTest, Alignment) {
   }
 }
 
+constexpr ThriftTensorEndianness otherEndianness =
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    ThriftTensorEndianness::BIG;
+#else
+    ThriftTensorEndianness::LITTLE;
+#endif
+
+void runSwappedTest(std::vector<long> sizes,
+                    std::vector<long> strides = {}) {
+  Tensor<float> src = createTensor(sizes, strides);
+
+  ThriftTensor serialized;
+  src.serialize(serialized, otherEndianness);
+  EXPECT_EQ(otherEndianness, serialized.endianness);
+
+  src.force(Tensor<float>::CONTIGUOUS);
+  auto bytes = serialized.data.cloneCoalescedAsValue();
+  ASSERT_EQ(sizeof(float) * src.size(), bytes.length());
+  for (long i = 0; i < src.size(); ++i) {
+    uint32_t expected;
+    memcpy(&expected, src.data() + i, sizeof(float));
+    uint32_t actual;
+    memcpy(&actual, bytes.data() + i * sizeof(float), sizeof(float));
+    EXPECT_EQ(__builtin_bswap32(expected), actual);
+  }
+
+  Tensor<float> deserialized(serialized);
+  EXPECT_TRUE(src.sizes() == deserialized.sizes());
+  EXPECT_EQ(0, memcmp(src.data(), deserialized.data(),
+                      sizeof(float) * src.size()));
+}
+
+TEST(SerializationTest, NonNativeEndianness) {
+  runSwappedTest({1});
+  runSwappedTest({2}, {200});
+  runSwappedTest({20, 10});
+  runSwappedTest({20, 10}, {400, 4});
+  runSwappedTest({20, 30, 10}, {1, 20, 600});
+  runSwappedTest({20, 30}, {8192 * 30, 8192});
+}
+
+TEST(SerializationTest, ThriftStorageNonNativeEndianness) {
+  Storage<long> storage(size_t(1000), long(0x0102030405060708L));
+  ThriftStorage serialized;
+  storage.serialize(serialized, otherEndianness);
+  EXPECT_EQ(otherEndianness, serialized.endianness);
+  // Swapping must never touch the source
+  EXPECT_FALSE(static_cast<const void*>(serialized.data.data()) ==
+               storage.data());
+  EXPECT_EQ(0x0102030405060708L, storage.at(0));
+
+  // Split into a chain at odd offsets so elements straddle buffers
+  auto head = serialized.data.cloneOne();
+  auto tail = serialized.data.cloneOne();
+  head->trimEnd(head->length() - 13);
+  tail->trimStart(13);
+  head->prependChain(std::move(tail));
+  serialized.data = std::move(*head);
+
+  Storage<long> deserialized(serialized);
+  EXPECT_EQ(storage.size(), deserialized.size());
+  for (size_t i = 0; i < deserialized.size(); ++i) {
+    EXPECT_EQ(0x0102030405060708L, deserialized.at(i));
+  }
+}
+
+TEST(SerializationTest, Half) {
+  // Non-contiguous, with values that are exact in both 16-bit formats
+  auto t = createTensor({4, 5, 6}, {1, 4, 20});
+  for (auto dtype : {ThriftTensorDataType::HALF,
+                     ThriftTensorDataType::BFLOAT16}) {
+    for (auto endianness : {ThriftTensorEndianness::LITTLE,
+                            ThriftTensorEndianness::BIG}) {
+      ThriftTensor serialized;
+      serializeAsHalf(serialized, t, dtype, endianness);
+      EXPECT_EQ(dtype, serialized.dataType);
+      EXPECT_EQ(t.size() * 2, serialized.data.computeChainDataLength());
+
+      Tensor<float> deserialized(serialized);
+      EXPECT_TRUE(deserialized.isExactlyEqual(t));
+
+      // Other element types don't accept 16-bit data
+      EXPECT_THROW(Tensor<double>{serialized}, std::invalid_argument);
+    }
+  }
+
+  ThriftTensor serialized;
+  EXPECT_THROW(serializeAsHalf(serialized, t, ThriftTensorDataType::FLOAT),
+               std::invalid_argument);
+}
+
+TEST(SerializationTest, Quantized) {
+  // Rows with very different ranges, with some exact zeros
+  Tensor<float> t({30, 50});
+  for (long i = 0; i < 30; ++i) {
+    for (long j = 0; j < 50; ++j) {
+      t.at({i, j}) = j % 7 == 0 ? 0 : (j - 20) * (i + 1) * 0.01f;
+    }
+  }
+
+  for (int axis : {-1, 0, 1}) {
+    ThriftTensor serialized;
+    serializeQuantized(serialized, t, axis);
+    EXPECT_EQ(ThriftTensorDataType::QUINT8, serialized.dataType);
+    EXPECT_EQ(t.size(), serialized.data.computeChainDataLength());
+    EXPECT_EQ(axis == -1 ? 1 : t.size(axis), serialized.scales.size());
+
+    Tensor<float> deserialized(serialized);
+    ASSERT_TRUE(deserialized.sizes() == t.sizes());
+    for (long i = 0; i < 30; ++i) {
+      for (long j = 0; j < 50; ++j) {
+        int c = axis == -1 ? 0 : axis == 0 ? i : j;
+        float x = t.at({i, j});
+        float y = deserialized.at({i, j});
+        if (x == 0) {
+          EXPECT_EQ(0, y);
+        } else {
+          EXPECT_NEAR(x, y, serialized.scales[c] * 0.501);
+        }
+      }
+    }
+  }
+
+  // Per-row parameters are much more precise for the small rows
+  ThriftTensor perRow;
+  ThriftTensor perTensor;
+  serializeQuantized(perRow, t, 0);
+  serializeQuantized(perTensor, t, -1);
+  EXPECT_LT(perRow.scales[0] * 10, perTensor.scales[0]);
+
+  Tensor<float> zeros({4, 4});
+  zeros.zero();
+  serializeQuantized(perRow, zeros, 0, ThriftTensorCompression::ZSTD);
+  EXPECT_TRUE(Tensor<float>(perRow).isExactlyEqual(zeros));
+
+  EXPECT_THROW(serializeQuantized(perRow, t, 2), std::invalid_argument);
+  serializeQuantized(perRow, t, 0);
+  perRow.scales.pop_back();
+  EXPECT_THROW(Tensor<float>{perRow}, std::invalid_argument);
+  EXPECT_THROW(Tensor<double>{perTensor}, std::invalid_argument);
+
+  // Sizes whose product wraps around to 0, with no data
+  serializeQuantized(perRow, t, 1);
+  perRow.sizes = {1L << 32, 1, 1L << 32};
+  perRow.scales.resize(1);
+  perRow.zeroPoints.resize(1);
+  perRow.compression = ThriftTensorCompression::NONE;
+  perRow.data = folly::IOBuf();
+  EXPECT_THROW(Tensor<float>{perRow}, std::invalid_argument);
+}
+
+TEST(SerializationTest, Sparse) {
+  Tensor<float> t({100, 4, 5});
+  t.zero();
+  for (long i : {3, 17, 99}) {
+    for (long j = 0; j < 4; ++j) {
+      t.at({i, j, long(i + j) % 5}) = i + j * 0.5f;
+    }
+  }
+
+  for (int indexedDims : {1, 2, 3}) {
+    ThriftSparseTensor serialized;
+    serializeSparse(serialized, t, indexedDims);
+    EXPECT_EQ(indexedDims, serialized.indexedDims);
+    auto values = Tensor<float>(serialized.values);
+    EXPECT_EQ(indexedDims == 1 ? 3 : 12, values.size(0));
+    EXPECT_TRUE(deserializeSparse<float>(serialized).isExactlyEqual(t));
+
+    // Accumulate into a non-contiguous tensor
+    Tensor<float> dest({5, 4, 100});
+    dest.fill(1);
+    dest.transpose(0, 2);
+    accumulateSparse(dest, serialized, 2.0f);
+    Tensor<float> expected(t, Tensor<float>::UNIQUE);
+    expected.mul(expected, 2);
+    expected.add(expected, 1);
+    EXPECT_TRUE(dest.isExactlyEqual(expected));
+  }
+
+  // Row-sparse encoding, compressed, of a tensor with no nonzeros
+  Tensor<long> zeros({10, 10});
+  zeros.zero();
+  ThriftSparseTensor serialized;
+  serializeSparse(serialized, zeros, 1, ThriftTensorEndianness::BIG,
+                  ThriftTensorCompression::LZ4);
+  EXPECT_EQ(0, Tensor<long>(serialized.values).ndims());
+  EXPECT_TRUE(deserializeSparse<long>(serialized).isExactlyEqual(zeros));
+
+  // ... and of an empty one
+  Tensor<float> empty({0, 5});
+  serializeSparse(serialized, empty, 1);
+  EXPECT_EQ(0, Tensor<long>(serialized.indices).ndims());
+  EXPECT_EQ(0, Tensor<float>(serialized.values).ndims());
+  EXPECT_EQ((std::vector<long>{0, 5}), serialized.sizes);
+
+  serializeSparse(serialized, t, 1);
+  serialized.indexedDims = 2;  // doesn't match indices and values
+  EXPECT_THROW(deserializeSparse<float>(serialized), std::invalid_argument);
+  EXPECT_THROW(serializeSparse(serialized, t, 4), std::invalid_argument);
+  Tensor<float> wrongSize({100, 4, 6});
+  serializeSparse(serialized, t, 1);
+  EXPECT_THROW(accumulateSparse(wrongSize, serialized),
+               std::invalid_argument);
+}
+
+TEST(SerializationTest, Streaming) {
+  auto t = createTensor({20, 30, 10}, {1, 20, 600});
+  for (auto endianness : {ThriftTensorEndianness::LITTLE,
+                          ThriftTensorEndianness::BIG}) {
+    ThriftTensor expected;
+    t.serialize(expected, endianness);
+
+    // Chunk size is rounded down to whole elements
+    ThriftTensor header;
+    folly::IOBufQueue chunks;
+    serializeStreaming(header, t, [&] (std::unique_ptr<folly::IOBuf> chunk) {
+      EXPECT_LE(chunk->length(), 1000);
+      EXPECT_EQ(0, chunk->length() % sizeof(float));
+      chunks.append(std::move(chunk));
+    }, endianness, 1001);
+    EXPECT_EQ(expected.sizes, header.sizes);
+    EXPECT_EQ(expected.endianness, header.endianness);
+    EXPECT_EQ(0, header.data.computeChainDataLength());
+
+    auto data = chunks.move()->cloneCoalescedAsValue();
+    auto expectedData = expected.data.cloneCoalescedAsValue();
+    ASSERT_EQ(expectedData.length(), data.length());
+    EXPECT_EQ(0, memcmp(expectedData.data(), data.data(), data.length()));
+
+    // Read back in pieces that split elements
+    Tensor<float> dest;
+    TensorStreamReader<float> reader(dest, header);
+    for (size_t pos = 0; pos < data.length(); pos += 7) {
+      EXPECT_FALSE(reader.done());
+      EXPECT_THROW(reader.finish(), std::invalid_argument);
+      auto piece = data.cloneOne();
+      piece->trimStart(pos);
+      piece->trimEnd(piece->length() - std::min<size_t>(7, piece->length()));
+      reader.append(*piece);
+    }
+    EXPECT_TRUE(reader.done());
+    reader.finish();
+    EXPECT_TRUE(dest.isExactlyEqual(t));
+    EXPECT_THROW(reader.append(data), std::invalid_argument);
+  }
+
+  // Wrong type
+  ThriftTensor header;
+  serializeStreaming(header, t, [] (std::unique_ptr<folly::IOBuf>) { });
+  Tensor<double> wrongType;
+  EXPECT_THROW(TensorStreamReader<double>(wrongType, header),
+               std::invalid_argument);
+}
+
+TEST(SerializationTest, DeserializeInto) {
+  auto src = createTensor({20, 30, 10});
+  for (auto endianness : {ThriftTensorEndianness::LITTLE,
+                          ThriftTensorEndianness::BIG}) {
+    ThriftTensor serialized;
+    src.serialize(serialized, endianness);
+
+    // Contiguous and non-contiguous destinations
+    Tensor<float> contig({20, 30, 10});
+    Tensor<float> strided({10, 30, 20});
+    strided.transpose(0, 2);
+    for (auto dest : {&contig, &strided}) {
+      auto ptr = dest->data();
+      dest->deserializeInto(serialized);
+      EXPECT_EQ(ptr, dest->data());
+      EXPECT_TRUE(dest->isExactlyEqual(src));
+    }
+  }
+
+  // Chained data, with an element straddling buffers
+  ThriftTensor serialized;
+  src.serialize(serialized);
+  auto tail = serialized.data.clone();
+  serialized.data.trimEnd(serialized.data.length() - 1001);
+  tail->trimStart(1001);
+  serialized.data.prependChain(std::move(tail));
+  Tensor<float> dest({20, 30, 10});
+  dest.deserializeInto(serialized);
+  EXPECT_TRUE(dest.isExactlyEqual(src));
+
+  Tensor<float> wrongSize({20, 30, 11});
+  EXPECT_THROW(wrongSize.deserializeInto(serialized), std::invalid_argument);
+  Tensor<double> wrongType({20, 30, 10});
+  EXPECT_THROW(wrongType.deserializeInto(serialized), std::invalid_argument);
+}
+
+TEST(SerializationTest, Bundle) {
+  std::vector<Tensor<float>> src;
+  src.push_back(createTensor({3}));
+  src.push_back(createTensor({4, 5}));
+  src.push_back(Tensor<float>());
+  auto transposed = createTensor({7, 2});
+  transposed.transpose(0, 1);
+  src.push_back(transposed);
+  src.push_back(createTensor({1}));
+
+  for (auto endianness : {ThriftTensorEndianness::LITTLE,
+                          ThriftTensorEndianness::BIG}) {
+    ThriftTensorBundle bundle;
+    serializeMany(bundle, src, endianness);
+    EXPECT_EQ(src.size(), bundle.offsets.size());
+    for (auto offset : bundle.offsets) {
+      EXPECT_EQ(0, offset * sizeof(float) % kTensorBundleAlignment);
+    }
+
+    auto out = deserializeMany<float>(bundle);
+    ASSERT_EQ(src.size(), out.size());
+    for (size_t i = 0; i < src.size(); ++i) {
+      EXPECT_TRUE(src[i].isExactlyEqual(out[i]));
+      EXPECT_TRUE(out[i].isContiguous());
+    }
+    // All views of the same storage
+    EXPECT_EQ(out[1].data(), out[0].data() + bundle.offsets[1]);
+    EXPECT_EQ(out[4].data(), out[0].data() + bundle.offsets[4]);
+  }
+
+  // Native byte order: no copy on deserialization
+  ThriftTensorBundle bundle;
+  serializeMany(bundle, src);
+  auto out = deserializeMany<float>(bundle);
+  EXPECT_EQ(bundle.storage.data.data(),
+            reinterpret_cast<const uint8_t*>(out[0].data()));
+
+  EXPECT_THROW(deserializeMany<double>(bundle), std::invalid_argument);
+  bundle.offsets.back() = 1 << 20;
+  EXPECT_THROW(deserializeMany<float>(bundle), std::invalid_argument);
+  bundle.offsets.pop_back();
+  EXPECT_THROW(deserializeMany<float>(bundle), std::invalid_argument);
+
+  // Sizes of the {4, 5} tensor whose product wraps around to 0
+  serializeMany(bundle, src);
+  ASSERT_EQ(2, bundle.ndims[1]);
+  bundle.sizes[1] = bundle.sizes[2] = 1L << 32;
+  EXPECT_THROW(deserializeMany<float>(bundle), std::invalid_argument);
+}
+
+TEST(SerializationTest, Checksum) {
+  folly::CPUThreadPoolExecutor executor(4);
+  auto src = createTensor({20, 30, 64});
+  // Runs short enough to be copied, and long enough to be cloned
+  auto copied = src;
+  copied.narrow(2, 5, 30);
+  auto cloned = src;
+  cloned.narrow(1, 5, 20);
+
+  for (auto view : {&copied, &cloned}) {
+    // All ways of gathering give the same checksum for the same bytes
+    ThriftTensor reference;
+    Tensor<float>(*view, Tensor<float>::CONTIGUOUS).serialize(
+        reference, ThriftTensorEndianness::NATIVE, SHARE_ALL, nullptr,
+        ThriftTensorCompression::NONE, ThriftTensorChecksum::CRC32C);
+    EXPECT_EQ(ThriftTensorChecksum::CRC32C, reference.checksumType);
+    verifyChecksum(reference);
+
+    for (auto exec : {static_cast<folly::Executor*>(nullptr),
+                      static_cast<folly::Executor*>(&executor)}) {
+      for (auto compression : {ThriftTensorCompression::NONE,
+                               ThriftTensorCompression::LZ4}) {
+        ThriftTensor serialized;
+        view->serialize(serialized, ThriftTensorEndianness::NATIVE,
+                        SHARE_ALL, exec, compression,
+                        ThriftTensorChecksum::CRC32C);
+        EXPECT_EQ(reference.checksum, serialized.checksum);
+        verifyChecksum(serialized);
+        Tensor<float> dest(view->sizes());
+        dest.deserializeInto(serialized);
+        EXPECT_TRUE(dest.isExactlyEqual(*view));
+      }
+    }
+  }
+
+  // Corrupt one byte
+  ThriftTensor serialized;
+  src.serialize(serialized, ThriftTensorEndianness::BIG, SHARE_NONE, nullptr,
+                ThriftTensorCompression::NONE, ThriftTensorChecksum::CRC32C);
+  verifyChecksum(serialized);
+  serialized.data.coalesce();
+  serialized.data.writableData()[1234] ^= 1;
+  EXPECT_THROW(verifyChecksum(serialized), std::invalid_argument);
+  Tensor<float> dest({20, 30, 64});
+  EXPECT_THROW(dest.deserializeInto(serialized), std::invalid_argument);
+
+  // No checksum: nothing to verify
+  serialized.checksumType = ThriftTensorChecksum::NONE;
+  verifyChecksum(serialized);
+
+  ThriftStorage storage;
+  src.storage().serialize(storage, ThriftTensorEndianness::NATIVE,
+                          SHARE_ALL, ThriftTensorChecksum::CRC32C);
+  verifyChecksum(storage);
+  storage.checksum ^= 1;
+  EXPECT_THROW(verifyChecksum(storage), std::invalid_argument);
+}
+
+TEST(SerializationTest, Delta) {
+  auto base = createTensor({100, 16});
+  Tensor<float> current(base, Tensor<float>::UNIQUE);
+  current[3].fill(-1);
+  current[70].front() = 42;
+  current[99].fill(7);
+
+  for (auto compression : {ThriftTensorCompression::NONE,
+                           ThriftTensorCompression::LZ4}) {
+    ThriftTensorDelta delta;
+    current.serializeDelta(base, delta, 16, ThriftTensorEndianness::BIG,
+                           compression);
+    EXPECT_EQ(3 * 16, delta.changedBlocks.sizes.at(0));
+
+    // Contiguous and strided destinations
+    Tensor<float> contig(base, Tensor<float>::UNIQUE);
+    Tensor<float> strided({16, 100});
+    strided.transpose(0, 1);
+    strided.copy(base);
+    for (auto dest : {&contig, &strided}) {
+      dest->applyDelta(delta);
+      EXPECT_TRUE(dest->isExactlyEqual(current));
+    }
+  }
+
+  // Blocks that don't divide the size: 6 blocks, the last one short; rows
+  // 3, 70, and 99 are in blocks 0, 3, and 5.
+  ThriftTensorDelta delta;
+  current.serializeDelta(base, delta, 300);
+  ASSERT_EQ(1, delta.changed.size());
+  EXPECT_EQ(0x29, uint8_t(delta.changed[0]));
+  EXPECT_EQ(700, delta.changedBlocks.sizes.at(0));
+  Tensor<float> dest(base, Tensor<float>::UNIQUE);
+  dest.applyDelta(delta);
+  EXPECT_TRUE(dest.isExactlyEqual(current));
+
+  // No changes at all
+  base.serializeDelta(base, delta);
+  EXPECT_EQ(std::string(1, '\0'), delta.changed);
+  EXPECT_TRUE(delta.changedBlocks.sizes.empty());
+
+  EXPECT_THROW(current.serializeDelta(createTensor({100, 15}), delta),
+               std::invalid_argument);
+  current.serializeDelta(base, delta, 16);
+  delta.changed[0] ^= 1;
+  EXPECT_THROW(dest.applyDelta(delta), std::invalid_argument);
+  Tensor<double> wrongType({100, 16});
+  delta.changed[0] ^= 1;
+  EXPECT_THROW(wrongType.applyDelta(delta), std::invalid_argument);
+}
+
+TEST(SerializationTest, Shared) {
+  Tensor<float> src(Storage<float>::createShared(20 * 30), 0, {20, 30});
+  src.fill(1);
+  src[3][4].front() = 5;
+  Tensor<float> view(src);
+  view.transpose();
+  view.narrow(0, 2, 10);
+
+  for (auto t : {&src, &view}) {
+    ThriftSharedTensor shared;
+    int fd = t->exportShared(shared);
+    EXPECT_EQ(src.storage().sharedMemoryFd(), fd);
+    auto imported = Tensor<float>::importShared(shared, fd);
+    EXPECT_TRUE(t->isExactlyEqual(imported));
+    EXPECT_TRUE(imported.sizes() == t->sizes());
+    EXPECT_TRUE(imported.strides() == t->strides());
+    EXPECT_NE(t->data(), imported.data());
+  }
+
+  ThriftSharedTensor shared;
+  int fd = src.exportShared(shared);
+  auto imported = Tensor<float>::importShared(shared, fd);
+  src[3][4].front() = 6;
+  EXPECT_EQ(6, imported.at({3, 4}));
+
+  EXPECT_THROW(Tensor<double>::importShared(shared, fd),
+               std::invalid_argument);
+  auto tooBig = shared;
+  tooBig.sizes[0] = 21;
+  EXPECT_THROW(Tensor<float>::importShared(tooBig, fd),
+               std::invalid_argument);
+
+  // Descriptors whose arithmetic wraps around
+  auto wrapped = shared;
+  wrapped.storageSize = (1L << 62) + 1;  // * sizeof(float) wraps to 4
+  EXPECT_THROW(Tensor<float>::importShared(wrapped, fd),
+               std::invalid_argument);
+  wrapped = shared;
+  wrapped.strides = {1L << 62, 1};
+  wrapped.sizes[0] = 5;  // 4 * 2^62 wraps to 0
+  EXPECT_THROW(Tensor<float>::importShared(wrapped, fd),
+               std::invalid_argument);
+  wrapped = shared;
+  wrapped.strides.clear();
+  wrapped.sizes = {1L << 40, 1L << 40, 1};
+  EXPECT_THROW(Tensor<float>::importShared(wrapped, fd),
+               std::invalid_argument);
+
+  Tensor<float> notShared({3});
+  EXPECT_THROW(notShared.exportShared(shared), std::invalid_argument);
+}
+
 TEST(SerializationTest, BigTensorNarrow) {
   auto t = thpp::Tensor<float>({32, 256, 6, 6});
   t.zero();
@@ -8,7 +8,17 @@
  *
  */
 
+#include <thpp/CopyStats.h>
+#include <thpp/NumaAllocator.h>
+#include <thpp/OpStats.h>
 #include <thpp/Tensor.h>
+#include <thpp/TensorView.h>
+
+#ifndef NO_FOLLY
+#include <folly/executors/CPUThreadPoolExecutor.h>
+#include <thpp/TensorForeach.h>
+#include <thpp/TensorParallel.h>
+#endif
 
 #include <glog/logging.h>
 #include <gtest/gtest.h>
@@ -94,6 +104,354 @@ TEST_F(TensorTest, At) {
   EXPECT_EQ(50403, a.at({2, 3, 4}));
 }
 
+TEST_F(TensorTest, View) {
+  auto v = view<3>(a);
+  EXPECT_EQ(20304, v(1, 2, 3));
+  EXPECT_EQ(20304, v[1][2][3]);
+  EXPECT_EQ(20304, v.select(1, 2)(1, 3));
+  EXPECT_THROW(v.at(10, 0, 0), std::invalid_argument);
+  EXPECT_THROW(view<2>(a), std::invalid_argument);
+
+  auto n = v.narrow(2, 1, 3);
+  EXPECT_EQ(10 * 20 * 3, n.size());
+  EXPECT_FALSE(n.isContiguous());
+  EXPECT_EQ(a.at({4, 5, 2}), n(4, 5, 1));
+
+  a.transpose();
+  TensorView<const long, 3> t = view<3>(a);
+  EXPECT_EQ(50403, t(2, 3, 4));
+
+  v(0, 0, 0) = 42;
+  EXPECT_EQ(42, a.at({0, 0, 0}));
+}
+
+TEST_F(TensorTest, Arena) {
+  TensorArena arena(4096);
+  {
+    TensorArena::Scope scope(arena);
+    auto s = a.sum(2);
+    auto m = a.max(1);
+    auto c = a.cumsum(0) + a;
+    EXPECT_EQ(10 * 20, s.size());
+    EXPECT_EQ(30 * 10101 + 29 * 30 / 2, s.at({0, 0, 0}));
+    EXPECT_EQ(10 * 30, m.first.size());
+    EXPECT_EQ(10 * 30, m.second.size());
+    EXPECT_EQ(2 * a.at({0, 1, 2}), c.at({0, 1, 2}));
+    EXPECT_TRUE(s.isUnique());
+    EXPECT_EQ(4, arena.liveAllocations());
+    EXPECT_LT(4096, arena.capacity());
+
+    // Explicitly sized tensors don't come from the arena
+    LongTensor t({10});
+    EXPECT_EQ(4, arena.liveAllocations());
+  }
+  EXPECT_EQ(0, arena.liveAllocations());
+  auto capacity = arena.capacity();
+  arena.reset();
+  EXPECT_EQ(0, arena.bytesUsed());
+  EXPECT_EQ(capacity, arena.capacity());
+
+  // Not installed any more
+  auto s = a.sum(2);
+  EXPECT_EQ(0, arena.liveAllocations());
+}
+
+#ifndef NO_FOLLY
+TEST_F(TensorTest, Parallel) {
+  folly::CPUThreadPoolExecutor executor(4);
+  LongTensor t({10, 20, 30});
+  parallelFill(t, 42L, &executor, 1000);
+  EXPECT_EQ(42 * t.size(), t.sumall());
+  parallelZero(t, &executor, 1000);
+  EXPECT_EQ(0, t.sumall());
+  parallelCopy(t, a, &executor, 1000);
+  EXPECT_TRUE(t.isExactlyEqual(a));
+
+  // Non-contiguous tensors are handled by TH
+  LongTensor u({30, 20, 10});
+  u.transpose(0, 2);
+  parallelCopy(u, a, &executor, 1000);
+  EXPECT_TRUE(u.isExactlyEqual(a));
+  EXPECT_THROW(parallelCopy(u, LongTensor({10}), &executor),
+               std::invalid_argument);
+}
+#endif
+
+TEST_F(TensorTest, NumaReplicated) {
+  NumaReplicated<long> replicated(a);
+  EXPECT_EQ(NumaAllocator::numNodes(), replicated.numReplicas());
+  EXPECT_TRUE(replicated.local().isExactlyEqual(a));
+  EXPECT_NE(a.data(), replicated.local().data());
+}
+
+TEST_F(TensorTest, ConvertingCopy) {
+  Tensor<double> d({10, 20, 30});
+  for (long i = 0; i < d.size(); ++i) {
+    d.data()[i] = i / 3.0;
+  }
+  auto check = [&] (const Tensor<float>& f) {
+    for (long i = 0; i < 10; ++i) {
+      for (long j = 0; j < 20; ++j) {
+        for (long k = 0; k < 30; ++k) {
+          ASSERT_EQ(float(d.at({i, j, k})), f.at({i, j, k}));
+        }
+      }
+    }
+  };
+
+  // Contiguous, contiguous rows, and fully strided (left to TH)
+  Tensor<float> contig({10, 20, 30});
+  contig.copy(d);
+  check(contig);
+  Tensor<float> rows({10, 20, 40});
+  rows.narrow(2, 5, 30);
+  rows.copy(d);
+  check(rows);
+  Tensor<float> strided({30, 20, 10});
+  strided.transpose(0, 2);
+  strided.copy(d);
+  check(strided);
+
+  // And back
+  Tensor<double> back({10, 20, 30});
+  back.copy(contig);
+  EXPECT_EQ(double(float(d.at({9, 19, 29}))), back.at({9, 19, 29}));
+
+  Tensor<unsigned char> bytes({300});
+  for (long i = 0; i < 300; ++i) {
+    bytes.data()[i] = i;
+  }
+  Tensor<float> f({300});
+  f.copy(bytes);
+  EXPECT_EQ(255.0f, f.at(255));
+  EXPECT_EQ(float(299 % 256), f.at(299));
+
+#ifndef NO_FOLLY
+  folly::CPUThreadPoolExecutor executor(4);
+  for (auto dest : {&contig, &rows, &strided}) {
+    dest->zero();
+    parallelCopy(*dest, d, &executor, 100);
+    check(*dest);
+  }
+#endif
+}
+
+TEST_F(TensorTest, CopyOnWrite) {
+  auto copies = [] { return getCopyStats(CopyReason::COPY_ON_WRITE).count; };
+  resetCopyStats();
+  const LongTensor& ca = a;
+  auto original = ca.data();
+
+  LongTensor clone(a, LongTensor::COPY_ON_WRITE);
+  const LongTensor& cclone = clone;
+  EXPECT_EQ(original, cclone.data());
+  EXPECT_FALSE(clone.isUnique());
+  EXPECT_TRUE(cclone.isExactlyEqual(a));
+  EXPECT_EQ(0, cclone.at({1, 2, 3}) - ca.at({1, 2, 3}));
+  EXPECT_EQ(0, copies());
+
+  // Writing to the clone through a view copies, once, and leaves the
+  // original alone
+  {
+    LongTensor view(clone);
+    view.select(0, 1);
+    view.fill(-1);
+    EXPECT_EQ(1, copies());
+    EXPECT_NE(original, cclone.data());
+    EXPECT_EQ(-1, cclone.at({1, 2, 3}));
+    EXPECT_EQ(original, ca.data());
+    EXPECT_TRUE(a.isExactlyEqual(create(1)));
+    clone.add(1);
+    EXPECT_EQ(1, copies());
+    EXPECT_EQ(0, view.at({2, 3}));
+  }
+  EXPECT_TRUE(clone.isUnique());
+
+  // Writing to the original copies as well, leaving the clone alone
+  LongTensor clone2(a, LongTensor::COPY_ON_WRITE);
+  a.add(1);
+  EXPECT_EQ(2, copies());
+  EXPECT_TRUE(clone2.isExactlyEqual(create(1)));
+  auto expected = create(1);
+  expected.add(1);
+  EXPECT_TRUE(a.isExactlyEqual(expected));
+
+  // UNIQUE, or CONTIGUOUS for a non-contiguous tensor, copy right away
+  LongTensor transposed(b);
+  transposed.transpose(0, 2);
+  EXPECT_TRUE(LongTensor(b, LongTensor::UNIQUE | LongTensor::COPY_ON_WRITE)
+              .isUnique());
+  EXPECT_TRUE(LongTensor(transposed, LongTensor::CONTIGUOUS |
+                         LongTensor::COPY_ON_WRITE).isUnique());
+  EXPECT_EQ(2, copies());
+}
+
+TEST_F(TensorTest, SmallShapes) {
+  auto vec = [] (LongRange r) { return std::vector<long>(r.begin(), r.end()); };
+
+  Tensor<float> t({2, 3, 4, 5});
+  EXPECT_EQ((std::vector<long>{2, 3, 4, 5}), vec(t.sizes()));
+  EXPECT_EQ((std::vector<long>{60, 20, 5, 1}), vec(t.strides()));
+  Tensor<float> view(t.storage(), 1, {2, 2}, {3, 1});
+  EXPECT_EQ((std::vector<long>{3, 1}), vec(view.strides()));
+  EXPECT_EQ(t.data() + 5, &view.at({1, 1}));
+  Tensor<float> empty((LongRange()));
+  EXPECT_EQ(0, empty.ndims());
+
+  // More dimensions than the small path handles
+  Tensor<float> big(std::vector<long>{2, 3, 4, 5, 6});
+  EXPECT_EQ(5, big.ndims());
+  EXPECT_TRUE(big.isContiguous());
+  big.resize({6, 20});
+  EXPECT_EQ((std::vector<long>{6, 20}), vec(big.sizes()));
+  EXPECT_EQ(720, big.storage().size());
+
+  // Headers of destroyed tensors are reused; empty the cache first, so
+  // that it has room.
+  std::vector<Tensor<float>> drain(
+      detail::TensorOps<Tensor<float>>::HeaderCache::kMaxHeaders);
+  const void* header;
+  {
+    Tensor<float> row(t[1]);
+    header = row.asTH();
+  }
+  Tensor<float> reused({3});
+  EXPECT_EQ(header, reused.asTH());
+  EXPECT_EQ(1, reused.ndims());
+  EXPECT_EQ(3, reused.storage().size());
+}
+
+#ifndef NO_FOLLY
+TEST_F(TensorTest, Foreach) {
+  auto make = [] (float start) {
+    std::vector<Tensor<float>> tensors;
+    for (auto sizes : {std::vector<long>{3, 4}, std::vector<long>{10},
+                       std::vector<long>{100, 7}}) {
+      Tensor<float> t(sizes);
+      for (long i = 0; i < t.size(); ++i) {
+        t.data()[i] = start + i;
+      }
+      tensors.push_back(std::move(t));
+    }
+    return tensors;
+  };
+
+  folly::CPUThreadPoolExecutor executor(4);
+  for (bool pack : {false, true}) {
+    for (auto ex : {static_cast<folly::Executor*>(nullptr),
+                    static_cast<folly::Executor*>(&executor)}) {
+      auto self = make(1);
+      auto b = make(2);
+      auto c = make(3);
+      // A non-contiguous operand can't be split
+      Tensor<float> t({7, 100});
+      t.transpose();
+      t.copy(self[2]);
+      self[2] = t;
+      if (pack) {
+        packTensors(self);
+        packTensors(b);
+        packTensors(c);
+        EXPECT_TRUE(self[2].isContiguous());
+        EXPECT_EQ(self[0].data() + 22, self[2].data());
+      }
+      auto expected = make(1);
+
+      foreachMul(self, 2, ex, 64);
+      foreachAdd(self, 1, ex, 64);
+      foreachCadd(self, 3, b, ex, 64);
+      foreachAddcmul(self, 0.5, b, c, ex, 64);
+      foreachAddcdiv(self, 2, b, c, ex, 64);
+      foreachCmul(self, c, ex, 64);
+      for (size_t i = 0; i < expected.size(); ++i) {
+        auto& e = expected[i];
+        e.mul(2);
+        e.add(1);
+        e.cadd(3, b[i]);
+        e.addcmul(0.5, b[i], c[i]);
+        e.addcdiv(2, b[i], c[i]);
+        e.cmul(c[i]);
+        EXPECT_TRUE(e.isExactlyEqual(self[i])) << i;
+      }
+    }
+  }
+
+  auto self = make(1);
+  auto shorter = make(1);
+  shorter.pop_back();
+  EXPECT_THROW(foreachCadd(self, 1, shorter), std::invalid_argument);
+  auto other = make(1);
+  other[1] = Tensor<float>({11});
+  EXPECT_THROW(foreachCmul(self, other), std::invalid_argument);
+}
+#endif
+
+TEST_F(TensorTest, OpStats) {
+  auto find = [] (const char* op) {
+    for (auto& stats : getOpStats()) {
+      if (stats.op == op && stats.type == "torch.FloatTensor") {
+        return stats;
+      }
+    }
+    return OpStats();
+  };
+
+  resetOpStats();
+  Tensor<float> x({10, 20});
+  Tensor<float> y({10, 20});
+  x.fill(1);
+  y.fill(2);
+  x += y;
+  EXPECT_EQ(600, x.sumall());
+
+  if (!kOpStatsEnabled) {
+    EXPECT_TRUE(getOpStats().empty());
+    return;
+  }
+  auto fill = find("fill");
+  EXPECT_EQ(2, fill.calls);
+  EXPECT_EQ(400, fill.elements);
+  EXPECT_EQ(400 * sizeof(float), fill.bytes);
+  auto cadd = find("cadd");
+  EXPECT_EQ(1, cadd.calls);
+  EXPECT_EQ(200, cadd.elements);
+  EXPECT_EQ(3 * 200 * sizeof(float), cadd.bytes);
+  EXPECT_EQ(1, find("sumall").calls);
+  EXPECT_EQ(0, find("addmm").calls);
+
+  resetOpStats();
+  EXPECT_TRUE(getOpStats().empty());
+}
+
+TEST_F(TensorTest, Into) {
+  LongTensor out;
+  a.sum(1, out);
+  EXPECT_TRUE(out.isExactlyEqual(a.sum(1)));
+  auto data = out.data();
+  b.sum(1, out);
+  EXPECT_EQ(data, out.data());
+  EXPECT_TRUE(out.isExactlyEqual(b.sum(1)));
+
+  a.cumprod(2, out);
+  EXPECT_EQ(a.at({1, 2, 0}) * a.at({1, 2, 1}), out.at({1, 2, 1}));
+
+  LongTensor indices;
+  a.max(0, out, indices);
+  EXPECT_EQ(a.at({9, 3, 4}), out.at({0, 3, 4}));
+  EXPECT_EQ(9, indices.at({0, 3, 4}));
+  auto indexData = indices.data();
+  b.min(0, out, indices);
+  EXPECT_EQ(indexData, indices.data());
+  EXPECT_EQ(0, indices.at({0, 3, 4}));
+
+  LongTensor index({2});
+  index.at({0}) = 1;
+  index.at({1}) = 3;
+  a.indexSelect(1, index, out);  // 1-based
+  EXPECT_EQ(a.at({0, 0, 0}), out.at({0, 0, 0}));
+  EXPECT_EQ(a.at({0, 2, 0}), out.at({0, 1, 0}));
+}
+
 TEST_F(TensorTest, NonFloatEqual) {
   EXPECT_TRUE(a.isExactlyEqual(a));
   EXPECT_TRUE(a.isApproximatelyEqual(a));
@@ -149,6 +507,31 @@ TEST_F(TensorTest, EqualMoreDimensionsThanSize) {
   EXPECT_FALSE(x.isExactlyEqual(z));
 }
 
+TEST_F(TensorTest, EqualNonContiguous) {
+  // Same values, different layouts
+  auto x = Tensor<float>{{3, 700}};
+  auto y = Tensor<float>{{700, 3}};
+  for (long j = 0; j < x.size(0); ++j) {
+    for (long i = 0; i < x.size(1); ++i) {
+      x.at({j, i}) = j * 1000 + i;
+      y.at({i, j}) = j * 1000 + i;
+    }
+  }
+  y.transpose();
+  EXPECT_TRUE(x.isExactlyEqual(y));
+  EXPECT_TRUE(y.isApproximatelyEqual(x));
+
+  y.at({2, 699}) += 1;
+  EXPECT_FALSE(x.isExactlyEqual(y));
+  EXPECT_FALSE(y.isApproximatelyEqual(x));
+
+  // Contiguous long tensors are compared bitwise
+  EXPECT_TRUE(a.isExactlyEqual(Tensor<long>(a, Tensor<long>::UNIQUE)));
+
+  // Empty tensor
+  EXPECT_TRUE(Tensor<float>().isExactlyEqual(Tensor<float>()));
+}
+
 TEST_F(TensorTest, EqualMismatch) {
   auto x = Tensor<float>{{1, 1, 1}};
   auto y = Tensor<float>{{1, 1, 1, 1}};
@@ -190,4 +573,8 @@ TEST_F(TensorTest, TensorPtr) {
   testTensorPtr<Tensor<long>>();
 }
 
+TEST_F(TensorTest, FrozenTensorPtr) {
+  testFrozenTensorPtr<Tensor<long>>();
+}
+
 }}  // namespaces